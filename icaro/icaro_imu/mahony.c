@@ -16,6 +16,7 @@
 
 #include "mahony.h"
 #include <math.h>
+#include <stdint.h>
 
 //-------------------------------------------------------------------------------------------
 // Definitions
@@ -23,16 +24,11 @@
 #define DEFAULT_SAMPLE_FREQ	200.0f	// sample frequency in Hz
 #define twoKpDef	2.0f * 5.0f //(2.0f * 0.5f)	// 2 * proportional gain
 #define twoKiDef	0.0f // (2.0f * 0.0f)	// 2 * integral gain
+#define DT_RANGE	4.0f	// measured periods may be up to 4 times off the nominal one
+#define DT_SMOOTHING	0.05f	// weight of the newest period in the measured rate
 
-static	float twoKp;		// 2 * proportional gain (Kp)
-static	float twoKi;		// 2 * integral gain (Ki)
-static	float q0, q1, q2, q3;	// quaternion of sensor frame relative to auxiliary frame
-static	float integralFBx, integralFBy, integralFBz;  // integral error terms scaled by Ki
-static	float invSampleFreq;
-static	float roll, pitch, yaw;
-static	char anglesComputed;
+static mahony_filter_t default_filter;	// filter behind the process wide API
 float invSqrt(float x);
-void computeAngles();
 
 //============================================================================================
 // Functions
@@ -40,24 +36,68 @@ void computeAngles();
 //-------------------------------------------------------------------------------------------
 // AHRS algorithm update
 
-void mahony_init()
+void mahony_filter_init(mahony_filter_t *filter, const mahony_config_t *config)
 {
-    twoKp = twoKpDef;	// 2 * proportional gain (Kp)
-    twoKi = twoKiDef;	// 2 * integral gain (Ki)
-    q0 = 1.0f;
-    q1 = 0.0f;
-    q2 = 0.0f;
-    q3 = 0.0f;
-    integralFBx = 0.0f;
-    integralFBy = 0.0f;
-    integralFBz = 0.0f;
-    anglesComputed = 0;
-    invSampleFreq = 1.0f / DEFAULT_SAMPLE_FREQ;
+    filter->twoKp = config ? config->twoKp : twoKpDef;	// 2 * proportional gain (Kp)
+    filter->twoKi = config ? config->twoKi : twoKiDef;	// 2 * integral gain (Ki)
+    filter->q0 = 1.0f;
+    filter->q1 = 0.0f;
+    filter->q2 = 0.0f;
+    filter->q3 = 0.0f;
+    filter->integralFBx = 0.0f;
+    filter->integralFBy = 0.0f;
+    filter->integralFBz = 0.0f;
+    filter->anglesComputed = 0;
+    filter->invSampleFreq = 1.0f / (config ? config->sampleFreq : DEFAULT_SAMPLE_FREQ);
+    filter->dtMin = filter->invSampleFreq / DT_RANGE;
+    filter->dtMax = filter->invSampleFreq * DT_RANGE;
+    filter->dtMean = filter->invSampleFreq;
+    filter->dtClamped = 0;
 }
 
-void begin(float sampleFrequency) { invSampleFreq = 1.0f / sampleFrequency; }
+void mahony_filter_set_dt_limits(mahony_filter_t *filter, float dtMin, float dtMax)
+{
+    filter->dtMin = dtMin;
+    filter->dtMax = dtMax;
+}
 
-void mahony_update(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz)
+// nominal rate without resetting the attitude, the measured period limits
+// follow it as in mahony_filter_init()
+void mahony_filter_set_sample_freq(mahony_filter_t *filter, float sampleFreq)
+{
+    filter->invSampleFreq = 1.0f / sampleFreq;
+    filter->dtMin = filter->invSampleFreq / DT_RANGE;
+    filter->dtMax = filter->invSampleFreq * DT_RANGE;
+    filter->dtMean = filter->invSampleFreq;
+}
+
+// the first sample, a stalled loop or a millis() wrap give a bogus period, it is
+// clamped and counted, the clamped period is integrated and averaged
+static void setDt(mahony_filter_t *filter, float dt)
+{
+    if (!(dt >= filter->dtMin)) { dt = filter->dtMin; filter->dtClamped++; }
+    else if (dt > filter->dtMax) { dt = filter->dtMax; filter->dtClamped++; }
+    filter->invSampleFreq = dt;
+    filter->dtMean += DT_SMOOTHING * (dt - filter->dtMean);
+}
+
+float mahony_filter_get_sample_freq(mahony_filter_t *filter) { return 1.0f / filter->dtMean; }
+
+void mahony_filter_update_dt(mahony_filter_t *filter, float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz, float dt)
+{
+    setDt(filter, dt);
+    mahony_filter_update(filter, gx, gy, gz, ax, ay, az, mx, my, mz);
+}
+
+void mahony_filter_update_imu_dt(mahony_filter_t *filter, float gx, float gy, float gz, float ax, float ay, float az, float dt)
+{
+    setDt(filter, dt);
+    mahony_filter_update_imu(filter, gx, gy, gz, ax, ay, az);
+}
+
+// the state is loaded into locals and stored back once, working on a filter
+// pointer costs no more than the file-scope variables did
+void mahony_filter_update(mahony_filter_t *filter, float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz)
 {
     float recipNorm;
     float q0q0, q0q1, q0q2, q0q3, q1q1, q1q2, q1q3, q2q2, q2q3, q3q3;
@@ -65,11 +105,14 @@ void mahony_update(float gx, float gy, float gz, float ax, float ay, float az, f
     float halfvx, halfvy, halfvz, halfwx, halfwy, halfwz;
     float halfex, halfey, halfez;
     float qa, qb, qc;
+    float q0 = filter->q0, q1 = filter->q1, q2 = filter->q2, q3 = filter->q3;
+    float integralFBx = filter->integralFBx, integralFBy = filter->integralFBy, integralFBz = filter->integralFBz;
+    float twoKp = filter->twoKp, twoKi = filter->twoKi, invSampleFreq = filter->invSampleFreq;
 
     // Use IMU algorithm if magnetometer measurement invalid
     // (avoids NaN in magnetometer normalisation)
     if((mx == 0.0f) && (my == 0.0f) && (mz == 0.0f)) {
-        mahony_updateIMU(gx, gy, gz, ax, ay, az);
+        mahony_filter_update_imu(filter, gx, gy, gz, ax, ay, az);
         return;
     }
 
@@ -161,22 +204,28 @@ void mahony_update(float gx, float gy, float gz, float ax, float ay, float az, f
 
     // Normalise quaternion
     recipNorm = invSqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
-    q0 *= recipNorm;
-    q1 *= recipNorm;
-    q2 *= recipNorm;
-    q3 *= recipNorm;
-    anglesComputed = 0;
+    filter->q0 = q0 * recipNorm;
+    filter->q1 = q1 * recipNorm;
+    filter->q2 = q2 * recipNorm;
+    filter->q3 = q3 * recipNorm;
+    filter->integralFBx = integralFBx;
+    filter->integralFBy = integralFBy;
+    filter->integralFBz = integralFBz;
+    filter->anglesComputed = 0;
 }
 
 //-------------------------------------------------------------------------------------------
 // IMU algorithm update
 
-void mahony_updateIMU(float gx, float gy, float gz, float ax, float ay, float az)
+void mahony_filter_update_imu(mahony_filter_t *filter, float gx, float gy, float gz, float ax, float ay, float az)
 {
     float recipNorm;
     float halfvx, halfvy, halfvz;
     float halfex, halfey, halfez;
     float qa, qb, qc;
+    float q0 = filter->q0, q1 = filter->q1, q2 = filter->q2, q3 = filter->q3;
+    float integralFBx = filter->integralFBx, integralFBy = filter->integralFBy, integralFBz = filter->integralFBz;
+    float twoKp = filter->twoKp, twoKi = filter->twoKi, invSampleFreq = filter->invSampleFreq;
 
     // Convert gyroscope degrees/sec to radians/sec
     gx *= 0.0174533f;
@@ -239,11 +288,14 @@ void mahony_updateIMU(float gx, float gy, float gz, float ax, float ay, float az
 
     // Normalise quaternion
     recipNorm = invSqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
-    q0 *= recipNorm;
-    q1 *= recipNorm;
-    q2 *= recipNorm;
-    q3 *= recipNorm;
-    anglesComputed = 0;
+    filter->q0 = q0 * recipNorm;
+    filter->q1 = q1 * recipNorm;
+    filter->q2 = q2 * recipNorm;
+    filter->q3 = q3 * recipNorm;
+    filter->integralFBx = integralFBx;
+    filter->integralFBy = integralFBy;
+    filter->integralFBz = integralFBz;
+    filter->anglesComputed = 0;
 }
 
 //-------------------------------------------------------------------------------------------
@@ -253,46 +305,77 @@ void mahony_updateIMU(float gx, float gy, float gz, float ax, float ay, float az
 float invSqrt(float x)
 {
     float halfx = 0.5f * x;
-    float y = x;
-    long i = *(long*)&y;
-    i = 0x5f3759df - (i>>1);
-    y = *(float*)&i;
-    y = y * (1.5f - (halfx * y * y));
-    y = y * (1.5f - (halfx * y * y));
-    return y;
+    union
+    {
+        float f;
+        int32_t i;
+    } y = {x};
+    y.i = 0x5f3759df - (y.i >> 1);
+    y.f = y.f * (1.5f - (halfx * y.f * y.f));
+    y.f = y.f * (1.5f - (halfx * y.f * y.f));
+    return y.f;
 }
 
 //-------------------------------------------------------------------------------------------
 
-void computeAngles()
+static void computeAngles(mahony_filter_t *filter)
 {
-    roll = atan2f(q0*q1 + q2*q3, 0.5f - q1*q1 - q2*q2);
-    pitch = asinf(-2.0f * (q1*q3 - q0*q2));
-    yaw = atan2f(q1*q2 + q0*q3, 0.5f - q2*q2 - q3*q3);
-    anglesComputed = 1;
+    float q0 = filter->q0, q1 = filter->q1, q2 = filter->q2, q3 = filter->q3;
+    filter->roll = atan2f(q0*q1 + q2*q3, 0.5f - q1*q1 - q2*q2);
+    filter->pitch = asinf(-2.0f * (q1*q3 - q0*q2));
+    filter->yaw = atan2f(q1*q2 + q0*q3, 0.5f - q2*q2 - q3*q3);
+    filter->anglesComputed = 1;
 }
 
-float getRoll() {
-    if (!anglesComputed) computeAngles();
-    return roll * 57.29578f;
+float mahony_filter_get_roll(mahony_filter_t *filter) {
+    if (!filter->anglesComputed) computeAngles(filter);
+    return filter->roll * 57.29578f;
 }
-float getPitch() {
-    if (!anglesComputed) computeAngles();
-    return pitch * 57.29578f;
+float mahony_filter_get_pitch(mahony_filter_t *filter) {
+    if (!filter->anglesComputed) computeAngles(filter);
+    return filter->pitch * 57.29578f;
 }
-float getYaw() {
-    if (!anglesComputed) computeAngles();
-    return yaw * 57.29578f + 180.0f;
+float mahony_filter_get_yaw(mahony_filter_t *filter) {
+    if (!filter->anglesComputed) computeAngles(filter);
+    return filter->yaw * 57.29578f + 180.0f;
 }
-float getRollRadians() {
-    if (!anglesComputed) computeAngles();
-    return roll;
+float mahony_filter_get_roll_radians(mahony_filter_t *filter) {
+    if (!filter->anglesComputed) computeAngles(filter);
+    return filter->roll;
 }
-float getPitchRadians() {
-    if (!anglesComputed) computeAngles();
-    return pitch;
+float mahony_filter_get_pitch_radians(mahony_filter_t *filter) {
+    if (!filter->anglesComputed) computeAngles(filter);
+    return filter->pitch;
 }
-float getYawRadians() {
-    if (!anglesComputed) computeAngles();
-    return yaw;
-}
\ No newline at end of file
+float mahony_filter_get_yaw_radians(mahony_filter_t *filter) {
+    if (!filter->anglesComputed) computeAngles(filter);
+    return filter->yaw;
+}
+
+//-------------------------------------------------------------------------------------------
+// Process wide filter
+
+void mahony_init(const mahony_config_t *config) { mahony_filter_init(&default_filter, config); }
+
+void begin(float sampleFrequency) { mahony_filter_set_sample_freq(&default_filter, sampleFrequency); }
+
+void mahony_update(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz)
+{ mahony_filter_update(&default_filter, gx, gy, gz, ax, ay, az, mx, my, mz); }
+
+void mahony_updateIMU(float gx, float gy, float gz, float ax, float ay, float az)
+{ mahony_filter_update_imu(&default_filter, gx, gy, gz, ax, ay, az); }
+
+void mahony_update_dt(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz, float dt)
+{ mahony_filter_update_dt(&default_filter, gx, gy, gz, ax, ay, az, mx, my, mz, dt); }
+
+void mahony_updateIMU_dt(float gx, float gy, float gz, float ax, float ay, float az, float dt)
+{ mahony_filter_update_imu_dt(&default_filter, gx, gy, gz, ax, ay, az, dt); }
+
+float getSampleFreq() { return mahony_filter_get_sample_freq(&default_filter); }
+unsigned long getDtClamped() { return default_filter.dtClamped; }
+float getRoll() { return mahony_filter_get_roll(&default_filter); }
+float getPitch() { return mahony_filter_get_pitch(&default_filter); }
+float getYaw() { return mahony_filter_get_yaw(&default_filter); }
+float getRollRadians() { return mahony_filter_get_roll_radians(&default_filter); }
+float getPitchRadians() { return mahony_filter_get_pitch_radians(&default_filter); }
+float getYawRadians() { return mahony_filter_get_yaw_radians(&default_filter); }
\ No newline at end of file
@@ -0,0 +1,349 @@
+//=====================================================================================================
+// mahony_fixed.c
+//=====================================================================================================
+//
+// Fixed-point version of the Mahony AHRS filter in mahony.c, same algorithm and
+// variable names, see mahony_fixed.h for the number formats.
+//
+//=====================================================================================================
+
+//---------------------------------------------------------------------------------------------------
+// Header files
+
+#include "mahony_fixed.h"
+
+//-------------------------------------------------------------------------------------------
+// Definitions
+
+#define DEFAULT_SAMPLE_FREQ	200.0f	// sample frequency in Hz
+#define twoKpDef	2.0f * 5.0f	// 2 * proportional gain
+#define twoKiDef	0.0f	// 2 * integral gain
+#define gyroScaleDef	(1.0f / 65.5f)	// degrees/sec per LSB at MPU6050_GYRO_FS_500
+
+#define HALF_Q14	8192	// 0.5
+#define HALF_Q28	(1L << 27)	// 0.5
+#define HALF_PI_Q13	12868
+#define PI_Q13	25736
+
+//============================================================================================
+// Fixed-point helpers
+
+// 16x16 bit product, Q14 * Q14 = Q28
+static inline int32_t mul16(int16_t a, int16_t b) { return (int32_t)a * b; }
+
+// (a * b) >> 14 with two 16x16 bit products instead of a 32x32 one
+static int32_t mul32x16(int32_t a, int16_t b)
+{
+    int16_t hi = a >> 16;
+    uint16_t lo = a & 0xFFFF;
+    return mul16(hi, b) * 4 + (((int32_t)lo * b) >> 14);
+}
+
+static inline int32_t shift_right(int32_t a, int8_t n) { return n >= 0 ? a >> n : a * (1L << -n); }
+
+//-------------------------------------------------------------------------------------------
+// Fast inverse square-root
+//
+// 1/sqrt(x) = y * 2^(-29 - shift), y in Q14. x is brought to [2^29, 2^31) with an even
+// shift so m = x / 2^30 is in [0.5, 2), a quadratic seed is within 2.5% of 1/sqrt(m) and
+// two Newton steps take it to the Q14 resolution.
+
+static int16_t invSqrt(uint32_t x, int8_t *shift)
+{
+    int8_t s = 0;
+    int16_t m, y, t;
+
+    if (x == 0) { *shift = 0; return 0; }
+    while (x >= (1UL << 31)) { x >>= 2; s++; }
+    while (x < (1UL << 29)) { x <<= 2; s--; }
+
+    m = x >> 16;
+    y = 30962 + (mul16(m, -19043 + (mul16(4744, m) >> 14)) >> 14);
+    for (uint8_t i = 0; i < 2; i++) {
+        t = mul16(mul16(m, y) >> 14, y) >> 14;	// m * y^2, 1.0 once converged
+        y = ((int32_t)y * (uint16_t)(3 * MAHONY_FIXED_Q14_ONE - t)) >> 15;
+    }
+    *shift = s;
+    return y;
+}
+
+// Integer square root, Q28 in, Q14 out
+static uint16_t isqrt(uint32_t x)
+{
+    uint32_t root = 0, bit = 1UL << 30;
+
+    while (bit > x) bit >>= 2;
+    while (bit) {
+        if (x >= root + bit) {
+            x -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+// Normalise a raw vector to Q14, 0 if it is all zeros
+static void normalise(int16_t *x, int16_t *y, int16_t *z)
+{
+    int8_t shift;
+    int16_t recipNorm = invSqrt((uint32_t)mul16(*x, *x) + (uint32_t)mul16(*y, *y) + (uint32_t)mul16(*z, *z), &shift);
+
+    *x = mul16(*x, recipNorm) >> (15 + shift);
+    *y = mul16(*y, recipNorm) >> (15 + shift);
+    *z = mul16(*z, recipNorm) >> (15 + shift);
+}
+
+//-------------------------------------------------------------------------------------------
+// atan2 in Q13 radians from Q14 arguments
+//
+// atan(z) ~= pi/4 z - z (z - 1) (0.2447 + 0.0663 z) on [0, 1], max error 0.0015 rad,
+// the other octants by symmetry.
+
+static int16_t atan2Q13(int16_t y, int16_t x)
+{
+    int16_t absx = x < 0 ? -x : x;
+    int16_t absy = y < 0 ? -y : y;
+    int16_t z, r;
+
+    if (absx == 0 && absy == 0) return 0;
+    if (absy <= absx) {
+        z = ((int32_t)absy << 14) / absx;
+    } else {
+        z = ((int32_t)absx << 14) / absy;
+    }
+    r = (mul16(12868, z) - mul16(mul16(z, z - MAHONY_FIXED_Q14_ONE) >> 14, 4009 + (mul16(1086, z) >> 14))) >> 15;
+    if (absy > absx) r = HALF_PI_Q13 - r;
+    if (x < 0) r = PI_Q13 - r;
+    return y < 0 ? -r : r;
+}
+
+//============================================================================================
+// Functions
+
+void mahony_fixed_init(mahony_fixed_t *filter, const mahony_fixed_config_t *config)
+{
+    float twoKp = config ? config->twoKp : twoKpDef;
+    float twoKi = config ? config->twoKi : twoKiDef;
+    float sampleFreq = config ? config->sampleFreq : DEFAULT_SAMPLE_FREQ;
+    float gyroScale = config ? config->gyroScale : gyroScaleDef;
+    float kp = twoKp * 0.5f / sampleFreq * (float)(1L << 20);
+    float ki = twoKi * 0.5f / (sampleFreq * sampleFreq) * 4294967296.0f;
+
+    filter->q0 = MAHONY_FIXED_Q30_ONE;
+    filter->q1 = 0;
+    filter->q2 = 0;
+    filter->q3 = 0;
+    filter->integralFBx = 0;
+    filter->integralFBy = 0;
+    filter->integralFBz = 0;
+    // degrees/sec per LSB to radians, times 0.5 / sampleFreq, in Q44
+    filter->gyroK = gyroScale * 0.0174533f * 0.5f / sampleFreq * 17592186044416.0f;
+    filter->kp = kp > 32767.0f ? 32767 : kp;
+    filter->ki = ki > 32767.0f ? 32767 : ki;
+    filter->anglesComputed = 0;
+}
+
+//-------------------------------------------------------------------------------------------
+// Feedback, integration and normalisation shared by both updates, halfe* are Q28
+
+static void integrate(mahony_fixed_t *filter, int16_t gx, int16_t gy, int16_t gz, int32_t halfex, int32_t halfey, int32_t halfez, char feedback)
+{
+    int32_t gdx, gdy, gdz;
+    int16_t qa, qb, qc, qd, recipNorm;
+    int8_t shift;
+
+    // Convert gyroscope to the half rotation of this update, Q30
+    gdx = mul32x16(filter->gyroK, gx);
+    gdy = mul32x16(filter->gyroK, gy);
+    gdz = mul32x16(filter->gyroK, gz);
+
+    if (feedback) {
+        // Compute and apply integral feedback if enabled
+        if (filter->ki > 0) {
+            // integral error scaled by Ki
+            filter->integralFBx += mul32x16(halfex, filter->ki) >> 16;
+            filter->integralFBy += mul32x16(halfey, filter->ki) >> 16;
+            filter->integralFBz += mul32x16(halfez, filter->ki) >> 16;
+            gdx += filter->integralFBx;	// apply integral feedback
+            gdy += filter->integralFBy;
+            gdz += filter->integralFBz;
+            } else {
+            filter->integralFBx = 0;	// prevent integral windup
+            filter->integralFBy = 0;
+            filter->integralFBz = 0;
+        }
+
+        // Apply proportional feedback
+        gdx += mul32x16(halfex, filter->kp) >> 4;
+        gdy += mul32x16(halfey, filter->kp) >> 4;
+        gdz += mul32x16(halfez, filter->kp) >> 4;
+    }
+
+    // Integrate rate of change of quaternion
+    qa = filter->q0 >> 16;
+    qb = filter->q1 >> 16;
+    qc = filter->q2 >> 16;
+    qd = filter->q3 >> 16;
+    filter->q0 += -mul32x16(gdx, qb) - mul32x16(gdy, qc) - mul32x16(gdz, qd);
+    filter->q1 += mul32x16(gdx, qa) + mul32x16(gdz, qc) - mul32x16(gdy, qd);
+    filter->q2 += mul32x16(gdy, qa) - mul32x16(gdz, qb) + mul32x16(gdx, qd);
+    filter->q3 += mul32x16(gdz, qa) + mul32x16(gdy, qb) - mul32x16(gdx, qc);
+
+    // Normalise quaternion, |q|^2 is Q28 so 1/|q| = recipNorm * 2^(-1 - shift) in Q14
+    qa = filter->q0 >> 16;
+    qb = filter->q1 >> 16;
+    qc = filter->q2 >> 16;
+    qd = filter->q3 >> 16;
+    recipNorm = invSqrt(mul16(qa, qa) + mul16(qb, qb) + mul16(qc, qc) + mul16(qd, qd), &shift);
+    filter->q0 = shift_right(mul32x16(filter->q0, recipNorm), 1 + shift);
+    filter->q1 = shift_right(mul32x16(filter->q1, recipNorm), 1 + shift);
+    filter->q2 = shift_right(mul32x16(filter->q2, recipNorm), 1 + shift);
+    filter->q3 = shift_right(mul32x16(filter->q3, recipNorm), 1 + shift);
+    filter->anglesComputed = 0;
+}
+
+//-------------------------------------------------------------------------------------------
+// AHRS algorithm update
+
+void mahony_fixed_update(mahony_fixed_t *filter, int16_t gx, int16_t gy, int16_t gz, int16_t ax, int16_t ay, int16_t az, int16_t mx, int16_t my, int16_t mz)
+{
+    int16_t q0, q1, q2, q3;
+    int16_t q0q0, q0q1, q0q2, q0q3, q1q1, q1q2, q1q3, q2q2, q2q3, q3q3;
+    int16_t hx, hy, bx, bz;
+    int16_t halfvx, halfvy, halfvz, halfwx, halfwy, halfwz;
+    int32_t halfex = 0, halfey = 0, halfez = 0;
+
+    // Use IMU algorithm if magnetometer measurement invalid
+    // (avoids NaN in magnetometer normalisation)
+    if((mx == 0) && (my == 0) && (mz == 0)) {
+        mahony_fixed_update_imu(filter, gx, gy, gz, ax, ay, az);
+        return;
+    }
+
+    // Compute feedback only if accelerometer measurement valid
+    // (avoids NaN in accelerometer normalisation)
+    if(!((ax == 0) && (ay == 0) && (az == 0))) {
+
+        // Normalise accelerometer and magnetometer measurement
+        normalise(&ax, &ay, &az);
+        normalise(&mx, &my, &mz);
+
+        // Auxiliary variables to avoid repeated arithmetic
+        q0 = filter->q0 >> 16;
+        q1 = filter->q1 >> 16;
+        q2 = filter->q2 >> 16;
+        q3 = filter->q3 >> 16;
+        q0q0 = mul16(q0, q0) >> 14;
+        q0q1 = mul16(q0, q1) >> 14;
+        q0q2 = mul16(q0, q2) >> 14;
+        q0q3 = mul16(q0, q3) >> 14;
+        q1q1 = mul16(q1, q1) >> 14;
+        q1q2 = mul16(q1, q2) >> 14;
+        q1q3 = mul16(q1, q3) >> 14;
+        q2q2 = mul16(q2, q2) >> 14;
+        q2q3 = mul16(q2, q3) >> 14;
+        q3q3 = mul16(q3, q3) >> 14;
+
+        // Reference direction of Earth's magnetic field
+        hx = (mul16(mx, HALF_Q14 - q2q2 - q3q3) + mul16(my, q1q2 - q0q3) + mul16(mz, q1q3 + q0q2)) >> 13;
+        hy = (mul16(mx, q1q2 + q0q3) + mul16(my, HALF_Q14 - q1q1 - q3q3) + mul16(mz, q2q3 - q0q1)) >> 13;
+        bx = isqrt(mul16(hx, hx) + mul16(hy, hy));
+        bz = (mul16(mx, q1q3 - q0q2) + mul16(my, q2q3 + q0q1) + mul16(mz, HALF_Q14 - q1q1 - q2q2)) >> 13;
+
+        // Estimated direction of gravity and magnetic field
+        halfvx = q1q3 - q0q2;
+        halfvy = q0q1 + q2q3;
+        halfvz = q0q0 - HALF_Q14 + q3q3;
+        halfwx = (mul16(bx, HALF_Q14 - q2q2 - q3q3) + mul16(bz, q1q3 - q0q2)) >> 14;
+        halfwy = (mul16(bx, q1q2 - q0q3) + mul16(bz, q0q1 + q2q3)) >> 14;
+        halfwz = (mul16(bx, q0q2 + q1q3) + mul16(bz, HALF_Q14 - q1q1 - q2q2)) >> 14;
+
+        // Error is sum of cross product between estimated direction
+        // and measured direction of field vectors
+        halfex = (mul16(ay, halfvz) - mul16(az, halfvy)) + (mul16(my, halfwz) - mul16(mz, halfwy));
+        halfey = (mul16(az, halfvx) - mul16(ax, halfvz)) + (mul16(mz, halfwx) - mul16(mx, halfwz));
+        halfez = (mul16(ax, halfvy) - mul16(ay, halfvx)) + (mul16(mx, halfwy) - mul16(my, halfwx));
+
+        integrate(filter, gx, gy, gz, halfex, halfey, halfez, 1);
+        return;
+    }
+
+    integrate(filter, gx, gy, gz, halfex, halfey, halfez, 0);
+}
+
+//-------------------------------------------------------------------------------------------
+// IMU algorithm update
+
+void mahony_fixed_update_imu(mahony_fixed_t *filter, int16_t gx, int16_t gy, int16_t gz, int16_t ax, int16_t ay, int16_t az)
+{
+    int16_t q0, q1, q2, q3;
+    int16_t halfvx, halfvy, halfvz;
+    int32_t halfex = 0, halfey = 0, halfez = 0;
+    char feedback = 0;
+
+    // Compute feedback only if accelerometer measurement valid
+    // (avoids NaN in accelerometer normalisation)
+    if(!((ax == 0) && (ay == 0) && (az == 0))) {
+
+        // Normalise accelerometer measurement
+        normalise(&ax, &ay, &az);
+
+        // Estimated direction of gravity
+        q0 = filter->q0 >> 16;
+        q1 = filter->q1 >> 16;
+        q2 = filter->q2 >> 16;
+        q3 = filter->q3 >> 16;
+        halfvx = (mul16(q1, q3) - mul16(q0, q2)) >> 14;
+        halfvy = (mul16(q0, q1) + mul16(q2, q3)) >> 14;
+        halfvz = (mul16(q0, q0) - HALF_Q28 + mul16(q3, q3)) >> 14;
+
+        // Error is sum of cross product between estimated
+        // and measured direction of gravity
+        halfex = mul16(ay, halfvz) - mul16(az, halfvy);
+        halfey = mul16(az, halfvx) - mul16(ax, halfvz);
+        halfez = mul16(ax, halfvy) - mul16(ay, halfvx);
+        feedback = 1;
+    }
+
+    integrate(filter, gx, gy, gz, halfex, halfey, halfez, feedback);
+}
+
+//-------------------------------------------------------------------------------------------
+
+static void computeAngles(mahony_fixed_t *filter)
+{
+    int16_t q0 = filter->q0 >> 16, q1 = filter->q1 >> 16, q2 = filter->q2 >> 16, q3 = filter->q3 >> 16;
+    int16_t sinp;
+
+    filter->roll = atan2Q13((mul16(q0, q1) + mul16(q2, q3)) >> 14, HALF_Q14 - ((mul16(q1, q1) + mul16(q2, q2)) >> 14));
+    // asin(x) = atan2(x, sqrt(1 - x^2))
+    sinp = (mul16(q0, q2) - mul16(q1, q3)) >> 13;
+    sinp = sinp > MAHONY_FIXED_Q14_ONE ? MAHONY_FIXED_Q14_ONE : sinp < -MAHONY_FIXED_Q14_ONE ? -MAHONY_FIXED_Q14_ONE : sinp;
+    filter->pitch = atan2Q13(sinp, isqrt((1UL << 28) - mul16(sinp, sinp)));
+    filter->yaw = atan2Q13((mul16(q1, q2) + mul16(q0, q3)) >> 14, HALF_Q14 - ((mul16(q2, q2) + mul16(q3, q3)) >> 14));
+    filter->anglesComputed = 1;
+}
+
+void mahony_fixed_get_angles(mahony_fixed_t *filter, int16_t *roll, int16_t *pitch, int16_t *yaw)
+{
+    if (!filter->anglesComputed) computeAngles(filter);
+    *roll = filter->roll;
+    *pitch = filter->pitch;
+    *yaw = filter->yaw;
+}
+
+float mahony_fixed_get_roll(mahony_fixed_t *filter) {
+    if (!filter->anglesComputed) computeAngles(filter);
+    return filter->roll * (57.29578f / (1 << MAHONY_FIXED_ANGLE_Q));
+}
+float mahony_fixed_get_pitch(mahony_fixed_t *filter) {
+    if (!filter->anglesComputed) computeAngles(filter);
+    return filter->pitch * (57.29578f / (1 << MAHONY_FIXED_ANGLE_Q));
+}
+float mahony_fixed_get_yaw(mahony_fixed_t *filter) {
+    if (!filter->anglesComputed) computeAngles(filter);
+    return filter->yaw * (57.29578f / (1 << MAHONY_FIXED_ANGLE_Q)) + 180.0f;
+}
@@ -0,0 +1,52 @@
+//=====================================================================================================
+// mahony_fixed.h
+//=====================================================================================================
+//
+// Fixed-point version of the Mahony AHRS filter in mahony.c for cores without an FPU.
+//
+// Unit vectors and the quaternion products are Q14 (int16_t, 1.0 = 16384), the quaternion
+// itself and the per update rotation are Q30 (int32_t). Every product is a 16x16 bit
+// multiply, the ATmega328P has a hardware multiplier for those. The inverse square root
+// is a Newton iteration, atan2/asin a polynomial, there is no float in the update.
+//
+// Plain C on stdint.h, builds for AVR and for the host.
+//
+//=====================================================================================================
+#ifndef MahonyFixed_h
+#define MahonyFixed_h
+
+#include <stdint.h>
+
+#define MAHONY_FIXED_Q14_ONE (1L << 14)
+#define MAHONY_FIXED_Q30_ONE (1L << 30)
+#define MAHONY_FIXED_ANGLE_Q 13 // angles are radians in Q13
+
+typedef struct {
+    float twoKp;		// 2 * proportional gain (Kp), twoKp / sampleFreq up to 0.0625
+    float twoKi;		// 2 * integral gain (Ki), twoKi / sampleFreq^2 up to 1.5e-5
+    float sampleFreq;	// sample frequency in Hz
+    float gyroScale;	// gyroscope degrees/sec per LSB, e.g. 1 / 65.5 at +/- 500 deg/s
+} mahony_fixed_config_t;
+
+typedef struct {
+    int32_t q0, q1, q2, q3;	// Q30 quaternion of sensor frame relative to auxiliary frame
+    int32_t integralFBx, integralFBy, integralFBz;	// Q30 integral feedback, as rotation per update
+    int32_t gyroK;	// raw gyroscope to Q30 half rotation per update, Q44
+    int16_t kp;		// Q28 error to Q30 half rotation per update, Q20
+    int16_t ki;		// Q28 error to Q30 integral step, Q32
+    int16_t roll, pitch, yaw;	// Q13 radians
+    char anglesComputed;
+} mahony_fixed_t;
+
+void mahony_fixed_init(mahony_fixed_t *filter, const mahony_fixed_config_t *config);
+void mahony_fixed_update(mahony_fixed_t *filter, int16_t gx, int16_t gy, int16_t gz, int16_t ax, int16_t ay, int16_t az, int16_t mx, int16_t my, int16_t mz);
+void mahony_fixed_update_imu(mahony_fixed_t *filter, int16_t gx, int16_t gy, int16_t gz, int16_t ax, int16_t ay, int16_t az);
+void mahony_fixed_get_angles(mahony_fixed_t *filter, int16_t *roll, int16_t *pitch, int16_t *yaw);
+float mahony_fixed_get_roll(mahony_fixed_t *filter);
+float mahony_fixed_get_pitch(mahony_fixed_t *filter);
+float mahony_fixed_get_yaw(mahony_fixed_t *filter);
+
+#endif
+//=====================================================================================================
+// End of file
+//=====================================================================================================
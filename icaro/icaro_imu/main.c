@@ -6,6 +6,7 @@
 #include <util/atomic.h>
 
 #include "icarolib/timer/timer.h"
+#include "icarolib/scheduler/scheduler.h"
 #include "icarolib/twi/i2cdevlib.h"
 #include "icarolib/twi/twi.h"
 #include "icarolib/icaro_common.h"
@@ -13,8 +14,10 @@
 
 #include "./sensors/mpu6050.h"
 #include "./sensors/hcm5883l.h"
+#include "./sensors/hcm5883l_registers.h"
 #include "./eeprom/eeprom.h"
 #include "./mahony.h"
+#include "./mahony_fixed.h"
 
 #ifdef DEBUG
 #include "icarolib/uart/uart.h"
@@ -22,14 +25,77 @@ char BUFFER[150] = {0};
 int count = 0;
 #endif
 
-#define REGISTER_LENGTH 13
+#define REGISTER_LENGTH 15
 
-// STATUS[1] ROLL[4] PITCH[4] YAW[4]
+// sensor bus speed, both the mpu6050 and the hmc5883l support fast mode
+#ifndef IMU_TWI_FREQ
+#define IMU_TWI_FREQ TWI_FREQ_FAST
+#endif
+
+// scheduler: a 1kHz timer2 tick, the sensors are sampled every
+// IMU_SAMPLE_PERIOD ticks, 200Hz by default, both filters are set up for
+// IMU_SAMPLE_FREQ. Fusion runs a slot after the sample, when the reads are
+// done, housekeeping once a second in a slot of its own
+#define IMU_TICK_HZ 1000
+#ifndef IMU_SAMPLE_PERIOD
+#define IMU_SAMPLE_PERIOD 5
+#endif
+#define IMU_SAMPLE_FREQ ((float)IMU_TICK_HZ / IMU_SAMPLE_PERIOD)
+#define IMU_FUSE_SLOT 1
+#define IMU_HOUSEKEEPING_PERIOD 1000
+#define IMU_HOUSEKEEPING_SLOT 3
+
+// STATUS[1] ROLL[4] PITCH[4] YAW[4] OVERRUNS[2]
 uint8_t REGISTER[REGISTER_LENGTH] = {0};
 int16_t gx, gy, gz, ax, ay, az, mx, my, mz;
 
+// MPU6050_AUX_MAG: the mpu6050 auxiliary i2c master polls the magnetometer and
+// the 9 axes come in a single burst read
+#ifdef MPU6050_AUX_MAG
+#define AUX_MAG_RATE 75 // Hz, HMC5883L_RATE_75
+uint8_t mag_data[HMC5883L_HEADING_LENGTH];
+#endif
+
+// filter gains, 2 * Kp and 2 * Ki, and the gyro scale of MPU6050_GYRO_FS_500
+#define IMU_TWO_KP (2.0f * 5.0f)
+#define IMU_TWO_KI 0.0f
+#define IMU_GYRO_SCALE (1.0f / 65.5f)
+
+// MAHONY_FIXED: the fixed-point filter on the raw readings. It integrates at
+// its configured sample rate, not the measured one, and twoKp / sampleFreq
+// must stay within 0.0625 for its Q20 gain
+#ifdef MAHONY_FIXED
+#if IMU_TICK_HZ / IMU_SAMPLE_PERIOD < 160
+#error "IMU_SAMPLE_PERIOD too long for the MAHONY_FIXED gain"
+#endif
+mahony_fixed_t fixed_filter;
+#endif
+
+// MAHONY_PROFILE: cpu cycles spent in the filter update, printed with DEBUG
+#ifdef MAHONY_PROFILE
+uint32_t profile_cycles = 0;
+uint16_t profile_updates = 0;
+#endif
+
+// the timer tick puts a sample on the bus, the TWI interrupt reads it while
+// the main loop fuses the previous one
+twi_transaction_t motion_read;
+uint8_t motion_buffer[MPU6050_MOTION_9_LENGTH];
+#ifndef MPU6050_AUX_MAG
+twi_transaction_t heading_read;
+uint8_t heading_buffer[HMC5883L_HEADING_LENGTH];
+#endif
+volatile uint8_t acquiring = 0;
+uint16_t read_errors = 0;
+uint8_t sample_task;
+
 uint8_t twi_request_address = 0;
 
+// micros() when the sample went on the bus and of the previous fused one, the
+// filter integrates the measured period, a skipped sample doubles it
+volatile unsigned long sample_time = 0;
+unsigned long last_sample = 0;
+
 void setup(void);
 void setup_sensors(void);
 void calibrate_gyro_accel(void);
@@ -40,7 +106,15 @@ void on_receive(int num_bytes)
 {
     int address = wire_read();   
     for (; wire_available() && address < REGISTER_LENGTH; address++)
-    { REGISTER[address] = wire_read(); }
+    {
+        REGISTER[address] = wire_read();
+        // any write to the overruns register clears the counts behind it
+        if (address == IMU_OVERRUNS_ADDRESS || address == IMU_OVERRUNS_ADDRESS + 1)
+        {
+            scheduler_clear_overruns(SCHEDULER_ALL);
+            REGISTER[address] = 0;
+        }
+    }
 }
 
 void on_request()
@@ -88,6 +162,7 @@ void setup(void)
     
     init_millis(F_CPU);
     wire_init();
+    wire_set_clock(IMU_TWI_FREQ);
     wire_set_address(IMU_TWI_ADDRESS);
     wire_set_on_receive(on_receive);
     wire_set_on_request(on_request);
@@ -136,18 +211,99 @@ void setup_sensors(void)
     #endif
 
     hcm5883l_initialize();
+    
+    #ifdef MPU6050_AUX_MAG
+    hcm5883l_start_continuous(HMC5883L_RATE_75);
+    mpu6050_aux_slave_enable(HMC5883L_ADDRESS, HMC5883L_DATAX_H, HMC5883L_HEADING_LENGTH, AUX_MAG_RATE);
+    #endif
 
-    mahony_init();
+    #ifdef MAHONY_FIXED
+    mahony_fixed_config_t fixed_config = {IMU_TWO_KP, IMU_TWO_KI, IMU_SAMPLE_FREQ, IMU_GYRO_SCALE};
+    mahony_fixed_init(&fixed_filter, &fixed_config);
+    #else
+    mahony_config_t config = {IMU_TWO_KP, IMU_TWO_KI, IMU_SAMPLE_FREQ};
+    mahony_init(&config);
+    #endif
 
     _delay_ms(100);
 }
 
+void start_acquisition(void)
+{
+    #ifdef MPU6050_AUX_MAG
+    mpu6050_start_motion(&motion_read, motion_buffer, MPU6050_MOTION_9_LENGTH);
+    #else
+    mpu6050_start_motion(&motion_read, motion_buffer, MPU6050_MOTION_6_LENGTH);
+    hcm5883l_start_heading(&heading_read, heading_buffer);
+    #endif
+    acquiring = 1;
+}
+
+// waits for the reads in flight and decodes them, 0 when one failed
+uint8_t finish_acquisition(void)
+{
+    uint8_t status = twi_wait(&motion_read);
+    #ifndef MPU6050_AUX_MAG
+    status |= twi_wait(&heading_read);
+    #endif
+    
+    if (status != TWI_DONE)
+    {
+        read_errors++;
+        acquiring = 0;
+        return 0;
+    }
+    
+    mpu6050_decode_motion_6(motion_buffer, &ax, &ay, &az, &gx, &gy, &gz);
+    #ifdef MPU6050_AUX_MAG
+    for (uint8_t i = 0; i < HMC5883L_HEADING_LENGTH; i++)
+    { mag_data[i] = motion_buffer[MPU6050_EXT_SENS_OFFSET + i]; }
+    hcm5883l_decode_heading(mag_data, &mx, &my, &mz);
+    #else
+    hcm5883l_decode_heading(heading_buffer, &mx, &my, &mz);
+    #endif
+    // decoded, the next sample may reuse the buffers
+    acquiring = 0;
+    return 1;
+}
+
+// timer interrupt task, a sample still waiting for fusion is an overrun
+void sample(void)
+{
+    if (REGISTER[IMU_STATUS_ADDRESS] != IMU_STATUS_RUNNING) { return; }
+    if (acquiring)
+    {
+        scheduler_count_overrun(sample_task);
+        return;
+    }
+    sample_time = micros();
+    start_acquisition();
+}
+
 void calculate_roll_pitch_yaw()
 {
-    mpu6050_get_motion_6(&ax, &ay, &az, &gx, &gy, &gz);
-    hcm5883l_get_heading(&mx, &my, &mz);
+    if (!acquiring) { return; }
+    // sample() does not touch it while acquiring
+    unsigned long taken = sample_time;
+    if (!finish_acquisition()) { return; }
+    
+    #if DEBUG
+    count++;
+    #endif
+    
+    #ifndef MAHONY_FIXED
+    float dt = (taken - last_sample) * 1e-6f;
+    #endif
+    last_sample = taken;
+    
+    #ifdef MAHONY_PROFILE
+    uint32_t start = timer_ticks();
+    #endif
     
-    mahony_update(
+    #ifdef MAHONY_FIXED
+    mahony_fixed_update(&fixed_filter, gx, gy, gz, ax, ay, az, mx, my, mz);
+    #else
+    mahony_update_dt(
         gz * 0.001,
         gy * 0.001,
         gz * 0.001,
@@ -156,16 +312,84 @@ void calculate_roll_pitch_yaw()
         az * 0.001,
         mx * 0.001,
         my * 0.001,
-        mz * 0.001);
+        mz * 0.001,
+        dt);
+    #endif
+    
+    #ifdef MAHONY_PROFILE
+    profile_cycles += (timer_ticks() - start) * TIMER_TICK_PRESCALER;
+    profile_updates++;
+    #endif
+
+    #ifdef MAHONY_FIXED
+    float roll = mahony_fixed_get_roll(&fixed_filter);
+    float pitch = mahony_fixed_get_pitch(&fixed_filter);
+    float yaw = mahony_fixed_get_yaw(&fixed_filter);
+    #else
+    float roll = getRoll();
+    float pitch = getPitch();
+    float yaw = getYaw();
+    #endif
 
     ATOMIC_BLOCK(ATOMIC_FORCEON)
     {
-     float_to_bytes(getRoll(), &REGISTER[IMU_ROLL_ADDRESS]);
-     float_to_bytes(getPitch(), &REGISTER[IMU_PITCH_ADDRESS]);
-     float_to_bytes(getYaw(), &REGISTER[IMU_YAW_ADDRESS]);   
+     // read with interrupts off, a clear from on_receive() is never overwritten
+     uint16_t overruns = scheduler_overruns(SCHEDULER_ALL);
+     float_to_bytes(roll, &REGISTER[IMU_ROLL_ADDRESS]);
+     float_to_bytes(pitch, &REGISTER[IMU_PITCH_ADDRESS]);
+     float_to_bytes(yaw, &REGISTER[IMU_YAW_ADDRESS]);   
+     REGISTER[IMU_OVERRUNS_ADDRESS] = overruns;
+     REGISTER[IMU_OVERRUNS_ADDRESS + 1] = overruns >> 8;
     }    
 }
 
+void housekeeping(void)
+{
+    if (REGISTER[IMU_STATUS_ADDRESS] != IMU_STATUS_RUNNING) { return; }
+    
+    PORTB ^= (1 << PB5);
+    
+    #if DEBUG
+    #if SENSOR_RAW_VALUES
+    sprintf(BUFFER,
+        "raw\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\n",
+        gx, gy, gz, ax, ay, az, mx, my, mz);    
+    uart_puts(BUFFER);
+    #endif
+    
+    sprintf(
+        BUFFER,
+        "rpy\t%f\t%f\t%f\treadings\t%d\n",
+        bytes_to_float(&REGISTER[IMU_ROLL_ADDRESS]),
+        bytes_to_float(&REGISTER[IMU_PITCH_ADDRESS]),
+        bytes_to_float(&REGISTER[IMU_YAW_ADDRESS]),
+        count
+    );
+    
+    uart_puts(BUFFER);
+    count = 0;
+    
+    sprintf(BUFFER, "twi\t%u\tread errors\n", read_errors);
+    uart_puts(BUFFER);
+    
+    sprintf(BUFFER, "scheduler\t%u\toverruns\t%u\tskipped samples\n",
+        scheduler_overruns(SCHEDULER_ALL), scheduler_overruns(sample_task));
+    uart_puts(BUFFER);
+    
+    #ifndef MAHONY_FIXED
+    sprintf(BUFFER, "rate\t%f\tHz\tclamped\t%lu\n", getSampleFreq(), getDtClamped());
+    uart_puts(BUFFER);
+    #endif
+    
+    #ifdef MAHONY_PROFILE
+    sprintf(BUFFER, "mahony\t%lu\tcycles/update\n", profile_cycles / (profile_updates ? profile_updates : 1));
+    uart_puts(BUFFER);
+    profile_cycles = 0;
+    profile_updates = 0;
+    #endif
+    #endif
+}
+
 int main(void)
 {
     REGISTER[IMU_STATUS_ADDRESS] = IMU_STATUS_INITIALIZING;
@@ -179,53 +403,19 @@ int main(void)
     uart_puts("ready to start\n");
     #endif
     
-    long last = 0;
-    long delta = 0;
+    scheduler_init(IMU_TICK_HZ);
+    sample_task = scheduler_add(sample, IMU_SAMPLE_PERIOD, 0, SCHEDULER_ISR);
+    scheduler_add(calculate_roll_pitch_yaw, IMU_SAMPLE_PERIOD, IMU_FUSE_SLOT, 0);
+    scheduler_add(housekeeping, IMU_HOUSEKEEPING_PERIOD, IMU_HOUSEKEEPING_SLOT, 0);
     
     while(1)
     {
-        delta = millis() - last;
+        scheduler_run();
         
-        if (REGISTER[IMU_STATUS_ADDRESS] == IMU_STATUS_RUNNING)
-        {
-            calculate_roll_pitch_yaw();
-        
-            if(delta > 1000)
-            {
-                PORTB ^= (1 << PB5);
-        
-                #if DEBUG
-                #if SENSOR_RAW_VALUES
-                sprintf(BUFFER,
-                    "raw\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\n",
-                    gx, gy, gz, ax, ay, az, mx, my, mz);    
-                uart_puts(BUFFER);
-                #endif
-                
-                count++;
-                sprintf(
-                    BUFFER,
-                    "rpy\t%f\t%f\t%f\treadings\t%d\n",
-                    bytes_to_float(&REGISTER[IMU_ROLL_ADDRESS]),
-                    bytes_to_float(&REGISTER[IMU_PITCH_ADDRESS]),
-                    bytes_to_float(&REGISTER[IMU_YAW_ADDRESS]),
-                    count
-                );
-                
-                uart_puts(BUFFER);
-                count = 0;
-                #endif
-                
-                last = millis();
-            }
-            #if DEBUG
-            count++;
-            #endif
-        }
-        else if (REGISTER[IMU_STATUS_CALIBRATING] == IMU_STATUS_RUNNING)
+        if (REGISTER[IMU_STATUS_ADDRESS] != IMU_STATUS_RUNNING
+            && REGISTER[IMU_STATUS_CALIBRATING] == IMU_STATUS_RUNNING)
         {
             calibrate_gyro_accel();
         }
     }
 }
-
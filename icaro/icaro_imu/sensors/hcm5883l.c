@@ -7,7 +7,7 @@
 #include "./hcm5883l_registers.h"
 
 uint8_t mode;
-uint8_t mag_buffer[6];
+uint8_t mag_buffer[HMC5883L_HEADING_LENGTH];
 
 /** Set magnetic field gain value.
 * @param gain New magnetic field gain value
@@ -58,6 +58,20 @@ void hcm5883l_initialize()
 	setMode(HMC5883L_MODE_SINGLE);
 }
 
+/** Switch to continuous measurement, e.g. to be polled by the MPU6050
+* auxiliary I2C master, which can not re-trigger Single mode.
+* @param rate Output rate, HMC5883L_RATE_*
+* @see HMC5883L_MODE_CONTINUOUS
+*/
+void hcm5883l_start_continuous(uint8_t rate)
+{
+	i2c_write_byte(HMC5883L_ADDRESS, HMC5883L_CONFIG_A,
+	(HMC5883L_AVERAGING_8 << (HMC5883L_CRA_AVERAGE_BIT - HMC5883L_CRA_AVERAGE_LENGTH + 1)) |
+	(rate << (HMC5883L_CRA_RATE_BIT - HMC5883L_CRA_RATE_LENGTH + 1)) |
+	(HMC5883L_BIAS_NORMAL << (HMC5883L_CRA_BIAS_BIT - HMC5883L_CRA_BIAS_LENGTH + 1)));
+	setMode(HMC5883L_MODE_CONTINUOUS);
+}
+
 /** Get 3-axis heading measurements.
 * In the event the ADC reading overflows or underflows for the given channel,
 * or if there is a math overflow during the bias measurement, this data
@@ -74,7 +88,7 @@ void hcm5883l_get_heading(int16_t *x, int16_t *y, int16_t *z)
 	i2c_read_bytes(
         HMC5883L_ADDRESS,
         HMC5883L_DATAX_H,
-        6,
+        HMC5883L_HEADING_LENGTH,
         mag_buffer,
         I2CDEV_DEFAULT_READ_TIMEOUT
     );
@@ -84,7 +98,41 @@ void hcm5883l_get_heading(int16_t *x, int16_t *y, int16_t *z)
         HMC5883L_MODE,
         HMC5883L_MODE_SINGLE << (HMC5883L_MODEREG_BIT - HMC5883L_MODEREG_LENGTH + 1));
 	}
-	*x = (((int16_t)mag_buffer[0]) << 8) | mag_buffer[1];
-	*y = (((int16_t)mag_buffer[4]) << 8) | mag_buffer[5];
-	*z = (((int16_t)mag_buffer[2]) << 8) | mag_buffer[3];
+	hcm5883l_decode_heading(mag_buffer, x, y, z);
+}
+
+/** Queue the 3-axis heading read on the asynchronous TWI master. In Single
+* mode the next measurement is triggered by a write queued right behind it.
+* @param transaction Transaction to submit, poll it with twi_poll()
+* @param buffer Container for HMC5883L_HEADING_LENGTH bytes
+* @return Status of submit operation (0 = queued)
+* @see hcm5883l_decode_heading()
+*/
+uint8_t hcm5883l_start_heading(twi_transaction_t *transaction, uint8_t *buffer)
+{
+	static const uint8_t reg_address = HMC5883L_DATAX_H;
+	static uint8_t single[2] = {HMC5883L_MODE};
+	static twi_transaction_t trigger;
+	uint8_t status = i2c_submit_read(transaction, HMC5883L_ADDRESS, &reg_address, HMC5883L_HEADING_LENGTH, buffer, 0);
+
+	if (status == 0 && mode == HMC5883L_MODE_SINGLE)
+	{
+		single[1] = HMC5883L_MODE_SINGLE << (HMC5883L_MODEREG_BIT - HMC5883L_MODEREG_LENGTH + 1);
+		trigger.address = HMC5883L_ADDRESS;
+		trigger.write_data = single;
+		trigger.write_length = 2;
+		twi_submit(&trigger);
+	}
+	return status;
+}
+
+/** Decode 3-axis heading registers, the device orders them X, Z, Y.
+* @param buffer HMC5883L_HEADING_LENGTH bytes read from HMC5883L_DATAX_H
+* @see hcm5883l_get_heading()
+*/
+void hcm5883l_decode_heading(const uint8_t *buffer, int16_t *x, int16_t *y, int16_t *z)
+{
+	*x = (((int16_t)buffer[0]) << 8) | buffer[1];
+	*y = (((int16_t)buffer[4]) << 8) | buffer[5];
+	*z = (((int16_t)buffer[2]) << 8) | buffer[3];
 }
\ No newline at end of file
@@ -1,7 +1,14 @@
 #ifndef __HCM5883L_H_
 #define __HCM5883L_H_
 
+#include "icarolib/twi/twi.h"
+
+#define HMC5883L_HEADING_LENGTH 6
+
 void hcm5883l_initialize();
+void hcm5883l_start_continuous(uint8_t rate);
 void hcm5883l_get_heading(int16_t *x, int16_t *y, int16_t *z);
+uint8_t hcm5883l_start_heading(twi_transaction_t *transaction, uint8_t *buffer);
+void hcm5883l_decode_heading(const uint8_t *buffer, int16_t *x, int16_t *y, int16_t *z);
 
 #endif
\ No newline at end of file
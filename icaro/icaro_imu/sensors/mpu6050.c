@@ -4,10 +4,17 @@
 
 #include "util/delay.h"
 #include "icarolib/twi/i2cdevlib.h"
+#include "icarolib/twi/i2cshadow.h"
 
 #include "mpu6050.h"
 #include "mpu6050_registers.h"
 
+// configuration registers kept in the shadow, SMPLRT_DIV to PWR_MGMT_2
+#define MPU6050_SHADOW_FIRST MPU6050_SMPLRT_DIV
+#define MPU6050_SHADOW_LENGTH (MPU6050_PWR_MGMT_2 - MPU6050_SMPLRT_DIV + 1)
+
+static i2c_shadow_t shadow;
+
 
 /**
 * Set clock source setting.
@@ -43,8 +50,8 @@
 */
 void mpu6050_set_clock_source(uint8_t source)
 {
-    i2c_write_bits(
-    MPU6050_ADDRESS,
+    i2c_shadow_write_bits(
+    &shadow,
     MPU6050_PWR_MGMT_1,
     MPU6050_PWR_MGMT_1_CLK_SEL_BIT,
     MPU6050_PWR_MGMT_1_CLK_SEL_LENGTH,
@@ -63,8 +70,8 @@ void mpu6050_set_clock_source(uint8_t source)
 */
 void mpu6050_set_full_scale_gyro_range(uint8_t range)
 {
-    i2c_write_bits(
-    MPU6050_ADDRESS,
+    i2c_shadow_write_bits(
+    &shadow,
     MPU6050_GYRO_CONFIG,
     MPU6050_GYRO_FS_SEL_BIT,
     MPU6050_GYRO_FS_SEL_LENGTH,
@@ -79,8 +86,8 @@ void mpu6050_set_full_scale_gyro_range(uint8_t range)
 */
 void mpu6050_set_full_scale_accel_range(uint8_t range)
 {
-    i2c_write_bits(
-    MPU6050_ADDRESS,
+    i2c_shadow_write_bits(
+    &shadow,
     MPU6050_ACCEL_CONFIG,
     MPU6050_ACCEL_CONFIG_AFS_SEL_BIT,
     MPU6050_ACCEL_CONFIG_AFS_SEL_LENGTH,
@@ -97,8 +104,8 @@ void mpu6050_set_full_scale_accel_range(uint8_t range)
 */
 void mpu6050_set_sleep_enabled(uint8_t enabled)
 {
-    i2c_write_bit(
-    MPU6050_ADDRESS,
+    i2c_shadow_write_bit(
+    &shadow,
     MPU6050_PWR_MGMT_1,
     MPU6050_PWR_MGMT_1_SLEEP_BIT,
     enabled);
@@ -114,8 +121,8 @@ void mpu6050_set_sleep_enabled(uint8_t enabled)
 */
 void mpu6050_set_I2C_master_mode_enabled(uint8_t enabled)
 {
-    i2c_write_bit(
-    MPU6050_ADDRESS,
+    i2c_shadow_write_bit(
+    &shadow,
     MPU6050_USER_CTRL,
     MPU6050_USER_CTRL_I2C_MST_EN_BIT,
     enabled);
@@ -138,8 +145,8 @@ void mpu6050_set_I2C_master_mode_enabled(uint8_t enabled)
 */
 void mpu6050_set_I2C_bypass_enabled(uint8_t enabled)
 {
-    i2c_write_bit(
-    MPU6050_ADDRESS,
+    i2c_shadow_write_bit(
+    &shadow,
     MPU6050_INT_PIN_CFG,
     MPU6050_INT_PIN_CFG_I2C_BYPASS_EN_BIT,
     enabled);
@@ -154,9 +161,10 @@ uint8_t mpu6050_self_test()
     uint8_t rawData[4];
     uint8_t selfTest[6];
     float factoryTrim[6];
-    // Configure the accelerometer for self-test
-    i2c_write_byte(MPU6050_ADDRESS, MPU6050_ACCEL_CONFIG, 0xF0);     // Enable self test on all three axes and set accelerometer range to +/- 8 g
-    i2c_write_byte(MPU6050_ADDRESS, MPU6050_GYRO_CONFIG, 0xE0);       // Enable self test on all three axes and set gyro range to +/- 250 degrees/s
+    // Configure the accelerometer for self-test, through the shadow so a later
+    // set_full_scale_*() is not skipped as already held
+    i2c_shadow_write_byte(&shadow, MPU6050_ACCEL_CONFIG, 0xF0);     // Enable self test on all three axes and set accelerometer range to +/- 8 g
+    i2c_shadow_write_byte(&shadow, MPU6050_GYRO_CONFIG, 0xE0);       // Enable self test on all three axes and set gyro range to +/- 250 degrees/s
     _delay_ms(0.250);                                                // Delay a while to let the device execute the self-test
     i2c_read_bytes(MPU6050_ADDRESS, MPU6050_SELF_TEST_X, 4, rawData, I2CDEV_DEFAULT_READ_TIMEOUT); // X-axis self-test results
     //rawData[1] = i2c_read_byte(MPU6050_ADDRESS, MPU6050_SELF_TEST_Y); // Y-axis self-test results
@@ -194,17 +202,28 @@ uint8_t mpu6050_self_test()
 * to their most sensitive settings, namely +/- 2g and +/- 250 degrees/sec, and sets
 * the clock source to use the X Gyro for reference, which is slightly better than
 * the default internal clock source.
+*
+* The configuration registers are loaded into the shadow once, skipping the
+* data and status registers: I2C_SLV4_DI and I2C_MST_STATUS (which clears on
+* read) stay out of it, and so do INT_STATUS and the sensor data after
+* INT_ENABLE. The settings are flushed together as coalesced burst writes.
 */
 void mpu6050_initialize()
 {
+    i2c_shadow_init(&shadow, MPU6050_ADDRESS, MPU6050_SHADOW_FIRST, MPU6050_SHADOW_LENGTH);
+    i2c_shadow_refresh(&shadow, MPU6050_SMPLRT_DIV, MPU6050_I2C_SLV4_CTRL - MPU6050_SMPLRT_DIV + 1);
+    i2c_shadow_invalidate(&shadow, MPU6050_I2C_SLV4_DI, MPU6050_I2C_MST_STATUS - MPU6050_I2C_SLV4_DI + 1);
+    i2c_shadow_refresh(&shadow, MPU6050_INT_PIN_CFG, MPU6050_INT_ENABLE - MPU6050_INT_PIN_CFG + 1);
+    i2c_shadow_refresh(&shadow, MPU6050_I2C_MST_DELAY_CTRL, MPU6050_PWR_MGMT_2 - MPU6050_I2C_MST_DELAY_CTRL + 1);
     
+    i2c_shadow_hold(&shadow);
     mpu6050_set_I2C_master_mode_enabled(0);
     mpu6050_set_I2C_bypass_enabled(1);
     mpu6050_set_clock_source(MPU6050_CLOCK_PLL_XGYRO);
     mpu6050_set_full_scale_gyro_range(MPU6050_GYRO_FS_500);
     mpu6050_set_full_scale_accel_range(MPU6050_ACCEL_FS_8);
     mpu6050_set_sleep_enabled(0);
-    
+    i2c_shadow_flush(&shadow);
 }
 
 /**
@@ -223,15 +242,42 @@ void mpu6050_initialize()
 */
 void mpu6050_get_motion_6(int16_t *ax, int16_t *ay, int16_t *az, int16_t *gx, int16_t *gy, int16_t *gz)
 {
-    uint8_t buffer[14];
+    uint8_t buffer[MPU6050_MOTION_6_LENGTH];
 
     i2c_read_bytes(
     MPU6050_ADDRESS,
     MPU6050_ACCEL_XOUT_H,
-    14,
+    MPU6050_MOTION_6_LENGTH,
     buffer,
     I2CDEV_DEFAULT_READ_TIMEOUT);
     
+    mpu6050_decode_motion_6(buffer, ax, ay, az, gx, gy, gz);
+}
+
+/**
+* Queue the motion burst read on the asynchronous TWI master, the CPU is free
+* while the bytes come in.
+* @param transaction Transaction to submit, poll it with twi_poll()
+* @param buffer Container for length bytes read from ACCEL_XOUT_H
+* @param length MPU6050_MOTION_6_LENGTH, or MPU6050_MOTION_9_LENGTH with the
+* auxiliary slave enabled
+* @return Status of submit operation (0 = queued)
+* @see mpu6050_decode_motion_6()
+*/
+uint8_t mpu6050_start_motion(twi_transaction_t *transaction, uint8_t *buffer, uint8_t length)
+{
+    static const uint8_t reg_address = MPU6050_ACCEL_XOUT_H;
+
+    return i2c_submit_read(transaction, MPU6050_ADDRESS, &reg_address, length, buffer, 0);
+}
+
+/**
+* Decode a motion burst read, the temperature in between is skipped.
+* @param buffer At least MPU6050_MOTION_6_LENGTH bytes read from ACCEL_XOUT_H
+* @see mpu6050_start_motion()
+*/
+void mpu6050_decode_motion_6(const uint8_t *buffer, int16_t *ax, int16_t *ay, int16_t *az, int16_t *gx, int16_t *gy, int16_t *gz)
+{
     *ax = buffer[0] << 8 | buffer[1];
     *ay = buffer[2] << 8 | buffer[3];
     *az = buffer[4] << 8 | buffer[5];
@@ -240,6 +286,91 @@ void mpu6050_get_motion_6(int16_t *ax, int16_t *ay, int16_t *az, int16_t *gx, in
     *gz = buffer[12] << 8 | buffer[13];
 }
 
+/**
+* Get raw 6-axis motion sensor readings and the auxiliary slave data.
+*
+* With the auxiliary I2C master enabled the slave data is mirrored right after
+* the gyroscope registers, so everything comes in one burst read.
+* @param ext_data Container for MPU6050_MOTION_9_LENGTH - MPU6050_EXT_SENS_OFFSET
+* bytes read from EXT_SENS_DATA_00
+* @see mpu6050_get_motion_6()
+* @see mpu6050_aux_slave_enable()
+*/
+void mpu6050_get_motion_9(int16_t *ax, int16_t *ay, int16_t *az, int16_t *gx, int16_t *gy, int16_t *gz, uint8_t *ext_data)
+{
+    uint8_t buffer[MPU6050_MOTION_9_LENGTH];
+
+    i2c_read_bytes(
+    MPU6050_ADDRESS,
+    MPU6050_ACCEL_XOUT_H,
+    MPU6050_MOTION_9_LENGTH,
+    buffer,
+    I2CDEV_DEFAULT_READ_TIMEOUT);
+    
+    mpu6050_decode_motion_6(buffer, ax, ay, az, gx, gy, gz);
+    for (uint8_t i = MPU6050_EXT_SENS_OFFSET; i < MPU6050_MOTION_9_LENGTH; i++)
+    { ext_data[i - MPU6050_EXT_SENS_OFFSET] = buffer[i]; }
+}
+
+/**
+* Get the sample rate from the CONFIG and SMPLRT_DIV registers.
+*
+* The gyroscope output rate is 8kHz with the DLPF disabled (DLPF_CFG 0 or 7)
+* and 1kHz otherwise.
+*
+* @return Sample rate in Hz, 0 if the registers can not be read
+*/
+uint16_t mpu6050_get_rate(void)
+{
+    uint8_t config, div, dlpf;
+
+    if (!i2c_shadow_read_byte(&shadow, MPU6050_CONFIG, &config) ||
+        !i2c_shadow_read_byte(&shadow, MPU6050_SMPLRT_DIV, &div))
+    { return 0; }
+    
+    dlpf = config & ((1 << MPU6050_CONFIG_DLPF_CFG_LENGTH) - 1);
+    return ((dlpf == 0 || dlpf == 7) ? 8000 : 1000) / (1 + div);
+}
+
+/**
+* Let the auxiliary I2C master poll a slave.
+*
+* Slave 0 reads length bytes from slave_reg and mirrors them into
+* EXT_SENS_DATA_00, read back with mpu6050_get_motion_9(). Bypass is turned
+* off, so the slave must be configured before (e.g. continuous mode).
+*
+* @param slave_address I2C address of the auxiliary slave
+* @param slave_reg First register to read
+* @param length Number of bytes to read (1-15)
+* @param slave_rate Rate in Hz the slave is read at, every sample if 0
+* @return Status of operation (true = success)
+*/
+uint8_t mpu6050_aux_slave_enable(uint8_t slave_address, uint8_t slave_reg, uint8_t length, uint16_t slave_rate)
+{
+    uint16_t rate = mpu6050_get_rate();
+    uint8_t delay = 0;
+    
+    if (length == 0 || length > 15) { return 0; }
+    
+    // slave is read every 1 + delay samples
+    if (slave_rate > 0 && rate > slave_rate)
+    {
+        delay = rate / slave_rate - 1;
+        delay = delay > 31 ? 31 : delay;
+    }
+    
+    i2c_shadow_hold(&shadow);
+    i2c_shadow_write_bits(&shadow, MPU6050_I2C_MST_CTRL, MPU6050_I2C_MST_CTRL_CLK_BIT, MPU6050_I2C_MST_CTRL_CLK_LENGTH, MPU6050_I2C_MST_CLK_400);
+    i2c_shadow_write_byte(&shadow, MPU6050_I2C_SLV0_ADDR, (1 << MPU6050_I2C_SLV_RW_BIT) | slave_address);
+    i2c_shadow_write_byte(&shadow, MPU6050_I2C_SLV0_REG, slave_reg);
+    i2c_shadow_write_byte(&shadow, MPU6050_I2C_SLV0_CTRL, (1 << MPU6050_I2C_SLV_CTRL_EN_BIT) | length);
+    i2c_shadow_write_bits(&shadow, MPU6050_I2C_SLV4_CTRL, MPU6050_I2C_SLV4_CTRL_MST_DLY_BIT, MPU6050_I2C_SLV4_CTRL_MST_DLY_LENGTH, delay);
+    i2c_shadow_write_bit(&shadow, MPU6050_I2C_MST_DELAY_CTRL, MPU6050_I2C_MST_DELAY_CTRL_SLV0_DLY_EN_BIT, delay > 0);
+    mpu6050_set_I2C_bypass_enabled(0);
+    mpu6050_set_I2C_master_mode_enabled(1);
+    return i2c_shadow_flush(&shadow);
+}
+
 uint8_t mpu6050_who_am_i()
 {
     uint8_t buffer[14];
@@ -4,9 +4,20 @@
 #include <stdint.h>
 #include <inttypes.h>
 
+#include "icarolib/twi/twi.h"
+
+#define MPU6050_MOTION_6_LENGTH 14 // ACCEL_XOUT_H TO GYRO_ZOUT_L
+#define MPU6050_MOTION_9_LENGTH 20 // ACCEL_XOUT_H TO EXT_SENS_DATA_05
+#define MPU6050_EXT_SENS_OFFSET 14 // EXT_SENS_DATA_00 IN A MOTION 9 READ
+
 uint8_t mpu6050_self_test(void);
 void mpu6050_initialize();
 void mpu6050_get_motion_6(int16_t* ax, int16_t* ay, int16_t* az, int16_t* gx, int16_t* gy, int16_t* gz);
+void mpu6050_get_motion_9(int16_t* ax, int16_t* ay, int16_t* az, int16_t* gx, int16_t* gy, int16_t* gz, uint8_t* ext_data);
+uint8_t mpu6050_start_motion(twi_transaction_t* transaction, uint8_t* buffer, uint8_t length);
+void mpu6050_decode_motion_6(const uint8_t* buffer, int16_t* ax, int16_t* ay, int16_t* az, int16_t* gx, int16_t* gy, int16_t* gz);
+uint16_t mpu6050_get_rate(void);
+uint8_t mpu6050_aux_slave_enable(uint8_t slave_address, uint8_t slave_reg, uint8_t length, uint16_t slave_rate);
 
 uint8_t mpu6050_who_am_i();
 uint8_t mpu6050_test_connection(void);
@@ -10,8 +10,16 @@
 #define MPU6050_SELF_TEST_Z                             0x0F
 #define MPU6050_SELF_TEST_A                             0x10
 #define MPU6050_SMPLRT_DIV                              0x19
+
+// START CONFIG
 #define MPU6050_CONFIG                                  0x1A
 
+#define MPU6050_CONFIG_DLPF_CFG_BIT                     2
+#define MPU6050_CONFIG_DLPF_CFG_LENGTH                  3
+
+#define MPU6050_DLPF_BW_256                             0x00
+// ENDS CONFIG
+
 // START GYRO CONFIG
 #define MPU6050_GYRO_CONFIG                             0x1B
 
@@ -37,7 +45,16 @@
 // ENDS ACCEL CONFIG
 
 #define MPU6050_FIFO_EN                                 0x23
+// START I2C MASTER CTRL
 #define MPU6050_I2C_MST_CTRL                            0x24
+
+#define MPU6050_I2C_MST_CTRL_WAIT_FOR_ES_BIT            6
+#define MPU6050_I2C_MST_CTRL_CLK_BIT                    3
+#define MPU6050_I2C_MST_CTRL_CLK_LENGTH                 4
+
+#define MPU6050_I2C_MST_CLK_400                         0x0D
+// ENDS I2C MASTER CTRL
+
 #define MPU6050_I2C_SLV0_ADDR                           0x25
 #define MPU6050_I2C_SLV0_REG                            0x26
 #define MPU6050_I2C_SLV0_CTRL                           0x27
@@ -54,6 +71,18 @@
 #define MPU6050_I2C_SLV4_REG                            0x32
 #define MPU6050_I2C_SLV4_DO                             0x33
 #define MPU6050_I2C_SLV4_CTRL                           0x34
+
+// START I2C SLAVE CTRL
+#define MPU6050_I2C_SLV_RW_BIT                          7
+
+#define MPU6050_I2C_SLV_CTRL_EN_BIT                     7
+#define MPU6050_I2C_SLV_CTRL_LEN_BIT                    3
+#define MPU6050_I2C_SLV_CTRL_LEN_LENGTH                 4
+
+#define MPU6050_I2C_SLV4_CTRL_MST_DLY_BIT               4
+#define MPU6050_I2C_SLV4_CTRL_MST_DLY_LENGTH            5
+// ENDS I2C SLAVE CTRL
+
 #define MPU6050_I2C_SLV4_DI                             0x35
 #define MPU6050_I2C_MST_STATUS                          0x36
 
@@ -112,6 +141,8 @@
 #define MPU6050_I2C_SLV2_DO                             0x65
 #define MPU6050_I2C_SLV3_DO                             0x66
 #define MPU6050_I2C_MST_DELAY_CTRL                      0x67
+
+#define MPU6050_I2C_MST_DELAY_CTRL_SLV0_DLY_EN_BIT      0
 #define MPU6050_SIGNAL_PATH_RESET                       0x68
 
 // START USER CTRL
@@ -19,6 +19,7 @@
 #define  IMU_ROLL_ADDRESS 1
 #define  IMU_PITCH_ADDRESS 5
 #define  IMU_YAW_ADDRESS 9
+#define  IMU_OVERRUNS_ADDRESS 13 // uint16_t, little endian, scheduler overruns, a write clears them
 
 #define IMU_START 0
 #define IMU_STOP 1
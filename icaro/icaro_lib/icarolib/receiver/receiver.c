@@ -0,0 +1,133 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#include "timer/timer.h"
+#include "receiver.h"
+
+#define RECEIVER_TICKS_PER_US (F_CPU / 8000000UL) // timer1 at F_CPU / 8
+
+// interrupt side, pulses in timer1 ticks, the interrupt writes buffer active
+// while readers copy buffer published
+static uint8_t receiver_mask;
+static uint8_t last_state;
+static uint8_t updated;
+static uint16_t rise[RECEIVER_CHANNELS];
+static uint16_t pulses[2][RECEIVER_CHANNELS];
+static uint8_t frame_mask[2];
+static uint8_t active;
+static volatile uint8_t published;
+static volatile uint8_t sequence;
+
+// reader side, last good pulse and when it came
+static uint8_t read_sequence;
+static uint8_t seen_mask;
+static uint16_t values[RECEIVER_CHANNELS];
+static unsigned long seen[RECEIVER_CHANNELS];
+static uint16_t glitches;
+
+/**
+* Capture the PB pins in mask as receiver channels, bit n is channel n.
+* Timer1 must be running, see init_millis().
+* @param mask PCINT0 to PCINT5 pins to capture
+*/
+void receiver_init(uint8_t mask)
+{
+    mask &= (1 << RECEIVER_CHANNELS) - 1;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        DDRB &= ~mask;
+        receiver_mask = mask;
+        last_state = PINB;
+        updated = 0;
+        PCMSK0 = (PCMSK0 & ~((1 << RECEIVER_CHANNELS) - 1)) | mask;
+        PCIFR = (1 << PCIF0);
+        if (mask) { PCICR |= (1 << PCIE0); }
+        else { PCICR &= ~(1 << PCIE0); }
+    }
+}
+
+/**
+* Latest pulse widths, a channel keeps its last good pulse until it times out.
+* @param channels Container for RECEIVER_CHANNELS pulse widths in us
+* @return Valid channels, bit n is channel n
+*/
+uint8_t receiver_read(uint16_t* channels)
+{
+    unsigned long now = micros();
+    uint8_t buffer, frame, valid = 0;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        buffer = published;
+        frame = sequence;
+    }
+
+    // the interrupt fills the other buffer until the next frame is published
+    if (frame != read_sequence)
+    {
+        read_sequence = frame;
+        for (uint8_t channel = 0; channel < RECEIVER_CHANNELS; channel++)
+        {
+            if (!(frame_mask[buffer] & (1 << channel))) { continue; }
+            uint16_t pulse = pulses[buffer][channel] / RECEIVER_TICKS_PER_US;
+            if (pulse < RECEIVER_MIN_PULSE || pulse > RECEIVER_MAX_PULSE)
+            {
+                glitches++;
+                continue;
+            }
+            values[channel] = pulse;
+            seen[channel] = now;
+            seen_mask |= 1 << channel;
+        }
+    }
+
+    for (uint8_t channel = 0; channel < RECEIVER_CHANNELS; channel++)
+    {
+        if ((seen_mask & (1 << channel)) && now - seen[channel] < RECEIVER_TIMEOUT) { valid |= 1 << channel; }
+        channels[channel] = values[channel];
+    }
+    return valid;
+}
+
+/**
+* @return Pulses rejected for being out of range, like the first falling edge
+*/
+uint16_t receiver_glitches(void) { return glitches; }
+
+static void receiver_publish(void)
+{
+    frame_mask[active] = updated;
+    published = active;
+    active ^= 1;
+    updated = 0;
+    sequence++;
+}
+
+ISR(PCINT0_vect)
+{
+    uint16_t now = TCNT1;
+    uint8_t state = PINB;
+    uint8_t changed = (state ^ last_state) & receiver_mask;
+    uint8_t bit = 1;
+
+    last_state = state;
+    for (uint8_t channel = 0; changed; channel++, bit <<= 1)
+    {
+        if (!(changed & bit)) { continue; }
+        changed &= ~bit;
+
+        if (state & bit)
+        {
+            rise[channel] = now;
+            continue;
+        }
+
+        // a channel pulsing twice means the frame missed one, publish it anyway
+        if (updated & bit) { receiver_publish(); }
+        pulses[active][channel] = now - rise[channel];
+        updated |= bit;
+        if (updated == receiver_mask) { receiver_publish(); }
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef RECEIVER_H_
+#define RECEIVER_H_
+
+#include <inttypes.h>
+
+#define RECEIVER_CHANNELS 6 // PB0 to PB5, PCINT0 to PCINT5
+
+#ifndef RECEIVER_MIN_PULSE
+#define RECEIVER_MIN_PULSE 800 // us, shorter pulses are glitches
+#endif
+
+#ifndef RECEIVER_MAX_PULSE
+#define RECEIVER_MAX_PULSE 2200 // us
+#endif
+
+#ifndef RECEIVER_TIMEOUT
+#define RECEIVER_TIMEOUT 100000UL // us without a good pulse before a channel is invalid
+#endif
+
+/** RC receiver pulse capture on the PCINT0 port.
+* One pin-change interrupt serves every channel. It reads TCNT1, free running
+* at F_CPU / 8 since init_millis(), finds the changed pins by XOR with the
+* previous port state and writes the pulse widths into one half of a double
+* buffer. A frame is published when every channel has pulsed, or when one
+* pulses again first. Range checks and timeouts are done by receiver_read().
+*/
+void receiver_init(uint8_t mask);
+uint8_t receiver_read(uint16_t* channels);
+uint16_t receiver_glitches(void);
+
+#endif
@@ -0,0 +1,173 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#include "scheduler.h"
+
+typedef struct
+{
+    void (*run)(void);
+    uint16_t period;
+    uint16_t countdown; // ticks to the next release
+    uint8_t flags;
+    volatile uint8_t ready;
+    volatile uint16_t overruns;
+} scheduler_task_t;
+
+static scheduler_task_t tasks[SCHEDULER_MAX_TASKS];
+static volatile uint8_t task_count;
+static volatile uint16_t ticks;
+
+// timer2 clock select values CS22:CS20 and their prescalers
+static const uint16_t prescalers[] = {1, 8, 32, 64, 128, 256, 1024};
+
+/**
+* Start the Timer2 compare tick, CTC mode with the smallest prescaler that
+* reaches the rate. 1kHz at 16MHz is exact, a prescaler of 64 and 250 counts.
+* @param tick_hz Tick rate in Hz
+* @return Tick rate actually set, rounded by the compare value
+*/
+uint16_t scheduler_init(uint16_t tick_hz)
+{
+    uint32_t counts = 0;
+    uint8_t select;
+
+    for (select = 0; select < sizeof(prescalers) / sizeof(prescalers[0]); select++)
+    {
+        counts = (F_CPU / prescalers[select] + tick_hz / 2) / tick_hz;
+        if (counts <= 256) { break; }
+    }
+    if (select == sizeof(prescalers) / sizeof(prescalers[0])) { select--, counts = 256; }
+    if (counts == 0) { counts = 1; }
+
+    TCCR2A = (1 << WGM21);
+    TCCR2B = select + 1;
+    OCR2A = counts - 1;
+    TCNT2 = 0;
+    TIMSK2 |= (1 << OCIE2A);
+
+    return F_CPU / prescalers[select] / counts;
+}
+
+/**
+* @param run Task function
+* @param period Ticks between releases
+* @param slot Tick within the period the task is released in, spreads tasks
+* with the same period over different ticks
+* @param flags SCHEDULER_ISR to run it from the timer interrupt
+* @return Task number, SCHEDULER_ALL when the table is full
+*/
+uint8_t scheduler_add(void (*run)(void), uint16_t period, uint16_t slot, uint8_t flags)
+{
+    uint8_t task = SCHEDULER_ALL;
+
+    if (period == 0) { return SCHEDULER_ALL; }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (task_count < SCHEDULER_MAX_TASKS)
+        {
+            task = task_count;
+            tasks[task].run = run;
+            tasks[task].period = period;
+            tasks[task].countdown = (slot % period) ? slot % period : period;
+            tasks[task].flags = flags;
+            tasks[task].ready = 0;
+            tasks[task].overruns = 0;
+            task_count++;
+        }
+    }
+    return task;
+}
+
+/**
+* Run the released tasks, the first added one that is ready goes first and
+* the scan starts over after each, so a long task delays but never starves
+* an earlier one.
+* @return Number of tasks run
+*/
+uint8_t scheduler_run(void)
+{
+    uint8_t count = 0;
+    uint8_t i = 0;
+
+    while (i < task_count)
+    {
+        if (tasks[i].ready)
+        {
+            tasks[i].ready = 0;
+            tasks[i].run();
+            count++;
+            i = 0;
+        }
+        else { i++; }
+    }
+    return count;
+}
+
+uint16_t scheduler_ticks(void)
+{
+    uint16_t value;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { value = ticks; }
+    return value;
+}
+
+/**
+* Count an overrun the task found itself, like an interrupt task whose
+* previous work is not consumed yet.
+*/
+void scheduler_count_overrun(uint8_t task)
+{
+    if (task >= task_count) { return; }
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { tasks[task].overruns++; }
+}
+
+/**
+* @param task Task number, or SCHEDULER_ALL for the sum over all tasks
+* @return Overruns since the task was added or its count was cleared
+*/
+uint16_t scheduler_overruns(uint8_t task)
+{
+    uint16_t value = 0;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        for (uint8_t i = 0; i < task_count; i++)
+        {
+            if (task == SCHEDULER_ALL || task == i) { value += tasks[i].overruns; }
+        }
+    }
+    return value;
+}
+
+/**
+* @param task Task number, or SCHEDULER_ALL for every task
+*/
+void scheduler_clear_overruns(uint8_t task)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        for (uint8_t i = 0; i < task_count; i++)
+        {
+            if (task == SCHEDULER_ALL || task == i) { tasks[i].overruns = 0; }
+        }
+    }
+}
+
+ISR(TIMER2_COMPA_vect)
+{
+    ticks++;
+
+    for (uint8_t i = 0; i < task_count; i++)
+    {
+        scheduler_task_t* task = &tasks[i];
+
+        if (--task->countdown) { continue; }
+        task->countdown = task->period;
+
+        if (task->flags & SCHEDULER_ISR) { task->run(); }
+        else if (task->ready) { task->overruns++; }
+        else { task->ready = 1; }
+    }
+}
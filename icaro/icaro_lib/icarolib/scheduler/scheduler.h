@@ -0,0 +1,27 @@
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+#include <inttypes.h>
+
+#ifndef SCHEDULER_MAX_TASKS
+#define SCHEDULER_MAX_TASKS 4
+#endif
+
+#define SCHEDULER_ISR 0x01 // run from the timer interrupt, keep it short
+#define SCHEDULER_ALL 0xFF
+
+/** Cooperative fixed-rate scheduler on a Timer2 compare tick.
+* Every task is released once per period ticks, in the slot tick % period.
+* The timer interrupt runs SCHEDULER_ISR tasks right away and marks the others
+* ready, scheduler_run() then runs the ready ones from the main loop, first
+* added first. A task released again before it ran counts an overrun.
+*/
+uint16_t scheduler_init(uint16_t tick_hz);
+uint8_t scheduler_add(void (*run)(void), uint16_t period, uint16_t slot, uint8_t flags);
+uint8_t scheduler_run(void);
+uint16_t scheduler_ticks(void);
+void scheduler_count_overrun(uint8_t task);
+uint16_t scheduler_overruns(uint8_t task);
+void scheduler_clear_overruns(uint8_t task);
+
+#endif
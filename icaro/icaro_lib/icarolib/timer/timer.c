@@ -13,41 +13,111 @@ REMEMBER: Add sei(); after init_millis() to enable global interrupts!
 
 #include "timer.h"
 
+// timer1_us_shift turns ticks into microseconds, only exact at these clocks
+#if F_CPU != 8000000UL && F_CPU != 16000000UL
+#error "timer.c needs F_CPU of 8 or 16MHz"
+#endif
 
+// timer1 runs free at f_cpu / 8 and only interrupts on overflow, every 65536
+// ticks (32.768ms at 16MHz), instead of a compare match every millisecond.
+// The overflow carries the milliseconds plus the microseconds past them.
+volatile unsigned long timer1_overflows;
 volatile unsigned long timer1_millis;
+volatile unsigned int timer1_fract;
+unsigned int timer1_millis_inc;
+unsigned int timer1_fract_inc;
+unsigned char timer1_us_shift; // ticks to microseconds, f_cpu of 8 or 16MHz
 //NOTE: A unsigned long holds values from 0 to 4,294,967,295 (2^32 - 1). It will roll over to 0 after reaching its maximum value.
 
-ISR(TIMER1_COMPA_vect)
+ISR(TIMER1_OVF_vect)
 {
-	timer1_millis++;
+	unsigned long ms = timer1_millis + timer1_millis_inc;
+	unsigned int fract = timer1_fract + timer1_fract_inc;
+	
+	if (fract >= 1000) {
+		fract -= 1000;
+		ms++;
+	}
+	timer1_millis = ms;
+	timer1_fract = fract;
+	timer1_overflows++;
 }
 
 void init_millis(unsigned long f_cpu)
 {
-	unsigned long ctc_match_overflow;
-	
-	ctc_match_overflow = ((f_cpu / 1000) / 8); //when timer1 is this value, 1ms has passed
+	unsigned long us_per_overflow;
 	
-	// (Set timer to clear when matching ctc_match_overflow) | (Set clock divisor to 8)
-	TCCR1B |= (1 << WGM12) | (1 << CS11);
+	timer1_us_shift = f_cpu >= 16000000 ? 1 : 0;
+	us_per_overflow = 65536UL >> timer1_us_shift;
+	timer1_millis_inc = us_per_overflow / 1000;
+	timer1_fract_inc = us_per_overflow % 1000;
 	
-	// high byte first, then low byte
-	OCR1AH = (ctc_match_overflow >> 8);
-	OCR1AL = ctc_match_overflow;
+	// normal mode, counting to 0xFFFF and wrapping | clock divisor 8
+	TCCR1A = 0;
+	TCCR1B = (1 << CS11);
+	TCNT1 = 0;
+	TIFR1 = (1 << TOV1);
 	
-	// Enable the compare match interrupt
-	TIMSK1 |= (1 << OCIE1A);
+	// Enable the overflow interrupt, the compare match one is not used
+	TIMSK1 = (TIMSK1 & ~(1 << OCIE1A)) | (1 << TOIE1);
 	
 	//REMEMBER TO ENABLE GLOBAL INTERRUPTS AFTER THIS WITH sei(); !!!
 }
 
-unsigned long millis ()
+// The overflow state and the count read together. An overflow while
+// interrupts are off is still pending in TOV1, it belongs to this reading
+// when the count has already wrapped.
+static unsigned int timer1_read(unsigned long *ms, unsigned int *fract, unsigned long *overflows)
 {
-	unsigned long millis_return;
+	unsigned int ticks;
 	
-	// Ensure this cannot be disrupted
-	ATOMIC_BLOCK(ATOMIC_FORCEON) {
-		millis_return = timer1_millis;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+		*ms = timer1_millis;
+		*fract = timer1_fract;
+		*overflows = timer1_overflows;
+		ticks = TCNT1;
+		if ((TIFR1 & (1 << TOV1)) && ticks < 0x8000) {
+			*ms += timer1_millis_inc;
+			*fract += timer1_fract_inc;
+			if (*fract >= 1000) {
+				*fract -= 1000;
+				(*ms)++;
+			}
+			(*overflows)++;
+		}
 	}
-	return millis_return;
-}
\ No newline at end of file
+	return ticks;
+}
+
+unsigned long millis ()
+{
+	unsigned long ms, overflows;
+	unsigned int fract;
+	unsigned int ticks = timer1_read(&ms, &fract, &overflows);
+	
+	// ticks of a whole overflow are 65535us at 8MHz, unsigned int would wrap
+	return ms + ((unsigned long)fract + (ticks >> timer1_us_shift)) / 1000;
+}
+
+// Microseconds since init_millis(), resolution 1us, wraps after about 71
+// minutes, differences of unsigned longs stay correct.
+unsigned long micros()
+{
+	unsigned long ms, overflows;
+	unsigned int fract;
+	unsigned int ticks = timer1_read(&ms, &fract, &overflows);
+	
+	return ms * 1000 + fract + (ticks >> timer1_us_shift);
+}
+
+// Raw timer1 ticks since init_millis(), f_cpu / 8 per second (0.5us at 16MHz),
+// for cycle level profiling: cycles = ticks * 8. Wraps after about 35 minutes
+// at 16MHz.
+unsigned long timer_ticks()
+{
+	unsigned long ms, overflows;
+	unsigned int fract;
+	unsigned int ticks = timer1_read(&ms, &fract, &overflows);
+	
+	return (overflows << 16) | ticks;
+}
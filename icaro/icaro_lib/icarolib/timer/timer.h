@@ -11,6 +11,10 @@
 
 void init_millis(unsigned long f_cpu);
 unsigned long millis();
+unsigned long micros();
+unsigned long timer_ticks();
+
+#define TIMER_TICK_PRESCALER 8 // cpu cycles per timer_ticks()
 
 
 #endif /* TIMER_H_ */
\ No newline at end of file
@@ -35,6 +35,8 @@ void wire_init()
 
 void wire_set_address(uint8_t address) { twi_set_address(address); }
 
+uint32_t wire_set_clock(uint32_t frequency) { return twi_set_frequency(frequency); }
+
 int8_t wire_get_status(void)
 {
     return twi_get_state();
@@ -242,8 +244,7 @@ int8_t i2c_read_bytes(uint8_t dev_address, uint8_t reg_address, uint8_t length,
     {
         wire_begin_transmission(dev_address);
         wire_write(reg_address);
-        wire_end_transmission(1);
-        wire_begin_transmission(dev_address);
+        if (wire_end_transmission(0)) { break; } // repeated start into the read
         wire_request_from(dev_address, (uint8_t)min(length - k, BUFFER_LENGTH), 0, 0, 1);
         for (; wire_available() && (timeout == 0 || millis() - t1 < timeout); count++) { data[count] = wire_read(); }
     }
@@ -251,6 +252,28 @@ int8_t i2c_read_bytes(uint8_t dev_address, uint8_t reg_address, uint8_t length,
     return count;
 }
 
+/** Queue a read of multiple bytes from an 8-bit device register, the register
+* address is written and the data read after a repeated start, all from the
+* TWI interrupt.
+* @param transaction Transaction to fill in and submit, see twi_submit()
+* @param dev_address I2C slave device address
+* @param reg_address First register address, must stay valid until completion
+* @param length Number of bytes to read
+* @param data Buffer to store read data in, valid once twi_poll() is TWI_DONE
+* @param callback Optional completion callback, runs in the TWI interrupt
+* @return Status of submit operation (0 = queued)
+*/
+uint8_t i2c_submit_read(twi_transaction_t *transaction, uint8_t dev_address, const uint8_t *reg_address, uint8_t length, uint8_t *data, void (*callback)(twi_transaction_t*))
+{
+    transaction->address = dev_address;
+    transaction->write_data = reg_address;
+    transaction->write_length = 1;
+    transaction->read_data = data;
+    transaction->read_length = length;
+    transaction->callback = callback;
+    return twi_submit(transaction);
+}
+
 /** Read multiple words from a 16-bit device register.
 * @param dev_address I2C slave device address
 * @param reg_address First register reg_address to read from
@@ -267,8 +290,7 @@ int8_t i2c_read_words(uint8_t dev_address, uint8_t reg_address, uint8_t length,
     {
         wire_begin_transmission(dev_address);
         wire_write(reg_address);
-        wire_end_transmission(1);
-        wire_begin_transmission(dev_address);
+        if (wire_end_transmission(0)) { break; } // repeated start into the read
         wire_request_from(dev_address, (uint8_t)(length * 2), 0, 0, 1);    
         uint8_t msb = 1;
         for (; wire_available() && count < length && (timeout == 0 || millis() - t1 < timeout);)
@@ -2,12 +2,14 @@
 #define I2CDEVLIB_H_
 
 #include <stdlib.h>
+#include "twi.h"
 
 #define BUFFER_LENGTH 32
 #define I2CDEV_DEFAULT_READ_TIMEOUT 1000
 
 void wire_init();
 void wire_set_address(uint8_t address);
+uint32_t wire_set_clock(uint32_t frequency);
 int8_t wire_get_status(void);
 uint8_t wire_request_from(uint8_t address, uint8_t quantity, uint32_t iaddress, uint8_t isize, uint8_t sendStop);
 void wire_begin_transmission(uint8_t address);
@@ -30,6 +32,7 @@ int8_t i2c_read_byte(uint8_t dev_address, uint8_t reg_address, uint8_t *data, ui
 int8_t i2c_read_word(uint8_t dev_address, uint8_t reg_address, uint16_t *data, uint16_t timeout);
 int8_t i2c_read_bytes(uint8_t dev_address, uint8_t reg_address, uint8_t length, uint8_t *data, uint16_t timeout);
 int8_t i2c_read_words(uint8_t dev_address, uint8_t reg_address, uint8_t length, uint16_t *data, uint16_t timeout);
+uint8_t i2c_submit_read(twi_transaction_t *transaction, uint8_t dev_address, const uint8_t *reg_address, uint8_t length, uint8_t *data, void (*callback)(twi_transaction_t*));
 uint8_t i2c_write_bit(uint8_t dev_address, uint8_t reg_address, uint8_t bit_num, uint8_t data);
 uint8_t i2c_write_bit_word(uint8_t dev_address, uint8_t reg_address, uint8_t bit_num, uint16_t data);
 uint8_t i2c_write_bits(uint8_t dev_address, uint8_t reg_address, uint8_t bit_start, uint8_t length, uint8_t data);
@@ -0,0 +1,180 @@
+#include <string.h>
+#include <inttypes.h>
+#include "i2cdevlib.h"
+#include "i2cshadow.h"
+
+#define bit_get(map, i) ((map)[(i) >> 3] & (1 << ((i) & 7)))
+#define bit_set(map, i) ((map)[(i) >> 3] |= (1 << ((i) & 7)))
+#define bit_clr(map, i) ((map)[(i) >> 3] &= ~(1 << ((i) & 7)))
+
+static int16_t shadow_index(i2c_shadow_t *shadow, uint8_t reg_address)
+{
+    if (reg_address < shadow->first || reg_address >= shadow->first + shadow->length) { return -1; }
+    return reg_address - shadow->first;
+}
+
+/** Set up an empty shadow, every register starts unknown.
+* @param shadow Shadow register file
+* @param dev_address I2C slave device address
+* @param first First register covered
+* @param length Number of registers covered (not more than I2C_SHADOW_LENGTH)
+* @return Status of operation (true = success)
+*/
+uint8_t i2c_shadow_init(i2c_shadow_t *shadow, uint8_t dev_address, uint8_t first, uint8_t length)
+{
+    memset(shadow, 0, sizeof(*shadow));
+    if (length > I2C_SHADOW_LENGTH) { return 0; }
+    shadow->dev_address = dev_address;
+    shadow->first = first;
+    shadow->length = length;
+    return 1;
+}
+
+/** Declare the value of a register without reading it, e.g. its reset value.
+* @param shadow Shadow register file
+* @param reg_address Register address
+* @param value Value the device holds
+*/
+void i2c_shadow_declare(i2c_shadow_t *shadow, uint8_t reg_address, uint8_t value)
+{
+    int16_t i = shadow_index(shadow, reg_address);
+    if (i < 0) { return; }
+    shadow->values[i] = value;
+    bit_set(shadow->valid, i);
+    bit_clr(shadow->dirty, i);
+}
+
+/** Populate a range of the shadow from the device, reads are split in
+* BUFFER_LENGTH chunks. Registers with a pending write keep their local value.
+* @param shadow Shadow register file
+* @param reg_address First register to read
+* @param length Number of registers to read
+* @return Status of operation (true = success)
+*/
+uint8_t i2c_shadow_refresh(i2c_shadow_t *shadow, uint8_t reg_address, uint8_t length)
+{
+    uint8_t buffer[BUFFER_LENGTH];
+    uint8_t chunk, k;
+    int16_t i;
+
+    if (length == 0 || shadow_index(shadow, reg_address) < 0 || shadow_index(shadow, reg_address + length - 1) < 0) { return 0; }
+    while (length > 0)
+    {
+        chunk = length < BUFFER_LENGTH ? length : BUFFER_LENGTH;
+        if (i2c_read_bytes(shadow->dev_address, reg_address, chunk, buffer, I2CDEV_DEFAULT_READ_TIMEOUT) != chunk) { return 0; }
+        for (k = 0; k < chunk; k++)
+        {
+            i = reg_address + k - shadow->first;
+            if (bit_get(shadow->dirty, i)) { continue; }
+            shadow->values[i] = buffer[k];
+            bit_set(shadow->valid, i);
+        }
+        reg_address += chunk;
+        length -= chunk;
+    }
+    return 1;
+}
+
+/** Forget a range of registers the device changes on its own (self clearing
+* bits, status). Pending writes in the range are dropped.
+* @param shadow Shadow register file
+* @param reg_address First register to forget
+* @param length Number of registers
+*/
+void i2c_shadow_invalidate(i2c_shadow_t *shadow, uint8_t reg_address, uint8_t length)
+{
+    int16_t i;
+    for (uint8_t k = 0; k < length; k++)
+    {
+        if ((i = shadow_index(shadow, reg_address + k)) < 0) { continue; }
+        bit_clr(shadow->valid, i);
+        bit_clr(shadow->dirty, i);
+    }
+}
+
+/** Read a register through the shadow, the bus is only used when unknown.
+* @param shadow Shadow register file
+* @param reg_address Register address
+* @param data Container for byte value
+* @return Status of operation (true = success)
+*/
+uint8_t i2c_shadow_read_byte(i2c_shadow_t *shadow, uint8_t reg_address, uint8_t *data)
+{
+    int16_t i = shadow_index(shadow, reg_address);
+    if (i < 0) { return i2c_read_byte(shadow->dev_address, reg_address, data, I2CDEV_DEFAULT_READ_TIMEOUT) == 1; }
+    if (!bit_get(shadow->valid, i) && !i2c_shadow_refresh(shadow, reg_address, 1)) { return 0; }
+    *data = shadow->values[i];
+    return 1;
+}
+
+/** Write a single bit in a shadowed register.
+* @param shadow Shadow register file
+* @param reg_address Register address
+* @param bit_num Bit position to write (0-7)
+* @param data New bit value to write
+* @return Status of operation (true = success)
+*/
+uint8_t i2c_shadow_write_bit(i2c_shadow_t *shadow, uint8_t reg_address, uint8_t bit_num, uint8_t data)
+{
+    return i2c_shadow_write_bits(shadow, reg_address, bit_num, 1, data != 0);
+}
+
+/** Write multiple bits in a shadowed register.
+* @param shadow Shadow register file
+* @param reg_address Register address
+* @param bit_start First bit position to write (0-7)
+* @param length Number of bits to write (not more than 8)
+* @param data Right-aligned value to write
+* @return Status of operation (true = success)
+*/
+uint8_t i2c_shadow_write_bits(i2c_shadow_t *shadow, uint8_t reg_address, uint8_t bit_start, uint8_t length, uint8_t data)
+{
+    uint8_t b;
+    uint8_t mask = ((1 << length) - 1) << (bit_start - length + 1);
+    if (shadow_index(shadow, reg_address) < 0) { return i2c_write_bits(shadow->dev_address, reg_address, bit_start, length, data); }
+    if (!i2c_shadow_read_byte(shadow, reg_address, &b)) { return 0; }
+    data <<= (bit_start - length + 1);
+    b = (b & ~mask) | (data & mask);
+    return i2c_shadow_write_byte(shadow, reg_address, b);
+}
+
+/** Write a shadowed register, skipped when the device already holds the value.
+* @param shadow Shadow register file
+* @param reg_address Register address
+* @param data New byte value to write
+* @return Status of operation (true = success)
+*/
+uint8_t i2c_shadow_write_byte(i2c_shadow_t *shadow, uint8_t reg_address, uint8_t data)
+{
+    int16_t i = shadow_index(shadow, reg_address);
+    if (i < 0) { return i2c_write_byte(shadow->dev_address, reg_address, data); }
+    if (bit_get(shadow->valid, i) && shadow->values[i] == data) { return 1; }
+    shadow->values[i] = data;
+    bit_set(shadow->valid, i);
+    bit_set(shadow->dirty, i);
+    return shadow->hold ? 1 : i2c_shadow_flush(shadow);
+}
+
+/** Defer writes until the next i2c_shadow_flush().
+* @param shadow Shadow register file
+*/
+void i2c_shadow_hold(i2c_shadow_t *shadow) { shadow->hold = 1; }
+
+/** Write every dirty register, each run of contiguous dirty registers is one
+* burst write of up to BUFFER_LENGTH - 1 bytes. Ends a hold.
+* @param shadow Shadow register file
+* @return Status of operation (true = success), failed registers stay dirty
+*/
+uint8_t i2c_shadow_flush(i2c_shadow_t *shadow)
+{
+    uint8_t i = 0, start, k, status = 1;
+    shadow->hold = 0;
+    while (i < shadow->length)
+    {
+        if (!bit_get(shadow->dirty, i)) { i++; continue; }
+        for (start = i; i < shadow->length && i - start < BUFFER_LENGTH - 1 && bit_get(shadow->dirty, i); i++) { continue; }
+        if (!i2c_write_bytes(shadow->dev_address, shadow->first + start, i - start, shadow->values + start)) { status = 0; continue; }
+        for (k = start; k < i; k++) { bit_clr(shadow->dirty, k); }
+    }
+    return status;
+}
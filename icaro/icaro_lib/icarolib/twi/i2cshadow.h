@@ -0,0 +1,38 @@
+#ifndef I2CSHADOW_H_
+#define I2CSHADOW_H_
+
+#include <inttypes.h>
+
+#ifndef I2C_SHADOW_LENGTH
+#define I2C_SHADOW_LENGTH 88
+#endif
+
+/** Shadow register file of one I2C device.
+* Local copy of a window of registers so bit field writes skip the register
+* read. Writes are sent right away, or between i2c_shadow_hold() and
+* i2c_shadow_flush() where contiguous dirty registers become one burst write.
+* Registers outside the window go straight to the bus.
+*/
+typedef struct
+{
+    uint8_t dev_address;
+    uint8_t first;
+    uint8_t length;
+    uint8_t hold;
+    uint8_t values[I2C_SHADOW_LENGTH];
+    uint8_t valid[I2C_SHADOW_LENGTH / 8];
+    uint8_t dirty[I2C_SHADOW_LENGTH / 8];
+} i2c_shadow_t;
+
+uint8_t i2c_shadow_init(i2c_shadow_t *shadow, uint8_t dev_address, uint8_t first, uint8_t length);
+void i2c_shadow_declare(i2c_shadow_t *shadow, uint8_t reg_address, uint8_t value);
+uint8_t i2c_shadow_refresh(i2c_shadow_t *shadow, uint8_t reg_address, uint8_t length);
+void i2c_shadow_invalidate(i2c_shadow_t *shadow, uint8_t reg_address, uint8_t length);
+uint8_t i2c_shadow_read_byte(i2c_shadow_t *shadow, uint8_t reg_address, uint8_t *data);
+uint8_t i2c_shadow_write_bit(i2c_shadow_t *shadow, uint8_t reg_address, uint8_t bit_num, uint8_t data);
+uint8_t i2c_shadow_write_bits(i2c_shadow_t *shadow, uint8_t reg_address, uint8_t bit_start, uint8_t length, uint8_t data);
+uint8_t i2c_shadow_write_byte(i2c_shadow_t *shadow, uint8_t reg_address, uint8_t data);
+void i2c_shadow_hold(i2c_shadow_t *shadow);
+uint8_t i2c_shadow_flush(i2c_shadow_t *shadow);
+
+#endif /* I2CSHADOW_H_ */
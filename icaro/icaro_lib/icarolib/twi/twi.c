@@ -1,6 +1,7 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include <util/twi.h>
+#include <util/atomic.h>
 #include "twi.h"
 
 #ifndef cbi
@@ -21,6 +22,7 @@ static void (*twi_on_slave_transmit)(void);
 static void (*twi_on_slave_receive)(uint8_t*, int);
 
 static uint8_t twi_master_buffer[TWI_BUFFER_LENGTH];
+static uint8_t* twi_master_data; // twi_master_buffer or the transaction's buffers
 static volatile uint8_t twi_master_buffer_index;
 static volatile uint8_t twi_master_buffer_length;
 
@@ -31,9 +33,15 @@ static volatile uint8_t twi_tx_buffer_length;
 static uint8_t twi_rx_buffer[TWI_BUFFER_LENGTH];
 static volatile uint8_t twi_rx_buffer_index;
 
+// asynchronous master queue, the head is the transaction on the bus
+static twi_transaction_t* volatile twi_queue_head;
+static twi_transaction_t* twi_queue_tail;
+static volatile uint8_t twi_async;
+static volatile uint8_t twi_blocking; // a blocking transfer owns the bus until twi_release()
+
 void twi_stop(void);
 void twi_reply(uint8_t ack);
-void twi_reply(uint8_t ack);
+static void twi_start_next(void);
 
 void twi_init(void)
 {
@@ -41,10 +49,7 @@ void twi_init(void)
     twi_send_stop = 1;
     twi_in_rep_start = 0;
     
-    cbi(TWSR, TWPS0);
-    cbi(TWSR, TWPS1);
-    
-    TWBR = ((F_CPU / TWI_FREQ) - 16) / 2;
+    twi_set_frequency(TWI_FREQ);
     TWCR = _BV(TWEN) | _BV(TWIE) | _BV(TWEA);
 }
 
@@ -54,19 +59,95 @@ void twi_disable(void) { TWCR &= ~(_BV(TWEN) | _BV(TWIE) | _BV(TWEA)); }
 
 void twi_set_address(uint8_t address) { TWAR = address << 1; }
 
+/**
+* Set the master SCL frequency registers directly,
+* SCL = F_CPU / (16 + 2 * bit_rate * 4^prescaler).
+* Waits for the master transfers in progress so none changes speed midway.
+* @param bit_rate TWBR value
+* @param prescaler TWPS value, 0 to 3 for a prescaler of 1, 4, 16 or 64
+*/
+void twi_set_bit_rate(uint8_t bit_rate, uint8_t prescaler)
+{
+    while (TWI_MTX == twi_state || TWI_MRX == twi_state || twi_queue_head) { continue; }
+    
+    TWSR = (TWSR & ~(_BV(TWPS0) | _BV(TWPS1))) | (prescaler & 0x03);
+    TWBR = bit_rate;
+}
+
+/**
+* Set the master SCL frequency, 100kHz standard or 400kHz fast mode, with the
+* smallest prescaler that reaches it.
+* @param frequency SCL frequency in Hz
+* @return Frequency actually set, rounded down by the TWBR steps
+*/
+uint32_t twi_set_frequency(uint32_t frequency)
+{
+    uint32_t bit_rate = 0;
+    uint8_t prescaler;
+    
+    if (frequency == 0 || F_CPU / frequency <= 16) { prescaler = 0; }
+    else
+    {
+        for (prescaler = 0; prescaler < 4; prescaler++)
+        {
+            // round up so the bus never runs faster than asked
+            bit_rate = (F_CPU / frequency - 16 + (2UL << (2 * prescaler)) - 1) / (2UL << (2 * prescaler));
+            if (bit_rate <= 0xFF) { break; }
+        }
+        if (prescaler == 4) { prescaler = 3, bit_rate = 0xFF; }
+    }
+    
+    twi_set_bit_rate(bit_rate, prescaler);
+    return F_CPU / (16 + (bit_rate << (1 + 2 * prescaler)));
+}
+
 void twi_attach_slave_rx_event(void (*function)(uint8_t*, int)) { twi_on_slave_receive = function; }
 
 void twi_attach_slave_tx_event(void (*function)(void)) { twi_on_slave_transmit = function; }
 
+/**
+* Claim the bus for a blocking transfer once it is free and the queue drained,
+* or at once when a repeated start holds it. Checking and claiming is atomic so
+* a transaction submitted from an interrupt cannot start in between, and the
+* queue stays off the bus until the caller took its result in twi_release().
+* @param state TWI_MRX or TWI_MTX
+*/
+static void twi_claim(uint8_t state)
+{
+    uint8_t claimed = 0;
+    
+    while (!claimed)
+    {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            if (TWI_READY == twi_state && (!twi_queue_head || twi_in_rep_start))
+            {
+                twi_state = state;
+                twi_blocking = 1;
+                claimed = 1;
+            }
+        }
+    }
+}
+
+static void twi_release(void)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        twi_blocking = 0;
+        twi_start_next();
+    }
+}
+
 uint8_t twi_read(uint8_t address, uint8_t* data, uint8_t length, uint8_t send_stop)
 {
     uint8_t i;
     if (TWI_BUFFER_LENGTH < length) { return 0; }
-    while (TWI_READY != twi_state) { continue; }
+    twi_claim(TWI_MRX);
     
-    twi_state = TWI_MRX;
     twi_send_stop = send_stop;
     twi_error = 0xFF;
+    twi_master_data = twi_master_buffer;
     twi_master_buffer_index = 0;
     twi_master_buffer_length = length-1;
     
@@ -86,21 +167,22 @@ uint8_t twi_read(uint8_t address, uint8_t* data, uint8_t length, uint8_t send_st
     if (twi_master_buffer_index < length) { length = twi_master_buffer_index; }
 
     for (i = 0; i < length; ++i) { data[i] = twi_master_buffer[i]; }
+    twi_release();
     
     return length;
 }
 
 uint8_t twi_write(uint8_t address, uint8_t* data, uint8_t length, uint8_t wait, uint8_t send_stop)
 {
-    uint8_t i;
+    uint8_t i, error;
     
     if (TWI_BUFFER_LENGTH < length) { return 1; }
-    while (TWI_READY != twi_state) { continue; }
+    twi_claim(TWI_MTX);
     
-    twi_state = TWI_MTX;
     twi_send_stop = send_stop;
     twi_error = 0xFF;
 
+    twi_master_data = twi_master_buffer;
     twi_master_buffer_index = 0;
     twi_master_buffer_length = length;
     
@@ -117,10 +199,12 @@ uint8_t twi_write(uint8_t address, uint8_t* data, uint8_t length, uint8_t wait,
     else { TWCR = _BV(TWINT) | _BV(TWEA) | _BV(TWEN) | _BV(TWIE) | _BV(TWSTA); }
     
     while (wait && (TWI_MTX == twi_state)) { continue; }
+    error = twi_error;
+    twi_release();
 
-    if (twi_error == 0xFF) { return 0; }
-    else if (twi_error == TW_MT_SLA_NACK) { return 2; }
-    else if (twi_error == TW_MT_DATA_NACK) { return 3; }
+    if (error == 0xFF) { return 0; }
+    else if (error == TW_MT_SLA_NACK) { return 2; }
+    else if (error == TW_MT_DATA_NACK) { return 3; }
     else { return 4; }
 }
 
@@ -134,6 +218,96 @@ uint8_t twi_transmit(const uint8_t* data, uint8_t length)
     return 0;
 }
 
+/**
+* Queue a master transaction, it runs from the interrupt once the transactions
+* ahead of it and any blocking transfer are done.
+* @param transaction Filled in by the caller, status zeroed before first use
+* @return 0 queued, 1 nothing to transfer, 2 already pending
+*/
+uint8_t twi_submit(twi_transaction_t* transaction)
+{
+    if (!transaction->write_length && !transaction->read_length) { return 1; }
+    if (TWI_PENDING(transaction->status)) { return 2; }
+    
+    transaction->status = TWI_QUEUED;
+    transaction->count = 0;
+    transaction->next = 0;
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (twi_queue_head) { twi_queue_tail->next = transaction; }
+        else { twi_queue_head = transaction; }
+        twi_queue_tail = transaction;
+        twi_start_next();
+    }
+    return 0;
+}
+
+/**
+* @return Transaction status, TWI_PENDING() while queued or on the bus
+*/
+uint8_t twi_poll(const twi_transaction_t* transaction) { return transaction->status; }
+
+/**
+* Block until the transaction completes.
+* @return Final transaction status
+*/
+uint8_t twi_wait(const twi_transaction_t* transaction)
+{
+    while (TWI_PENDING(transaction->status)) { continue; }
+    return transaction->status;
+}
+
+static void twi_begin_read(twi_transaction_t* transaction)
+{
+    twi_state = TWI_MRX;
+    twi_master_data = transaction->read_data;
+    twi_master_buffer_index = 0;
+    twi_master_buffer_length = transaction->read_length - 1;
+    twi_slarw = TW_READ | (transaction->address << 1);
+}
+
+/**
+* Put the head of the queue on the bus when it is free. A transaction that
+* lost arbitration or was interrupted by slave activity starts over.
+*/
+static void twi_start_next(void)
+{
+    twi_transaction_t* transaction = twi_queue_head;
+    
+    if (!transaction || twi_blocking || TWI_READY != twi_state || twi_in_rep_start) { return; }
+    
+    twi_async = 1;
+    twi_send_stop = 1;
+    twi_error = 0xFF;
+    transaction->status = TWI_ACTIVE;
+    transaction->count = 0;
+    
+    if (transaction->write_length)
+    {
+        twi_state = TWI_MTX;
+        twi_master_data = (uint8_t*)transaction->write_data;
+        twi_master_buffer_index = 0;
+        twi_master_buffer_length = transaction->write_length;
+        twi_slarw = TW_WRITE | (transaction->address << 1);
+    }
+    else { twi_begin_read(transaction); }
+    
+    TWCR = _BV(TWEN) | _BV(TWIE) | _BV(TWEA) | _BV(TWINT) | _BV(TWSTA);
+}
+
+static void twi_complete(uint8_t status)
+{
+    twi_transaction_t* transaction = twi_queue_head;
+    
+    twi_async = 0;
+    twi_queue_head = transaction->next;
+    if (!twi_queue_head) { twi_queue_tail = 0; }
+    
+    transaction->status = status;
+    if (transaction->callback) { transaction->callback(transaction); }
+}
+
 void twi_stop(void)
 {
     TWCR = _BV(TWEN) | _BV(TWIE) | _BV(TWEA) | _BV(TWINT) | _BV(TWSTO);
@@ -153,6 +327,12 @@ void twi_release_bus(void)
     twi_state = TWI_READY;
 }
 
+static void twi_master_finish(uint8_t status)
+{
+    twi_stop();
+    if (twi_async) { twi_complete(status); }
+}
+
 ISR(TWI_vect)
 {
     switch(TW_STATUS)
@@ -172,12 +352,18 @@ ISR(TWI_vect)
         {
             if (twi_master_buffer_index < twi_master_buffer_length)
             {
-                TWDR = twi_master_buffer[twi_master_buffer_index++];
+                TWDR = twi_master_data[twi_master_buffer_index++];
                 twi_reply(1);
             }
+            else if (twi_async && twi_queue_head->read_length)
+            {
+                // register address written, repeated start into the read
+                twi_begin_read(twi_queue_head);
+                TWCR = _BV(TWINT) | _BV(TWSTA) | _BV(TWEN) | _BV(TWIE);
+            }
             else
             {
-                if (twi_send_stop) { twi_stop(); }
+                if (twi_send_stop) { twi_master_finish(TWI_DONE); }
                 else
                 {
                     twi_in_rep_start = 1;
@@ -190,13 +376,13 @@ ISR(TWI_vect)
         case TW_MT_SLA_NACK:  // SLA+W transmitted, NACK received
         {
             twi_error = TW_MT_SLA_NACK;
-            twi_stop();
+            twi_master_finish(TWI_ADDRESS_NACK);
         }
         break;
         case TW_MT_DATA_NACK: // data transmitted, NACK received
         {
             twi_error = TW_MT_DATA_NACK;
-            twi_stop();
+            twi_master_finish(TWI_DATA_NACK);
         }
         break;
         case TW_MT_ARB_LOST: // arbitration lost in SLA+W or data
@@ -208,7 +394,7 @@ ISR(TWI_vect)
         
         // MASTER RECEIVER
         case TW_MR_DATA_ACK: // data received, ACK returned
-        twi_master_buffer[twi_master_buffer_index++] = TWDR;
+        twi_master_data[twi_master_buffer_index++] = TWDR;
         /* fall through */
         case TW_MR_SLA_ACK:  // SLA+R transmitted, ACK received
         {
@@ -218,8 +404,9 @@ ISR(TWI_vect)
         break;
         case TW_MR_DATA_NACK: // data received, NACK returned
         {
-            twi_master_buffer[twi_master_buffer_index++] = TWDR;
-            if (twi_send_stop) { twi_stop(); }
+            twi_master_data[twi_master_buffer_index++] = TWDR;
+            if (twi_async) { twi_queue_head->count = twi_master_buffer_index; }
+            if (twi_send_stop) { twi_master_finish(TWI_DONE); }
             else {
                 twi_in_rep_start = 1;
                 TWCR = _BV(TWINT) | _BV(TWSTA)| _BV(TWEN) ;
@@ -229,7 +416,7 @@ ISR(TWI_vect)
         break;
         case TW_MR_SLA_NACK: // SLA+R transmitted, NACK received
         {
-            twi_stop();
+            twi_master_finish(TWI_ADDRESS_NACK);
         }
         break;
         
@@ -307,8 +494,11 @@ ISR(TWI_vect)
         case TW_BUS_ERROR: // illegal start or stop condition
         {
             twi_error = TW_BUS_ERROR;
-            twi_stop();
+            twi_master_finish(TWI_BUS_ERROR);
         }
         break;
     }
+    
+    // bus released by a stop, a lost arbitration or the end of a slave transfer
+    twi_start_next();
 }
\ No newline at end of file
@@ -1,8 +1,11 @@
 #ifndef __TWI_H__
 #define __TWI_H__
 
+#define TWI_FREQ_STANDARD 100000L
+#define TWI_FREQ_FAST     400000L
+
 #ifndef TWI_FREQ
-#define TWI_FREQ 100000L
+#define TWI_FREQ TWI_FREQ_STANDARD
 #endif
 
 #ifndef TWI_BUFFER_LENGTH
@@ -15,15 +18,49 @@
 #define TWI_SRX   3
 #define TWI_STX   4
 
+// twi_transaction_t status, the error codes match the twi_write() returns
+#define TWI_DONE         0
+#define TWI_ADDRESS_NACK 2
+#define TWI_DATA_NACK    3
+#define TWI_BUS_ERROR    4
+#define TWI_QUEUED       0x80
+#define TWI_ACTIVE       0x81
+#define TWI_PENDING(status) ((status) & 0x80)
+
+/**
+* Master transaction for the asynchronous queue, owned by the caller until it
+* completes. The write bytes go out first (usually the register address), a
+* repeated start then reads read_length bytes. Either length may be 0.
+* The callback runs in the TWI interrupt, it may submit another transaction.
+*/
+typedef struct twi_transaction
+{
+    uint8_t address;
+    const uint8_t* write_data;
+    uint8_t write_length;
+    uint8_t* read_data;
+    uint8_t read_length;
+    volatile uint8_t status;
+    volatile uint8_t count; // bytes read
+    void (*callback)(struct twi_transaction*);
+    void* context;
+    struct twi_transaction* next;
+} twi_transaction_t;
+
 void twi_init(void);
 int8_t twi_get_state(void);
 void twi_disable(void);
 void twi_set_address(uint8_t address);
+void twi_set_bit_rate(uint8_t bit_rate, uint8_t prescaler);
+uint32_t twi_set_frequency(uint32_t frequency);
 void twi_attach_slave_rx_event(void (*function)(uint8_t*, int));
 void twi_attach_slave_tx_event(void (*function)(void));
 uint8_t twi_read(uint8_t address, uint8_t* data, uint8_t length, uint8_t send_stop);
 uint8_t twi_write(uint8_t address, uint8_t* data, uint8_t length, uint8_t wait, uint8_t send_stop);
 uint8_t twi_transmit(const uint8_t* data, uint8_t length);
+uint8_t twi_submit(twi_transaction_t* transaction);
+uint8_t twi_poll(const twi_transaction_t* transaction);
+uint8_t twi_wait(const twi_transaction_t* transaction);
 
 #endif
 
@@ -12,17 +12,14 @@
 #include <util/delay.h>
 
 #include "icarolib/timer/timer.h"
+#include "icarolib/receiver/receiver.h"
 #include "icarolib/uart/uart.h"
 
-char BUFFER[150];
-volatile long last = 0;
+// receiver channels 1 to 5 on PB0 to PB4 (arduino pins 8 to 12), PB5 is the led
+#define RECEIVER_PINS 0x1F
 
-volatile long last_d8 = 0;
-uint8_t last_channel_1;
-uint16_t timer_1;
-uint16_t channel_1_value;
-uint16_t current_time;
-int receiver_input[5];
+char BUFFER[150];
+uint16_t receiver_input[RECEIVER_CHANNELS];
 
 void setup(void)
 {
@@ -30,8 +27,7 @@ void setup(void)
     uart_init(UART_BAUD_SELECT(UART_BAUD_RATE, F_CPU));
     sei();
     
-    PCICR |= (1 << PCIE0);
-    PCMSK0 |= (1 << PCINT0);
+    receiver_init(RECEIVER_PINS);
     
     uart_puts("setup finish\n");
 }
@@ -58,27 +54,18 @@ int main(void)
     while (1)
     {
         _delay_ms(100);
-        sprintf(BUFFER, "> %d \n", receiver_input[1]);
+        uint8_t valid = receiver_read(receiver_input);
+        sprintf(
+            BUFFER,
+            "> %u %u %u %u %u valid %02x glitches %u\n",
+            receiver_input[0],
+            receiver_input[1],
+            receiver_input[2],
+            receiver_input[3],
+            receiver_input[4],
+            valid,
+            receiver_glitches()
+        );
         uart_puts(BUFFER);
     }
 }
-
-ISR(PCINT0_vect)
-{
-    current_time = millis();
-    if(PINB & 0b00000001)
-    {                                        //Is input 8 high?
-        if(last_channel_1 == 0)
-        {                                   //Input 8 changed from 0 to 1.
-            last_channel_1 = 1;                                      //Remember current input state.
-            timer_1 = current_time;                                  //Set timer_1 to current_time.
-        }
-    }
-    else if(last_channel_1 == 1)
-    {                                //Input 8 is not high and changed from 1 to 0.
-        last_channel_1 = 0;                                        //Remember current input state.
-        receiver_input[1] = current_time - timer_1;                 //Channel 1 is current_time - timer_1.
-    }
-}
-
-
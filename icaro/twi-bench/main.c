@@ -0,0 +1,113 @@
+/*
+ * twi-bench.c
+ *
+ * Throughput and latency of the MPU6050 14-byte motion read at each TWI bus
+ * speed, for the three ways icarolib can do it:
+ *   stop      register write, STOP, then the read (the old i2c_read_bytes)
+ *   rep-start register write, repeated start, read (i2c_read_bytes)
+ *   queue     the same transfer on the interrupt driven queue (i2c_submit_read)
+ *
+ * One line per speed and mode goes out on the UART at UART_BAUD_RATE:
+ *   mode  scl_hz  bytes/s  avg_us  min_us  max_us  errors
+ * bytes/s counts the payload only. Latency is micros() around each blocking
+ * read, so it includes the call overhead and has the resolution of micros().
+ */
+
+#include <stdio.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/delay.h>
+
+#include "icarolib/timer/timer.h"
+#include "icarolib/twi/i2cdevlib.h"
+#include "icarolib/twi/twi.h"
+#include "icarolib/uart/uart.h"
+
+#define BENCH_ADDRESS  0x68 // MPU6050, AD0 low
+#define BENCH_REGISTER 0x3B // ACCEL_XOUT_H
+#define BENCH_LENGTH   14
+#define BENCH_READS    500
+
+char BUFFER[120] = {0};
+uint8_t data[BENCH_LENGTH];
+
+const uint32_t speeds[] = {TWI_FREQ_STANDARD, 200000L, TWI_FREQ_FAST};
+
+uint8_t read_stop(void)
+{
+    wire_begin_transmission(BENCH_ADDRESS);
+    wire_write(BENCH_REGISTER);
+    if (wire_end_transmission(1)) { return 0; }
+    return wire_request_from(BENCH_ADDRESS, BENCH_LENGTH, 0, 0, 1) == BENCH_LENGTH;
+}
+
+uint8_t read_repeated_start(void)
+{
+    return i2c_read_bytes(BENCH_ADDRESS, BENCH_REGISTER, BENCH_LENGTH, data, 0) == BENCH_LENGTH;
+}
+
+uint8_t read_queue(void)
+{
+    static const uint8_t reg_address = BENCH_REGISTER;
+    static twi_transaction_t transaction;
+
+    if (i2c_submit_read(&transaction, BENCH_ADDRESS, &reg_address, BENCH_LENGTH, data, 0)) { return 0; }
+    return twi_wait(&transaction) == TWI_DONE && transaction.count == BENCH_LENGTH;
+}
+
+void run(const char* mode, uint32_t scl, uint8_t (*read)(void))
+{
+    unsigned long total = 0, min = 0xFFFFFFFF, max = 0;
+    uint16_t errors = 0;
+
+    for (uint16_t i = 0; i < BENCH_READS; i++)
+    {
+        unsigned long start = micros();
+        uint8_t ok = read();
+        unsigned long elapsed = micros() - start;
+
+        if (!ok) { errors++; continue; }
+        total += elapsed;
+        if (elapsed < min) { min = elapsed; }
+        if (elapsed > max) { max = elapsed; }
+    }
+
+    uint16_t reads = BENCH_READS - errors;
+    unsigned long average = reads ? total / reads : 0;
+    sprintf(
+        BUFFER,
+        "%s\t%lu\t%lu\t%lu\t%lu\t%lu\t%u\n",
+        mode,
+        (unsigned long)scl,
+        average ? BENCH_LENGTH * 1000000UL / average : 0,
+        average,
+        reads ? min : 0,
+        max,
+        errors
+    );
+    uart_puts(BUFFER);
+}
+
+int main(void)
+{
+    sei();
+    init_millis(F_CPU);
+    wire_init();
+    uart_init(UART_BAUD_SELECT(UART_BAUD_RATE, F_CPU));
+
+    _delay_ms(100);
+
+    while (1)
+    {
+        uart_puts("mode\tscl_hz\tbytes/s\tavg_us\tmin_us\tmax_us\terrors\n");
+        for (uint8_t i = 0; i < sizeof(speeds) / sizeof(speeds[0]); i++)
+        {
+            uint32_t scl = wire_set_clock(speeds[i]);
+
+            run("stop", scl, read_stop);
+            run("rep-start", scl, read_repeated_start);
+            run("queue", scl, read_queue);
+        }
+        _delay_ms(5000);
+    }
+}
@@ -27,6 +27,7 @@
 
 #include "MahonyAHRS.h"
 #include <math.h>
+#include <stdint.h>
 
 //-------------------------------------------------------------------------------------------
 // Definitions
@@ -34,16 +35,22 @@
 #define DEFAULT_SAMPLE_FREQ 512.0f // sample frequency in Hz
 #define twoKpDef (2.0f * 0.5f)	   // 2 * proportional gain
 #define twoKiDef (2.0f * 0.0f)	   // 2 * integral gain
+#define DT_RANGE 4.0f			   // measured periods may be up to 4 times off the nominal one
+#define DT_SMOOTHING 0.05f		   // weight of the newest period in the measured rate
 
 // Variables
 
-float twoKp = twoKpDef;											  // 2 * proportional gain (Kp)
-float twoKi = twoKiDef;											  // 2 * integral gain (Ki)
-float q0 = 1.0f, q1 = 0.0f, q2 = 0.0f, q3 = 0.0f;				  // quaternion of sensor frame relative to auxiliary frame
-float integralFBx = 0.0f, integralFBy = 0.0f, integralFBz = 0.0f; // integral error terms scaled by Ki
-float invSampleFreq;
-float roll, pitch, yaw;
-char anglesComputed = 1.0f / DEFAULT_SAMPLE_FREQ;
+// filter behind the process wide API
+static mahony_filter_t default_filter = {
+	twoKpDef, twoKiDef,
+	1.0f, 0.0f, 0.0f, 0.0f,
+	0.0f, 0.0f, 0.0f,
+	1.0f / DEFAULT_SAMPLE_FREQ,
+	0.0f, 0.0f, 0.0f,
+	0,
+	1.0f / (DEFAULT_SAMPLE_FREQ * DT_RANGE), DT_RANGE / DEFAULT_SAMPLE_FREQ,
+	1.0f / DEFAULT_SAMPLE_FREQ,
+	0};
 
 //============================================================================================
 // Functions
@@ -55,19 +62,93 @@ char anglesComputed = 1.0f / DEFAULT_SAMPLE_FREQ;
 float mahony_invSqrt(float x)
 {
 	float halfx = 0.5f * x;
-	float y = x;
-	long i = *(long *)&y;
-	i = 0x5f3759df - (i >> 1);
-	y = *(float *)&i;
-	y = y * (1.5f - (halfx * y * y));
-	y = y * (1.5f - (halfx * y * y));
-	return y;
+	union
+	{
+		float f;
+		int32_t i;
+	} y = {x};
+	y.i = 0x5f3759df - (y.i >> 1);
+	y.f = y.f * (1.5f - (halfx * y.f * y.f));
+	y.f = y.f * (1.5f - (halfx * y.f * y.f));
+	return y.f;
+}
+
+//-------------------------------------------------------------------------------------------
+// Filter state
+
+void mahony_filter_init(mahony_filter_t *filter, const mahony_config_t *config)
+{
+	filter->twoKp = config ? config->twoKp : twoKpDef;
+	filter->twoKi = config ? config->twoKi : twoKiDef;
+	filter->q0 = 1.0f;
+	filter->q1 = 0.0f;
+	filter->q2 = 0.0f;
+	filter->q3 = 0.0f;
+	filter->integralFBx = 0.0f;
+	filter->integralFBy = 0.0f;
+	filter->integralFBz = 0.0f;
+	filter->invSampleFreq = 1.0f / (config ? config->sampleFreq : DEFAULT_SAMPLE_FREQ);
+	filter->roll = 0.0f;
+	filter->pitch = 0.0f;
+	filter->yaw = 0.0f;
+	filter->anglesComputed = 0;
+	filter->dtMin = filter->invSampleFreq / DT_RANGE;
+	filter->dtMax = filter->invSampleFreq * DT_RANGE;
+	filter->dtMean = filter->invSampleFreq;
+	filter->dtClamped = 0;
+}
+
+void mahony_filter_set_dt_limits(mahony_filter_t *filter, float dtMin, float dtMax)
+{
+	filter->dtMin = dtMin;
+	filter->dtMax = dtMax;
+}
+
+// Nominal rate without resetting the attitude, the measured period limits
+// follow it as in mahony_filter_init()
+void mahony_filter_set_sample_freq(mahony_filter_t *filter, float sampleFreq)
+{
+	filter->invSampleFreq = 1.0f / sampleFreq;
+	filter->dtMin = filter->invSampleFreq / DT_RANGE;
+	filter->dtMax = filter->invSampleFreq * DT_RANGE;
+	filter->dtMean = filter->invSampleFreq;
+}
+
+//-------------------------------------------------------------------------------------------
+// Measured sample period
+//
+// A stalled loop, the first sample or a clock step would integrate the gyro
+// over a bogus interval, such periods are clamped and counted. The clamped
+// period is what the filter integrates with and what the rate is averaged from.
+
+static void mahony_filter_set_dt(mahony_filter_t *filter, float dt)
+{
+	if (!(dt >= filter->dtMin))
+	{
+		dt = filter->dtMin;
+		filter->dtClamped++;
+	}
+	else if (dt > filter->dtMax)
+	{
+		dt = filter->dtMax;
+		filter->dtClamped++;
+	}
+	filter->invSampleFreq = dt;
+	filter->dtMean += DT_SMOOTHING * (dt - filter->dtMean);
+}
+
+float mahony_filter_get_sample_freq(mahony_filter_t *filter)
+{
+	return 1.0f / filter->dtMean;
 }
 
 //-------------------------------------------------------------------------------------------
 // AHRS algorithm update
+//
+// The state is loaded into locals and stored back once, the filter pointer
+// does not make the update any slower than the file-scope variables did.
 
-void mahony_update(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz)
+void mahony_filter_update(mahony_filter_t *filter, float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz)
 {
 	float recipNorm;
 	float q0q0, q0q1, q0q2, q0q3, q1q1, q1q2, q1q3, q2q2, q2q3, q3q3;
@@ -75,12 +156,15 @@ void mahony_update(float gx, float gy, float gz, float ax, float ay, float az, f
 	float halfvx, halfvy, halfvz, halfwx, halfwy, halfwz;
 	float halfex, halfey, halfez;
 	float qa, qb, qc;
+	float q0 = filter->q0, q1 = filter->q1, q2 = filter->q2, q3 = filter->q3;
+	float integralFBx = filter->integralFBx, integralFBy = filter->integralFBy, integralFBz = filter->integralFBz;
+	float twoKp = filter->twoKp, twoKi = filter->twoKi, invSampleFreq = filter->invSampleFreq;
 
 	// Use IMU algorithm if magnetometer measurement invalid
 	// (avoids NaN in magnetometer normalisation)
 	if ((mx == 0.0f) && (my == 0.0f) && (mz == 0.0f))
 	{
-		mahony_update_imu(gx, gy, gz, ax, ay, az);
+		mahony_filter_update_imu(filter, gx, gy, gz, ax, ay, az);
 		return;
 	}
 
@@ -176,22 +260,34 @@ void mahony_update(float gx, float gy, float gz, float ax, float ay, float az, f
 
 	// Normalise quaternion
 	recipNorm = mahony_invSqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
-	q0 *= recipNorm;
-	q1 *= recipNorm;
-	q2 *= recipNorm;
-	q3 *= recipNorm;
-	anglesComputed = 0;
+	filter->q0 = q0 * recipNorm;
+	filter->q1 = q1 * recipNorm;
+	filter->q2 = q2 * recipNorm;
+	filter->q3 = q3 * recipNorm;
+	filter->integralFBx = integralFBx;
+	filter->integralFBy = integralFBy;
+	filter->integralFBz = integralFBz;
+	filter->anglesComputed = 0;
+}
+
+void mahony_filter_update_dt(mahony_filter_t *filter, float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz, float dt)
+{
+	mahony_filter_set_dt(filter, dt);
+	mahony_filter_update(filter, gx, gy, gz, ax, ay, az, mx, my, mz);
 }
 
 //-------------------------------------------------------------------------------------------
 // IMU algorithm update
 
-void mahony_update_imu(float gx, float gy, float gz, float ax, float ay, float az)
+void mahony_filter_update_imu(mahony_filter_t *filter, float gx, float gy, float gz, float ax, float ay, float az)
 {
 	float recipNorm;
 	float halfvx, halfvy, halfvz;
 	float halfex, halfey, halfez;
 	float qa, qb, qc;
+	float q0 = filter->q0, q1 = filter->q1, q2 = filter->q2, q3 = filter->q3;
+	float integralFBx = filter->integralFBx, integralFBy = filter->integralFBy, integralFBz = filter->integralFBz;
+	float twoKp = filter->twoKp, twoKi = filter->twoKi, invSampleFreq = filter->invSampleFreq;
 
 	// Convert gyroscope degrees/sec to radians/sec
 	gx *= 0.0174533f;
@@ -258,61 +354,153 @@ void mahony_update_imu(float gx, float gy, float gz, float ax, float ay, float a
 
 	// Normalise quaternion
 	recipNorm = mahony_invSqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
-	q0 *= recipNorm;
-	q1 *= recipNorm;
-	q2 *= recipNorm;
-	q3 *= recipNorm;
-	anglesComputed = 0;
+	filter->q0 = q0 * recipNorm;
+	filter->q1 = q1 * recipNorm;
+	filter->q2 = q2 * recipNorm;
+	filter->q3 = q3 * recipNorm;
+	filter->integralFBx = integralFBx;
+	filter->integralFBy = integralFBy;
+	filter->integralFBz = integralFBz;
+	filter->anglesComputed = 0;
+}
+
+void mahony_filter_update_imu_dt(mahony_filter_t *filter, float gx, float gy, float gz, float ax, float ay, float az, float dt)
+{
+	mahony_filter_set_dt(filter, dt);
+	mahony_filter_update_imu(filter, gx, gy, gz, ax, ay, az);
+}
+
+//-------------------------------------------------------------------------------------------
+
+static void mahony_filter_compute_angles(mahony_filter_t *filter)
+{
+	float q0 = filter->q0, q1 = filter->q1, q2 = filter->q2, q3 = filter->q3;
+
+	filter->roll = atan2f(q0 * q1 + q2 * q3, 0.5f - q1 * q1 - q2 * q2);
+	filter->pitch = asinf(-2.0f * (q1 * q3 - q0 * q2));
+	filter->yaw = atan2f(q1 * q2 + q0 * q3, 0.5f - q2 * q2 - q3 * q3);
+	filter->anglesComputed = 1;
+}
+
+void mahony_filter_get_quaternion(mahony_filter_t *filter, float *q)
+{
+	q[0] = filter->q0;
+	q[1] = filter->q1;
+	q[2] = filter->q2;
+	q[3] = filter->q3;
+}
+
+float mahony_filter_get_roll(mahony_filter_t *filter)
+{
+	if (!filter->anglesComputed)
+		mahony_filter_compute_angles(filter);
+	return filter->roll * 57.29578f;
+}
+
+float mahony_filter_get_pitch(mahony_filter_t *filter)
+{
+	if (!filter->anglesComputed)
+		mahony_filter_compute_angles(filter);
+	return filter->pitch * 57.29578f;
+}
+
+float mahony_filter_get_yaw(mahony_filter_t *filter)
+{
+	if (!filter->anglesComputed)
+		mahony_filter_compute_angles(filter);
+	return filter->yaw * 57.29578f + 180.0f;
+}
+
+float mahony_filter_get_roll_radians(mahony_filter_t *filter)
+{
+	if (!filter->anglesComputed)
+		mahony_filter_compute_angles(filter);
+	return filter->roll;
+}
+
+float mahony_filter_get_pitch_radians(mahony_filter_t *filter)
+{
+	if (!filter->anglesComputed)
+		mahony_filter_compute_angles(filter);
+	return filter->pitch;
+}
+
+float mahony_filter_get_yaw_radians(mahony_filter_t *filter)
+{
+	if (!filter->anglesComputed)
+		mahony_filter_compute_angles(filter);
+	return filter->yaw;
 }
 
 //-------------------------------------------------------------------------------------------
+// Process wide filter
+
+void mahony_update(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz)
+{
+	mahony_filter_update(&default_filter, gx, gy, gz, ax, ay, az, mx, my, mz);
+}
+
+void mahony_update_imu(float gx, float gy, float gz, float ax, float ay, float az)
+{
+	mahony_filter_update_imu(&default_filter, gx, gy, gz, ax, ay, az);
+}
+
+void mahony_update_dt(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz, float dt)
+{
+	mahony_filter_update_dt(&default_filter, gx, gy, gz, ax, ay, az, mx, my, mz, dt);
+}
+
+void mahony_update_imu_dt(float gx, float gy, float gz, float ax, float ay, float az, float dt)
+{
+	mahony_filter_update_imu_dt(&default_filter, gx, gy, gz, ax, ay, az, dt);
+}
+
+void mahony_set_sample_freq(float sampleFreq)
+{
+	mahony_filter_set_sample_freq(&default_filter, sampleFreq);
+}
+
+float mahony_get_sample_freq()
+{
+	return mahony_filter_get_sample_freq(&default_filter);
+}
+
+unsigned long mahony_get_dt_clamped()
+{
+	return default_filter.dtClamped;
+}
 
-void mahony_compute_angles()
+void mahony_get_quaternion(float *q)
 {
-	roll = atan2f(q0 * q1 + q2 * q3, 0.5f - q1 * q1 - q2 * q2);
-	pitch = asinf(-2.0f * (q1 * q3 - q0 * q2));
-	yaw = atan2f(q1 * q2 + q0 * q3, 0.5f - q2 * q2 - q3 * q3);
-	anglesComputed = 1;
+	mahony_filter_get_quaternion(&default_filter, q);
 }
 
 float mahony_get_roll()
 {
-	if (!anglesComputed)
-		mahony_compute_angles();
-	return roll * 57.29578f;
+	return mahony_filter_get_roll(&default_filter);
 }
 
 float mahony_get_pitch()
 {
-	if (!anglesComputed)
-		mahony_compute_angles();
-	return pitch * 57.29578f;
+	return mahony_filter_get_pitch(&default_filter);
 }
 
 float mahony_get_yaw()
 {
-	if (!anglesComputed)
-		mahony_compute_angles();
-	return yaw * 57.29578f + 180.0f;
+	return mahony_filter_get_yaw(&default_filter);
 }
 
 float mahony_get_roll_radians()
 {
-	if (!anglesComputed)
-		mahony_compute_angles();
-	return roll;
+	return mahony_filter_get_roll_radians(&default_filter);
 }
 
 float mahony_get_pitch_radians()
 {
-	if (!anglesComputed)
-		mahony_compute_angles();
-	return pitch;
+	return mahony_filter_get_pitch_radians(&default_filter);
 }
 
 float mahony_get_yaw_radians()
 {
-	if (!anglesComputed)
-		mahony_compute_angles();
-	return yaw;
+	return mahony_filter_get_yaw_radians(&default_filter);
 }
@@ -19,9 +19,57 @@
 #include <math.h>
 
 //--------------------------------------------------------------------------------------------
+// Filter state, one per estimator
 
+typedef struct
+{
+	float twoKp;	  // 2 * proportional gain (Kp)
+	float twoKi;	  // 2 * integral gain (Ki)
+	float sampleFreq; // sample frequency in Hz
+} mahony_config_t;
+
+typedef struct
+{
+	float twoKp;								// 2 * proportional gain (Kp)
+	float twoKi;								// 2 * integral gain (Ki)
+	float q0, q1, q2, q3;						// quaternion of sensor frame relative to auxiliary frame
+	float integralFBx, integralFBy, integralFBz; // integral error terms scaled by Ki
+	float invSampleFreq;
+	float roll, pitch, yaw;
+	char anglesComputed;
+	float dtMin, dtMax;		  // measured sample periods are clamped to this range, seconds
+	float dtMean;			  // smoothed measured sample period, seconds
+	unsigned long dtClamped;  // measured sample periods outside [dtMin, dtMax]
+} mahony_filter_t;
+
+void mahony_filter_init(mahony_filter_t *filter, const mahony_config_t *config);
+void mahony_filter_update(mahony_filter_t *filter, float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz);
+void mahony_filter_update_imu(mahony_filter_t *filter, float gx, float gy, float gz, float ax, float ay, float az);
+void mahony_filter_update_dt(mahony_filter_t *filter, float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz, float dt);
+void mahony_filter_update_imu_dt(mahony_filter_t *filter, float gx, float gy, float gz, float ax, float ay, float az, float dt);
+void mahony_filter_set_dt_limits(mahony_filter_t *filter, float dtMin, float dtMax);
+void mahony_filter_set_sample_freq(mahony_filter_t *filter, float sampleFreq);
+float mahony_filter_get_sample_freq(mahony_filter_t *filter);
+void mahony_filter_get_quaternion(mahony_filter_t *filter, float *q);
+float mahony_filter_get_roll(mahony_filter_t *filter);
+float mahony_filter_get_pitch(mahony_filter_t *filter);
+float mahony_filter_get_yaw(mahony_filter_t *filter);
+float mahony_filter_get_roll_radians(mahony_filter_t *filter);
+float mahony_filter_get_pitch_radians(mahony_filter_t *filter);
+float mahony_filter_get_yaw_radians(mahony_filter_t *filter);
+
+//--------------------------------------------------------------------------------------------
+// Single process wide filter, wraps a default mahony_filter_t
+
+float mahony_invSqrt(float x);
 void mahony_update(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz);
 void mahony_update_imu(float gx, float gy, float gz, float ax, float ay, float az);
+void mahony_update_dt(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz, float dt);
+void mahony_update_imu_dt(float gx, float gy, float gz, float ax, float ay, float az, float dt);
+void mahony_set_sample_freq(float sampleFreq);
+float mahony_get_sample_freq();
+unsigned long mahony_get_dt_clamped();
+void mahony_get_quaternion(float *q);
 float mahony_get_roll();
 float mahony_get_pitch();
 float mahony_get_yaw();
@@ -0,0 +1,153 @@
+/**
+ * Non-blocking pipe output of comm.c against readers that do not keep up.
+ *
+ * Records are written flat out, with no reader at all, with a reader that
+ * takes one PIPE_BUF chunk per millisecond under either drop policy, and
+ * with a reader that closes the pipe halfway. The cost per record and the
+ * slowest single call show the writer is never held up. The reader decodes
+ * what it gets: every record is either delivered whole or counted as dropped,
+ * and a torn frame fails the run.
+ *
+ *   make bench && ./bench/comm_bench [records]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "../comm/comm.h"
+#include "../stats/clock.h"
+
+#define BENCH_FIFO "/tmp/icaro_comm_bench"
+
+typedef struct
+{
+    pthread_t thread;
+    int delay_us;               // between reads
+    long quit_after;            // records, -1 reads to the end
+    atomic_int opened, stop;
+    telemetry_decoder_t decoder;
+} reader_t;
+
+static long count = 200000;
+
+static void *reader_run(void *arg)
+{
+    reader_t *reader = arg;
+    uint8_t buffer[PIPE_BUF];
+    telemetry_record_t record;
+    int fd = open(BENCH_FIFO, O_RDONLY | O_NONBLOCK), ready;
+    ssize_t length;
+    size_t used;
+
+    telemetry_decoder_init(&reader->decoder);
+    atomic_store(&reader->opened, 1);
+    if (fd < 0)
+        return NULL;
+    while (reader->quit_after < 0 || (long)reader->decoder.records < reader->quit_after)
+    {
+        length = read(fd, buffer, sizeof(buffer));
+        if (length <= 0 && atomic_load(&reader->stop))
+            break;
+        for (used = 0; length > 0 && used < (size_t)length;)
+            used += telemetry_decoder_feed(&reader->decoder, buffer + used, length - used, &record, &ready);
+        usleep(reader->delay_us);
+    }
+    close(fd);
+    return NULL;
+}
+
+static int run(const char *name, comm_drop_policy_t policy, reader_t *reader)
+{
+    comm_stats_t before, after;
+    telemetry_record_t record;
+    uint64_t start, call, slowest = 0;
+    long i, received = 0;
+    double elapsed;
+    int ok = 1;
+
+    memset(&record, 0, sizeof(record));
+    record.type = TELEMETRY_ATTITUDE;
+    if (reader)
+    {
+        atomic_init(&reader->opened, 0);
+        atomic_init(&reader->stop, 0);
+        pthread_create(&reader->thread, NULL, reader_run, reader);
+        while (!atomic_load(&reader->opened))
+            usleep(100);
+    }
+    comm_set_drop_policy(policy);
+    comm_open_fifo(BENCH_FIFO);
+    comm_get_stats(&before);
+
+    start = clock_now_ns();
+    for (i = 0; i < count; i++)
+    {
+        call = clock_now_ns();
+        record.timestamp = call;
+        record.roll = i;
+        comm_write_record(&record);
+        call = clock_now_ns() - call;
+        slowest = call > slowest ? call : slowest;
+    }
+    elapsed = (double)(clock_now_ns() - start) / count;
+
+    // let a live reader drain the queue before counting
+    for (i = 0; reader && i < 2000 && comm_flush() == 0; i++)
+    {
+        comm_get_stats(&after);
+        if (after.pending == 0)
+            break;
+        usleep(1000);
+    }
+    comm_close();
+    comm_get_stats(&after);
+    if (reader)
+    {
+        atomic_store(&reader->stop, 1);
+        pthread_join(reader->thread, NULL);
+        received = reader->decoder.records;
+        ok = reader->decoder.crc_errors == 0 && reader->decoder.frame_errors == 0;
+    }
+    if (reader && reader->quit_after < 0)
+        ok &= received + (long)(after.dropped - before.dropped) == count;
+
+    printf("%-14s %10.1f %10.1f %10ld %10lu %10lu %8lu %6lu %s\n", name, elapsed, slowest / 1000.0,
+           received, after.dropped - before.dropped, after.full - before.full,
+           (unsigned long)after.high_water, after.disconnects - before.disconnects, ok ? "ok" : "FAIL");
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    reader_t slow = {.delay_us = 1000, .quit_after = -1};
+    reader_t slow_newest = {.delay_us = 1000, .quit_after = -1};
+    reader_t fast = {.delay_us = 0, .quit_after = -1};
+    reader_t leaving = {.delay_us = 100, .quit_after = 1000};
+    int ok = 1;
+
+    if (argc > 1)
+        count = atol(argv[1]);
+    if (count <= 0)
+    {
+        fprintf(stderr, "usage: %s [records]\n", argv[0]);
+        return 1;
+    }
+
+    unlink(BENCH_FIFO);
+    printf("%-14s %10s %10s %10s %10s %10s %8s %6s\n", "reader", "ns/record", "max_us", "received",
+           "dropped", "full", "high", "gone");
+    ok &= run("none", COMM_DROP_OLDEST, NULL);
+    ok &= run("fast", COMM_DROP_OLDEST, &fast);
+    ok &= run("slow-oldest", COMM_DROP_OLDEST, &slow);
+    ok &= run("slow-newest", COMM_DROP_NEWEST, &slow_newest);
+    ok &= run("leaving", COMM_DROP_OLDEST, &leaving);
+    unlink(BENCH_FIFO);
+    return ok ? 0 : 1;
+}
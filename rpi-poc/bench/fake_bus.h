@@ -0,0 +1,28 @@
+#ifndef __FAKE_BUS_H_
+#define __FAKE_BUS_H_
+
+/**
+ * Fake I2C adapter for benchmarks.
+ *
+ * Link with -Wl,--wrap=open,--wrap=open64,--wrap=close,--wrap=ioctl,--wrap=read,--wrap=write
+ * and every /dev/i2c-N opened by I2Cdev.c is backed by /dev/zero. Each call still
+ * enters the kernel once, so the timings keep the real syscall cost while the
+ * data read back is all zeros. I2C_FUNCS reports the functionality set with
+ * fake_bus_set_funcs() and I2C_RDWR zero fills every read message.
+ */
+
+typedef struct
+{
+    unsigned long open;
+    unsigned long close;
+    unsigned long ioctl;
+    unsigned long read;
+    unsigned long write;
+} fake_bus_stats_t;
+
+void fake_bus_set_funcs(unsigned long funcs);
+void fake_bus_reset_stats(void);
+fake_bus_stats_t fake_bus_get_stats(void);
+unsigned long fake_bus_syscalls(const fake_bus_stats_t *stats);
+
+#endif
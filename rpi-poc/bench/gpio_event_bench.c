@@ -0,0 +1,104 @@
+/**
+ * Wake up latency and CPU cost of waiting for the data ready edge, blocking
+ * in poll() against spinning on the source as the old while(1) loop did.
+ *
+ * A thread triggers a fake event source at a fixed rate with the current
+ * CLOCK_MONOTONIC time, the sampling side measures how late it sees each edge
+ * and how much CPU it burnt in between:
+ *   make bench && ./bench/gpio_event_bench [events] [rate_hz]
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "../gpio/gpio_event.h"
+#include "../stats/clock.h"
+
+static gpio_event_source_t source;
+static long events = 2000;
+static long period_ns = 1000000;
+
+static void *trigger(void *arg)
+{
+    struct timespec next;
+    long i;
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (i = 0; i < events; i++)
+    {
+        next.tv_nsec += period_ns;
+        while (next.tv_nsec >= 1000000000)
+        {
+            next.tv_nsec -= 1000000000;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+        gpio_event_trigger(&source, clock_now_ns());
+    }
+    return NULL;
+}
+
+static double thread_cpu_us(void)
+{
+    struct rusage usage;
+
+    getrusage(RUSAGE_THREAD, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1e6 +
+           usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+static void run(const char *name, int timeout_ms)
+{
+    pthread_t thread;
+    uint64_t timestamp, latency, min = UINT64_MAX, max = 0, sum = 0;
+    double cpu;
+    long seen = 0;
+
+    if (gpio_event_open_fake(&source) != 0)
+        exit(1);
+    cpu = thread_cpu_us();
+    pthread_create(&thread, NULL, trigger, NULL);
+    while (seen + (long)source.missed < events)
+    {
+        if (gpio_event_wait(&source, timeout_ms, &timestamp) != 1)
+            continue;
+        latency = clock_now_ns() - timestamp;
+        min = latency < min ? latency : min;
+        max = latency > max ? latency : max;
+        sum += latency;
+        seen++;
+    }
+    cpu = thread_cpu_us() - cpu;
+    pthread_join(thread, NULL);
+
+    printf("%-6s %8ld %8lu %10.1f %10.1f %10.1f %12.1f\n",
+           name, seen, source.missed,
+           min / 1e3, (double)sum / seen / 1e3, max / 1e3,
+           cpu / events);
+    gpio_event_close(&source);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1)
+        events = atol(argv[1]);
+    if (argc > 2)
+        period_ns = 1000000000L / atol(argv[2]);
+    if (events <= 0 || period_ns <= 0)
+    {
+        fprintf(stderr, "usage: %s [events] [rate_hz]\n", argv[0]);
+        return 1;
+    }
+
+    printf("%-6s %8s %8s %10s %10s %10s %12s\n",
+           "mode", "events", "missed", "min_us", "avg_us", "max_us", "cpu_us/event");
+    run("poll", -1);
+    run("spin", 0);
+    return 0;
+}
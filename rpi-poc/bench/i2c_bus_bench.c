@@ -0,0 +1,182 @@
+/**
+ * Syscall cost per 9-axis sample: per-transfer open/close, the persistent bus
+ * context with write()+read() register reads, the persistent bus context
+ * with combined I2C_RDWR register reads, the whole sweep as one batch and
+ * the single burst read with the magnetometer behind the MPU6050 auxiliary
+ * I2C master.
+ * The last two rows compare mpu6050_initialize() done with read-modify-write
+ * per setting against the shadow register file.
+ *
+ * Runs against the fake adapter in fake_bus.c, so it needs no hardware:
+ *   make bench && ./bench/i2c_bus_bench [samples]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+#include "fake_bus.h"
+#include "../i2c/I2Cdev.h"
+#include "../sensors/mpu6050.h"
+#include "../sensors/mpu6050_registers.h"
+#include "../sensors/hcm5883l.h"
+#include "../sensors/hcm5883l_registers.h"
+#include "../stats/clock.h"
+
+#define DEFAULT_SAMPLES 100000
+
+/**
+ * Transfer as read_bytes() did it before the bus context: open, select, write
+ * register, read, close.
+ */
+static int legacy_read_bytes(uint8_t dev_addr, uint8_t reg_addr, uint8_t length, uint8_t *data)
+{
+    int fd = open("/dev/i2c-1", O_RDWR);
+    if (fd < 0)
+        return -1;
+    if (ioctl(fd, I2C_SLAVE, dev_addr) < 0 || write(fd, &reg_addr, 1) != 1 || read(fd, data, length) != length)
+    {
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    return length;
+}
+
+static int legacy_write_byte(uint8_t dev_addr, uint8_t reg_addr, uint8_t data)
+{
+    uint8_t buf[2] = {reg_addr, data};
+    int fd = open("/dev/i2c-1", O_RDWR);
+    if (fd < 0)
+        return -1;
+    if (ioctl(fd, I2C_SLAVE, dev_addr) < 0 || write(fd, buf, 2) != 2)
+    {
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+static void legacy_sample(void)
+{
+    uint8_t buffer[14];
+
+    legacy_read_bytes(MPU6050_ADDRESS, MPU6050_ACCEL_XOUT_H, 14, buffer);
+    legacy_read_bytes(HMC5883L_ADDRESS, HMC5883L_DATAX_H, 6, buffer);
+    legacy_write_byte(HMC5883L_ADDRESS, HMC5883L_MODE, HMC5883L_MODE_SINGLE);
+}
+
+static void bus_sample(void)
+{
+    int16_t ax, ay, az, gx, gy, gz, mx, my, mz;
+
+    mpu6050_get_motion_6(&ax, &ay, &az, &gx, &gy, &gz);
+    getHeading(&mx, &my, &mz);
+}
+
+static i2c_batch_t sweep;
+static uint8_t motion_buffer[MPU6050_MOTION_9_LENGTH];
+static uint8_t heading_buffer[HMC5883L_HEADING_LENGTH];
+
+static void batch_sample(void)
+{
+    int16_t ax, ay, az, gx, gy, gz, mx, my, mz;
+
+    i2c_batch_submit(&sweep);
+    mpu6050_decode_motion_6(motion_buffer, &ax, &ay, &az, &gx, &gy, &gz);
+    hcm5883l_decode_heading(heading_buffer, &mx, &my, &mz);
+}
+
+static void aux_sample(void)
+{
+    int16_t ax, ay, az, gx, gy, gz, mx, my, mz;
+
+    i2c_batch_submit(&sweep);
+    mpu6050_decode_motion_6(motion_buffer, &ax, &ay, &az, &gx, &gy, &gz);
+    hcm5883l_decode_heading(motion_buffer + MPU6050_EXT_SENS_OFFSET, &mx, &my, &mz);
+}
+
+/**
+ * mpu6050_initialize() as it was before the shadow registers, one read and
+ * one write per setting.
+ */
+static void rmw_initialize(void)
+{
+    write_bit(MPU6050_ADDRESS, MPU6050_USER_CTRL, MPU6050_USER_CTRL_I2C_MST_EN_BIT, 0);
+    write_bit(MPU6050_ADDRESS, MPU6050_INT_PIN_CFG, MPU6050_INT_PIN_CFG_I2C_BYPASS_EN_BIT, 1);
+    write_bits(MPU6050_ADDRESS, MPU6050_PWR_MGMT_1, MPU6050_PWR_MGMT_1_CLK_SEL_BIT, MPU6050_PWR_MGMT_1_CLK_SEL_LENGTH, MPU6050_CLOCK_PLL_XGYRO);
+    write_bits(MPU6050_ADDRESS, MPU6050_GYRO_CONFIG, MPU6050_GYRO_FS_SEL_BIT, MPU6050_GYRO_FS_SEL_LENGTH, MPU6050_GYRO_FS_250);
+    write_bits(MPU6050_ADDRESS, MPU6050_ACCEL_CONFIG, MPU6050_ACCEL_CONFIG_AFS_SEL_BIT, MPU6050_ACCEL_CONFIG_AFS_SEL_LENGTH, MPU6050_ACCEL_FS_2);
+    write_bit(MPU6050_ADDRESS, MPU6050_PWR_MGMT_1, MPU6050_PWR_MGMT_1_SLEEP_BIT, 0);
+}
+
+static void run(const char *name, void (*sample)(void), long samples)
+{
+    fake_bus_stats_t stats;
+    double start, elapsed;
+    long i;
+
+    fake_bus_reset_stats();
+    start = clock_now_ns();
+    for (i = 0; i < samples; i++)
+        sample();
+    elapsed = clock_now_ns() - start;
+    stats = fake_bus_get_stats();
+
+    printf("%-12s %8ld %12.1f %10.2f %8.2f %8.2f\n",
+           name,
+           samples,
+           elapsed / samples,
+           (double)fake_bus_syscalls(&stats) / samples,
+           (double)stats.open / samples,
+           (double)stats.ioctl / samples);
+}
+
+int main(int argc, char **argv)
+{
+    long samples = argc > 1 ? atol(argv[1]) : DEFAULT_SAMPLES;
+
+    if (samples <= 0)
+    {
+        fprintf(stderr, "usage: %s [samples]\n", argv[0]);
+        return 1;
+    }
+
+    printf("%-12s %8s %12s %10s %8s %8s\n", "mode", "samples", "ns/sample", "syscalls", "opens", "ioctls");
+    run("per-transfer", legacy_sample, samples);
+
+    // adapter functionality is probed on open
+    fake_bus_set_funcs(0);
+    if (i2c_bus_open(I2C_DEFAULT_ADAPTER) != I2C_OK)
+        return 1;
+    hcm5883l_initialize();
+    run("persistent", bus_sample, samples);
+    i2c_bus_close();
+
+    fake_bus_set_funcs(I2C_FUNC_I2C);
+    if (i2c_bus_open(I2C_DEFAULT_ADAPTER) != I2C_OK)
+        return 1;
+    run("rdwr", bus_sample, samples);
+
+    i2c_batch_init(&sweep);
+    mpu6050_batch_motion_6(&sweep, motion_buffer);
+    hcm5883l_batch_heading(&sweep, heading_buffer);
+    run("batch", batch_sample, samples);
+
+    i2c_batch_init(&sweep);
+    mpu6050_batch_motion_9(&sweep, motion_buffer);
+    run("batch-aux", aux_sample, samples);
+
+    run("init-rmw", rmw_initialize, samples / 10 + 1);
+    run("init-shadow", mpu6050_initialize, samples / 10 + 1);
+    i2c_bus_close();
+
+    return 0;
+}
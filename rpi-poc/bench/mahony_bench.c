@@ -0,0 +1,224 @@
+/**
+ * Cost per Mahony update: the file-scope state the filter used to have, the
+ * process wide API now wrapping a mahony_filter_t, one mahony_filter_t used
+ * directly, one fed a measured period per sample and four independent filters
+ * updated in turn. Every filter is fed the same synthetic 9-axis samples, the
+ * quaternion difference to the legacy filter checks the results are unchanged.
+ * At each of rates[] the measured period path must match the nominal one and
+ * the process wide filter must not clamp any period.
+ *
+ *   make bench && ./bench/mahony_bench [samples]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "../MahonyAHRS.h"
+#include "mahony_legacy.h"
+#include "../stats/clock.h"
+
+#define FILTERS 4
+#define RATE_SAMPLES 10000
+
+static const float rates[] = {100.0f, 250.0f, 1000.0f};
+
+typedef struct
+{
+    float gx, gy, gz, ax, ay, az, mx, my, mz;
+} sample_t;
+
+static sample_t *samples;
+static long count = 1000000;
+static mahony_filter_t filters[FILTERS];
+
+/**
+ * Slow wobble around level with a little noise, degrees/s for the gyroscope
+ * and raw counts for the accelerometer and magnetometer like main.c feeds.
+ */
+static void make_samples(void)
+{
+    long i;
+
+    srand(1);
+    for (i = 0; i < count; i++)
+    {
+        float t = i / 512.0f;
+        float noise = (rand() % 100 - 50) * 0.01f;
+        sample_t *s = &samples[i];
+
+        s->gx = 20.0f * sinf(t) + noise;
+        s->gy = 15.0f * cosf(0.7f * t) - noise;
+        s->gz = 5.0f * sinf(0.3f * t);
+        s->ax = 8192.0f * 0.2f * sinf(t) + noise;
+        s->ay = 8192.0f * 0.2f * cosf(0.7f * t);
+        s->az = 8192.0f + noise;
+        s->mx = 200.0f + 40.0f * sinf(0.3f * t);
+        s->my = -120.0f + noise;
+        s->mz = 400.0f;
+    }
+}
+
+static void legacy_run(void)
+{
+    long i;
+
+    for (i = 0; i < count; i++)
+    {
+        sample_t *s = &samples[i];
+        legacy_mahony_update(s->gx, s->gy, s->gz, s->ax, s->ay, s->az, s->mx, s->my, s->mz);
+    }
+}
+
+static void wrapper_run(void)
+{
+    long i;
+
+    for (i = 0; i < count; i++)
+    {
+        sample_t *s = &samples[i];
+        mahony_update(s->gx, s->gy, s->gz, s->ax, s->ay, s->az, s->mx, s->my, s->mz);
+    }
+}
+
+static void filter_run(void)
+{
+    long i;
+
+    for (i = 0; i < count; i++)
+    {
+        sample_t *s = &samples[i];
+        mahony_filter_update(&filters[0], s->gx, s->gy, s->gz, s->ax, s->ay, s->az, s->mx, s->my, s->mz);
+    }
+}
+
+static void filter_dt_run(void)
+{
+    long i;
+
+    for (i = 0; i < count; i++)
+    {
+        sample_t *s = &samples[i];
+        mahony_filter_update_dt(&filters[0], s->gx, s->gy, s->gz, s->ax, s->ay, s->az, s->mx, s->my, s->mz, 1.0f / 512.0f);
+    }
+}
+
+static void filters_run(void)
+{
+    long i;
+
+    for (i = 0; i < count; i++)
+    {
+        sample_t *s = &samples[i];
+        mahony_filter_update(&filters[i % FILTERS], s->gx, s->gy, s->gz, s->ax, s->ay, s->az, s->mx, s->my, s->mz);
+    }
+}
+
+/**
+ * One filter at the nominal rate, one fed the period of that rate and the
+ * process wide filter set to the rate, the filter difference and the clamped
+ * count are returned.
+ */
+static float rate_run(float rate, unsigned long *clamped)
+{
+    mahony_config_t config = {2.0f * 0.5f, 0.0f, rate};
+    unsigned long before = mahony_get_dt_clamped();
+    float diff = 0.0f;
+    long i, n = count < RATE_SAMPLES ? count : RATE_SAMPLES;
+
+    mahony_filter_init(&filters[0], &config);
+    mahony_filter_init(&filters[1], NULL);
+    mahony_filter_set_sample_freq(&filters[1], rate);
+    mahony_set_sample_freq(rate);
+    for (i = 0; i < n; i++)
+    {
+        sample_t *s = &samples[i];
+        mahony_filter_update(&filters[0], s->gx, s->gy, s->gz, s->ax, s->ay, s->az, s->mx, s->my, s->mz);
+        mahony_filter_update_dt(&filters[1], s->gx, s->gy, s->gz, s->ax, s->ay, s->az, s->mx, s->my, s->mz, 1.0f / rate);
+        mahony_update_dt(s->gx, s->gy, s->gz, s->ax, s->ay, s->az, s->mx, s->my, s->mz, 1.0f / rate);
+    }
+    diff = fmaxf(diff, fabsf(filters[0].q0 - filters[1].q0));
+    diff = fmaxf(diff, fabsf(filters[0].q1 - filters[1].q1));
+    diff = fmaxf(diff, fabsf(filters[0].q2 - filters[1].q2));
+    diff = fmaxf(diff, fabsf(filters[0].q3 - filters[1].q3));
+    *clamped = mahony_get_dt_clamped() - before;
+    return diff;
+}
+
+static void reset(void)
+{
+    int i;
+
+    for (i = 0; i < FILTERS; i++)
+        mahony_filter_init(&filters[i], NULL);
+    legacy_mahony_reset();
+}
+
+static void run(const char *name, void (*updates)(void))
+{
+    double start, elapsed;
+
+    reset();
+    start = clock_now_ns();
+    updates();
+    elapsed = clock_now_ns() - start;
+
+    printf("%-10s %10ld %12.1f\n", name, count, elapsed / count);
+}
+
+int main(int argc, char **argv)
+{
+    float legacy[4], diff = 0.0f, dt_diff = 0.0f, rate_diff = 0.0f;
+    unsigned long clamped, rate_clamped = 0;
+    unsigned int r;
+    mahony_filter_t *filter = &filters[0];
+
+    if (argc > 1)
+        count = atol(argv[1]);
+    samples = count > 0 ? malloc(count * sizeof(*samples)) : NULL;
+    if (samples == NULL)
+    {
+        fprintf(stderr, "usage: %s [samples]\n", argv[0]);
+        return 1;
+    }
+    make_samples();
+
+    printf("%-10s %10s %12s\n", "mode", "updates", "ns/update");
+    run("legacy", legacy_run);
+    run("wrapper", wrapper_run);
+    run("filter", filter_run);
+    run("filter-dt", filter_dt_run);
+    run("filter-x4", filters_run);
+
+    // same input, the instance must land on the same attitude as the globals
+    reset();
+    filter_run();
+    legacy_run();
+    legacy_mahony_get_quaternion(legacy);
+    diff = fmaxf(diff, fabsf(legacy[0] - filter->q0));
+    diff = fmaxf(diff, fabsf(legacy[1] - filter->q1));
+    diff = fmaxf(diff, fabsf(legacy[2] - filter->q2));
+    diff = fmaxf(diff, fabsf(legacy[3] - filter->q3));
+    printf("max quaternion difference to legacy %g\n", diff);
+
+    // a measured period equal to the nominal one integrates the same
+    reset();
+    filter_dt_run();
+    dt_diff = fmaxf(dt_diff, fabsf(legacy[0] - filter->q0));
+    dt_diff = fmaxf(dt_diff, fabsf(legacy[1] - filter->q1));
+    dt_diff = fmaxf(dt_diff, fabsf(legacy[2] - filter->q2));
+    dt_diff = fmaxf(dt_diff, fabsf(legacy[3] - filter->q3));
+    printf("max quaternion difference of the measured period filter %g, rate %.1f Hz\n", dt_diff, mahony_filter_get_sample_freq(filter));
+
+    for (r = 0; r < sizeof(rates) / sizeof(rates[0]); r++)
+    {
+        float d = rate_run(rates[r], &clamped);
+        printf("at %.0f Hz: measured period difference %g, process wide filter %lu clamped, rate %.1f Hz\n",
+               rates[r], d, clamped, mahony_get_sample_freq());
+        rate_diff = fmaxf(rate_diff, d);
+        rate_clamped += clamped;
+    }
+
+    free(samples);
+    return diff == 0.0f && dt_diff == 0.0f && rate_diff == 0.0f && rate_clamped == 0 ? 0 : 1;
+}
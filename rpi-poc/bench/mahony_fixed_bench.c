@@ -0,0 +1,253 @@
+/**
+ * Fixed-point Mahony filter of the icaro_imu firmware (mahony_fixed.c) against
+ * its float reference (mahony.c), both built for the host.
+ *
+ * Both filters get the same raw samples, either synthetic ones from a known
+ * roll/pitch/yaw trajectory with sensor noise, or a recording of the
+ * firmware's "raw" debug lines (gx gy gz ax ay az mx my mz per line). The
+ * angle difference is reported per axis after a warm up and the run fails
+ * when it is above the bound. Timings are TSC cycles on x86 and ns elsewhere,
+ * the ARM cycle counter is not readable from user space on a stock Pi kernel.
+ * The AVR figures come from the firmware's MAHONY_PROFILE build.
+ *
+ *   make bench && ./bench/mahony_fixed_bench [-n samples] [-f raw.log] [-e max_error_deg]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TICK_UNIT "cycles"
+#else
+#define TICK_UNIT "ns"
+#endif
+
+#include "../../icaro/icaro_imu/mahony.h"
+#include "../../icaro/icaro_imu/mahony_fixed.h"
+#include "../stats/clock.h"
+
+#define SAMPLE_FREQ 200.0   // Hz, the firmware default
+#define GYRO_SCALE 65.5     // LSB per degrees/sec, MPU6050_GYRO_FS_500
+#define ACCEL_SCALE 4096.0  // LSB per g, MPU6050_ACCEL_FS_8
+#define MAG_SCALE 545.0     // LSB at 0.5 Gauss, HMC5883L_GAIN_1090
+#define MAG_DIP 60.0        // degrees
+#define WARM_UP 400         // samples, both filters start level and converge
+
+typedef struct
+{
+    int16_t gx, gy, gz, ax, ay, az, mx, my, mz;
+} raw_t;
+
+static double rad(double degrees) { return degrees * M_PI / 180.0; }
+
+static double noise(double amplitude) { return amplitude * (rand() / (double)RAND_MAX - 0.5) * 2.0; }
+
+static int16_t lsb(double value)
+{
+    value = round(value);
+    return value > 32767 ? 32767 : value < -32768 ? -32768 : value;
+}
+
+static void euler_to_quaternion(double roll, double pitch, double yaw, double *q)
+{
+    double cr = cos(roll / 2), sr = sin(roll / 2);
+    double cp = cos(pitch / 2), sp = sin(pitch / 2);
+    double cy = cos(yaw / 2), sy = sin(yaw / 2);
+
+    q[0] = cr * cp * cy + sr * sp * sy;
+    q[1] = sr * cp * cy - cr * sp * sy;
+    q[2] = cr * sp * cy + sr * cp * sy;
+    q[3] = cr * cp * sy - sr * sp * cy;
+}
+
+/**
+ * Sensor frame readings for a smooth roll/pitch/yaw trajectory, the body
+ * rates come from consecutive attitudes, gravity and the magnetic field are
+ * rotated into the sensor frame.
+ */
+static void synthesize(raw_t *samples, long count)
+{
+    double q[4], n[4];
+    long i;
+
+    srand(1);
+    euler_to_quaternion(0, 0, 0, q);
+    for (i = 0; i < count; i++)
+    {
+        double t = (i + 1) / SAMPLE_FREQ;
+        double wx, wy, wz, r[3][3], m[3] = {cos(rad(MAG_DIP)), 0.0, sin(rad(MAG_DIP))};
+        raw_t *s = &samples[i];
+
+        euler_to_quaternion(rad(40.0 * sin(0.5 * t)), rad(30.0 * sin(0.37 * t)), rad(90.0 * sin(0.11 * t)), n);
+        // body rate = 2 * vec(conj(q) * n) / dt
+        wx = 2.0 * (q[0] * n[1] - q[1] * n[0] - q[2] * n[3] + q[3] * n[2]) * SAMPLE_FREQ;
+        wy = 2.0 * (q[0] * n[2] + q[1] * n[3] - q[2] * n[0] - q[3] * n[1]) * SAMPLE_FREQ;
+        wz = 2.0 * (q[0] * n[3] - q[1] * n[2] + q[2] * n[1] - q[3] * n[0]) * SAMPLE_FREQ;
+        memcpy(q, n, sizeof(q));
+
+        r[0][0] = 1 - 2 * (q[2] * q[2] + q[3] * q[3]);
+        r[0][1] = 2 * (q[1] * q[2] - q[0] * q[3]);
+        r[0][2] = 2 * (q[1] * q[3] + q[0] * q[2]);
+        r[1][0] = 2 * (q[1] * q[2] + q[0] * q[3]);
+        r[1][1] = 1 - 2 * (q[1] * q[1] + q[3] * q[3]);
+        r[1][2] = 2 * (q[2] * q[3] - q[0] * q[1]);
+        r[2][0] = 2 * (q[1] * q[3] - q[0] * q[2]);
+        r[2][1] = 2 * (q[2] * q[3] + q[0] * q[1]);
+        r[2][2] = 1 - 2 * (q[1] * q[1] + q[2] * q[2]);
+
+        s->gx = lsb(wx * 180.0 / M_PI * GYRO_SCALE + noise(5));
+        s->gy = lsb(wy * 180.0 / M_PI * GYRO_SCALE + noise(5));
+        s->gz = lsb(wz * 180.0 / M_PI * GYRO_SCALE + noise(5));
+        s->ax = lsb(r[2][0] * ACCEL_SCALE + noise(20));
+        s->ay = lsb(r[2][1] * ACCEL_SCALE + noise(20));
+        s->az = lsb(r[2][2] * ACCEL_SCALE + noise(20));
+        s->mx = lsb((r[0][0] * m[0] + r[1][0] * m[1] + r[2][0] * m[2]) * MAG_SCALE + noise(3));
+        s->my = lsb((r[0][1] * m[0] + r[1][1] * m[1] + r[2][1] * m[2]) * MAG_SCALE + noise(3));
+        s->mz = lsb((r[0][2] * m[0] + r[1][2] * m[1] + r[2][2] * m[2]) * MAG_SCALE + noise(3));
+    }
+}
+
+static long load(const char *path, raw_t **samples)
+{
+    char line[256];
+    long count = 0, size = 1024;
+    FILE *file = fopen(path, "r");
+
+    if (file == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+    *samples = malloc(size * sizeof(**samples));
+    while (fgets(line, sizeof(line), file))
+    {
+        raw_t *s;
+        char *values = strncmp(line, "raw", 3) == 0 ? line + 3 : line;
+        int gx, gy, gz, ax, ay, az, mx, my, mz;
+
+        if (sscanf(values, "%d %d %d %d %d %d %d %d %d", &gx, &gy, &gz, &ax, &ay, &az, &mx, &my, &mz) != 9)
+            continue;
+        if (count == size)
+            *samples = realloc(*samples, (size *= 2) * sizeof(**samples));
+        s = &(*samples)[count++];
+        s->gx = gx, s->gy = gy, s->gz = gz;
+        s->ax = ax, s->ay = ay, s->az = az;
+        s->mx = mx, s->my = my, s->mz = mz;
+    }
+    fclose(file);
+    return count;
+}
+
+// TICK_UNIT since an arbitrary point
+static uint64_t cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return clock_now_ns();
+#endif
+}
+
+typedef struct
+{
+    double max, sum2;
+} angle_error_t;
+
+static void accumulate(angle_error_t *error, double difference)
+{
+    difference = fabs(remainder(difference, 360.0));
+    error->max = difference > error->max ? difference : error->max;
+    error->sum2 += difference * difference;
+}
+
+int main(int argc, char **argv)
+{
+    raw_t *samples = NULL;
+    const char *path = NULL;
+    long count = 20000, i;
+    double bound = 1.0;
+    uint64_t float_cycles = 0, fixed_cycles = 0, start;
+    angle_error_t roll = {0}, pitch = {0}, yaw = {0};
+    mahony_filter_t reference;
+    mahony_fixed_t fixed;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:f:e:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            count = atol(optarg);
+            break;
+        case 'f':
+            path = optarg;
+            break;
+        case 'e':
+            bound = atof(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n samples] [-f raw.log] [-e max_error_deg]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (path)
+    {
+        count = load(path, &samples);
+    }
+    else if (count > 0)
+    {
+        samples = malloc(count * sizeof(*samples));
+        synthesize(samples, count);
+    }
+    if (count <= WARM_UP)
+    {
+        fprintf(stderr, "need more than %d samples\n", WARM_UP);
+        return 1;
+    }
+
+    mahony_filter_init(&reference, NULL);
+    mahony_fixed_init(&fixed, NULL);
+    for (i = 0; i < count; i++)
+    {
+        raw_t *s = &samples[i];
+
+        start = cycles();
+        mahony_filter_update(&reference,
+                             s->gx / GYRO_SCALE, s->gy / GYRO_SCALE, s->gz / GYRO_SCALE,
+                             s->ax, s->ay, s->az, s->mx, s->my, s->mz);
+        float_cycles += cycles() - start;
+
+        start = cycles();
+        mahony_fixed_update(&fixed, s->gx, s->gy, s->gz, s->ax, s->ay, s->az, s->mx, s->my, s->mz);
+        fixed_cycles += cycles() - start;
+
+        if (i < WARM_UP)
+            continue;
+        accumulate(&roll, mahony_fixed_get_roll(&fixed) - mahony_filter_get_roll(&reference));
+        accumulate(&pitch, mahony_fixed_get_pitch(&fixed) - mahony_filter_get_pitch(&reference));
+        accumulate(&yaw, mahony_fixed_get_yaw(&fixed) - mahony_filter_get_yaw(&reference));
+    }
+    count -= WARM_UP;
+
+    printf("%-8s %12s\n", "filter", TICK_UNIT "/update");
+    printf("%-8s %12.1f\n", "float", (double)float_cycles / (count + WARM_UP));
+    printf("%-8s %12.1f\n", "fixed", (double)fixed_cycles / (count + WARM_UP));
+    printf("%-8s %10s %10s\n", "angle", "max_deg", "rms_deg");
+    printf("%-8s %10.4f %10.4f\n", "roll", roll.max, sqrt(roll.sum2 / count));
+    printf("%-8s %10.4f %10.4f\n", "pitch", pitch.max, sqrt(pitch.sum2 / count));
+    printf("%-8s %10.4f %10.4f\n", "yaw", yaw.max, sqrt(yaw.sum2 / count));
+
+    free(samples);
+    if (roll.max > bound || pitch.max > bound || yaw.max > bound)
+    {
+        printf("FAIL: fixed point is more than %.2f degrees off the float reference\n", bound);
+        return 1;
+    }
+    printf("OK: within %.2f degrees of the float reference\n", bound);
+    return 0;
+}
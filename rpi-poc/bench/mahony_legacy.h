@@ -0,0 +1,9 @@
+#ifndef __MAHONY_LEGACY_H_
+#define __MAHONY_LEGACY_H_
+
+void legacy_mahony_update(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz);
+void legacy_mahony_update_imu(float gx, float gy, float gz, float ax, float ay, float az);
+void legacy_mahony_reset(void);
+void legacy_mahony_get_quaternion(float *q);
+
+#endif
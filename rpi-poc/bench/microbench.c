@@ -0,0 +1,462 @@
+/**
+ * Micro-benchmarks of the hot paths, one line per case in a table, CSV or
+ * JSON so runs can be kept and compared.
+ *
+ * Every case is calibrated to about 1 ms per repetition, warmed up, then
+ * timed over the repetitions. ns/op is reported as the mean and the min,
+ * p50, p90, p99 and max over the repetitions, spread between p50 and p99
+ * shows how much a figure can be trusted on the host it came from. Inputs
+ * cycle through a table of samples so the branches see varied data.
+ *
+ *   filter   mahony_update and mahony_update_imu (process wide filter),
+ *            mahony_filter_update, the angles computed from the quaternion
+ *   invsqrt  mahony_invSqrt against 1/sqrtf and a single Newton step
+ *   decode   mpu6050_decode_motion_6 and hcm5883l_decode_heading
+ *   i2c      mpu6050_get_motion_6 and the motion 6 plus heading batch main.c
+ *            submits, on the simulated bus with free transfers, so only
+ *            the driver, backend and register model code is timed
+ *   telemetry telemetry_encode and the decoder fed the frames
+ *
+ * The build has no optimisation flags, like the rest of the Makefile, the
+ * figures are those of the code as it runs in main.
+ *
+ *   make bench && ./bench/microbench [-o text|csv|json] [-r repetitions] [-w warmup_ms] [-f filter]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "../MahonyAHRS.h"
+#include "../comm/telemetry.h"
+#include "../i2c/I2Cdev.h"
+#include "../i2c/sim_bus.h"
+#include "../sensors/mpu6050.h"
+#include "../sensors/hcm5883l.h"
+#include "../sensors/sim_motion.h"
+#include "../sensors/mpu6050_sim.h"
+#include "../sensors/hcm5883l_sim.h"
+#include "../stats/clock.h"
+
+#define INPUTS 1024          // power of two, inputs cycle through the table
+#define REPETITION_NS 1000000 // calibration target per repetition
+#define MAX_REPETITIONS 1000
+
+typedef struct
+{
+    float gx, gy, gz, ax, ay, az, mx, my, mz;
+} input_t;
+
+typedef struct
+{
+    const char *group;
+    const char *name;
+    void (*run)(long iterations);
+} bench_case_t;
+
+typedef struct
+{
+    long iterations;     // per repetition
+    int repetitions;
+    double mean, min, p50, p90, p99, max; // ns/op
+} result_t;
+
+static input_t inputs[INPUTS];
+static uint8_t motion_buffers[INPUTS][MPU6050_MOTION_6_LENGTH];
+static uint8_t frames[INPUTS][TELEMETRY_FRAME_MAX];
+static size_t frame_lengths[INPUTS];
+static telemetry_record_t records[INPUTS];
+static mahony_filter_t filter;
+static i2c_sim_bus_t bus;
+static mpu6050_sim_t mpu;
+static hcm5883l_sim_t mag;
+static sim_motion_synthetic_t synthetic;
+static i2c_batch_t sweep;
+static uint8_t motion[MPU6050_MOTION_6_LENGTH], heading[HMC5883L_HEADING_LENGTH];
+static volatile float sink; // keeps results alive
+static volatile int16_t sink16;
+
+static void run_mahony_update(long n)
+{
+    long i;
+
+    for (i = 0; i < n; i++)
+    {
+        input_t *s = &inputs[i & (INPUTS - 1)];
+        mahony_update(s->gx, s->gy, s->gz, s->ax, s->ay, s->az, s->mx, s->my, s->mz);
+    }
+}
+
+static void run_mahony_update_imu(long n)
+{
+    long i;
+
+    for (i = 0; i < n; i++)
+    {
+        input_t *s = &inputs[i & (INPUTS - 1)];
+        mahony_update_imu(s->gx, s->gy, s->gz, s->ax, s->ay, s->az);
+    }
+}
+
+static void run_filter_update(long n)
+{
+    long i;
+
+    for (i = 0; i < n; i++)
+    {
+        input_t *s = &inputs[i & (INPUTS - 1)];
+        mahony_filter_update(&filter, s->gx, s->gy, s->gz, s->ax, s->ay, s->az, s->mx, s->my, s->mz);
+    }
+}
+
+/**
+ * The getters compute all three angles once per update, clearing the flag
+ * makes every call pay for it.
+ */
+static void run_compute_angles(long n)
+{
+    long i;
+
+    for (i = 0; i < n; i++)
+    {
+        filter.anglesComputed = 0;
+        sink = mahony_filter_get_roll(&filter);
+    }
+}
+
+static void run_invsqrt(long n)
+{
+    float sum = 0.0f;
+    long i;
+
+    for (i = 0; i < n; i++)
+        sum += mahony_invSqrt(inputs[i & (INPUTS - 1)].az);
+    sink = sum;
+}
+
+static void run_recip_sqrtf(long n)
+{
+    float sum = 0.0f;
+    long i;
+
+    for (i = 0; i < n; i++)
+        sum += 1.0f / sqrtf(inputs[i & (INPUTS - 1)].az);
+    sink = sum;
+}
+
+static float invsqrt_newton1(float x)
+{
+    float halfx = 0.5f * x;
+    union
+    {
+        float f;
+        int32_t i;
+    } y = {x};
+    y.i = 0x5f3759df - (y.i >> 1);
+    return y.f * (1.5f - (halfx * y.f * y.f));
+}
+
+static void run_invsqrt_newton1(long n)
+{
+    float sum = 0.0f;
+    long i;
+
+    for (i = 0; i < n; i++)
+        sum += invsqrt_newton1(inputs[i & (INPUTS - 1)].az);
+    sink = sum;
+}
+
+static void run_decode_motion_6(long n)
+{
+    int16_t ax, ay, az, gx, gy, gz;
+    long i;
+
+    for (i = 0; i < n; i++)
+        mpu6050_decode_motion_6(motion_buffers[i & (INPUTS - 1)], &ax, &ay, &az, &gx, &gy, &gz);
+    sink16 = ax + ay + az + gx + gy + gz;
+}
+
+static void run_decode_heading(long n)
+{
+    int16_t x, y, z;
+    long i;
+
+    for (i = 0; i < n; i++)
+        hcm5883l_decode_heading(motion_buffers[i & (INPUTS - 1)], &x, &y, &z);
+    sink16 = x + y + z;
+}
+
+static void run_get_motion_6(long n)
+{
+    int16_t ax, ay, az, gx, gy, gz;
+    long i;
+
+    for (i = 0; i < n; i++)
+        mpu6050_get_motion_6(&ax, &ay, &az, &gx, &gy, &gz);
+    sink16 = ax + gz;
+}
+
+static void run_sweep(long n)
+{
+    long i;
+
+    for (i = 0; i < n; i++)
+        i2c_batch_submit(&sweep);
+    sink16 = motion[0] + heading[0];
+}
+
+static void run_telemetry_encode(long n)
+{
+    uint8_t frame[TELEMETRY_FRAME_MAX];
+    size_t length = 0;
+    long i;
+
+    for (i = 0; i < n; i++)
+        length += telemetry_encode(&records[i & (INPUTS - 1)], i, frame);
+    sink = length;
+}
+
+static void run_telemetry_decode(long n)
+{
+    telemetry_decoder_t decoder;
+    telemetry_record_t record;
+    int ready;
+    long i;
+
+    telemetry_decoder_init(&decoder);
+    for (i = 0; i < n; i++)
+        telemetry_decoder_feed(&decoder, frames[i & (INPUTS - 1)], frame_lengths[i & (INPUTS - 1)], &record, &ready);
+    sink = decoder.records;
+}
+
+static const bench_case_t cases[] = {
+    {"filter", "mahony_update", run_mahony_update},
+    {"filter", "mahony_update_imu", run_mahony_update_imu},
+    {"filter", "mahony_filter_update", run_filter_update},
+    {"filter", "compute_angles", run_compute_angles},
+    {"invsqrt", "mahony_invSqrt", run_invsqrt},
+    {"invsqrt", "1/sqrtf", run_recip_sqrtf},
+    {"invsqrt", "newton1", run_invsqrt_newton1},
+    {"decode", "mpu6050_decode_motion_6", run_decode_motion_6},
+    {"decode", "hcm5883l_decode_heading", run_decode_heading},
+    {"i2c", "mpu6050_get_motion_6", run_get_motion_6},
+    {"i2c", "batch_motion_6_heading", run_sweep},
+    {"telemetry", "telemetry_encode", run_telemetry_encode},
+    {"telemetry", "telemetry_decode", run_telemetry_decode},
+};
+
+/**
+ * Slow wobble around level with noise, degrees/s for the gyroscope and raw
+ * counts for the rest like main.c feeds, the raw buffers and telemetry
+ * frames are built from the same values.
+ */
+static void make_inputs(void)
+{
+    int i;
+
+    srand(1);
+    for (i = 0; i < INPUTS; i++)
+    {
+        float t = i / 128.0f, noise = (rand() % 100 - 50) * 0.01f;
+        input_t *s = &inputs[i];
+        telemetry_record_t *r = &records[i];
+        int16_t raw[7];
+        int j;
+
+        s->gx = 20.0f * sinf(t) + noise;
+        s->gy = 15.0f * cosf(0.7f * t) - noise;
+        s->gz = 5.0f * sinf(0.3f * t);
+        s->ax = 16384.0f * 0.2f * sinf(t) + noise;
+        s->ay = 16384.0f * 0.2f * cosf(0.7f * t);
+        s->az = 16384.0f + noise;
+        s->mx = 200.0f + 40.0f * sinf(0.3f * t);
+        s->my = -120.0f + noise;
+        s->mz = 400.0f;
+
+        raw[0] = s->ax, raw[1] = s->ay, raw[2] = s->az, raw[3] = 0;
+        raw[4] = s->gx * 131.0f, raw[5] = s->gy * 131.0f, raw[6] = s->gz * 131.0f;
+        for (j = 0; j < 7; j++)
+        {
+            motion_buffers[i][2 * j] = (uint16_t)raw[j] >> 8;
+            motion_buffers[i][2 * j + 1] = raw[j];
+        }
+
+        memset(r, 0, sizeof(*r));
+        r->type = TELEMETRY_ATTITUDE;
+        r->timestamp = 1000000000ull + i * 1000000ull;
+        r->q0 = cosf(t);
+        r->q1 = r->q2 = sinf(t) * 0.5f;
+        r->q3 = sinf(t) * 0.70710677f;
+        r->roll = 40.0f * sinf(t);
+        r->pitch = 30.0f * cosf(t);
+        r->yaw = 180.0f + 90.0f * sinf(0.3f * t);
+        r->ax = raw[0], r->ay = raw[1], r->az = raw[2];
+        r->gx = raw[4], r->gy = raw[5], r->gz = raw[6];
+        r->mx = s->mx, r->my = s->my, r->mz = s->mz;
+        frame_lengths[i] = telemetry_encode(r, i, frames[i]);
+    }
+}
+
+/**
+ * Both sensor models on the simulated bus, transfers cost nothing.
+ */
+static void setup_bus(void)
+{
+    sim_motion_source_t source;
+    i2c_sim_device_t device;
+    uint64_t origin = clock_now_ns();
+
+    sim_motion_synthetic_source(&source, &synthetic, 0.01);
+    i2c_sim_bus_init(&bus);
+    mpu6050_sim_init(&mpu, &source, origin, &bus);
+    mpu6050_sim_device(&mpu, &device);
+    i2c_sim_bus_attach(&bus, &device);
+    hcm5883l_sim_init(&mag, &source, origin);
+    hcm5883l_sim_device(&mag, &device);
+    i2c_sim_bus_attach(&bus, &device);
+    i2c_bus_set_backend(i2c_sim_bus_backend(&bus));
+    i2c_bus_open(0);
+    mpu6050_initialize();
+    hcm5883l_initialize();
+    i2c_batch_init(&sweep);
+    mpu6050_batch_motion_6(&sweep, motion);
+    hcm5883l_batch_heading(&sweep, heading);
+}
+
+static int compare(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double percentile(const double *sorted, int count, double p)
+{
+    int index = (int)ceil(p / 100.0 * count) - 1;
+    return sorted[index < 0 ? 0 : index];
+}
+
+/**
+ * Double the iterations until a repetition takes REPETITION_NS, keep
+ * running until the warm-up time is spent, then time the repetitions.
+ */
+static void measure(const bench_case_t *c, int repetitions, uint64_t warmup_ns, result_t *result)
+{
+    static double samples[MAX_REPETITIONS];
+    uint64_t start, elapsed, warm_start = clock_now_ns();
+    long iterations = 1;
+    double sum = 0.0;
+    int i;
+
+    mahony_filter_init(&filter, NULL);
+    for (;;)
+    {
+        start = clock_now_ns();
+        c->run(iterations);
+        elapsed = clock_now_ns() - start;
+        if (elapsed >= REPETITION_NS && clock_now_ns() - warm_start >= warmup_ns)
+            break;
+        if (elapsed < REPETITION_NS)
+            iterations *= 2;
+    }
+
+    for (i = 0; i < repetitions; i++)
+    {
+        start = clock_now_ns();
+        c->run(iterations);
+        samples[i] = (double)(clock_now_ns() - start) / iterations;
+        sum += samples[i];
+    }
+    qsort(samples, repetitions, sizeof(samples[0]), compare);
+
+    result->iterations = iterations;
+    result->repetitions = repetitions;
+    result->mean = sum / repetitions;
+    result->min = samples[0];
+    result->p50 = percentile(samples, repetitions, 50);
+    result->p90 = percentile(samples, repetitions, 90);
+    result->p99 = percentile(samples, repetitions, 99);
+    result->max = samples[repetitions - 1];
+}
+
+static void print_header(const char *format)
+{
+    if (strcmp(format, "csv") == 0)
+        printf("group,name,iterations,repetitions,mean_ns,min_ns,p50_ns,p90_ns,p99_ns,max_ns\n");
+    else if (strcmp(format, "json") == 0)
+        printf("[\n");
+    else
+        printf("%-10s %-24s %10s %9s %9s %9s %9s %9s %9s\n",
+               "group", "name", "iter/rep", "mean", "min", "p50", "p90", "p99", "max");
+}
+
+static void print_result(const char *format, const bench_case_t *c, const result_t *r, int first)
+{
+    if (strcmp(format, "csv") == 0)
+        printf("%s,%s,%ld,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n", c->group, c->name, r->iterations, r->repetitions,
+               r->mean, r->min, r->p50, r->p90, r->p99, r->max);
+    else if (strcmp(format, "json") == 0)
+        printf("%s  {\"group\": \"%s\", \"name\": \"%s\", \"iterations\": %ld, \"repetitions\": %d, "
+               "\"mean_ns\": %.3f, \"min_ns\": %.3f, \"p50_ns\": %.3f, \"p90_ns\": %.3f, \"p99_ns\": %.3f, \"max_ns\": %.3f}",
+               first ? "" : ",\n", c->group, c->name, r->iterations, r->repetitions,
+               r->mean, r->min, r->p50, r->p90, r->p99, r->max);
+    else
+        printf("%-10s %-24s %10ld %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f\n", c->group, c->name, r->iterations,
+               r->mean, r->min, r->p50, r->p90, r->p99, r->max);
+}
+
+int main(int argc, char **argv)
+{
+    const char *format = "text", *filter_name = NULL;
+    int repetitions = 50, warmup_ms = 100, opt, first = 1;
+    unsigned int i;
+    result_t result;
+
+    while ((opt = getopt(argc, argv, "o:r:w:f:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'o':
+            format = optarg;
+            break;
+        case 'r':
+            repetitions = atoi(optarg);
+            break;
+        case 'w':
+            warmup_ms = atoi(optarg);
+            break;
+        case 'f':
+            filter_name = optarg;
+            break;
+        default:
+            repetitions = 0;
+        }
+    }
+    if (repetitions < 1 || repetitions > MAX_REPETITIONS || warmup_ms < 0 ||
+        (strcmp(format, "text") && strcmp(format, "csv") && strcmp(format, "json")))
+    {
+        fprintf(stderr, "usage: %s [-o text|csv|json] [-r repetitions] [-w warmup_ms] [-f filter]\n", argv[0]);
+        return 1;
+    }
+
+    make_inputs();
+    setup_bus();
+    print_header(format);
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        const bench_case_t *c = &cases[i];
+
+        // a filter picks a group or any case with it in the name
+        if (filter_name && strcmp(filter_name, c->group) && !strstr(c->name, filter_name))
+            continue;
+        measure(c, repetitions, warmup_ms * 1000000ull, &result);
+        print_result(format, c, &result, first);
+        first = 0;
+    }
+    if (strcmp(format, "json") == 0)
+        printf("\n]\n");
+    i2c_bus_close();
+    return 0;
+}
@@ -0,0 +1,146 @@
+/**
+ * Rate and jitter of a fixed rate loop, a relative usleep() per cycle like
+ * the old loops against the absolute deadline runner under both overrun
+ * policies, with or without busy threads loading the machine.
+ *
+ * The loop body takes a tenth of the period and every STALL_EVERY cycles
+ * stalls for three periods. With -P the runner asks for SCHED_FIFO and
+ * mlockall(), that needs root or CAP_SYS_NICE.
+ *
+ *   make bench && ./bench/periodic_bench [-r rate_hz] [-s seconds] [-l load_threads] [-P priority]
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "../sched/periodic.h"
+#include "../stats/clock.h"
+
+#define STALL_EVERY 250
+
+static int rate = 1000;
+static int seconds = 2;
+static atomic_int loading;
+
+static void busy(uint64_t ns)
+{
+    uint64_t until = clock_now_ns() + ns;
+
+    while (clock_now_ns() < until)
+        ;
+}
+
+static void *load_run(void *arg)
+{
+    volatile unsigned long spins = 0;
+
+    while (atomic_load(&loading))
+        spins++;
+    return NULL;
+}
+
+static void body(unsigned long cycle, uint64_t period)
+{
+    busy(cycle % STALL_EVERY == STALL_EVERY - 1 ? 3 * period : period / 10);
+}
+
+static void report(const char *mode, unsigned long cycles, uint64_t elapsed, uint64_t jitter_sum, uint64_t jitter_max, unsigned long overruns)
+{
+    printf("%-10s %8lu %10.1f %12.1f %12.1f %9lu\n", mode, cycles, cycles * 1e9 / elapsed,
+           jitter_sum / 1000.0 / (cycles > 1 ? cycles - 1 : 1), jitter_max / 1000.0, overruns);
+}
+
+/**
+ * The old way, sleep a period after the body, the body time adds up.
+ */
+static void run_relative(uint64_t period)
+{
+    uint64_t start = clock_now_ns(), last = 0, now, jitter, jitter_sum = 0, jitter_max = 0;
+    unsigned long cycles = 0;
+
+    while ((now = clock_now_ns()) - start < seconds * 1000000000ull)
+    {
+        if (last)
+        {
+            jitter = now - last > period ? now - last - period : period - (now - last);
+            jitter_sum += jitter;
+            jitter_max = jitter > jitter_max ? jitter : jitter_max;
+        }
+        last = now;
+        body(cycles++, period);
+        usleep(period / 1000);
+    }
+    report("usleep", cycles, clock_now_ns() - start, jitter_sum, jitter_max, 0);
+}
+
+static void run_periodic(const char *mode, periodic_config_t *config)
+{
+    periodic_t loop;
+    uint64_t start;
+
+    periodic_init(&loop, config);
+    start = clock_now_ns();
+    while (clock_now_ns() - start < seconds * 1000000000ull)
+    {
+        periodic_wait(&loop);
+        body(loop.cycles, config->period);
+    }
+    report(mode, loop.cycles, clock_now_ns() - start, loop.jitter_sum, loop.jitter_max, loop.overruns);
+    periodic_print(&loop, mode);
+}
+
+int main(int argc, char **argv)
+{
+    periodic_config_t config = {0, PERIODIC_CATCH_UP, 0, 0, -1};
+    pthread_t *threads;
+    int load = 0, i, opt;
+
+    while ((opt = getopt(argc, argv, "r:s:l:P:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'r':
+            rate = atoi(optarg);
+            break;
+        case 's':
+            seconds = atoi(optarg);
+            break;
+        case 'l':
+            load = atoi(optarg);
+            break;
+        case 'P':
+            config.priority = atoi(optarg);
+            config.lock_memory = config.priority > 0;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-r rate_hz] [-s seconds] [-l load_threads] [-P priority]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (rate <= 0 || seconds <= 0 || load < 0)
+        return 1;
+    config.period = 1000000000ull / rate;
+
+    atomic_init(&loading, 1);
+    threads = calloc(load ? load : 1, sizeof(*threads));
+    for (i = 0; i < load; i++)
+        pthread_create(&threads[i], NULL, load_run, NULL);
+
+    printf("%-10s %8s %10s %12s %12s %9s\n", "mode", "cycles", "rate_hz", "jitter_us", "max_jitter_us", "overruns");
+    run_relative(config.period);
+    run_periodic("catchup", &config);
+    config.policy = PERIODIC_SKIP;
+    run_periodic("skip", &config);
+
+    atomic_store(&loading, 0);
+    for (i = 0; i < load; i++)
+        pthread_join(threads[i], NULL);
+    free(threads);
+    return 0;
+}
@@ -0,0 +1,150 @@
+/**
+ * Acquisition timing with a stalling output, read-fuse-print on one thread
+ * against the acquisition/fusion/publisher pipeline.
+ *
+ * A fake sensor is read on a fixed schedule, the publisher stalls for a
+ * while every so many attitudes like stdout on a pipe nobody drains. The
+ * lateness of every read against its schedule is what the output stalls
+ * cost the sensor timing.
+ *
+ *   make bench && ./bench/pipeline_bench [rate_hz] [seconds] [stall_ms]
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../MahonyAHRS.h"
+#include "../pipeline/pipeline.h"
+#include "../stats/clock.h"
+
+#define STALL_EVERY 100 // attitudes between publisher stalls
+
+static int rate = 1000;
+static int seconds = 2;
+static int stall_ms = 20;
+
+static uint64_t next_read;   // schedule of the fake sensor, CLOCK_MONOTONIC ns
+static uint64_t reads_left;
+static uint64_t late_max, late_sum, late_count;
+static mahony_filter_t filter;
+static uint64_t last_fused;
+static unsigned long publishes;
+
+/**
+ * One reading per period, a read that is already late goes ahead at once
+ * and its lateness is recorded.
+ */
+static int acquire(void *context, pipeline_sample_t *samples, int max)
+{
+    struct timespec ts = {next_read / 1000000000ull, next_read % 1000000000ull};
+    uint64_t now, late;
+
+    if (reads_left == 0)
+        return -1;
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+    now = clock_now_ns();
+    late = now - next_read;
+    late_max = late > late_max ? late : late_max;
+    late_sum += late;
+    late_count++;
+
+    samples[0].timestamp = now;
+    samples[0].gx = 10;
+    samples[0].gy = -5;
+    samples[0].gz = 3;
+    samples[0].ax = 100;
+    samples[0].ay = -200;
+    samples[0].az = 8192;
+    samples[0].mx = 200;
+    samples[0].my = -120;
+    samples[0].mz = 400;
+    next_read += 1000000000ull / rate;
+    reads_left--;
+    return 1;
+}
+
+static void fuse(void *context, const pipeline_sample_t *sample, pipeline_attitude_t *attitude)
+{
+    float dt = last_fused ? (sample->timestamp - last_fused) * 1e-9f : 0.0f;
+
+    last_fused = sample->timestamp;
+    mahony_filter_update_dt(&filter, sample->gx, sample->gy, sample->gz, sample->ax, sample->ay, sample->az,
+                            sample->mx, sample->my, sample->mz, dt);
+    attitude->timestamp = sample->timestamp;
+    attitude->fused = clock_now_ns();
+    attitude->roll = mahony_filter_get_roll(&filter);
+    attitude->pitch = mahony_filter_get_pitch(&filter);
+    attitude->yaw = mahony_filter_get_yaw(&filter);
+}
+
+static void publish(void *context, const pipeline_attitude_t *attitude)
+{
+    if (++publishes % STALL_EVERY == 0)
+        usleep(stall_ms * 1000);
+}
+
+static void reset(void)
+{
+    mahony_filter_init(&filter, NULL);
+    last_fused = 0;
+    publishes = 0;
+    late_max = late_sum = late_count = 0;
+    reads_left = (uint64_t)rate * seconds;
+    next_read = clock_now_ns() + 1000000;
+}
+
+static void report(const char *mode, unsigned long drops, size_t high_water)
+{
+    printf("%-10s %8lu %12.1f %12.1f %8lu %10zu\n", mode, (unsigned long)late_count,
+           late_sum / 1000.0 / late_count, late_max / 1000.0, drops, high_water);
+}
+
+int main(int argc, char **argv)
+{
+    pipeline_config_t config = {acquire, fuse, publish, NULL, -1, 0, 0};
+    pipeline_sample_t sample;
+    pipeline_attitude_t attitude;
+    pipeline_t pipeline;
+
+    if (argc > 1)
+        rate = atoi(argv[1]);
+    if (argc > 2)
+        seconds = atoi(argv[2]);
+    if (argc > 3)
+        stall_ms = atoi(argv[3]);
+    if (rate <= 0 || seconds <= 0 || stall_ms < 0)
+    {
+        fprintf(stderr, "usage: %s [rate_hz] [seconds] [stall_ms]\n", argv[0]);
+        return 1;
+    }
+
+    printf("%-10s %8s %12s %12s %8s %10s\n", "mode", "reads", "late_us", "max_late_us", "drops", "high_water");
+
+    reset();
+    while (acquire(NULL, &sample, 1) == 1)
+    {
+        fuse(NULL, &sample, &attitude);
+        publish(NULL, &attitude);
+    }
+    report("serial", 0, 0);
+
+    reset();
+    if (pipeline_start(&pipeline, &config) != 0)
+    {
+        fprintf(stderr, "Failed to start the pipeline\n");
+        return 1;
+    }
+    while (pipeline_running(&pipeline))
+        usleep(10000);
+    pipeline_stop(&pipeline);
+    report("pipeline", pipeline.samples.drops + pipeline.attitudes.drops,
+           pipeline.attitudes.high_water);
+    printf("pipeline: %lu acquired, %lu fused, %lu published, sample high-water %zu\n",
+           pipeline.acquired, pipeline.fused, pipeline.published, pipeline.samples.high_water);
+    return 0;
+}
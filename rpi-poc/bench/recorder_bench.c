@@ -0,0 +1,137 @@
+/**
+ * Flight data recorder hot path and crash recovery.
+ *
+ * Records are appended flat out into small segments so the run rotates
+ * through several of them, the cost per append and the slowest one show
+ * whether the writer ever waits on the disk. A child process then records
+ * and dies without stopping the recorder, everything it appended has to be
+ * recovered from its unclosed segments.
+ *
+ *   make bench && ./bench/recorder_bench [records] [directory]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "../recorder/recorder.h"
+#include "../stats/clock.h"
+
+#define SEGMENT_RECORDS 65536
+
+static long count = 1000000;
+static const char *directory = "/tmp";
+
+static void make_record(recorder_record_t *record, long i)
+{
+    memset(record, 0, sizeof(*record));
+    record->timestamp = 1000000000ull + i * 1000000ull;
+    record->flags = RECORDER_RAW | RECORDER_FUSED;
+    record->ax = i;
+    record->gy = -i;
+    record->mz = 400;
+    record->q0 = 1.0f;
+    record->roll = i * 0.001f;
+}
+
+/**
+ * Records in the segments of a recorder run with max_segments files, the
+ * sequence numbers have to be consecutive across them.
+ */
+static long read_back(uint32_t segments, long *gaps, uint32_t *recovered)
+{
+    recorder_reader_t reader;
+    char path[256];
+    long records = 0, expected = -1;
+    uint32_t segment, i;
+
+    *gaps = 0;
+    *recovered = 0;
+    for (segment = 0; segment < segments; segment++)
+    {
+        snprintf(path, sizeof(path), "%s/flight-%06u.fdr", directory, segment);
+        if (recorder_open(&reader, path) != 0)
+            continue;
+        for (i = 0; i < reader.count; i++)
+        {
+            if (expected >= 0 && reader.records[i].sequence != (uint32_t)expected)
+                (*gaps)++;
+            expected = reader.records[i].sequence + 1;
+        }
+        records += reader.count;
+        *recovered += reader.recovered;
+        recorder_close(&reader);
+        unlink(path);
+    }
+    return records;
+}
+
+int main(int argc, char **argv)
+{
+    recorder_config_t config = {NULL, SEGMENT_RECORDS, 0, 100, 0.0f};
+    recorder_t recorder;
+    recorder_record_t record;
+    uint64_t start, call, slowest = 0;
+    long i, records, gaps, crash_count;
+    uint32_t recovered, segments;
+    double elapsed;
+    pid_t child;
+    int status, ok = 1;
+
+    if (argc > 1)
+        count = atol(argv[1]);
+    if (argc > 2)
+        directory = argv[2];
+    config.directory = directory;
+    if (count <= 0)
+    {
+        fprintf(stderr, "usage: %s [records] [directory]\n", argv[0]);
+        return 1;
+    }
+
+    if (recorder_start(&recorder, &config) != 0)
+        return 1;
+    start = clock_now_ns();
+    for (i = 0; i < count; i++)
+    {
+        make_record(&record, i);
+        call = clock_now_ns();
+        recorder_append(&recorder, &record);
+        call = clock_now_ns() - call;
+        slowest = call > slowest ? call : slowest;
+    }
+    elapsed = (double)(clock_now_ns() - start) / count;
+    recorder_stop(&recorder);
+    segments = recorder.segments;
+    records = read_back(segments, &gaps, &recovered);
+    ok &= records + (long)recorder.dropped == count && gaps == 0;
+
+    printf("%-10s %10s %10s %10s %10s %8s %8s\n", "run", "ns/append", "max_us", "records", "dropped", "segments", "syncs");
+    printf("%-10s %10.1f %10.1f %10ld %10lu %8u %8lu\n", "append", elapsed, slowest / 1000.0,
+           records, (unsigned long)recorder.dropped, segments, (unsigned long)recorder.syncs);
+
+    // a crash leaves the segments open, with the synced count behind
+    crash_count = SEGMENT_RECORDS + SEGMENT_RECORDS / 2 + 17;
+    if ((child = fork()) == 0)
+    {
+        config.sync_interval = 60000;
+        if (recorder_start(&recorder, &config) != 0)
+            _exit(1);
+        for (i = 0; i < crash_count; i++)
+        {
+            make_record(&record, i);
+            while (recorder_append(&recorder, &record) != 0)
+                usleep(1000); // the next segment is not ready yet, keep them all
+        }
+        _exit(0);
+    }
+    waitpid(child, &status, 0);
+    records = read_back(3, &gaps, &recovered);
+    ok &= WIFEXITED(status) && WEXITSTATUS(status) == 0 && records == crash_count && gaps == 0;
+    printf("crash: %ld of %ld records read back, %u recovered past the synced count, %ld gaps\n",
+           records, crash_count, recovered, gaps);
+    return ok ? 0 : 1;
+}
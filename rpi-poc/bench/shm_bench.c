@@ -0,0 +1,148 @@
+/**
+ * Shared memory attitude publication under concurrent readers.
+ *
+ * A writer publishes records whose every field is derived from the sequence
+ * number, as fast as it can, while reader threads poll the latest record
+ * and follow the ring. A snapshot the seqlock let through with fields from
+ * two different records would break that relation, the run fails if a
+ * single one shows up. The writer cost is measured without and with the
+ * readers.
+ *
+ *   make bench && ./bench/shm_bench [records] [readers]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "../shm/attitude_shm.h"
+#include "../stats/clock.h"
+
+#define BENCH_SHM_NAME "/icaro_attitude_bench"
+
+static long count = 2000000;
+static atomic_int writing;
+
+typedef struct
+{
+    pthread_t thread;
+    unsigned long latest, followed, inconsistent, torn, lost;
+} reader_stats_t;
+
+static void make_record(telemetry_record_t *record, uint32_t i)
+{
+    record->timestamp = i * 1000ull;
+    record->q0 = record->q1 = record->q2 = record->q3 = (float)(i & 0xFFFF);
+    record->roll = (float)(i & 0xFFFF);
+    record->pitch = -(float)(i & 0xFFFF);
+    record->yaw = (float)(i & 0xFF);
+    record->ax = record->ay = record->az = (int16_t)i;
+    record->gx = record->gy = record->gz = (int16_t)~i;
+    record->mx = record->my = record->mz = (int16_t)(i >> 3);
+}
+
+static int consistent(const telemetry_record_t *record)
+{
+    telemetry_record_t expected;
+    uint32_t i = record->sequence;
+
+    make_record(&expected, i);
+    return record->timestamp == expected.timestamp &&
+           record->q0 == expected.q0 && record->q1 == expected.q0 && record->q2 == expected.q0 && record->q3 == expected.q0 &&
+           record->roll == expected.roll && record->pitch == expected.pitch && record->yaw == expected.yaw &&
+           record->ax == expected.ax && record->ay == expected.ax && record->az == expected.ax &&
+           record->gx == expected.gx && record->gy == expected.gx && record->gz == expected.gx &&
+           record->mx == expected.mx && record->my == expected.mx && record->mz == expected.mx;
+}
+
+static void *reader_run(void *arg)
+{
+    reader_stats_t *stats = arg;
+    attitude_shm_reader_t reader;
+    telemetry_record_t records[64];
+    int i, n;
+
+    if (attitude_shm_open(&reader, BENCH_SHM_NAME) != 0)
+        return NULL;
+    while (atomic_load(&writing))
+    {
+        if (attitude_shm_latest(&reader, records, NULL) == 0)
+        {
+            stats->latest++;
+            stats->inconsistent += !consistent(records);
+        }
+        n = attitude_shm_next(&reader, records, 64);
+        for (i = 0; i < n; i++)
+            stats->inconsistent += !consistent(&records[i]);
+        stats->followed += n;
+    }
+    stats->torn = reader.torn;
+    stats->lost = reader.lost;
+    attitude_shm_close(&reader);
+    return NULL;
+}
+
+static double publish_all(attitude_shm_writer_t *writer)
+{
+    attitude_shm_stats_t stats = {0, 0, 1000.0f, 0};
+    telemetry_record_t record = {0};
+    double start = clock_now_ns();
+    long i;
+
+    for (i = 0; i < count; i++)
+    {
+        make_record(&record, writer->published);
+        attitude_shm_publish(writer, &record, &stats);
+    }
+    return (clock_now_ns() - start) / count;
+}
+
+int main(int argc, char **argv)
+{
+    attitude_shm_writer_t writer;
+    reader_stats_t *readers;
+    unsigned long inconsistent = 0;
+    int reader_count = 2, i;
+    double alone, shared;
+
+    if (argc > 1)
+        count = atol(argv[1]);
+    if (argc > 2)
+        reader_count = atoi(argv[2]);
+    readers = calloc(reader_count > 0 ? reader_count : 1, sizeof(*readers));
+    if (count <= 0 || reader_count < 0 || readers == NULL)
+    {
+        fprintf(stderr, "usage: %s [records] [readers]\n", argv[0]);
+        return 1;
+    }
+
+    if (attitude_shm_create(&writer, BENCH_SHM_NAME) != 0)
+        return 1;
+    alone = publish_all(&writer);
+
+    atomic_init(&writing, 1);
+    for (i = 0; i < reader_count; i++)
+        pthread_create(&readers[i].thread, NULL, reader_run, &readers[i]);
+    usleep(10000);
+    shared = publish_all(&writer);
+    atomic_store(&writing, 0);
+
+    printf("%-10s %12s\n", "writer", "ns/publish");
+    printf("%-10s %12.1f\n", "alone", alone);
+    printf("%-10s %12.1f\n", "readers", shared);
+    printf("%-8s %12s %12s %8s %10s %12s\n", "reader", "latest", "followed", "torn", "lost", "inconsistent");
+    for (i = 0; i < reader_count; i++)
+    {
+        pthread_join(readers[i].thread, NULL);
+        printf("%-8d %12lu %12lu %8lu %10lu %12lu\n", i, readers[i].latest, readers[i].followed,
+               readers[i].torn, readers[i].lost, readers[i].inconsistent);
+        inconsistent += readers[i].inconsistent;
+    }
+
+    attitude_shm_destroy(&writer);
+    free(readers);
+    return inconsistent == 0 ? 0 : 1;
+}
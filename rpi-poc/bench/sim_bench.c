@@ -0,0 +1,195 @@
+/**
+ * The sensor drivers against the simulated bus (i2c/sim_bus.c) with the
+ * MPU6050 and HMC5883L register models, no hardware needed.
+ *
+ * A constant motion first has to come back through the drivers as the raw
+ * counts the configured full scales give. Then the acquisition loop of
+ * main.c (motion 6 plus heading in one batch, then the filter) runs flat out
+ * with the bus at no cost, 1 MHz, 400 kHz and 100 kHz, so the share of the
+ * loop the bus takes shows at each clock, and once with a failing
+ * transaction every 100. Last the FIFO is drained at 1 kHz and the frames
+ * received are checked against the sample clock.
+ *
+ *   make bench && ./bench/sim_bench [-d seconds]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "../i2c/I2Cdev.h"
+#include "../i2c/sim_bus.h"
+#include "../sensors/mpu6050.h"
+#include "../sensors/mpu6050_registers.h"
+#include "../sensors/hcm5883l.h"
+#include "../sensors/sim_motion.h"
+#include "../sensors/mpu6050_sim.h"
+#include "../sensors/hcm5883l_sim.h"
+#include "../MahonyAHRS.h"
+#include "../stats/clock.h"
+
+static const sim_motion_t still = {0.5, -0.25, 0.75, 10.0, -20.0, 30.0, 0.2, -0.1, 0.4};
+
+static i2c_sim_bus_t bus;
+static mpu6050_sim_t mpu;
+static hcm5883l_sim_t mag;
+static double duration = 1.0;
+
+static void constant_sample(void *context, uint64_t t, sim_motion_t *motion)
+{
+    *motion = still;
+}
+
+static void setup(const sim_motion_source_t *source)
+{
+    i2c_sim_device_t device;
+    uint64_t origin = clock_now_ns();
+
+    i2c_sim_bus_init(&bus);
+    mpu6050_sim_init(&mpu, source, origin, &bus);
+    mpu6050_sim_device(&mpu, &device);
+    i2c_sim_bus_attach(&bus, &device);
+    hcm5883l_sim_init(&mag, source, origin);
+    hcm5883l_sim_device(&mag, &device);
+    i2c_sim_bus_attach(&bus, &device);
+    i2c_bus_set_backend(i2c_sim_bus_backend(&bus));
+    i2c_bus_open(0);
+    mpu6050_initialize();
+    hcm5883l_initialize();
+}
+
+/**
+ * Counts the drivers read for the constant motion against the ones the
+ * power-on full scales give: 16384 LSB/g, 131 LSB/degree/s, 1090 LSB/Gauss.
+ */
+static int check_scaling(void)
+{
+    sim_motion_source_t source = {constant_sample, NULL};
+    int16_t ax, ay, az, gx, gy, gz, mx, my, mz;
+    int errors = 0;
+
+    setup(&source);
+    usleep(2 * HMC5883L_SIM_MEASUREMENT_NS / 1000);
+    mpu6050_get_motion_6(&ax, &ay, &az, &gx, &gy, &gz);
+    getHeading(&mx, &my, &mz);
+    i2c_bus_close();
+
+    errors += ax != 8192 || ay != -4096 || az != 12288;
+    errors += gx != 1310 || gy != -2620 || gz != 3930;
+    errors += mx != 218 || my != -109 || mz != 436;
+    printf("scaling: accel %d %d %d, gyro %d %d %d, mag %d %d %d: %s\n",
+           ax, ay, az, gx, gy, gz, mx, my, mz, errors ? "FAIL" : "OK");
+    return errors;
+}
+
+/**
+ * The acquisition loop of main.c for the bench duration.
+ */
+static int run_loop(const char *name, unsigned int khz, unsigned long fail_every)
+{
+    uint8_t motion[MPU6050_MOTION_6_LENGTH], heading[HMC5883L_HEADING_LENGTH];
+    float gyro_scale = 3.14159f / 180.0f / 131.0f;
+    unsigned long loops = 0, failed = 0, transactions;
+    uint64_t start, now, last;
+    mahony_filter_t filter;
+    i2c_batch_t batch;
+
+    i2c_sim_bus_set_speed(&bus, khz);
+    bus.fail_every = fail_every;
+    transactions = bus.transactions;
+    mahony_filter_init(&filter, NULL);
+    i2c_batch_init(&batch);
+    mpu6050_batch_motion_6(&batch, motion);
+    hcm5883l_batch_heading(&batch, heading);
+
+    start = last = clock_now_ns();
+    do
+    {
+        int16_t ax, ay, az, gx, gy, gz, mx, my, mz;
+
+        if (i2c_batch_submit(&batch) != I2C_OK)
+        {
+            failed++;
+            now = clock_now_ns();
+            continue;
+        }
+        now = clock_now_ns();
+        mpu6050_decode_motion_6(motion, &ax, &ay, &az, &gx, &gy, &gz);
+        hcm5883l_decode_heading(heading, &mx, &my, &mz);
+        mahony_filter_update_dt(&filter, gx * gyro_scale, gy * gyro_scale, gz * gyro_scale,
+                                ax, ay, az, mx, my, mz, (now - last) * 1e-9f);
+        last = now;
+        loops++;
+    } while (now - start < duration * 1e9);
+
+    printf("%-10s %10.0f %10.1f %12.2f %8lu\n", name, loops / duration,
+           (now - start) / 1e3 / (loops + failed), (double)(bus.transactions - transactions) / (loops + failed), failed);
+    bus.fail_every = 0;
+    return fail_every && failed == 0;
+}
+
+/**
+ * Drain the FIFO at 1 kHz like acquire_fifo() in main.c.
+ */
+static int run_fifo(void)
+{
+    static mpu6050_sample_t samples[MPU6050_FIFO_SIZE / MPU6050_FIFO_FRAME_LENGTH];
+    unsigned long frames = 0, expected;
+    uint64_t start;
+    int n;
+
+    i2c_sim_bus_set_speed(&bus, 400);
+    if (mpu6050_fifo_enable(1000, MPU6050_DLPF_BW_188) != I2C_OK)
+        return 1;
+    start = clock_now_ns();
+    // frames already queued plus the ones produced from here on
+    expected = mpu.fifo_count / MPU6050_FIFO_FRAME_LENGTH - mpu.produced;
+    while (clock_now_ns() - start < duration * 1e9)
+    {
+        n = mpu6050_fifo_read(samples, sizeof(samples) / sizeof(samples[0]));
+        frames += n > 0 ? n : 0;
+        usleep(MPU6050_FIFO_CHUNK_FRAMES * 1000);
+    }
+    expected += mpu.produced - mpu.fifo_count / MPU6050_FIFO_FRAME_LENGTH;
+    mpu6050_fifo_disable();
+    printf("fifo: %lu frames at %u Hz, %lu produced and not left queued, %lu overflows: %s\n",
+           frames, mpu6050_get_rate(), expected, mpu6050_fifo_overflows(),
+           frames == expected && mpu6050_fifo_overflows() == 0 ? "OK" : "FAIL");
+    return frames != expected || mpu6050_fifo_overflows() != 0;
+}
+
+int main(int argc, char **argv)
+{
+    sim_motion_synthetic_t synthetic;
+    sim_motion_source_t source;
+    int opt, errors;
+
+    while ((opt = getopt(argc, argv, "d:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'd':
+            duration = atof(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-d seconds]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    errors = check_scaling();
+
+    sim_motion_synthetic_source(&source, &synthetic, 0.01);
+    setup(&source);
+    printf("%-10s %10s %10s %12s %8s\n", "bus", "loops/s", "us/loop", "transfers", "failed");
+    errors += run_loop("free", 0, 0);
+    errors += run_loop("1MHz", 1000, 0);
+    errors += run_loop("400kHz", 400, 0);
+    errors += run_loop("100kHz", 100, 0);
+    errors += run_loop("400k-fail", 400, 100);
+    errors += run_fifo();
+    printf("bus: %lu transactions, %lu bytes, %lu errors\n", bus.transactions, bus.bytes, bus.errors);
+    i2c_bus_close();
+    return errors ? 1 : 0;
+}
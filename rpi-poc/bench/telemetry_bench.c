@@ -0,0 +1,184 @@
+/**
+ * Cost per attitude record of the text output (vsnprintf of the floats and a
+ * write() per message, like comm_write()) against the binary telemetry
+ * (fixed layout, CRC, COBS and batched writes), both written to /dev/null,
+ * plus the decoder. The decoded stream is checked against what was written,
+ * and a corrupted copy has to lose exactly the damaged records.
+ *
+ *   make bench && ./bench/telemetry_bench [records]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../comm/telemetry.h"
+#include "../stats/clock.h"
+
+static long count = 200000;
+static telemetry_record_t *records;
+static unsigned long text_bytes;
+
+static void make_records(void)
+{
+    long i;
+
+    for (i = 0; i < count; i++)
+    {
+        telemetry_record_t *r = &records[i];
+        float t = i / 1000.0f;
+
+        memset(r, 0, sizeof(*r));
+        r->timestamp = 1000000000ull + i * 1000000ull;
+        r->q0 = cosf(t);
+        r->q1 = sinf(t) * 0.5f;
+        r->q2 = sinf(t) * 0.5f;
+        r->q3 = sinf(t) * 0.70710677f;
+        r->roll = 40.0f * sinf(t);
+        r->pitch = 30.0f * cosf(t);
+        r->yaw = 180.0f + 90.0f * sinf(0.3f * t);
+        r->ax = i;
+        r->ay = -i;
+        r->az = 8192;
+        r->gx = i * 3;
+        r->gy = 0;
+        r->gz = -7;
+        r->mx = 200;
+        r->my = -120;
+        r->mz = 400;
+    }
+}
+
+static void text_write(int fd, char *format, ...)
+{
+    char buffer[512];
+    int length;
+    va_list args;
+
+    va_start(args, format);
+    length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (write(fd, buffer, length) != length)
+        exit(1);
+    text_bytes += length;
+}
+
+static double run_text(int fd)
+{
+    double start = clock_now_ns();
+    long i;
+
+    for (i = 0; i < count; i++)
+    {
+        telemetry_record_t *r = &records[i];
+        text_write(fd, "%lu\t%llu\t%f\t%f\t%f\t%f\t%f\t%f\t%f\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\n",
+                   (unsigned long)i, (unsigned long long)r->timestamp,
+                   r->q0, r->q1, r->q2, r->q3, r->roll, r->pitch, r->yaw,
+                   r->ax, r->ay, r->az, r->gx, r->gy, r->gz, r->mx, r->my, r->mz);
+    }
+    return (clock_now_ns() - start) / count;
+}
+
+static double run_binary(int fd, telemetry_writer_t *writer)
+{
+    double start = clock_now_ns();
+    long i;
+
+    telemetry_writer_init(writer, fd);
+    for (i = 0; i < count; i++)
+        telemetry_write(writer, &records[i]);
+    telemetry_flush(writer);
+    return (clock_now_ns() - start) / count;
+}
+
+static int same(const telemetry_record_t *a, const telemetry_record_t *b)
+{
+    return a->type == b->type && a->sequence == b->sequence && a->timestamp == b->timestamp &&
+           a->q0 == b->q0 && a->q1 == b->q1 && a->q2 == b->q2 && a->q3 == b->q3 &&
+           a->roll == b->roll && a->pitch == b->pitch && a->yaw == b->yaw &&
+           a->ax == b->ax && a->ay == b->ay && a->az == b->az &&
+           a->gx == b->gx && a->gy == b->gy && a->gz == b->gz &&
+           a->mx == b->mx && a->my == b->my && a->mz == b->mz;
+}
+
+/**
+ * Number of decoded records that differ from the written ones.
+ */
+static long decode(const uint8_t *stream, size_t length, telemetry_decoder_t *decoder)
+{
+    telemetry_record_t record;
+    size_t used = 0;
+    long mismatches = 0;
+    int ready;
+
+    telemetry_decoder_init(decoder);
+    while (used < length)
+    {
+        used += telemetry_decoder_feed(decoder, stream + used, length - used, &record, &ready);
+        if (ready == TELEMETRY_ATTITUDE && (record.sequence >= (uint32_t)count || !same(&record, &records[record.sequence])))
+            mismatches++;
+    }
+    return mismatches;
+}
+
+int main(int argc, char **argv)
+{
+    telemetry_writer_t writer;
+    telemetry_decoder_t decoder;
+    double text_ns, binary_ns, decode_ns, start;
+    uint8_t *stream;
+    size_t length = 0;
+    long i, mismatches, corrupted = 0;
+    int null_fd;
+
+    if (argc > 1)
+        count = atol(argv[1]);
+    records = count > 0 ? malloc(count * sizeof(*records)) : NULL;
+    stream = count > 0 ? malloc(count * TELEMETRY_FRAME_MAX) : NULL;
+    null_fd = open("/dev/null", O_WRONLY);
+    if (records == NULL || stream == NULL || null_fd < 0)
+    {
+        fprintf(stderr, "usage: %s [records]\n", argv[0]);
+        return 1;
+    }
+    make_records();
+
+    text_ns = run_text(null_fd);
+    binary_ns = run_binary(null_fd, &writer);
+
+    // the same stream again into memory for the decoder
+    for (i = 0; i < count; i++)
+        length += telemetry_encode(&records[i], i, stream + length);
+    for (i = 0; i < count; i++)
+        records[i].sequence = i;
+    start = clock_now_ns();
+    mismatches = decode(stream, length, &decoder);
+    decode_ns = (clock_now_ns() - start) / count;
+
+    printf("%-8s %12s %14s %10s\n", "path", "ns/record", "bytes/record", "writes");
+    printf("%-8s %12.1f %14.1f %10ld\n", "text", text_ns, (double)text_bytes / count, count);
+    printf("%-8s %12.1f %14.1f %10lu\n", "binary", binary_ns, (double)length / count, writer.writes);
+    printf("%-8s %12.1f\n", "decode", decode_ns);
+    printf("decoded %lu records, %ld mismatches, %lu crc errors, %lu frame errors\n",
+           decoder.records, mismatches, decoder.crc_errors, decoder.frame_errors);
+
+    // flip a byte in every 1000th frame, each must cost exactly that record
+    for (i = 0; i < (long)length; i += 1000 * (length / count))
+    {
+        stream[i + 10] ^= 0x5A;
+        corrupted++;
+    }
+    decode(stream, length, &decoder);
+    printf("corrupted %ld frames: %lu records, %lu lost, %lu crc errors, %lu frame errors\n",
+           corrupted, decoder.records, decoder.lost, decoder.crc_errors, decoder.frame_errors);
+
+    close(null_fd);
+    free(records);
+    free(stream);
+    return mismatches == 0 && decoder.records + corrupted == (unsigned long)count ? 0 : 1;
+}
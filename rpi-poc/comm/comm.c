@@ -1,41 +1,289 @@
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <limits.h>
+#include <signal.h>
+#include <errno.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <stdint.h>
 
 #include "comm.h"
+#include "../stats/clock.h"
 
-int fd;
+#if COMM_QUEUE < PIPE_BUF || (COMM_QUEUE & (COMM_QUEUE - 1)) || (COMM_QUEUE_MESSAGES & (COMM_QUEUE_MESSAGES - 1))
+#error "COMM_QUEUE must be a power of two of at least PIPE_BUF, COMM_QUEUE_MESSAGES a power of two"
+#endif
+
+static char fifo_path[PATH_MAX];
+static int fd = -1;
+static uint64_t next_open;              // earliest time to retry open()
+static comm_drop_policy_t drop_policy = COMM_DROP_OLDEST;
+static comm_stats_t stats;
+
+// free running counters, masked to index the arrays
+static uint8_t queue[COMM_QUEUE];
+static size_t queue_head, queue_tail;
+static uint16_t lengths[COMM_QUEUE_MESSAGES];
+static size_t message_head, message_tail;
+
+static uint32_t sequence;               // of the next telemetry record
+static uint64_t batch_start;            // timestamp of the first record since the last flush
+static size_t batch_bytes;              // bytes queued since the last flush
+
+static int comm_connect()
+{
+    uint64_t now = clock_now_ns();
+
+    if (now < next_open)
+    {
+        return -1;
+    }
+    next_open = now + COMM_RECONNECT_INTERVAL;
+    // ENXIO until a reader opens the pipe
+    if ((fd = open(fifo_path, O_WRONLY | O_NONBLOCK | O_CLOEXEC)) < 0)
+    {
+        return -1;
+    }
+    stats.connects++;
+    stats.connected = 1;
+    return 0;
+}
+
+static void comm_disconnect()
+{
+    close(fd);
+    fd = -1;
+    stats.disconnects++;
+    stats.connected = 0;
+}
+
+static void drop_oldest()
+{
+    size_t length = lengths[message_head++ & (COMM_QUEUE_MESSAGES - 1)];
+
+    queue_head += length;
+    stats.dropped++;
+    stats.dropped_bytes += length;
+}
+
+/**
+ * Queue one message, the drop policy makes room when the ring is full.
+ * Returns 0, -1 when the message was dropped.
+ */
+static int enqueue(const void *data, size_t length)
+{
+    size_t offset = queue_tail & (COMM_QUEUE - 1);
+    size_t first = length < COMM_QUEUE - offset ? length : COMM_QUEUE - offset;
+
+    if (length == 0 || length > PIPE_BUF)
+    {
+        return -1;
+    }
+    while (queue_tail - queue_head + length > COMM_QUEUE || message_tail - message_head == COMM_QUEUE_MESSAGES)
+    {
+        if (drop_policy == COMM_DROP_NEWEST)
+        {
+            stats.dropped++;
+            stats.dropped_bytes += length;
+            return -1;
+        }
+        drop_oldest();
+    }
+
+    memcpy(queue + offset, data, first);
+    memcpy(queue, (const uint8_t *)data + first, length - first);
+    queue_tail += length;
+    lengths[message_tail++ & (COMM_QUEUE_MESSAGES - 1)] = length;
+    stats.queued++;
+    if (queue_tail - queue_head > stats.high_water)
+    {
+        stats.high_water = queue_tail - queue_head;
+    }
+    return 0;
+}
+
+/**
+ * Creates the pipe if needed and tries to open it, without a reader the
+ * output is queued and the open retried on later writes.
+ */
+int comm_open_fifo(const char *path)
+{
+    snprintf(fifo_path, sizeof(fifo_path), "%s", path);
+    if (mkfifo(fifo_path, 0666) != 0 && errno != EEXIST)
+    {
+        return -1;
+    }
+    // a reader closing its end must not kill the sensor loop
+    signal(SIGPIPE, SIG_IGN);
+    next_open = 0;
+    comm_connect();
+    return 0;
+}
 
 void comm_open()
 {
-    mkfifo("/tmp/myfifo", 0666);
-    if ((fd = open("/tmp/myfifo", O_WRONLY)) < 0)
+    if (comm_open_fifo(COMM_FIFO_PATH) != 0)
     {
-        err("open")
+        err("mkfifo")
     }
 }
 
-void comm_write(char *format, ...)
+void comm_set_drop_policy(comm_drop_policy_t policy)
+{
+    drop_policy = policy;
+}
+
+int comm_write(char *format, ...)
 {
     char buffer[512];
+    int length;
     va_list args;
     va_start(args, format);
-    vsprintf(buffer, format, args);
+    length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
 
-    if (write(fd, buffer, strlen(buffer)) != strlen(buffer))
+    if (length >= (int)sizeof(buffer))
     {
-        err("write");
+        length = sizeof(buffer) - 1;
     }
+    if (enqueue(buffer, length) != 0)
+    {
+        comm_flush();
+        return -1;
+    }
+    return comm_flush();
+}
 
-    va_end(args);
+/**
+ * Binary telemetry, one frame per message, written out once about PIPE_BUF
+ * bytes were queued since the last write or the records span TELEMETRY_MAX_DELAY, see telemetry.h.
+ * Records dropped from the queue show up as lost in the decoder.
+ */
+static int write_frame(const uint8_t *frame, size_t length, uint64_t timestamp)
+{
+    int result = enqueue(frame, length);
+
+    if (batch_bytes == 0)
+    {
+        batch_start = timestamp;
+    }
+    batch_bytes += length;
+    // a full pipe is retried once per batch, not on every record
+    if (batch_bytes >= PIPE_BUF || timestamp - batch_start >= TELEMETRY_MAX_DELAY)
+    {
+        result |= comm_flush();
+    }
+    return result;
+}
+
+int comm_write_record(telemetry_record_t *record)
+{
+    uint8_t frame[TELEMETRY_FRAME_MAX];
+
+    return write_frame(frame, telemetry_encode(record, sequence++, frame), record->timestamp);
+}
+
+/**
+ * Loop statistics in the same stream and sequence as the records.
+ */
+int comm_write_stats(telemetry_stats_t *stats)
+{
+    uint8_t frame[TELEMETRY_FRAME_MAX];
+
+    return write_frame(frame, telemetry_encode_stats(stats, sequence++, frame), stats->timestamp);
+}
+
+/**
+ * Writes queued messages until the queue is empty or the pipe is full.
+ * Returns 0, -1 without a reader, the messages not written stay queued.
+ */
+int comm_flush()
+{
+    struct iovec iov[2];
+    size_t bytes, messages, offset;
+    ssize_t written;
+
+    batch_bytes = 0;
+    if (message_head == message_tail)
+    {
+        return 0;
+    }
+    if (fd < 0 && comm_connect() != 0)
+    {
+        return -1;
+    }
+
+    while (message_head != message_tail)
+    {
+        // whole messages up to PIPE_BUF, a pipe write that size is atomic
+        for (bytes = 0, messages = 0; message_head + messages != message_tail; messages++)
+        {
+            size_t length = lengths[(message_head + messages) & (COMM_QUEUE_MESSAGES - 1)];
+            if (bytes + length > PIPE_BUF)
+            {
+                break;
+            }
+            bytes += length;
+        }
+        offset = queue_head & (COMM_QUEUE - 1);
+        iov[0].iov_base = queue + offset;
+        iov[0].iov_len = bytes < COMM_QUEUE - offset ? bytes : COMM_QUEUE - offset;
+        iov[1].iov_base = queue;
+        iov[1].iov_len = bytes - iov[0].iov_len;
+
+        written = writev(fd, iov, iov[1].iov_len ? 2 : 1);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written < 0 && errno == EAGAIN)
+        {
+            stats.full++;
+            return 0;
+        }
+        if (written < 0)
+        {
+            // EPIPE, the reader is gone, the messages wait for the next one
+            comm_disconnect();
+            return -1;
+        }
+        stats.writes++;
+        if (written != (ssize_t)bytes)
+        {
+            stats.errors++;
+        }
+        queue_head += bytes;
+        message_head += messages;
+        stats.written += messages;
+    }
+    return 0;
 }
 
+void comm_get_stats(comm_stats_t *out)
+{
+    *out = stats;
+    out->pending = queue_tail - queue_head;
+}
+
+/**
+ * Flushes what the pipe takes, the rest is dropped.
+ */
 void comm_close()
 {
-    close(fd);
+    comm_flush();
+    while (message_head != message_tail)
+    {
+        drop_oldest();
+    }
+    if (fd >= 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+    stats.connected = 0;
 }
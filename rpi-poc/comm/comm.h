@@ -1,10 +1,61 @@
 #ifndef __COMM_H_
 #define __COMM_H_
 
+#include <stddef.h>
+
+#include "telemetry.h"
+
 #define err(mess) { fprintf(stderr,"Error: %s.", mess); exit(1); }
 
+/**
+ * Output to a named pipe that never blocks the caller.
+ *
+ * The pipe is opened non-blocking, without a reader the open fails and is
+ * retried at most every COMM_RECONNECT_INTERVAL. Messages, a text line or a
+ * telemetry frame each, are queued in a bounded ring and written with
+ * writev() while the pipe takes them, at most PIPE_BUF bytes of whole
+ * messages per call so a reader never sees half a line or frame. When the
+ * ring is full the drop policy discards the oldest queued message or the new
+ * one. A reader that goes away costs a reconnect, SIGPIPE is ignored.
+ *
+ * Not thread safe, call it from one thread, the publisher.
+ */
+
+#define COMM_FIFO_PATH "/tmp/myfifo"
+#define COMM_QUEUE 65536                    // bytes queued, power of two
+#define COMM_QUEUE_MESSAGES 2048            // messages queued, power of two
+#define COMM_RECONNECT_INTERVAL 500000000   // ns between open() attempts without a reader
+
+typedef enum
+{
+    COMM_DROP_OLDEST,   // a late reader gets the most recent data
+    COMM_DROP_NEWEST    // a late reader gets a contiguous stream from the oldest queued message
+} comm_drop_policy_t;
+
+typedef struct
+{
+    int connected;              // a reader has the pipe open
+    unsigned long queued;       // messages accepted
+    unsigned long written;      // messages written to the pipe
+    unsigned long dropped;      // messages discarded by the drop policy
+    unsigned long dropped_bytes;
+    unsigned long writes;       // writev() calls
+    unsigned long full;         // writes refused by a full pipe, the reader is slow
+    unsigned long errors;       // failed or short writes, their messages are lost
+    unsigned long connects;     // times a reader was found
+    unsigned long disconnects;  // times the reader went away
+    size_t pending;             // bytes queued now
+    size_t high_water;          // most bytes ever queued
+} comm_stats_t;
+
 void comm_open();
-void comm_write(char *, ...);
+int comm_open_fifo(const char *path);
+void comm_set_drop_policy(comm_drop_policy_t policy);
+int comm_write(char *, ...);
+int comm_write_record(telemetry_record_t *record);
+int comm_write_stats(telemetry_stats_t *stats);
+int comm_flush();
+void comm_get_stats(comm_stats_t *stats);
 void comm_close();
 
 #endif
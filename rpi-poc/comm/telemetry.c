@@ -0,0 +1,489 @@
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "telemetry.h"
+
+/**
+ * CRC-16/CCITT-FALSE, polynomial 0x1021, initial value 0xFFFF, table driven.
+ * The table is precomputed so the recorder and the publisher can both use it
+ * without synchronisation.
+ */
+static const uint16_t crc_table[256] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+    0x1231, 0x0210, 0x3273, 0x2252, 0x52B5, 0x4294, 0x72F7, 0x62D6,
+    0x9339, 0x8318, 0xB37B, 0xA35A, 0xD3BD, 0xC39C, 0xF3FF, 0xE3DE,
+    0x2462, 0x3443, 0x0420, 0x1401, 0x64E6, 0x74C7, 0x44A4, 0x5485,
+    0xA56A, 0xB54B, 0x8528, 0x9509, 0xE5EE, 0xF5CF, 0xC5AC, 0xD58D,
+    0x3653, 0x2672, 0x1611, 0x0630, 0x76D7, 0x66F6, 0x5695, 0x46B4,
+    0xB75B, 0xA77A, 0x9719, 0x8738, 0xF7DF, 0xE7FE, 0xD79D, 0xC7BC,
+    0x48C4, 0x58E5, 0x6886, 0x78A7, 0x0840, 0x1861, 0x2802, 0x3823,
+    0xC9CC, 0xD9ED, 0xE98E, 0xF9AF, 0x8948, 0x9969, 0xA90A, 0xB92B,
+    0x5AF5, 0x4AD4, 0x7AB7, 0x6A96, 0x1A71, 0x0A50, 0x3A33, 0x2A12,
+    0xDBFD, 0xCBDC, 0xFBBF, 0xEB9E, 0x9B79, 0x8B58, 0xBB3B, 0xAB1A,
+    0x6CA6, 0x7C87, 0x4CE4, 0x5CC5, 0x2C22, 0x3C03, 0x0C60, 0x1C41,
+    0xEDAE, 0xFD8F, 0xCDEC, 0xDDCD, 0xAD2A, 0xBD0B, 0x8D68, 0x9D49,
+    0x7E97, 0x6EB6, 0x5ED5, 0x4EF4, 0x3E13, 0x2E32, 0x1E51, 0x0E70,
+    0xFF9F, 0xEFBE, 0xDFDD, 0xCFFC, 0xBF1B, 0xAF3A, 0x9F59, 0x8F78,
+    0x9188, 0x81A9, 0xB1CA, 0xA1EB, 0xD10C, 0xC12D, 0xF14E, 0xE16F,
+    0x1080, 0x00A1, 0x30C2, 0x20E3, 0x5004, 0x4025, 0x7046, 0x6067,
+    0x83B9, 0x9398, 0xA3FB, 0xB3DA, 0xC33D, 0xD31C, 0xE37F, 0xF35E,
+    0x02B1, 0x1290, 0x22F3, 0x32D2, 0x4235, 0x5214, 0x6277, 0x7256,
+    0xB5EA, 0xA5CB, 0x95A8, 0x8589, 0xF56E, 0xE54F, 0xD52C, 0xC50D,
+    0x34E2, 0x24C3, 0x14A0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+    0xA7DB, 0xB7FA, 0x8799, 0x97B8, 0xE75F, 0xF77E, 0xC71D, 0xD73C,
+    0x26D3, 0x36F2, 0x0691, 0x16B0, 0x6657, 0x7676, 0x4615, 0x5634,
+    0xD94C, 0xC96D, 0xF90E, 0xE92F, 0x99C8, 0x89E9, 0xB98A, 0xA9AB,
+    0x5844, 0x4865, 0x7806, 0x6827, 0x18C0, 0x08E1, 0x3882, 0x28A3,
+    0xCB7D, 0xDB5C, 0xEB3F, 0xFB1E, 0x8BF9, 0x9BD8, 0xABBB, 0xBB9A,
+    0x4A75, 0x5A54, 0x6A37, 0x7A16, 0x0AF1, 0x1AD0, 0x2AB3, 0x3A92,
+    0xFD2E, 0xED0F, 0xDD6C, 0xCD4D, 0xBDAA, 0xAD8B, 0x9DE8, 0x8DC9,
+    0x7C26, 0x6C07, 0x5C64, 0x4C45, 0x3CA2, 0x2C83, 0x1CE0, 0x0CC1,
+    0xEF1F, 0xFF3E, 0xCF5D, 0xDF7C, 0xAF9B, 0xBFBA, 0x8FD9, 0x9FF8,
+    0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0,
+};
+
+uint16_t telemetry_crc16(const uint8_t *data, size_t length)
+{
+    uint16_t crc = 0xFFFF;
+
+    while (length--)
+        crc = (crc << 8) ^ crc_table[(crc >> 8) ^ *data++];
+    return crc;
+}
+
+static uint8_t *put_u16(uint8_t *p, uint16_t value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+    return p + 2;
+}
+
+static uint8_t *put_u32(uint8_t *p, uint32_t value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+    p[2] = value >> 16;
+    p[3] = value >> 24;
+    return p + 4;
+}
+
+static uint8_t *put_u64(uint8_t *p, uint64_t value)
+{
+    p = put_u32(p, value);
+    return put_u32(p, value >> 32);
+}
+
+static uint8_t *put_float(uint8_t *p, float value)
+{
+    uint32_t bits;
+
+    memcpy(&bits, &value, sizeof(bits));
+    return put_u32(p, bits);
+}
+
+static const uint8_t *get_u16(const uint8_t *p, uint16_t *value)
+{
+    *value = p[0] | (p[1] << 8);
+    return p + 2;
+}
+
+static const uint8_t *get_u32(const uint8_t *p, uint32_t *value)
+{
+    *value = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+    return p + 4;
+}
+
+static const uint8_t *get_u64(const uint8_t *p, uint64_t *value)
+{
+    uint32_t low, high;
+
+    p = get_u32(p, &low);
+    p = get_u32(p, &high);
+    *value = ((uint64_t)high << 32) | low;
+    return p;
+}
+
+static const uint8_t *get_float(const uint8_t *p, float *value)
+{
+    uint32_t bits;
+
+    p = get_u32(p, &bits);
+    memcpy(value, &bits, sizeof(bits));
+    return p;
+}
+
+static const uint8_t *get_i16(const uint8_t *p, int16_t *value)
+{
+    uint16_t bits;
+
+    p = get_u16(p, &bits);
+    *value = (int16_t)bits;
+    return p;
+}
+
+/**
+ * Consistent Overhead Byte Stuffing: every zero is replaced by the distance
+ * to the next one, a code byte leads each run of up to 254 non-zero bytes.
+ */
+static size_t cobs_encode(const uint8_t *data, size_t length, uint8_t *out)
+{
+    uint8_t *code = out, *p = out + 1;
+    uint8_t run = 1;
+
+    while (length--)
+    {
+        if (*data)
+        {
+            *p++ = *data;
+            run++;
+        }
+        if (!*data++ || run == 0xFF)
+        {
+            *code = run;
+            code = p++;
+            run = 1;
+        }
+    }
+    *code = run;
+    return p - out;
+}
+
+/**
+ * Returns the decoded length, 0 when the input is not valid COBS.
+ */
+static size_t cobs_decode(const uint8_t *data, size_t length, uint8_t *out)
+{
+    const uint8_t *end = data + length;
+    uint8_t *p = out;
+
+    while (data < end)
+    {
+        uint8_t run = *data++;
+        uint8_t i;
+
+        if (run == 0 || data + run - 1 > end)
+            return 0;
+        for (i = 1; i < run; i++)
+            *p++ = *data++;
+        if (run != 0xFF && data < end)
+            *p++ = 0;
+    }
+    return p - out;
+}
+
+/**
+ * Serialise record with the given sequence number into frame, which holds
+ * TELEMETRY_FRAME_MAX bytes. The record's type and sequence are set. Returns
+ * the frame length including the closing zero.
+ */
+size_t telemetry_encode(telemetry_record_t *record, uint32_t sequence, uint8_t *frame)
+{
+    uint8_t raw[TELEMETRY_RECORD_LENGTH + TELEMETRY_CRC_LENGTH];
+    uint8_t *p = raw;
+    size_t length;
+
+    record->type = TELEMETRY_ATTITUDE;
+    record->sequence = sequence;
+    *p++ = record->type;
+    *p++ = TELEMETRY_VERSION;
+    p = put_u32(p, record->sequence);
+    p = put_u64(p, record->timestamp);
+    p = put_float(p, record->q0);
+    p = put_float(p, record->q1);
+    p = put_float(p, record->q2);
+    p = put_float(p, record->q3);
+    p = put_float(p, record->roll);
+    p = put_float(p, record->pitch);
+    p = put_float(p, record->yaw);
+    p = put_u16(p, record->ax);
+    p = put_u16(p, record->ay);
+    p = put_u16(p, record->az);
+    p = put_u16(p, record->gx);
+    p = put_u16(p, record->gy);
+    p = put_u16(p, record->gz);
+    p = put_u16(p, record->mx);
+    p = put_u16(p, record->my);
+    p = put_u16(p, record->mz);
+    put_u16(p, telemetry_crc16(raw, TELEMETRY_RECORD_LENGTH));
+
+    length = cobs_encode(raw, sizeof(raw), frame);
+    frame[length++] = 0;
+    return length;
+}
+
+/**
+ * Serialise loop statistics like telemetry_encode(), the type and sequence
+ * are set.
+ */
+size_t telemetry_encode_stats(telemetry_stats_t *stats, uint32_t sequence, uint8_t *frame)
+{
+    uint8_t raw[TELEMETRY_STATS_LENGTH + TELEMETRY_CRC_LENGTH];
+    uint8_t *p = raw;
+    size_t length;
+    int i;
+
+    stats->type = TELEMETRY_STATS;
+    stats->sequence = sequence;
+    *p++ = stats->type;
+    *p++ = TELEMETRY_VERSION;
+    p = put_u32(p, stats->sequence);
+    p = put_u64(p, stats->timestamp);
+    p = put_u32(p, stats->interval);
+    for (i = 0; i < TELEMETRY_STATS_STAGES; i++)
+    {
+        p = put_u32(p, stats->stages[i].count);
+        p = put_u32(p, stats->stages[i].p50);
+        p = put_u32(p, stats->stages[i].p99);
+        p = put_u32(p, stats->stages[i].max);
+    }
+    p = put_u32(p, stats->i2c_errors);
+    p = put_u32(p, stats->i2c_short);
+    put_u16(p, telemetry_crc16(raw, TELEMETRY_STATS_LENGTH));
+
+    length = cobs_encode(raw, sizeof(raw), frame);
+    frame[length++] = 0;
+    return length;
+}
+
+/**
+ * Undo the COBS encoding and check length, CRC and version for the record
+ * type. Returns the type, -1 on a framing error, -2 on a CRC mismatch.
+ */
+static int decode_raw(const uint8_t *frame, size_t length, uint8_t *raw)
+{
+    size_t decoded, record_length;
+    uint16_t crc;
+
+    if (length > TELEMETRY_FRAME_MAX || (decoded = cobs_decode(frame, length, raw)) < 2)
+        return -1;
+    if (raw[0] == TELEMETRY_ATTITUDE)
+        record_length = TELEMETRY_RECORD_LENGTH;
+    else if (raw[0] == TELEMETRY_STATS)
+        record_length = TELEMETRY_STATS_LENGTH;
+    else
+        record_length = decoded - TELEMETRY_CRC_LENGTH; // CRC first, a damaged type is not a framing error
+    if (decoded != record_length + TELEMETRY_CRC_LENGTH)
+        return -1;
+    get_u16(raw + record_length, &crc);
+    if (crc != telemetry_crc16(raw, record_length))
+        return -2;
+    if ((raw[0] != TELEMETRY_ATTITUDE && raw[0] != TELEMETRY_STATS) || raw[1] != TELEMETRY_VERSION)
+        return -1;
+    return raw[0];
+}
+
+static void parse_attitude(const uint8_t *raw, telemetry_record_t *record)
+{
+    const uint8_t *p = raw;
+
+    record->type = *p++;
+    p++;
+    p = get_u32(p, &record->sequence);
+    p = get_u64(p, &record->timestamp);
+    p = get_float(p, &record->q0);
+    p = get_float(p, &record->q1);
+    p = get_float(p, &record->q2);
+    p = get_float(p, &record->q3);
+    p = get_float(p, &record->roll);
+    p = get_float(p, &record->pitch);
+    p = get_float(p, &record->yaw);
+    p = get_i16(p, &record->ax);
+    p = get_i16(p, &record->ay);
+    p = get_i16(p, &record->az);
+    p = get_i16(p, &record->gx);
+    p = get_i16(p, &record->gy);
+    p = get_i16(p, &record->gz);
+    p = get_i16(p, &record->mx);
+    p = get_i16(p, &record->my);
+    get_i16(p, &record->mz);
+}
+
+static void parse_stats(const uint8_t *raw, telemetry_stats_t *stats)
+{
+    const uint8_t *p = raw;
+    int i;
+
+    stats->type = *p++;
+    p++;
+    p = get_u32(p, &stats->sequence);
+    p = get_u64(p, &stats->timestamp);
+    p = get_u32(p, &stats->interval);
+    for (i = 0; i < TELEMETRY_STATS_STAGES; i++)
+    {
+        p = get_u32(p, &stats->stages[i].count);
+        p = get_u32(p, &stats->stages[i].p50);
+        p = get_u32(p, &stats->stages[i].p99);
+        p = get_u32(p, &stats->stages[i].max);
+    }
+    p = get_u32(p, &stats->i2c_errors);
+    get_u32(p, &stats->i2c_short);
+}
+
+/**
+ * Decode one attitude frame without its closing zero. Returns 0 and fills
+ * record, -1 on a framing error or another record type, -2 on a CRC mismatch.
+ */
+int telemetry_decode_frame(const uint8_t *frame, size_t length, telemetry_record_t *record)
+{
+    uint8_t raw[TELEMETRY_FRAME_MAX];
+    int type = decode_raw(frame, length, raw);
+
+    if (type != TELEMETRY_ATTITUDE)
+        return type < 0 ? type : -1;
+    parse_attitude(raw, record);
+    return 0;
+}
+
+/**
+ * Decode one statistics frame, returns like telemetry_decode_frame().
+ */
+int telemetry_decode_stats(const uint8_t *frame, size_t length, telemetry_stats_t *stats)
+{
+    uint8_t raw[TELEMETRY_FRAME_MAX];
+    int type = decode_raw(frame, length, raw);
+
+    if (type != TELEMETRY_STATS)
+        return type < 0 ? type : -1;
+    parse_stats(raw, stats);
+    return 0;
+}
+
+void telemetry_writer_init(telemetry_writer_t *writer, int fd)
+{
+    memset(writer, 0, sizeof(*writer));
+    writer->fd = fd;
+    writer->max_delay = TELEMETRY_MAX_DELAY;
+}
+
+/**
+ * Frame the record into the batch. The batch is written out first when the
+ * frame does not fit, and after it when the batch spans max_delay. Returns 0,
+ * -1 when a write failed.
+ */
+int telemetry_write(telemetry_writer_t *writer, telemetry_record_t *record)
+{
+    int result = 0;
+
+    if (writer->length + TELEMETRY_FRAME_MAX > TELEMETRY_BATCH)
+        result = telemetry_flush(writer);
+    if (writer->length == 0)
+        writer->batch_start = record->timestamp;
+    writer->length += telemetry_encode(record, writer->sequence++, writer->buffer + writer->length);
+    writer->records++;
+    if (writer->max_delay && record->timestamp - writer->batch_start >= writer->max_delay)
+        result |= telemetry_flush(writer);
+    return result;
+}
+
+/**
+ * Frame statistics into the batch like telemetry_write().
+ */
+int telemetry_write_stats(telemetry_writer_t *writer, telemetry_stats_t *stats)
+{
+    int result = 0;
+
+    if (writer->length + TELEMETRY_FRAME_MAX > TELEMETRY_BATCH)
+        result = telemetry_flush(writer);
+    if (writer->length == 0)
+        writer->batch_start = stats->timestamp;
+    writer->length += telemetry_encode_stats(stats, writer->sequence++, writer->buffer + writer->length);
+    writer->records++;
+    if (writer->max_delay && stats->timestamp - writer->batch_start >= writer->max_delay)
+        result |= telemetry_flush(writer);
+    return result;
+}
+
+/**
+ * Write the batch out, a failed or short write drops it, frames are never
+ * left half written in the buffer. Returns 0, -1 when bytes were lost.
+ */
+int telemetry_flush(telemetry_writer_t *writer)
+{
+    ssize_t written;
+
+    if (writer->length == 0)
+        return 0;
+    written = write(writer->fd, writer->buffer, writer->length);
+    writer->writes++;
+    if (written != (ssize_t)writer->length)
+    {
+        writer->errors++;
+        writer->length = 0;
+        return -1;
+    }
+    writer->length = 0;
+    return 0;
+}
+
+void telemetry_decoder_init(telemetry_decoder_t *decoder)
+{
+    memset(decoder, 0, sizeof(*decoder));
+}
+
+/**
+ * Consume bytes up to and including the end of the next frame. Returns how
+ * many bytes were consumed, *ready is the type of the valid record decoded,
+ * TELEMETRY_ATTITUDE into record or TELEMETRY_STATS into decoder->stats,
+ * 0 for none. Call again with the rest of the data until it is all consumed.
+ */
+size_t telemetry_decoder_feed(telemetry_decoder_t *decoder, const uint8_t *data, size_t length,
+                              telemetry_record_t *record, int *ready)
+{
+    size_t used = 0;
+    uint8_t raw[TELEMETRY_FRAME_MAX];
+    uint32_t sequence;
+    int result;
+
+    *ready = 0;
+    while (used < length)
+    {
+        uint8_t byte = data[used++];
+
+        if (byte != 0)
+        {
+            if (decoder->length < TELEMETRY_FRAME_MAX)
+                decoder->frame[decoder->length++] = byte;
+            else
+                decoder->overflow = 1;
+            continue;
+        }
+
+        // end of frame, an empty one is just a resync zero
+        if (decoder->length == 0 && !decoder->overflow)
+            continue;
+        result = decoder->overflow ? -1 : decode_raw(decoder->frame, decoder->length, raw);
+        decoder->length = 0;
+        decoder->overflow = 0;
+        if (result == -2)
+        {
+            decoder->crc_errors++;
+            continue;
+        }
+        if (result < 0)
+        {
+            decoder->frame_errors++;
+            continue;
+        }
+        if (result == TELEMETRY_STATS)
+        {
+            parse_stats(raw, &decoder->stats);
+            sequence = decoder->stats.sequence;
+        }
+        else
+        {
+            parse_attitude(raw, record);
+            sequence = record->sequence;
+        }
+
+        // a sequence number going backwards is a restarted writer, not a loss
+        if (decoder->records > 0 && (int32_t)(sequence - decoder->next_sequence) > 0)
+            decoder->lost += sequence - decoder->next_sequence;
+        decoder->next_sequence = sequence + 1;
+        decoder->records++;
+        *ready = result;
+        break;
+    }
+    return used;
+}
@@ -0,0 +1,130 @@
+#ifndef _TELEMETRY_H_
+#define _TELEMETRY_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Binary telemetry stream.
+ *
+ * Every record is serialised little-endian into a fixed layout, followed by
+ * a CRC-16/CCITT of the record bytes. Record and CRC are COBS encoded so the
+ * frame holds no zero byte, and a zero byte ends every frame. A reader that
+ * starts mid-stream or hits a corrupted frame resynchronises at the next zero.
+ *
+ *   offset  size  field
+ *        0     1  type, TELEMETRY_ATTITUDE
+ *        1     1  version, TELEMETRY_VERSION
+ *        2     4  sequence number, consecutive per writer, gaps are lost records
+ *        6     8  timestamp, CLOCK_MONOTONIC ns of the sample
+ *       14    16  quaternion q0..q3, float
+ *       30    12  roll, pitch, yaw, float degrees
+ *       42    18  raw ax, ay, az, gx, gy, gz, mx, my, mz, int16
+ *       60     2  CRC-16/CCITT of bytes 0-59
+ *
+ * Loop statistics records share the header and the sequence numbers:
+ *
+ *   offset  size  field
+ *        0     1  type, TELEMETRY_STATS
+ *        1     1  version, TELEMETRY_VERSION
+ *        2     4  sequence number
+ *        6     8  timestamp, CLOCK_MONOTONIC ns the interval ends at
+ *       14     4  interval, ns
+ *       18    96  per stage (acquire, mag, fuse, angles, output, period) the
+ *                 count, p50, p99 and max ns of the interval, uint32
+ *      114     4  I2C errors since start
+ *      118     4  I2C short reads and writes since start
+ *      122     2  CRC-16/CCITT of bytes 0-121
+ */
+
+#define TELEMETRY_ATTITUDE 1
+#define TELEMETRY_STATS 2
+#define TELEMETRY_VERSION 1
+
+#define TELEMETRY_RECORD_LENGTH 60
+#define TELEMETRY_STATS_LENGTH 122
+#define TELEMETRY_STATS_STAGES 6
+#define TELEMETRY_CRC_LENGTH 2
+// the longest record, COBS adds one byte per 254 plus one, the frame one zero byte
+#define TELEMETRY_FRAME_MAX (TELEMETRY_STATS_LENGTH + TELEMETRY_CRC_LENGTH + 2 + 1)
+
+#define TELEMETRY_BATCH 4096 // bytes a writer buffers before a write()
+#define TELEMETRY_MAX_DELAY 20000000 // ns of record timestamps a batch spans at most
+
+typedef struct
+{
+    uint8_t type;
+    uint32_t sequence;
+    uint64_t timestamp;
+    float q0, q1, q2, q3;
+    float roll, pitch, yaw;
+    int16_t ax, ay, az, gx, gy, gz, mx, my, mz;
+} telemetry_record_t;
+
+typedef struct
+{
+    uint32_t count;
+    uint32_t p50, p99, max;     // ns
+} telemetry_stage_t;
+
+typedef struct
+{
+    uint8_t type;
+    uint32_t sequence;
+    uint64_t timestamp;
+    uint32_t interval;          // ns
+    telemetry_stage_t stages[TELEMETRY_STATS_STAGES];
+    uint32_t i2c_errors;
+    uint32_t i2c_short;
+} telemetry_stats_t;
+
+/**
+ * Frames records into a buffer and writes the buffer out once it is full, once
+ * its records span max_delay or on telemetry_flush(). One write() covers up to
+ * about 60 records.
+ */
+typedef struct
+{
+    int fd;
+    uint64_t max_delay;         // ns, 0 writes only full batches
+    uint32_t sequence;          // stamped on the next record
+    uint64_t batch_start;       // timestamp of the first record buffered
+    size_t length;              // bytes buffered
+    unsigned long records;      // records framed
+    unsigned long writes;       // write() calls
+    unsigned long errors;       // failed or short write() calls, their bytes are lost
+    uint8_t buffer[TELEMETRY_BATCH];
+} telemetry_writer_t;
+
+/**
+ * Streaming decoder, bytes go in as they arrive in any chunking.
+ */
+typedef struct
+{
+    uint8_t frame[TELEMETRY_FRAME_MAX];
+    size_t length;              // bytes of the current frame so far
+    int overflow;               // current frame is too long, skipped up to its zero
+    uint32_t next_sequence;     // expected sequence number, valid once records > 0
+    unsigned long records;      // valid records decoded
+    unsigned long crc_errors;   // frames with a bad CRC
+    unsigned long frame_errors; // frames with a bad length, encoding, type or version
+    unsigned long lost;         // records missing from the sequence numbers
+    telemetry_stats_t stats;    // last statistics record decoded
+} telemetry_decoder_t;
+
+uint16_t telemetry_crc16(const uint8_t *data, size_t length);
+size_t telemetry_encode(telemetry_record_t *record, uint32_t sequence, uint8_t *frame);
+int telemetry_decode_frame(const uint8_t *frame, size_t length, telemetry_record_t *record);
+size_t telemetry_encode_stats(telemetry_stats_t *stats, uint32_t sequence, uint8_t *frame);
+int telemetry_decode_stats(const uint8_t *frame, size_t length, telemetry_stats_t *stats);
+
+void telemetry_writer_init(telemetry_writer_t *writer, int fd);
+int telemetry_write(telemetry_writer_t *writer, telemetry_record_t *record);
+int telemetry_write_stats(telemetry_writer_t *writer, telemetry_stats_t *stats);
+int telemetry_flush(telemetry_writer_t *writer);
+
+void telemetry_decoder_init(telemetry_decoder_t *decoder);
+size_t telemetry_decoder_feed(telemetry_decoder_t *decoder, const uint8_t *data, size_t length,
+                              telemetry_record_t *record, int *ready);
+
+#endif /* _TELEMETRY_H_ */
@@ -0,0 +1,203 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+
+#include "gpio_event.h"
+#include "../stats/clock.h"
+
+/**
+ * Drain line events, the kernel timestamps them with CLOCK_MONOTONIC when the
+ * edge is detected. Gaps in the line sequence numbers are edges the kernel
+ * dropped because its event buffer was full.
+ */
+static int line_read(gpio_event_source_t *source, uint64_t *timestamps, int max)
+{
+    struct gpio_v2_line_event events[GPIO_EVENT_BURST];
+    ssize_t length;
+    int i, count;
+
+    if (max > GPIO_EVENT_BURST)
+        max = GPIO_EVENT_BURST;
+    length = read(source->fd, events, max * sizeof(events[0]));
+    if (length < 0)
+        return errno == EAGAIN ? 0 : -1;
+
+    count = length / sizeof(events[0]);
+    for (i = 0; i < count; i++)
+    {
+        if (source->seqno != 0 && events[i].line_seqno != source->seqno + 1)
+            source->missed += events[i].line_seqno - source->seqno - 1;
+        source->seqno = events[i].line_seqno;
+        timestamps[i] = events[i].timestamp_ns;
+    }
+    return count;
+}
+
+static void line_close(gpio_event_source_t *source)
+{
+    close(source->fd);
+}
+
+static const gpio_event_ops_t line_ops = {line_read, line_close};
+
+static int fake_read(gpio_event_source_t *source, uint64_t *timestamps, int max)
+{
+    ssize_t length;
+
+    if (max > GPIO_EVENT_BURST)
+        max = GPIO_EVENT_BURST;
+    // writes of one timestamp are atomic on a pipe, reads never split one
+    length = read(source->fd, timestamps, max * sizeof(timestamps[0]));
+    if (length < 0)
+        return errno == EAGAIN ? 0 : -1;
+    return length / sizeof(timestamps[0]);
+}
+
+static void fake_close(gpio_event_source_t *source)
+{
+    close(source->fd);
+    close(source->trigger_fd);
+}
+
+static const gpio_event_ops_t fake_ops = {fake_read, fake_close};
+
+static void source_reset(gpio_event_source_t *source, const gpio_event_ops_t *ops)
+{
+    memset(source, 0, sizeof(*source));
+    source->fd = -1;
+    source->trigger_fd = -1;
+    source->ops = ops;
+}
+
+/**
+ * Request rising edge events of a GPIO line, e.g. the MPU6050 INT pin.
+ *
+ * @param source Source to set up
+ * @param chip GPIO character device, e.g. GPIO_EVENT_DEFAULT_CHIP
+ * @param line Line offset on the chip (the BCM number on a Raspberry Pi)
+ * @return 0 on success, -1 on failure
+ */
+int gpio_event_open_line(gpio_event_source_t *source, const char *chip, unsigned int line)
+{
+    struct gpio_v2_line_request request;
+    int chip_fd;
+
+    source_reset(source, &line_ops);
+    chip_fd = open(chip, O_RDONLY | O_CLOEXEC);
+    if (chip_fd < 0)
+    {
+        fprintf(stderr, "Failed to open %s: %s\n", chip, strerror(errno));
+        return -1;
+    }
+
+    memset(&request, 0, sizeof(request));
+    request.offsets[0] = line;
+    request.num_lines = 1;
+    request.config.flags = GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_RISING;
+    strncpy(request.consumer, "icaro-drdy", sizeof(request.consumer) - 1);
+    if (ioctl(chip_fd, GPIO_V2_GET_LINE_IOCTL, &request) < 0)
+    {
+        fprintf(stderr, "Failed to request line %u of %s: %s\n", line, chip, strerror(errno));
+        close(chip_fd);
+        return -1;
+    }
+    // the line request keeps its own fd, the chip is not needed anymore
+    close(chip_fd);
+
+    source->fd = request.fd;
+    fcntl(source->fd, F_SETFL, fcntl(source->fd, F_GETFL) | O_NONBLOCK);
+    return 0;
+}
+
+/**
+ * Set up a source fed by gpio_event_trigger() instead of a GPIO line, to
+ * drive the sampling loop without the hardware.
+ *
+ * @param source Source to set up
+ * @return 0 on success, -1 on failure
+ */
+int gpio_event_open_fake(gpio_event_source_t *source)
+{
+    int fds[2];
+
+    source_reset(source, &fake_ops);
+    if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) < 0)
+    {
+        fprintf(stderr, "Failed to create fake event pipe: %s\n", strerror(errno));
+        return -1;
+    }
+    source->fd = fds[0];
+    source->trigger_fd = fds[1];
+    return 0;
+}
+
+/**
+ * Queue an edge on a fake source, safe to call from another thread.
+ *
+ * @param source Source set up by gpio_event_open_fake()
+ * @param timestamp Edge time, usually clock_now_ns()
+ * @return 0 on success, -1 when the source is not a fake or the queue is full
+ */
+int gpio_event_trigger(gpio_event_source_t *source, uint64_t timestamp)
+{
+    if (source->trigger_fd < 0)
+        return -1;
+    return write(source->trigger_fd, &timestamp, sizeof(timestamp)) == sizeof(timestamp) ? 0 : -1;
+}
+
+/**
+ * Block until the next edge.
+ *
+ * Every queued event is drained and the newest is handed out, the older ones
+ * are samples that have been overwritten in the data registers already and
+ * count as missed.
+ *
+ * @param source Event source
+ * @param timeout_ms Maximum wait, -1 waits forever
+ * @param timestamp Edge time in CLOCK_MONOTONIC ns
+ * @return 1 on an event, 0 on timeout or signal, -1 on failure
+ */
+int gpio_event_wait(gpio_event_source_t *source, int timeout_ms, uint64_t *timestamp)
+{
+    struct pollfd pfd = {source->fd, POLLIN, 0};
+    uint64_t timestamps[GPIO_EVENT_BURST];
+    int count, ready;
+
+    ready = poll(&pfd, 1, timeout_ms);
+    if (ready < 0)
+        return errno == EINTR ? 0 : -1;
+    if (ready == 0)
+        return 0;
+    if (pfd.revents & (POLLERR | POLLHUP | POLLNVAL))
+        return -1;
+
+    count = source->ops->read(source, timestamps, GPIO_EVENT_BURST);
+    if (count <= 0)
+        return count;
+
+    *timestamp = timestamps[count - 1];
+    source->events++;
+    source->missed += count - 1;
+    return 1;
+}
+
+/**
+ * Release the source.
+ *
+ * @param source Event source
+ */
+void gpio_event_close(gpio_event_source_t *source)
+{
+    if (source->fd >= 0)
+        source->ops->close(source);
+    source->fd = -1;
+    source->trigger_fd = -1;
+}
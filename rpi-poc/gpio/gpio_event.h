@@ -0,0 +1,48 @@
+#ifndef _GPIO_EVENT_H_
+#define _GPIO_EVENT_H_
+
+#include <stdint.h>
+
+#define GPIO_EVENT_DEFAULT_CHIP "/dev/gpiochip0"
+#define GPIO_EVENT_BURST 16 // events drained per wake up
+
+typedef struct gpio_event_source gpio_event_source_t;
+
+/**
+ * Operations of an event source.
+ *
+ * read drains up to max queued events into timestamps (CLOCK_MONOTONIC ns,
+ * oldest first) and returns how many, 0 when none is queued, -1 on error.
+ * It is only called once the source fd polls readable.
+ */
+typedef struct
+{
+    int (*read)(gpio_event_source_t *source, uint64_t *timestamps, int max);
+    void (*close)(gpio_event_source_t *source);
+} gpio_event_ops_t;
+
+/**
+ * Edge event source the sampling loop blocks on.
+ *
+ * gpio_event_open_line() requests a line from the GPIO character device with
+ * the kernel timestamping each rising edge, gpio_event_open_fake() backs the
+ * source with a pipe fed by gpio_event_trigger(). Other sources only need a
+ * pollable fd and the ops.
+ */
+struct gpio_event_source
+{
+    int fd;         // pollable, readable while events are queued
+    int trigger_fd; // write end of the fake source, -1 otherwise
+    const gpio_event_ops_t *ops;
+    uint32_t seqno;         // last line sequence number seen, 0 before the first event
+    unsigned long events;   // events handed out by gpio_event_wait()
+    unsigned long missed;   // events drained or dropped without being handed out
+};
+
+int gpio_event_open_line(gpio_event_source_t *source, const char *chip, unsigned int line);
+int gpio_event_open_fake(gpio_event_source_t *source);
+int gpio_event_trigger(gpio_event_source_t *source, uint64_t timestamp);
+int gpio_event_wait(gpio_event_source_t *source, int timeout_ms, uint64_t *timestamp);
+void gpio_event_close(gpio_event_source_t *source);
+
+#endif /* _GPIO_EVENT_H_ */
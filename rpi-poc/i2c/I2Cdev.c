@@ -56,9 +56,11 @@ THE SOFTWARE.
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <stdatomic.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <linux/i2c.h>
 #include <linux/i2c-dev.h>
 #include "I2Cdev.h"
 
@@ -67,6 +69,328 @@ THE SOFTWARE.
  */
 uint16_t readTimeout = 0;
 
+static i2c_bus_t bus = {-1, I2C_DEFAULT_ADAPTER, -1, 0};
+
+// read from any thread through i2c_bus_get_stats() while transfers run
+static struct
+{
+    atomic_ulong reads, writes, batches, errors, short_reads, short_writes;
+} counters;
+
+#define COUNT(counter) atomic_fetch_add_explicit(&counters.counter, 1, memory_order_relaxed)
+
+static int linux_open(void *context, int adapter);
+static void linux_close(void *context);
+static int linux_read(void *context, uint8_t dev_addr, uint8_t reg_addr, uint8_t length, uint8_t *data);
+static int linux_write(void *context, uint8_t dev_addr, uint8_t reg_addr, uint8_t length, const uint8_t *data);
+static int linux_submit(void *context, i2c_batch_t *batch);
+
+const i2c_backend_t i2c_linux_backend = {
+    "linux", linux_open, linux_close, linux_read, linux_write, linux_submit, &bus};
+
+static const i2c_backend_t *backend = &i2c_linux_backend;
+
+/**
+ * Route every transfer through another bus implementation. The current one
+ * is closed first.
+ *
+ * @param new_backend Backend to use, NULL for the Linux adapter
+ */
+void i2c_bus_set_backend(const i2c_backend_t *new_backend)
+{
+    i2c_bus_close();
+    backend = new_backend ? new_backend : &i2c_linux_backend;
+}
+
+/**
+ * Get the bus implementation in use.
+ *
+ * @return Current backend
+ */
+const i2c_backend_t *i2c_bus_get_backend(void)
+{
+    return backend;
+}
+
+/**
+ * Open the I2C adapter used by every transfer.
+ *
+ * Transfers open I2C_DEFAULT_ADAPTER lazily when this is never called, so it is
+ * only required to pick a different adapter. Opening a different adapter closes
+ * the current one.
+ *
+ * @param adapter Adapter number, the device node is /dev/i2c-<adapter>
+ * @return I2C_OK on success, I2C_ERR on failure
+ */
+int i2c_bus_open(int adapter)
+{
+    return backend->open(backend->context, adapter);
+}
+
+/**
+ * Close the I2C adapter, the next transfer reopens it.
+ */
+void i2c_bus_close(void)
+{
+    backend->close(backend->context);
+}
+
+/**
+ * Get the transfer counters since start.
+ *
+ * @param stats Container for the counters
+ */
+void i2c_bus_get_stats(i2c_bus_stats_t *stats)
+{
+    stats->reads = atomic_load_explicit(&counters.reads, memory_order_relaxed);
+    stats->writes = atomic_load_explicit(&counters.writes, memory_order_relaxed);
+    stats->batches = atomic_load_explicit(&counters.batches, memory_order_relaxed);
+    stats->errors = atomic_load_explicit(&counters.errors, memory_order_relaxed);
+    stats->short_reads = atomic_load_explicit(&counters.short_reads, memory_order_relaxed);
+    stats->short_writes = atomic_load_explicit(&counters.short_writes, memory_order_relaxed);
+}
+
+static int linux_open(void *context, int adapter)
+{
+    char path[32];
+
+    if (bus.fd >= 0)
+    {
+        if (bus.adapter == adapter)
+            return I2C_OK;
+        linux_close(context);
+    }
+
+    snprintf(path, sizeof(path), "/dev/i2c-%d", adapter);
+    bus.fd = open(path, O_RDWR);
+    if (bus.fd < 0)
+    {
+        fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+        return I2C_ERR;
+    }
+    bus.adapter = adapter;
+    bus.address = -1;
+    if (ioctl(bus.fd, I2C_FUNCS, &bus.funcs) < 0)
+    {
+        bus.funcs = 0;
+    }
+
+    return I2C_OK;
+}
+
+static void linux_close(void *context)
+{
+    if (bus.fd >= 0)
+        close(bus.fd);
+    bus.fd = -1;
+    bus.address = -1;
+    bus.funcs = 0;
+}
+
+/**
+ * Get the Linux adapter context shared by all transfers.
+ *
+ * @return Bus context
+ */
+i2c_bus_t *i2c_bus_get(void)
+{
+    return &bus;
+}
+
+/**
+ * Make sure the adapter is open and the slave is selected.
+ *
+ * @param dev_addr I2C slave device address
+ * @return I2C_OK on success, I2C_ERR on failure
+ */
+static int i2c_bus_select(uint8_t dev_addr)
+{
+    if (bus.fd < 0 && linux_open(&bus, bus.adapter) != I2C_OK)
+        return I2C_ERR;
+    if (bus.address == dev_addr)
+        return I2C_OK;
+    if (ioctl(bus.fd, I2C_SLAVE, dev_addr) < 0)
+    {
+        fprintf(stderr, "Failed to select device: %s\n", strerror(errno));
+        bus.address = -1;
+        return I2C_ERR;
+    }
+    bus.address = dev_addr;
+
+    return I2C_OK;
+}
+
+/**
+ * Empty a batch.
+ *
+ * @param batch Batch to reset
+ */
+void i2c_batch_init(i2c_batch_t *batch)
+{
+    batch->count = 0;
+}
+
+/**
+ * Append a register read to a batch.
+ *
+ * @param batch Batch to append to
+ * @param dev_addr I2C slave device address
+ * @param reg_addr First register reg_addr to read from
+ * @param length Number of bytes to read
+ * @param data Buffer filled in when the batch is submitted
+ * @return Entry index in the batch, I2C_ERR when the batch is full
+ */
+int i2c_batch_read(i2c_batch_t *batch, uint8_t dev_addr, uint8_t reg_addr, uint8_t length, uint8_t *data)
+{
+    i2c_batch_entry_t *entry;
+
+    if (batch->count >= I2C_BATCH_MAX_ENTRIES)
+    {
+        fprintf(stderr, "Batch full, %d entries\n", I2C_BATCH_MAX_ENTRIES);
+        return I2C_ERR;
+    }
+    entry = &batch->entries[batch->count];
+    entry->dev_addr = dev_addr;
+    entry->length = length;
+    entry->data = data;
+    entry->write_buf[0] = reg_addr;
+    entry->status = I2C_ERR;
+
+    return batch->count++;
+}
+
+/**
+ * Append a register write to a batch. The payload is copied into the batch.
+ *
+ * @param batch Batch to append to
+ * @param dev_addr I2C slave device address
+ * @param reg_addr First register address to write to
+ * @param length Number of bytes to write (not more than I2C_BATCH_MAX_WRITE)
+ * @param data Bytes to write
+ * @return Entry index in the batch, I2C_ERR when the batch is full
+ */
+int i2c_batch_write(i2c_batch_t *batch, uint8_t dev_addr, uint8_t reg_addr, uint8_t length, const uint8_t *data)
+{
+    i2c_batch_entry_t *entry;
+
+    if (batch->count >= I2C_BATCH_MAX_ENTRIES || length > I2C_BATCH_MAX_WRITE)
+    {
+        fprintf(stderr, "Batch full or write too long (%d)\n", length);
+        return I2C_ERR;
+    }
+    entry = &batch->entries[batch->count];
+    entry->dev_addr = dev_addr;
+    entry->length = length;
+    entry->data = NULL;
+    entry->write_buf[0] = reg_addr;
+    memcpy(entry->write_buf + 1, data, length);
+    entry->status = I2C_ERR;
+
+    return batch->count++;
+}
+
+/**
+ * Transfer the entries of a batch one at a time.
+ *
+ * @param batch Batch to submit
+ * @return I2C_OK when every entry was transferred, I2C_ERR otherwise
+ */
+static int batch_submit_each(i2c_batch_t *batch)
+{
+    int i, result = I2C_OK;
+
+    for (i = 0; i < batch->count; i++)
+    {
+        i2c_batch_entry_t *entry = &batch->entries[i];
+        if (entry->data)
+            entry->status = backend->read(backend->context, entry->dev_addr, entry->write_buf[0], entry->length, entry->data);
+        else
+            entry->status = backend->write(backend->context, entry->dev_addr, entry->write_buf[0], entry->length, entry->write_buf + 1);
+        if (entry->status != I2C_OK)
+            result = I2C_ERR;
+    }
+    return result;
+}
+
+/**
+ * Transfer every entry of a batch.
+ *
+ * The backend transfers the batch as a whole when it can, otherwise each
+ * entry is read or written on its own. The status of each entry is updated,
+ * entries past a failed message are left as I2C_ERR.
+ *
+ * @param batch Batch to submit
+ * @return I2C_OK when every entry was transferred, I2C_ERR otherwise
+ */
+int i2c_batch_submit(i2c_batch_t *batch)
+{
+    int result = backend->submit ? backend->submit(backend->context, batch) : batch_submit_each(batch);
+
+    COUNT(batches);
+    if (result != I2C_OK)
+        COUNT(errors);
+    return result;
+}
+
+/**
+ * With I2C_FUNC_I2C the whole batch is one I2C_RDWR ioctl, otherwise each
+ * entry is a transfer of its own.
+ */
+static int linux_submit(void *context, i2c_batch_t *batch)
+{
+    struct i2c_msg msgs[I2C_BATCH_MAX_ENTRIES * 2];
+    struct i2c_rdwr_ioctl_data xfer;
+    int i, n = 0, done, result = I2C_OK;
+
+    if (bus.fd < 0 && linux_open(context, bus.adapter) != I2C_OK)
+    {
+        return I2C_ERR;
+    }
+
+    if (!(bus.funcs & I2C_FUNC_I2C))
+    {
+        return batch_submit_each(batch);
+    }
+
+    for (i = 0; i < batch->count; i++)
+    {
+        i2c_batch_entry_t *entry = &batch->entries[i];
+        msgs[n].addr = entry->dev_addr;
+        msgs[n].flags = 0;
+        msgs[n].buf = entry->write_buf;
+        msgs[n].len = entry->data ? 1 : entry->length + 1;
+        n++;
+        if (entry->data)
+        {
+            msgs[n].addr = entry->dev_addr;
+            msgs[n].flags = I2C_M_RD;
+            msgs[n].buf = entry->data;
+            msgs[n].len = entry->length;
+            n++;
+        }
+    }
+    xfer.msgs = msgs;
+    xfer.nmsgs = n;
+
+    done = ioctl(bus.fd, I2C_RDWR, &xfer);
+    if (done < 0)
+    {
+        fprintf(stderr, "Failed to submit batch: %s\n", strerror(errno));
+        done = 0;
+    }
+
+    // map the number of completed messages back onto the entries
+    for (i = 0, n = 0; i < batch->count; i++)
+    {
+        n += batch->entries[i].data ? 2 : 1;
+        batch->entries[i].status = n <= done ? I2C_OK : I2C_ERR;
+        if (batch->entries[i].status != I2C_OK)
+            result = I2C_ERR;
+    }
+
+    return result;
+}
+
 /**
  * Read a single bit from an 8-bit device register.
  * 
@@ -190,6 +514,42 @@ int8_t read_word(uint8_t dev_addr, uint8_t reg_addr, uint16_t *data)
     return read_words(dev_addr, reg_addr, 1, data);
 }
 
+/**
+ * Read multiple bytes from an 8-bit device register in a single I2C_RDWR
+ * transaction: the register address write and the data read are joined by a
+ * repeated start, so there is one syscall and no STOP in between.
+ *
+ * @param dev_addr I2C slave device address
+ * @param reg_addr First register reg_addr to read from
+ * @param length Number of bytes to read
+ * @param data Buffer to store read data in
+ * @return Number of bytes read (-1 indicates failure)
+ */
+static int8_t read_bytes_rdwr(uint8_t dev_addr, uint8_t reg_addr, uint8_t length, uint8_t *data)
+{
+    struct i2c_msg msgs[2];
+    struct i2c_rdwr_ioctl_data xfer;
+
+    msgs[0].addr = dev_addr;
+    msgs[0].flags = 0;
+    msgs[0].len = 1;
+    msgs[0].buf = &reg_addr;
+    msgs[1].addr = dev_addr;
+    msgs[1].flags = I2C_M_RD;
+    msgs[1].len = length;
+    msgs[1].buf = data;
+    xfer.msgs = msgs;
+    xfer.nmsgs = 2;
+
+    if (ioctl(bus.fd, I2C_RDWR, &xfer) != 2)
+    {
+        fprintf(stderr, "Failed to read device: %s\n", strerror(errno));
+        return (-1);
+    }
+
+    return length;
+}
+
 /**
  * Read multiple bytes from an 8-bit device register.
  * 
@@ -202,45 +562,57 @@ int8_t read_word(uint8_t dev_addr, uint8_t reg_addr, uint16_t *data)
  */
 int8_t read_bytes(uint8_t dev_addr, uint8_t reg_addr, uint8_t length, uint8_t *data)
 {
-    int8_t count = 0;
 #ifdef DEBUG
     printf("read %#x %#x %u\n", dev_addr, reg_addr, length);
 #endif
-    int fd = open("/dev/i2c-1", O_RDWR);
+    COUNT(reads);
+    if (backend->read(backend->context, dev_addr, reg_addr, length, data) != I2C_OK)
+    {
+        COUNT(errors);
+        return -1;
+    }
+    return length;
+}
+
+/**
+ * Linux adapter read, one I2C_RDWR transaction when the adapter supports it,
+ * otherwise a register address write() followed by a read().
+ */
+static int linux_read(void *context, uint8_t dev_addr, uint8_t reg_addr, uint8_t length, uint8_t *data)
+{
+    int count = 0;
 
-    if (fd < 0)
+    if (bus.fd < 0 && linux_open(context, bus.adapter) != I2C_OK)
     {
-        fprintf(stderr, "Failed to open device: %s\n", strerror(errno));
-        return (-1);
+        return I2C_ERR;
     }
-    if (ioctl(fd, I2C_SLAVE, dev_addr) < 0)
+    if (bus.funcs & I2C_FUNC_I2C)
     {
-        fprintf(stderr, "Failed to select device: %s\n", strerror(errno));
-        close(fd);
-        return (-1);
+        return read_bytes_rdwr(dev_addr, reg_addr, length, data) == length ? I2C_OK : I2C_ERR;
     }
-    if (write(fd, &reg_addr, 1) != 1)
+    if (i2c_bus_select(dev_addr) != I2C_OK)
+    {
+        return I2C_ERR;
+    }
+    if (write(bus.fd, &reg_addr, 1) != 1)
     {
         fprintf(stderr, "Failed to write reg: %s\n", strerror(errno));
-        close(fd);
-        return (-1);
+        return I2C_ERR;
     }
-    count = read(fd, data, length);
+    count = read(bus.fd, data, length);
     if (count < 0)
     {
         fprintf(stderr, "Failed to read device(%d): %s\n", count, strerror(errno));
-        close(fd);
-        return (-1);
+        return I2C_ERR;
     }
     else if (count != length)
     {
         fprintf(stderr, "Short read  from device, expected %d, got %d\n", length, count);
-        close(fd);
-        return (-1);
+        COUNT(short_reads);
+        return I2C_ERR;
     }
-    close(fd);
 
-    return count;
+    return I2C_OK;
 }
 
 /**
@@ -405,49 +777,52 @@ int write_word(uint8_t dev_addr, uint8_t reg_addr, uint16_t data)
  */
 int write_bytes(uint8_t dev_addr, uint8_t reg_addr, uint8_t length, uint8_t *data)
 {
-    int8_t count = 0;
-    uint8_t buf[128];
-    int fd;
-
 #ifdef DEBUG
     printf("write %#x %#x\n", dev_addr, reg_addr);
 #endif
-    if (length > 127)
+    COUNT(writes);
+    if (backend->write(backend->context, dev_addr, reg_addr, length, data) != I2C_OK)
     {
-        fprintf(stderr, "Byte write count (%d) > 127\n", length);
+        COUNT(errors);
         return -1;
     }
+    return 0;
+}
 
-    fd = open("/dev/i2c-1", O_RDWR);
-    if (fd < 0)
+/**
+ * Linux adapter write, the register address and the payload in one write().
+ */
+static int linux_write(void *context, uint8_t dev_addr, uint8_t reg_addr, uint8_t length, const uint8_t *data)
+{
+    int count = 0;
+    uint8_t buf[128];
+
+    if (length > 127)
     {
-        fprintf(stderr, "Failed to open device: %s\n", strerror(errno));
-        return -1;
+        fprintf(stderr, "Byte write count (%d) > 127\n", length);
+        return I2C_ERR;
     }
-    if (ioctl(fd, I2C_SLAVE, dev_addr) < 0)
+
+    if (i2c_bus_select(dev_addr) != I2C_OK)
     {
-        fprintf(stderr, "Failed to select device: %s\n", strerror(errno));
-        close(fd);
-        return -1;
+        return I2C_ERR;
     }
     buf[0] = reg_addr;
     memcpy(buf + 1, data, length);
-    count = write(fd, buf, length + 1);
+    count = write(bus.fd, buf, length + 1);
     if (count < 0)
     {
         fprintf(stderr, "Failed to write device(%d): %s\n", count, strerror(errno));
-        close(fd);
-        return -1;
+        return I2C_ERR;
     }
     else if (count != length + 1)
     {
         fprintf(stderr, "Short write to device, expected %d, got %d\n", length + 1, count);
-        close(fd);
-        return -1;
+        COUNT(short_writes);
+        return I2C_ERR;
     }
-    close(fd);
 
-    return 0;
+    return I2C_OK;
 }
 
 /**
@@ -461,49 +836,19 @@ int write_bytes(uint8_t dev_addr, uint8_t reg_addr, uint8_t length, uint8_t *dat
  */
 int write_words(uint8_t dev_addr, uint8_t reg_addr, uint8_t length, uint16_t *data)
 {
-    int8_t count = 0;
-    uint8_t buf[128];
-    int i, fd;
-
-    // Should do potential byteswap and call write_bytes() really, but that messes with the callers buffer
+    uint8_t buf[126];
+    int i;
 
+    // big-endian like the 16-bit registers, in a copy so the callers buffer is left alone
     if (length > 63)
     {
         fprintf(stderr, "Word write count (%d) > 63\n", length);
         return -1;
     }
-
-    fd = open("/dev/i2c-1", O_RDWR);
-    if (fd < 0)
-    {
-        fprintf(stderr, "Failed to open device: %s\n", strerror(errno));
-        return -1;
-    }
-    if (ioctl(fd, I2C_SLAVE, dev_addr) < 0)
-    {
-        fprintf(stderr, "Failed to select device: %s\n", strerror(errno));
-        close(fd);
-        return -1;
-    }
-    buf[0] = reg_addr;
     for (i = 0; i < length; i++)
     {
-        buf[i * 2 + 1] = data[i] >> 8;
-        buf[i * 2 + 2] = data[i];
-    }
-    count = write(fd, buf, length * 2 + 1);
-    if (count < 0)
-    {
-        fprintf(stderr, "Failed to write device(%d): %s\n", count, strerror(errno));
-        close(fd);
-        return -1;
-    }
-    else if (count != length * 2 + 1)
-    {
-        fprintf(stderr, "Short write to device, expected %d, got %d\n", length + 1, count);
-        close(fd);
-        return -1;
+        buf[i * 2] = data[i] >> 8;
+        buf[i * 2 + 1] = data[i];
     }
-    close(fd);
-    return 0;
+    return write_bytes(dev_addr, reg_addr, length * 2, buf);
 }
@@ -49,9 +49,107 @@ THE SOFTWARE.
 #ifndef _I2CDEV_H_
 #define _I2CDEV_H_
 
+#include <stdint.h>
+
 #define I2C_OK 0
 #define I2C_ERR -1
 
+#define I2C_DEFAULT_ADAPTER 1
+
+/**
+ * I2C bus context.
+ *
+ * The adapter is opened once and kept open, the slave address selected with
+ * I2C_SLAVE is cached so the ioctl is only issued when the address changes.
+ * When the adapter reports I2C_FUNC_I2C register reads go out as one I2C_RDWR
+ * transaction, otherwise they fall back to write() followed by read().
+ */
+typedef struct
+{
+    int fd;              // adapter file descriptor, -1 when closed
+    int adapter;         // adapter number, /dev/i2c-<adapter>
+    int address;         // currently selected slave address, -1 when none
+    unsigned long funcs; // I2C_FUNCS reported by the adapter
+} i2c_bus_t;
+
+/**
+ * Transfer counters, kept whatever the backend. A batch counts once however
+ * many entries it has.
+ */
+typedef struct
+{
+    unsigned long reads;
+    unsigned long writes;
+    unsigned long batches;
+    unsigned long errors;       // failed reads, writes and batches
+    unsigned long short_reads;  // reads the adapter returned fewer bytes for
+    unsigned long short_writes; // writes the adapter took fewer bytes of
+} i2c_bus_stats_t;
+
+int i2c_bus_open(int adapter);
+void i2c_bus_close(void);
+i2c_bus_t *i2c_bus_get(void);
+void i2c_bus_get_stats(i2c_bus_stats_t *stats);
+
+#define I2C_BATCH_MAX_ENTRIES 16 // two messages per read, I2C_RDWR takes up to 42
+#define I2C_BATCH_MAX_WRITE 8    // payload bytes per batched write
+
+/**
+ * One read or write in a batch.
+ *
+ * Reads are a register address write followed by a repeated start read, writes
+ * carry the register address and the payload in a single message.
+ */
+typedef struct
+{
+    uint8_t dev_addr;
+    uint8_t length;
+    uint8_t *data;                              // read destination, NULL for writes
+    uint8_t write_buf[I2C_BATCH_MAX_WRITE + 1]; // register address and payload
+    int8_t status;                              // I2C_OK once transferred, I2C_ERR otherwise
+} i2c_batch_entry_t;
+
+/**
+ * List of transfers across any number of slaves submitted in one I2C_RDWR
+ * ioctl. A batch keeps its entries after a submit, so a sweep built once can
+ * be submitted again every sample.
+ */
+typedef struct
+{
+    uint8_t count;
+    i2c_batch_entry_t entries[I2C_BATCH_MAX_ENTRIES];
+} i2c_batch_t;
+
+/**
+ * Bus implementation behind the transfer functions.
+ *
+ * read and write move length bytes from or to consecutive registers and
+ * return I2C_OK or I2C_ERR. submit transfers a whole batch and sets the
+ * status of every entry, NULL submits the entries one by one through read
+ * and write. The Linux adapter (i2c_linux_backend) is used until another
+ * backend is set, e.g. the simulated bus in sim_bus.h.
+ */
+typedef struct
+{
+    const char *name;
+    int (*open)(void *context, int adapter);
+    void (*close)(void *context);
+    int (*read)(void *context, uint8_t dev_addr, uint8_t reg_addr, uint8_t length, uint8_t *data);
+    int (*write)(void *context, uint8_t dev_addr, uint8_t reg_addr, uint8_t length, const uint8_t *data);
+    int (*submit)(void *context, i2c_batch_t *batch);
+    void *context;
+} i2c_backend_t;
+
+extern const i2c_backend_t i2c_linux_backend;
+
+void i2c_bus_set_backend(const i2c_backend_t *backend);
+const i2c_backend_t *i2c_bus_get_backend(void);
+
+void i2c_batch_init(i2c_batch_t *batch);
+int i2c_batch_read(i2c_batch_t *batch, uint8_t dev_addr, uint8_t reg_addr, uint8_t length, uint8_t *data);
+int i2c_batch_write(i2c_batch_t *batch, uint8_t dev_addr, uint8_t reg_addr, uint8_t length, const uint8_t *data);
+int i2c_batch_submit(i2c_batch_t *batch);
+
 int8_t read_bit_word(uint8_t dev_addr, uint8_t reg_addr, uint8_t bit_num, uint16_t *data);
 int8_t read_bits(uint8_t dev_addr, uint8_t reg_addr, uint8_t bitStart, uint8_t length, uint8_t *data);
 int8_t read_bits_word(uint8_t dev_addr, uint8_t reg_addr, uint8_t bitStart, uint8_t length, uint16_t *data);
@@ -0,0 +1,243 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "I2Cdev.h"
+#include "shadow.h"
+
+#define BIT_GET(map, i) ((map)[(i) >> 3] & (1 << ((i) & 7)))
+#define BIT_SET(map, i) ((map)[(i) >> 3] |= (1 << ((i) & 7)))
+#define BIT_CLR(map, i) ((map)[(i) >> 3] &= ~(1 << ((i) & 7)))
+
+/**
+ * Check a register is inside the shadow window.
+ *
+ * @param shadow Shadow register file
+ * @param reg_addr Register address
+ * @return Index in the window, -1 when outside
+ */
+static int shadow_index(i2c_shadow_t *shadow, uint8_t reg_addr)
+{
+    if (reg_addr < shadow->first || reg_addr >= shadow->first + shadow->length)
+        return -1;
+    return reg_addr - shadow->first;
+}
+
+/**
+ * Set up an empty shadow, every register starts unknown.
+ *
+ * @param shadow Shadow register file
+ * @param dev_addr I2C slave device address
+ * @param first First register covered
+ * @param length Number of registers covered (not more than I2C_SHADOW_LENGTH)
+ * @return I2C_OK on success, I2C_ERR when the window is too large
+ */
+int i2c_shadow_init(i2c_shadow_t *shadow, uint8_t dev_addr, uint8_t first, uint8_t length)
+{
+    memset(shadow, 0, sizeof(*shadow));
+    if (length > I2C_SHADOW_LENGTH || first + length > 0x100)
+    {
+        fprintf(stderr, "Shadow window %#x+%d too large\n", first, length);
+        return I2C_ERR;
+    }
+    shadow->dev_addr = dev_addr;
+    shadow->first = first;
+    shadow->length = length;
+    return I2C_OK;
+}
+
+/**
+ * Declare the current value of a register without reading it, e.g. its
+ * documented reset value right after a device reset.
+ *
+ * @param shadow Shadow register file
+ * @param reg_addr Register address
+ * @param value Value the device holds
+ */
+void i2c_shadow_declare(i2c_shadow_t *shadow, uint8_t reg_addr, uint8_t value)
+{
+    int i = shadow_index(shadow, reg_addr);
+    if (i < 0)
+        return;
+    shadow->values[i] = value;
+    BIT_SET(shadow->valid, i);
+    BIT_CLR(shadow->dirty, i);
+}
+
+/**
+ * Populate a range of the shadow with one burst read. Registers with a pending
+ * write keep their local value.
+ *
+ * @param shadow Shadow register file
+ * @param reg_addr First register to read
+ * @param length Number of registers to read
+ * @return I2C_OK on success, I2C_ERR on failure
+ */
+int i2c_shadow_refresh(i2c_shadow_t *shadow, uint8_t reg_addr, uint8_t length)
+{
+    uint8_t buf[I2C_SHADOW_LENGTH];
+    int i, k;
+
+    if (shadow_index(shadow, reg_addr) < 0 || length == 0 || shadow_index(shadow, reg_addr + length - 1) < 0)
+        return I2C_ERR;
+    if (read_bytes(shadow->dev_addr, reg_addr, length, buf) != length)
+        return I2C_ERR;
+
+    for (k = 0; k < length; k++)
+    {
+        i = reg_addr + k - shadow->first;
+        if (BIT_GET(shadow->dirty, i))
+            continue;
+        shadow->values[i] = buf[k];
+        BIT_SET(shadow->valid, i);
+    }
+    return I2C_OK;
+}
+
+/**
+ * Forget a range of registers, for registers the device changes on its own
+ * (self clearing bits, status). Pending writes in the range are dropped and
+ * the next access reads them from the bus again.
+ *
+ * @param shadow Shadow register file
+ * @param reg_addr First register to forget
+ * @param length Number of registers
+ */
+void i2c_shadow_invalidate(i2c_shadow_t *shadow, uint8_t reg_addr, uint8_t length)
+{
+    int i, k;
+
+    for (k = 0; k < length; k++)
+    {
+        if ((i = shadow_index(shadow, reg_addr + k)) < 0)
+            continue;
+        BIT_CLR(shadow->valid, i);
+        BIT_CLR(shadow->dirty, i);
+    }
+}
+
+/**
+ * Read a register through the shadow, only a register not known yet is read
+ * from the bus.
+ *
+ * @param shadow Shadow register file
+ * @param reg_addr Register address
+ * @param data Container for byte value
+ * @return I2C_OK on success, I2C_ERR on failure
+ */
+int i2c_shadow_read_byte(i2c_shadow_t *shadow, uint8_t reg_addr, uint8_t *data)
+{
+    int i = shadow_index(shadow, reg_addr);
+
+    if (i < 0)
+        return read_byte(shadow->dev_addr, reg_addr, data) == 1 ? I2C_OK : I2C_ERR;
+    if (!BIT_GET(shadow->valid, i) && i2c_shadow_refresh(shadow, reg_addr, 1) != I2C_OK)
+        return I2C_ERR;
+    *data = shadow->values[i];
+    return I2C_OK;
+}
+
+/**
+ * Write a single bit in a shadowed register.
+ *
+ * @param shadow Shadow register file
+ * @param reg_addr Register address
+ * @param bit_num Bit position to write (0-7)
+ * @param data New bit value to write
+ * @return I2C_OK on success, I2C_ERR on failure
+ */
+int i2c_shadow_write_bit(i2c_shadow_t *shadow, uint8_t reg_addr, uint8_t bit_num, uint8_t data)
+{
+    return i2c_shadow_write_bits(shadow, reg_addr, bit_num, 1, data != 0);
+}
+
+/**
+ * Write multiple bits in a shadowed register, see write_bits().
+ *
+ * @param shadow Shadow register file
+ * @param reg_addr Register address
+ * @param bitStart First bit position to write (0-7)
+ * @param length Number of bits to write (not more than 8)
+ * @param data Right-aligned value to write
+ * @return I2C_OK on success, I2C_ERR on failure
+ */
+int i2c_shadow_write_bits(i2c_shadow_t *shadow, uint8_t reg_addr, uint8_t bitStart, uint8_t length, uint8_t data)
+{
+    uint8_t b;
+    uint8_t mask = ((1 << length) - 1) << (bitStart - length + 1);
+
+    if (shadow_index(shadow, reg_addr) < 0)
+        return write_bits(shadow->dev_addr, reg_addr, bitStart, length, data) == 0 ? I2C_OK : I2C_ERR;
+    if (i2c_shadow_read_byte(shadow, reg_addr, &b) != I2C_OK)
+        return I2C_ERR;
+
+    data <<= (bitStart - length + 1);
+    b = (b & ~mask) | (data & mask);
+    return i2c_shadow_write_byte(shadow, reg_addr, b);
+}
+
+/**
+ * Write a shadowed register. The write is skipped when the device already
+ * holds the value.
+ *
+ * @param shadow Shadow register file
+ * @param reg_addr Register address
+ * @param data New byte value to write
+ * @return I2C_OK on success, I2C_ERR on failure
+ */
+int i2c_shadow_write_byte(i2c_shadow_t *shadow, uint8_t reg_addr, uint8_t data)
+{
+    int i = shadow_index(shadow, reg_addr);
+
+    if (i < 0)
+        return write_byte(shadow->dev_addr, reg_addr, data) == 0 ? I2C_OK : I2C_ERR;
+    if (BIT_GET(shadow->valid, i) && shadow->values[i] == data)
+        return I2C_OK;
+
+    shadow->values[i] = data;
+    BIT_SET(shadow->valid, i);
+    BIT_SET(shadow->dirty, i);
+    return shadow->hold ? I2C_OK : i2c_shadow_flush(shadow);
+}
+
+/**
+ * Defer writes until the next i2c_shadow_flush().
+ *
+ * @param shadow Shadow register file
+ */
+void i2c_shadow_hold(i2c_shadow_t *shadow)
+{
+    shadow->hold = 1;
+}
+
+/**
+ * Write every dirty register, each run of contiguous dirty registers goes out
+ * as one burst write. Ends a hold.
+ *
+ * @param shadow Shadow register file
+ * @return I2C_OK on success, I2C_ERR when a write failed (those stay dirty)
+ */
+int i2c_shadow_flush(i2c_shadow_t *shadow)
+{
+    int i = 0, start, k, result = I2C_OK;
+
+    shadow->hold = 0;
+    while (i < shadow->length)
+    {
+        if (!BIT_GET(shadow->dirty, i))
+        {
+            i++;
+            continue;
+        }
+        for (start = i; i < shadow->length && BIT_GET(shadow->dirty, i); i++)
+            ;
+        if (write_bytes(shadow->dev_addr, shadow->first + start, i - start, shadow->values + start) != 0)
+        {
+            result = I2C_ERR;
+            continue;
+        }
+        for (k = start; k < i; k++)
+            BIT_CLR(shadow->dirty, k);
+    }
+    return result;
+}
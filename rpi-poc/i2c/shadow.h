@@ -0,0 +1,41 @@
+#ifndef _I2C_SHADOW_H_
+#define _I2C_SHADOW_H_
+
+#include <stdint.h>
+
+#define I2C_SHADOW_LENGTH 128 // registers a shadow can cover
+
+/**
+ * Shadow register file of one I2C device.
+ *
+ * Keeps a local copy of a window of registers so bit field updates do not have
+ * to read the register over the bus first. Writes mark registers dirty and are
+ * sent right away, or between i2c_shadow_hold() and i2c_shadow_flush() where
+ * contiguous dirty registers are coalesced into burst writes. Registers outside
+ * the window go straight to the bus.
+ */
+typedef struct
+{
+    uint8_t dev_addr;
+    uint8_t first;  // first register covered
+    uint8_t length; // number of registers covered
+    uint8_t hold;   // defer writes until i2c_shadow_flush()
+    uint8_t values[I2C_SHADOW_LENGTH];
+    uint8_t valid[I2C_SHADOW_LENGTH / 8];
+    uint8_t dirty[I2C_SHADOW_LENGTH / 8];
+} i2c_shadow_t;
+
+int i2c_shadow_init(i2c_shadow_t *shadow, uint8_t dev_addr, uint8_t first, uint8_t length);
+void i2c_shadow_declare(i2c_shadow_t *shadow, uint8_t reg_addr, uint8_t value);
+int i2c_shadow_refresh(i2c_shadow_t *shadow, uint8_t reg_addr, uint8_t length);
+void i2c_shadow_invalidate(i2c_shadow_t *shadow, uint8_t reg_addr, uint8_t length);
+
+int i2c_shadow_read_byte(i2c_shadow_t *shadow, uint8_t reg_addr, uint8_t *data);
+int i2c_shadow_write_bit(i2c_shadow_t *shadow, uint8_t reg_addr, uint8_t bit_num, uint8_t data);
+int i2c_shadow_write_bits(i2c_shadow_t *shadow, uint8_t reg_addr, uint8_t bitStart, uint8_t length, uint8_t data);
+int i2c_shadow_write_byte(i2c_shadow_t *shadow, uint8_t reg_addr, uint8_t data);
+
+void i2c_shadow_hold(i2c_shadow_t *shadow);
+int i2c_shadow_flush(i2c_shadow_t *shadow);
+
+#endif /* _I2C_SHADOW_H_ */
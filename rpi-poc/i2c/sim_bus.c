@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "sim_bus.h"
+#include "../stats/clock.h"
+
+/**
+ * Sleep until a transfer of bytes started at start would be done.
+ */
+static void bus_wait(i2c_sim_bus_t *bus, uint64_t start, unsigned int bytes)
+{
+    uint64_t end = start + bus->transaction_ns + bytes * bus->byte_ns;
+    struct timespec deadline;
+
+    if (bus->transaction_ns == 0 && bus->byte_ns == 0)
+        return;
+    deadline.tv_sec = end / 1000000000ull;
+    deadline.tv_nsec = end % 1000000000ull;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) != 0)
+        ;
+}
+
+/**
+ * Count a transaction, the injected failures included.
+ *
+ * @return I2C_OK, I2C_ERR when this one is made to fail
+ */
+static int bus_transaction(i2c_sim_bus_t *bus)
+{
+    bus->transactions++;
+    if (bus->fail_every && bus->transactions % bus->fail_every == 0)
+    {
+        bus->errors++;
+        return I2C_ERR;
+    }
+    return I2C_OK;
+}
+
+/**
+ * Transfer to or from one slave, an absent slave does not acknowledge.
+ */
+static int bus_transfer(i2c_sim_bus_t *bus, uint64_t now, uint8_t dev_addr, uint8_t reg_addr,
+                        uint8_t length, uint8_t *read_data, const uint8_t *write_data)
+{
+    i2c_sim_device_t *device = i2c_sim_bus_find(bus, dev_addr);
+
+    if (device == NULL)
+    {
+        bus->errors++;
+        return I2C_ERR;
+    }
+    if (read_data)
+        device->read(device->model, now, reg_addr, length, read_data);
+    else
+        device->write(device->model, now, reg_addr, length, write_data);
+    // slave address and register, plus the repeated start address of a read
+    bus->bytes += length + (read_data ? 3 : 2);
+    return I2C_OK;
+}
+
+static int sim_open(void *context, int adapter)
+{
+    return I2C_OK;
+}
+
+static void sim_close(void *context)
+{
+}
+
+static int sim_read(void *context, uint8_t dev_addr, uint8_t reg_addr, uint8_t length, uint8_t *data)
+{
+    i2c_sim_bus_t *bus = context;
+    uint64_t start = clock_now_ns();
+    int result;
+
+    pthread_mutex_lock(&bus->lock);
+    result = bus_transaction(bus);
+    if (result == I2C_OK)
+        result = bus_transfer(bus, start, dev_addr, reg_addr, length, data, NULL);
+    pthread_mutex_unlock(&bus->lock);
+    bus_wait(bus, start, length + 3);
+    return result;
+}
+
+static int sim_write(void *context, uint8_t dev_addr, uint8_t reg_addr, uint8_t length, const uint8_t *data)
+{
+    i2c_sim_bus_t *bus = context;
+    uint64_t start = clock_now_ns();
+    int result;
+
+    pthread_mutex_lock(&bus->lock);
+    result = bus_transaction(bus);
+    if (result == I2C_OK)
+        result = bus_transfer(bus, start, dev_addr, reg_addr, length, NULL, data);
+    pthread_mutex_unlock(&bus->lock);
+    bus_wait(bus, start, length + 2);
+    return result;
+}
+
+/**
+ * A batch is one transaction, the messages after a failed one are not sent.
+ */
+static int sim_submit(void *context, i2c_batch_t *batch)
+{
+    i2c_sim_bus_t *bus = context;
+    uint64_t start = clock_now_ns();
+    unsigned int bytes = 0;
+    int i, result;
+
+    pthread_mutex_lock(&bus->lock);
+    result = bus_transaction(bus);
+    for (i = 0; i < batch->count; i++)
+    {
+        i2c_batch_entry_t *entry = &batch->entries[i];
+
+        if (result == I2C_OK)
+            result = bus_transfer(bus, start, entry->dev_addr, entry->write_buf[0], entry->length,
+                                  entry->data, entry->data ? NULL : entry->write_buf + 1);
+        entry->status = result;
+        bytes += entry->length + (entry->data ? 3 : 2);
+    }
+    pthread_mutex_unlock(&bus->lock);
+    bus_wait(bus, start, bytes);
+    return result;
+}
+
+/**
+ * Set up an empty bus without latency.
+ *
+ * @param bus Simulated bus
+ */
+void i2c_sim_bus_init(i2c_sim_bus_t *bus)
+{
+    memset(bus, 0, sizeof(*bus));
+    pthread_mutex_init(&bus->lock, NULL);
+    bus->backend.name = "sim";
+    bus->backend.open = sim_open;
+    bus->backend.close = sim_close;
+    bus->backend.read = sim_read;
+    bus->backend.write = sim_write;
+    bus->backend.submit = sim_submit;
+    bus->backend.context = bus;
+}
+
+/**
+ * Latency of a bus clocked at khz, 9 clock cycles per byte and a few more
+ * for start, stop and the kernel round trip of a transaction.
+ *
+ * @param bus Simulated bus
+ * @param khz SCL frequency, 0 for no latency
+ */
+void i2c_sim_bus_set_speed(i2c_sim_bus_t *bus, unsigned int khz)
+{
+    bus->byte_ns = khz ? 9000000ull / khz : 0;
+    bus->transaction_ns = khz ? 20000 + 3000000ull / khz : 0;
+}
+
+/**
+ * Put a device model on the bus.
+ *
+ * @param bus Simulated bus
+ * @param device Device, copied
+ * @return I2C_OK, I2C_ERR when the bus is full or the address taken
+ */
+int i2c_sim_bus_attach(i2c_sim_bus_t *bus, const i2c_sim_device_t *device)
+{
+    if (bus->count >= I2C_SIM_MAX_DEVICES || i2c_sim_bus_find(bus, device->address))
+    {
+        fprintf(stderr, "Can not attach a simulated device at %#x\n", device->address);
+        return I2C_ERR;
+    }
+    bus->devices[bus->count++] = *device;
+    return I2C_OK;
+}
+
+/**
+ * Find the device answering at an address.
+ *
+ * @param bus Simulated bus
+ * @param address 7-bit slave address
+ * @return Device, NULL when none answers
+ */
+i2c_sim_device_t *i2c_sim_bus_find(i2c_sim_bus_t *bus, uint8_t address)
+{
+    int i;
+
+    for (i = 0; i < bus->count; i++)
+        if (bus->devices[i].address == address)
+            return &bus->devices[i];
+    return NULL;
+}
+
+/**
+ * Backend to hand to i2c_bus_set_backend().
+ *
+ * @param bus Simulated bus
+ * @return Backend transferring on this bus
+ */
+const i2c_backend_t *i2c_sim_bus_backend(i2c_sim_bus_t *bus)
+{
+    return &bus->backend;
+}
@@ -0,0 +1,56 @@
+#ifndef _I2C_SIM_BUS_H_
+#define _I2C_SIM_BUS_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "I2Cdev.h"
+
+#define I2C_SIM_MAX_DEVICES 8
+
+/**
+ * Register level model of one slave on the simulated bus.
+ *
+ * read and write get consecutive register accesses starting at reg_addr,
+ * the model decides how its address pointer moves (auto-increment, FIFO
+ * ports, wrap-around) and what side effects an access has. now is the
+ * CLOCK_MONOTONIC ns of the transfer, models produce their samples from it.
+ */
+typedef struct
+{
+    uint8_t address;
+    void *model;
+    void (*read)(void *model, uint64_t now, uint8_t reg_addr, uint8_t length, uint8_t *data);
+    void (*write)(void *model, uint64_t now, uint8_t reg_addr, uint8_t length, const uint8_t *data);
+} i2c_sim_device_t;
+
+/**
+ * In-process I2C bus for hosts without an adapter.
+ *
+ * Every transfer takes transaction_ns plus byte_ns per byte moved, including
+ * the address bytes, and the caller sleeps until then like it would in the
+ * kernel, so loop throughput against a slow bus can be measured on any
+ * machine. A batch is one transaction, like I2C_RDWR. fail_every makes every
+ * nth transaction fail. Transfers are serialised like on a real bus.
+ */
+typedef struct
+{
+    i2c_sim_device_t devices[I2C_SIM_MAX_DEVICES];
+    int count;
+    uint64_t transaction_ns;    // start, stop and turnaround per transaction
+    uint64_t byte_ns;           // 9 clock cycles per byte
+    unsigned long fail_every;   // 0 never fails
+    pthread_mutex_t lock;
+    i2c_backend_t backend;
+    unsigned long transactions;
+    unsigned long bytes;
+    unsigned long errors;       // injected failures and transfers to absent slaves
+} i2c_sim_bus_t;
+
+void i2c_sim_bus_init(i2c_sim_bus_t *bus);
+void i2c_sim_bus_set_speed(i2c_sim_bus_t *bus, unsigned int khz);
+int i2c_sim_bus_attach(i2c_sim_bus_t *bus, const i2c_sim_device_t *device);
+i2c_sim_device_t *i2c_sim_bus_find(i2c_sim_bus_t *bus, uint8_t address);
+const i2c_backend_t *i2c_sim_bus_backend(i2c_sim_bus_t *bus);
+
+#endif /* _I2C_SIM_BUS_H_ */
@@ -1,42 +1,760 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
+#include <signal.h>
+#include <unistd.h>
 
+#include "i2c/I2Cdev.h"
+#include "i2c/sim_bus.h"
+#include "comm/comm.h"
+#include "gpio/gpio_event.h"
+#include "pipeline/pipeline.h"
+#include "sched/periodic.h"
+#include "shm/attitude_shm.h"
+#include "recorder/recorder.h"
+#include "stats/loop_stats.h"
 #include "sensors/mpu6050.h"
+#include "sensors/mpu6050_registers.h"
 #include "sensors/hcm5883l.h"
+#include "sensors/hcm5883l_registers.h"
+#include "sensors/sim_motion.h"
+#include "sensors/mpu6050_sim.h"
+#include "sensors/hcm5883l_sim.h"
 #include "MahonyAHRS.h"
+#include "stats/clock.h"
 
 #define ACCELEROMETER_SENSITIVITY 8192.0
 #define GYROSCOPE_SENSITIVITY 65.536
 
-#define dt 0.01 // 10 ms sample rate!
+volatile sig_atomic_t running = 1;
 
-short accData[3], gyrData[3];
-float pitch, roll;
+void on_signal(int signum)
+{
+  running = 0;
+}
+
+#define AUX_MAG_RATE 75 // Hz, HMC5883L_RATE_75
+
+int aux_mag = 0; // 1 lets the MPU6050 auxiliary I2C master poll the magnetometer
+
+i2c_batch_t sweep;
+uint8_t motion_buffer[MPU6050_MOTION_9_LENGTH];
+uint8_t heading_buffer[HMC5883L_HEADING_LENGTH];
+
+/**
+ * In aux mode the magnetometer data is mirrored after the gyroscope registers
+ * and the whole sample is a single burst read.
+ */
+void setup_sweep()
+{
+  i2c_batch_init(&sweep);
+  if (aux_mag)
+  {
+    mpu6050_batch_motion_9(&sweep, motion_buffer);
+  }
+  else
+  {
+    mpu6050_batch_motion_6(&sweep, motion_buffer);
+    hcm5883l_batch_heading(&sweep, heading_buffer);
+  }
+}
+
+void get_heading(int16_t *mx, int16_t *my, int16_t *mz)
+{
+  if (aux_mag)
+  {
+    if (mpu6050_read_ext_sens_data(heading_buffer, HMC5883L_HEADING_LENGTH) == I2C_OK)
+      hcm5883l_decode_heading(heading_buffer, mx, my, mz);
+  }
+  else
+  {
+    getHeading(mx, my, mz);
+  }
+}
+
+#define FIFO_MAX_SAMPLES (MPU6050_FIFO_SIZE / MPU6050_FIFO_FRAME_LENGTH)
+
+int fifo_rate = 0; // Hz, 0 polls the data registers instead of the FIFO
+uint64_t fifo_period; // ns between FIFO frames, from the programmed sample rate
+mpu6050_sample_t fifo_samples[FIFO_MAX_SAMPLES];
+
+#define DRDY_TIMEOUT_MS 1000
+
+int drdy_line = -1; // GPIO line wired to the MPU6050 INT pin, -1 samples flat out
+int drdy_rate = 100; // Hz
+gpio_event_source_t drdy = {-1, -1};
+uint64_t last_fused = 0; // timestamp of the previous sample fused
+
+int binary = 0; // 1 writes framed binary telemetry to stdout instead of text
+telemetry_writer_t telemetry;
+
+int fifo_output = 0; // 1 writes to the COMM_FIFO_PATH pipe through comm instead of stdout
+
+int shared = 0; // 1 publishes every attitude to the ATTITUDE_SHM_NAME segment
+attitude_shm_writer_t shm;
+
+const char *sim_source = NULL; // "synthetic" or a flight data recorder segment, runs on the simulated bus
+int sim_khz = 400; // simulated bus clock, 0 makes transfers free
+i2c_sim_bus_t sim_bus;
+mpu6050_sim_t sim_mpu;
+hcm5883l_sim_t sim_mag;
+sim_motion_synthetic_t sim_synthetic;
+sim_motion_log_t sim_log;
+recorder_reader_t sim_reader;
+
+/**
+ * Both sensor models on an in-process bus instead of the adapter. The
+ * magnetometer sits on the host bus, which stands in for the auxiliary one
+ * as well, like the bypass wiring of the board.
+ */
+int setup_simulation()
+{
+  sim_motion_source_t source;
+  i2c_sim_device_t device;
+  uint64_t origin = clock_now_ns();
+
+  if (strcmp(sim_source, "synthetic") == 0)
+  {
+    sim_motion_synthetic_source(&source, &sim_synthetic, 0.01);
+  }
+  else if (recorder_open(&sim_reader, sim_source) == 0 && sim_reader.count > 0)
+  {
+    sim_motion_log_source(&source, &sim_log, sim_reader.records, sim_reader.count);
+  }
+  else
+  {
+    fprintf(stderr, "%s: not a flight data recorder segment\n", sim_source);
+    return -1;
+  }
+  i2c_sim_bus_init(&sim_bus);
+  i2c_sim_bus_set_speed(&sim_bus, sim_khz);
+  mpu6050_sim_init(&sim_mpu, &source, origin, &sim_bus);
+  mpu6050_sim_device(&sim_mpu, &device);
+  i2c_sim_bus_attach(&sim_bus, &device);
+  hcm5883l_sim_init(&sim_mag, &source, origin);
+  hcm5883l_sim_device(&sim_mag, &device);
+  i2c_sim_bus_attach(&sim_bus, &device);
+  i2c_bus_set_backend(i2c_sim_bus_backend(&sim_bus));
+  return 0;
+}
+
+void attitude_to_record(const pipeline_attitude_t *attitude, telemetry_record_t *record)
+{
+  record->type = TELEMETRY_ATTITUDE;
+  record->sequence = 0;
+  record->timestamp = attitude->timestamp;
+  record->q0 = attitude->q0;
+  record->q1 = attitude->q1;
+  record->q2 = attitude->q2;
+  record->q3 = attitude->q3;
+  record->roll = attitude->roll;
+  record->pitch = attitude->pitch;
+  record->yaw = attitude->yaw;
+  record->ax = attitude->ax;
+  record->ay = attitude->ay;
+  record->az = attitude->az;
+  record->gx = attitude->gx;
+  record->gy = attitude->gy;
+  record->gz = attitude->gz;
+  record->mx = attitude->mx;
+  record->my = attitude->my;
+  record->mz = attitude->mz;
+}
+
+/**
+ * Local consumers read the segment at their own pace, publishing never
+ * blocks so it happens on the fusion side for every sample.
+ */
+void publish_shared(const pipeline_attitude_t *attitude)
+{
+  telemetry_record_t record;
+  attitude_shm_stats_t stats;
+
+  attitude_to_record(attitude, &record);
+  stats.published = 0;
+  stats.updated = attitude->fused;
+  stats.sample_freq = mahony_get_sample_freq();
+  stats.dt_clamped = mahony_get_dt_clamped();
+  attitude_shm_publish(&shm, &record, &stats);
+}
+
+const char *record_directory = NULL; // flight data recorder segments go here, NULL records nothing
+recorder_t recorder;
+
+/**
+ * Raw sample and the attitude fused from it, a copy into the mapped segment.
+ */
+void record_sample(const pipeline_sample_t *sample, const pipeline_attitude_t *attitude)
+{
+  recorder_record_t record;
+
+  record.timestamp = sample->timestamp;
+  record.flags = RECORDER_RAW | RECORDER_FUSED;
+  record.ax = sample->ax;
+  record.ay = sample->ay;
+  record.az = sample->az;
+  record.gx = sample->gx;
+  record.gy = sample->gy;
+  record.gz = sample->gz;
+  record.mx = sample->mx;
+  record.my = sample->my;
+  record.mz = sample->mz;
+  record.q0 = attitude->q0;
+  record.q1 = attitude->q1;
+  record.q2 = attitude->q2;
+  record.q3 = attitude->q3;
+  record.roll = attitude->roll;
+  record.pitch = attitude->pitch;
+  record.yaw = attitude->yaw;
+  recorder_append(&recorder, &record);
+}
+
+loop_stats_t loop_stats;
+uint64_t last_acquired = 0; // start of the previous sample read
+
+/**
+ * Time between the starts of two reads, what paces the loop whatever does.
+ */
+void count_period(uint64_t acquired)
+{
+  if (last_acquired)
+    loop_stats_add(&loop_stats, LOOP_STATS_PERIOD, acquired - last_acquired);
+  last_acquired = acquired;
+}
+
+int pipeline_cpu = -2; // core the acquisition thread is pinned to, -1 unpinned, -2 no pipeline
+pipeline_t pipeline;
+
+int loop_rate = 0; // Hz, 0 reads flat out when neither the FIFO nor data ready paces the loop
+periodic_config_t loop_config = {0, PERIODIC_CATCH_UP, 0, 0, -1};
+periodic_t loop;
+int loop_started = 0;
+
+/**
+ * FIFO mode: drain the queued accel/gyro samples, the magnetometer is read
+ * once per drain and reused for all of them. The frames were sampled by the
+ * MPU6050 clock, they are stamped at the programmed period no matter when
+ * they are drained.
+ */
+int acquire_fifo(pipeline_sample_t *samples, int max)
+{
+  static uint64_t fifo_clock = 0; // timestamp of the last frame handed out
+  int16_t mx = 0, my = 0, mz = 0;
+  uint64_t acquired = clock_now_ns(), start;
+  int i, n = mpu6050_fifo_read(fifo_samples, max < FIFO_MAX_SAMPLES ? max : FIFO_MAX_SAMPLES);
+
+  loop_stats_record(&loop_stats, LOOP_STATS_ACQUIRE, acquired);
+  count_period(acquired);
+
+  if (n < 0)
+  {
+    fprintf(stderr, "FIFO read failed, %lu overflows\n", mpu6050_fifo_overflows());
+    // frames were lost, restart the clock from the next drain
+    fifo_clock = 0;
+    return 0;
+  }
+  if (n > 0)
+  {
+    if (fifo_clock == 0)
+      fifo_clock = clock_now_ns() - n * fifo_period;
+    start = clock_now_ns();
+    get_heading(&mx, &my, &mz);
+    loop_stats_record(&loop_stats, LOOP_STATS_MAG, start);
+    for (i = 0; i < n; i++)
+    {
+      mpu6050_sample_t *frame = &fifo_samples[i];
+      pipeline_sample_t *sample = &samples[i];
 
-void calculate_pitch_roll_yaw()
+      fifo_clock += fifo_period;
+      sample->timestamp = fifo_clock;
+      sample->ax = frame->ax;
+      sample->ay = frame->ay;
+      sample->az = frame->az;
+      sample->gx = frame->gx;
+      sample->gy = frame->gy;
+      sample->gz = frame->gz;
+      sample->mx = mx;
+      sample->my = my;
+      sample->mz = mz;
+    }
+  }
+  if (n < MPU6050_FIFO_CHUNK_FRAMES)
+  {
+    // let at least one burst worth of frames queue up
+    usleep(MPU6050_FIFO_CHUNK_FRAMES * 1000000 / fifo_rate);
+  }
+  return n;
+}
+
+/**
+ * Read the next samples: the FIFO, one reading after the data ready edge, one
+ * reading per period of the fixed rate loop or one reading flat out. Returns how many, 0 when there was nothing to read,
+ * -1 when data ready failed for good.
+ */
+int acquire(void *context, pipeline_sample_t *samples, int max)
+{
+  pipeline_sample_t *sample = &samples[0];
+  uint64_t acquired;
+  int result;
+
+  if (fifo_rate > 0)
+    return acquire_fifo(samples, max);
+
+  if (drdy_line >= 0)
+  {
+    // sleep until the INT edge, the kernel timestamp is the sample time
+    int ready = gpio_event_wait(&drdy, DRDY_TIMEOUT_MS, &sample->timestamp);
+    if (ready <= 0)
+      return ready;
+  }
+  else if (loop_rate > 0)
+  {
+    // set up on the first call, the scheduling options apply to the thread acquiring
+    if (!loop_started && periodic_init(&loop, &loop_config) == 0)
+      loop_started = 1;
+    periodic_wait(&loop);
+    sample->timestamp = clock_now_ns();
+  }
+  else
+  {
+    sample->timestamp = clock_now_ns();
+  }
+
+  // the sweep carries the heading too, so there is no separate mag stage
+  acquired = clock_now_ns();
+  result = i2c_batch_submit(&sweep);
+  loop_stats_record(&loop_stats, LOOP_STATS_ACQUIRE, acquired);
+  count_period(acquired);
+  if (result != I2C_OK)
+  {
+    return 0;
+  }
+  mpu6050_decode_motion_6(motion_buffer, &sample->ax, &sample->ay, &sample->az, &sample->gx, &sample->gy, &sample->gz);
+  hcm5883l_decode_heading(aux_mag ? motion_buffer + MPU6050_EXT_SENS_OFFSET : heading_buffer, &sample->mx, &sample->my, &sample->mz);
+  return 1;
+}
+
+/**
+ * The filter integrates the time since the previous sample, out of range
+ * values (the first sample, a stalled loop) are clamped by the filter.
+ */
+void fuse(void *context, const pipeline_sample_t *sample, pipeline_attitude_t *attitude)
 {
-  int16_t ax, ay, az, gx, gy, gz, mx, my, mz;
-  mpu6050_get_motion_6(&ax, &ay, &az, &gx, &gy, &gz);
-  getHeading(&mx, &my, &mz);
   float gyroScale = 3.14159f / 180.0f;
-  mahony_update(gx * gyroScale, gy * gyroScale, gz * gyroScale, ax, ay, az, mx, my, mz);
+  float dt = last_fused ? (sample->timestamp - last_fused) * 1e-9f : 0.0f;
+  uint64_t start = clock_now_ns();
+
+  last_fused = sample->timestamp;
+  mahony_update_dt(sample->gx * gyroScale, sample->gy * gyroScale, sample->gz * gyroScale,
+                   sample->ax, sample->ay, sample->az, sample->mx, sample->my, sample->mz, dt);
+  loop_stats_record(&loop_stats, LOOP_STATS_FUSE, start);
+
+  float q[4];
 
+  mahony_get_quaternion(q);
+  attitude->timestamp = sample->timestamp;
+  attitude->fused = clock_now_ns();
+  attitude->q0 = q[0];
+  attitude->q1 = q[1];
+  attitude->q2 = q[2];
+  attitude->q3 = q[3];
+  start = clock_now_ns();
+  attitude->roll = mahony_get_roll();
+  attitude->pitch = mahony_get_pitch();
+  attitude->yaw = mahony_get_yaw();
+  loop_stats_record(&loop_stats, LOOP_STATS_ANGLES, start);
+  attitude->ax = sample->ax;
+  attitude->ay = sample->ay;
+  attitude->az = sample->az;
+  attitude->gx = sample->gx;
+  attitude->gy = sample->gy;
+  attitude->gz = sample->gz;
+  attitude->mx = sample->mx;
+  attitude->my = sample->my;
+  attitude->mz = sample->mz;
+
+  if (shared)
+    publish_shared(attitude);
+  if (record_directory)
+    record_sample(sample, attitude);
+}
+
+void print_pitch_roll_yaw(void *context, const pipeline_attitude_t *attitude)
+{
+  if (fifo_output)
+  {
+    comm_write("%f\t%f\t%f\n", attitude->pitch, attitude->roll, attitude->yaw);
+    return;
+  }
   printf("%f\t%f\t%f\n",
-    mahony_get_pitch(),
-    mahony_get_roll(),
-    mahony_get_yaw()
+    attitude->pitch,
+    attitude->roll,
+    attitude->yaw
   );
 }
 
-int main(void)
+/**
+ * Binary telemetry, see comm/telemetry.h, telemetry_dump turns it back into text.
+ */
+void write_telemetry(void *context, const pipeline_attitude_t *attitude)
+{
+  telemetry_record_t record;
+
+  attitude_to_record(attitude, &record);
+  if (fifo_output)
+    comm_write_record(&record);
+  else
+    telemetry_write(&telemetry, &record);
+}
+
+uint64_t stats_interval = 0; // ns between loop statistics reports, 0 for none
+loop_stats_snapshot_t stats_before; // at the previous report
+
+uint32_t saturate(uint64_t value)
+{
+  return value > UINT32_MAX ? UINT32_MAX : value;
+}
+
+/**
+ * Stage timings of the interval since the previous report, a stats record on
+ * the telemetry channel in binary mode, lines on stderr otherwise so the text
+ * on stdout stays one attitude per line.
+ */
+void publish_stats()
+{
+  static loop_stats_snapshot_t now, delta;
+  telemetry_stats_t record;
+  i2c_bus_stats_t bus_stats;
+  int i;
+
+  loop_stats_snapshot(&loop_stats, &now);
+  loop_stats_delta(&now, &stats_before, &delta);
+  i2c_bus_get_stats(&bus_stats);
+  if (!binary)
+  {
+    loop_stats_print(&delta, "stats");
+    fprintf(stderr, "stats i2c %lu errors, %lu short reads, %lu short writes\n",
+            bus_stats.errors, bus_stats.short_reads, bus_stats.short_writes);
+  }
+  else
+  {
+    record.timestamp = now.timestamp;
+    record.interval = saturate(now.timestamp - stats_before.timestamp);
+    for (i = 0; i < TELEMETRY_STATS_STAGES; i++)
+    {
+      record.stages[i].count = saturate(delta.stages[i].count);
+      record.stages[i].p50 = saturate(histogram_percentile(&delta.stages[i], 50));
+      record.stages[i].p99 = saturate(histogram_percentile(&delta.stages[i], 99));
+      record.stages[i].max = saturate(delta.stages[i].max);
+    }
+    record.i2c_errors = saturate(bus_stats.errors);
+    record.i2c_short = saturate(bus_stats.short_reads + bus_stats.short_writes);
+    if (fifo_output)
+      comm_write_stats(&record);
+    else
+      telemetry_write_stats(&telemetry, &record);
+  }
+  stats_before = now;
+}
+
+void publish(void *context, const pipeline_attitude_t *attitude)
+{
+  uint64_t start = clock_now_ns();
+
+  if (binary)
+    write_telemetry(context, attitude);
+  else
+    print_pitch_roll_yaw(context, attitude);
+  loop_stats_record(&loop_stats, LOOP_STATS_OUTPUT, start);
+  if (stats_interval && start - stats_before.timestamp >= stats_interval)
+    publish_stats();
+}
+
+/**
+ * Read, fuse and print in turn on the calling thread.
+ */
+void run_serial()
+{
+  static pipeline_sample_t samples[FIFO_MAX_SAMPLES];
+  pipeline_attitude_t attitude;
+  int i, n;
+
+  while (running)
+  {
+    n = acquire(NULL, samples, FIFO_MAX_SAMPLES);
+    if (n < 0)
+      break;
+    for (i = 0; i < n; i++)
+      fuse(NULL, &samples[i], &attitude);
+    if (n > 0)
+      publish(NULL, &attitude);
+  }
+}
+
+/**
+ * Read, fuse and print on three threads, a slow stdout reader never delays
+ * the next sensor read.
+ */
+int run_pipeline()
 {
+  pipeline_config_t config = {acquire, fuse, publish, NULL, pipeline_cpu, 0, 0};
+
+  if (pipeline_start(&pipeline, &config) != 0)
+  {
+    fprintf(stderr, "Failed to start the pipeline\n");
+    return -1;
+  }
+  while (running && pipeline_running(&pipeline))
+  {
+    usleep(100000);
+  }
+  pipeline_stop(&pipeline);
+
+  fprintf(stderr, "pipeline%s: %lu samples acquired, %lu fused, %lu published\n",
+          pipeline.pinned ? " (acquisition pinned)" : "", pipeline.acquired, pipeline.fused, pipeline.published);
+  fprintf(stderr, "sample ring: %lu dropped, high-water %zu of %zu\n",
+          pipeline.samples.drops, pipeline.samples.high_water, ring_capacity(&pipeline.samples));
+  fprintf(stderr, "attitude ring: %lu dropped, high-water %zu of %zu\n",
+          pipeline.attitudes.drops, pipeline.attitudes.high_water, ring_capacity(&pipeline.attitudes));
+  return 0;
+}
+
+#define FLAT_OUT_SWEEPS 16
+
+float nominal_rate; // Hz the filter clamps measured periods around, recorded for replay
+
+/**
+ * Nominal rate the filter clamps measured periods around: the sensor rate with
+ * the FIFO or data ready, the fixed loop rate, or flat out the rate a few
+ * timed sweeps go through the bus at.
+ */
+float fuse_rate()
+{
+  uint64_t start;
+  int i;
+
+  if (fifo_rate > 0 || drdy_line >= 0)
+    return mpu6050_get_rate();
+  if (loop_rate > 0)
+    return loop_rate;
+  start = clock_now_ns();
+  for (i = 0; i < FLAT_OUT_SWEEPS; i++)
+    i2c_batch_submit(&sweep);
+  return FLAT_OUT_SWEEPS * 1e9f / (clock_now_ns() - start + 1);
+}
+
+void usage(const char *name)
+{
+  fprintf(stderr, "usage: %s [-a adapter] [-f fifo_rate_hz] [-m] [-g drdy_line [-c gpiochip] [-r rate_hz]]\n"
+                  "          [-t loop_rate_hz [-P fifo_priority] [-k cpu] [-o catchup|skip]] [-p cpu] [-b] [-s]\n"
+                  "          [-F oldest|newest] [-R record_dir] [-S synthetic|segment.fdr [-L bus_khz]] [-T stats_ms]\n", name);
+}
+
+int main(int argc, char **argv)
+{
+  int adapter = I2C_DEFAULT_ADAPTER;
+  const char *chip = GPIO_EVENT_DEFAULT_CHIP;
+  i2c_bus_stats_t bus_stats;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "a:f:mg:c:r:p:t:P:k:o:bsF:R:S:L:T:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'a':
+      adapter = atoi(optarg);
+      break;
+    case 'f':
+      fifo_rate = atoi(optarg);
+      break;
+    case 'm':
+      aux_mag = 1;
+      break;
+    case 'g':
+      drdy_line = atoi(optarg);
+      break;
+    case 'c':
+      chip = optarg;
+      break;
+    case 'r':
+      drdy_rate = atoi(optarg);
+      break;
+    case 'p':
+      pipeline_cpu = atoi(optarg);
+      break;
+    case 't':
+      loop_rate = atoi(optarg);
+      break;
+    case 'P':
+      // a realtime loop must not page fault either
+      loop_config.priority = atoi(optarg);
+      loop_config.lock_memory = loop_config.priority > 0;
+      break;
+    case 'k':
+      loop_config.cpu = atoi(optarg);
+      break;
+    case 'o':
+      loop_config.policy = strcmp(optarg, "skip") == 0 ? PERIODIC_SKIP : PERIODIC_CATCH_UP;
+      break;
+    case 'b':
+      binary = 1;
+      break;
+    case 's':
+      shared = 1;
+      break;
+    case 'F':
+      // a slow or absent reader of the pipe loses data, never stalls the loop
+      fifo_output = 1;
+      comm_set_drop_policy(strcmp(optarg, "newest") == 0 ? COMM_DROP_NEWEST : COMM_DROP_OLDEST);
+      break;
+    case 'R':
+      record_directory = optarg;
+      break;
+    case 'S':
+      sim_source = optarg;
+      break;
+    case 'L':
+      sim_khz = atoi(optarg);
+      break;
+    case 'T':
+      stats_interval = atoi(optarg) * 1000000ull;
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  // the FIFO batches samples, waking up on every one of them defeats it, and
+  // either of them already paces the loop
+  if ((drdy_line >= 0) + (fifo_rate > 0) + (loop_rate > 0) > 1 ||
+      (sim_source && drdy_line >= 0)) // no INT line to a simulated sensor
+  {
+    usage(argv[0]);
+    return 1;
+  }
+  if (loop_rate > 0)
+    loop_config.period = 1000000000ull / loop_rate;
+
+  loop_stats_init(&loop_stats);
+  stats_before.timestamp = loop_stats.started;
+  if (sim_source && setup_simulation() != 0)
+    return 1;
+  if (i2c_bus_open(adapter) != I2C_OK)
+  {
+    return 1;
+  }
+
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+
   mpu6050_initialize();
   hcm5883l_initialize();
-  while (1)
+  if (fifo_rate > 0 && mpu6050_fifo_enable(fifo_rate, MPU6050_DLPF_BW_188) != I2C_OK)
+  {
+    fprintf(stderr, "Failed to enable FIFO at %d Hz\n", fifo_rate);
+    return 1;
+  }
+  if (fifo_rate > 0)
+    fifo_period = 1000000000ull / mpu6050_get_rate();
+  // after the FIFO, the slave delay depends on the sample rate
+  if (aux_mag)
+  {
+    hcm5883l_start_continuous(HMC5883L_RATE_75);
+    if (mpu6050_aux_slave_enable(HMC5883L_ADDRESS, HMC5883L_DATAX_H, HMC5883L_HEADING_LENGTH, AUX_MAG_RATE) != I2C_OK)
+    {
+      fprintf(stderr, "Failed to enable the auxiliary I2C master\n");
+      return 1;
+    }
+  }
+  if (drdy_line >= 0)
+  {
+    if (gpio_event_open_line(&drdy, chip, drdy_line) != 0 ||
+        mpu6050_data_ready_enable(drdy_rate, MPU6050_DLPF_BW_42) != I2C_OK)
+    {
+      fprintf(stderr, "Failed to set up data ready on %s line %d\n", chip, drdy_line);
+      return 1;
+    }
+  }
+  setup_sweep();
+  nominal_rate = fuse_rate();
+  mahony_set_sample_freq(nominal_rate);
+  telemetry_writer_init(&telemetry, STDOUT_FILENO);
+  if (fifo_output)
+    comm_open();
+  if (shared && attitude_shm_create(&shm, ATTITUDE_SHM_NAME) != 0)
+  {
+    fprintf(stderr, "Failed to create shared memory %s\n", ATTITUDE_SHM_NAME);
+    return 1;
+  }
+  if (record_directory)
+  {
+    recorder_config_t config = {record_directory, 0, 0, 0, nominal_rate};
+
+    if (recorder_start(&recorder, &config) != 0)
+    {
+      fprintf(stderr, "Failed to start recording to %s\n", record_directory);
+      return 1;
+    }
+  }
+  if (pipeline_cpu >= -1)
+    run_pipeline();
+  else
+    run_serial();
+  if (stats_interval)
+    publish_stats(); // the last partial interval
+  loop_stats_snapshot(&loop_stats, &stats_before);
+
+  if (drdy_line >= 0)
+  {
+    mpu6050_data_ready_disable();
+    gpio_event_close(&drdy);
+    fprintf(stderr, "%lu data ready events, %lu missed\n", drdy.events, drdy.missed);
+  }
+  if (fifo_output)
+  {
+    comm_stats_t stats;
+
+    comm_close();
+    comm_get_stats(&stats);
+    fprintf(stderr, "%s: %lu messages written, %lu dropped, %lu pending, high-water %zu bytes, "
+                    "%lu full pipe, %lu reconnects\n",
+            COMM_FIFO_PATH, stats.written, stats.dropped, (unsigned long)stats.pending, stats.high_water,
+            stats.full, stats.disconnects);
+  }
+  else if (binary)
+  {
+    telemetry_flush(&telemetry);
+    fprintf(stderr, "%lu telemetry records in %lu writes, %lu failed\n", telemetry.records, telemetry.writes, telemetry.errors);
+  }
+  if (shared)
+    attitude_shm_destroy(&shm);
+  if (record_directory)
+  {
+    recorder_stop(&recorder);
+    fprintf(stderr, "recorded %lu samples in %u segments, %lu dropped, %lu syncs, %lu errors\n",
+            recorder.records, recorder.segments, (unsigned long)recorder.dropped,
+            (unsigned long)recorder.syncs, (unsigned long)recorder.errors);
+  }
+  if (loop_started)
+    periodic_print(&loop, "loop");
+  if (aux_mag)
+    mpu6050_aux_slave_disable();
+  i2c_bus_close();
+  if (sim_source)
   {
-    calculate_pitch_roll_yaw();
+    fprintf(stderr, "simulated bus at %d kHz: %lu transactions, %lu bytes, %lu errors, %lu samples, %lu FIFO overflows\n",
+            sim_khz, sim_bus.transactions, sim_bus.bytes, sim_bus.errors, sim_mpu.produced, sim_mpu.fifo_overflows);
+    if (sim_reader.records)
+      recorder_close(&sim_reader);
   }
+  fprintf(stderr, "fused at %.1f Hz, %lu sample periods clamped\n", mahony_get_sample_freq(), mahony_get_dt_clamped());
+  loop_stats_print(&stats_before, "loop");
+  i2c_bus_get_stats(&bus_stats);
+  fprintf(stderr, "i2c: %lu reads, %lu writes, %lu batches, %lu errors, %lu short reads, %lu short writes\n",
+          bus_stats.reads, bus_stats.writes, bus_stats.batches, bus_stats.errors, bus_stats.short_reads,
+          bus_stats.short_writes);
 
   return 0;
 }
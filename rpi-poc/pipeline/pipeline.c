@@ -0,0 +1,232 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <poll.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "pipeline.h"
+
+#define PIPELINE_IDLE_MS 100 // consumers recheck running at least this often
+
+static void signal_ready(int fd)
+{
+    uint64_t one = 1;
+
+    // non-blocking, a saturated counter still reads as ready
+    if (write(fd, &one, sizeof(one)) < 0)
+        return;
+}
+
+static void wait_ready(int fd)
+{
+    struct pollfd pfd = {fd, POLLIN, 0};
+    uint64_t count;
+
+    if (poll(&pfd, 1, PIPELINE_IDLE_MS) > 0 && read(fd, &count, sizeof(count)) < 0)
+        return;
+}
+
+/**
+ * Pushes never block, a full sample ring is counted in samples.drops and the
+ * next read goes ahead on schedule.
+ */
+static void *acquisition_run(void *arg)
+{
+    pipeline_t *pipeline = arg;
+    pipeline_sample_t samples[PIPELINE_BURST];
+    int i, count;
+
+    if (pipeline->config.acquisition_cpu >= 0)
+    {
+        cpu_set_t cpus;
+
+        CPU_ZERO(&cpus);
+        CPU_SET(pipeline->config.acquisition_cpu, &cpus);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0)
+            pipeline->pinned = 1;
+        else
+            fprintf(stderr, "Failed to pin acquisition to cpu %d\n", pipeline->config.acquisition_cpu);
+    }
+
+    while (atomic_load(&pipeline->running))
+    {
+        count = pipeline->config.acquire(pipeline->config.context, samples, PIPELINE_BURST);
+        if (count < 0)
+            break;
+        for (i = 0; i < count; i++)
+            ring_push(&pipeline->samples, &samples[i]);
+        if (count > 0)
+        {
+            pipeline->acquired += count;
+            signal_ready(pipeline->samples_ready);
+        }
+    }
+
+    atomic_store(&pipeline->running, 0);
+    signal_ready(pipeline->samples_ready);
+    return NULL;
+}
+
+/**
+ * Whatever was pushed before the upstream stage stopped is still drained,
+ * stopping is read before the ring so nothing slips in between.
+ */
+static void *fusion_run(void *arg)
+{
+    pipeline_t *pipeline = arg;
+    pipeline_sample_t sample;
+    pipeline_attitude_t attitude;
+    int fused, stopping;
+
+    for (;;)
+    {
+        stopping = !atomic_load(&pipeline->running);
+        fused = 0;
+        while (ring_pop(&pipeline->samples, &sample))
+        {
+            pipeline->config.fuse(pipeline->config.context, &sample, &attitude);
+            fused++;
+        }
+        if (fused > 0)
+        {
+            pipeline->fused += fused;
+            ring_push(&pipeline->attitudes, &attitude);
+            signal_ready(pipeline->attitudes_ready);
+        }
+        else if (stopping)
+        {
+            break;
+        }
+        else
+        {
+            wait_ready(pipeline->samples_ready);
+        }
+    }
+
+    atomic_store(&pipeline->fusing, 0);
+    signal_ready(pipeline->attitudes_ready);
+    return NULL;
+}
+
+static void *publisher_run(void *arg)
+{
+    pipeline_t *pipeline = arg;
+    pipeline_attitude_t attitude;
+    int stopping;
+
+    for (;;)
+    {
+        stopping = !atomic_load(&pipeline->fusing);
+        if (ring_pop(&pipeline->attitudes, &attitude))
+        {
+            pipeline->config.publish(pipeline->config.context, &attitude);
+            pipeline->published++;
+        }
+        else if (stopping)
+        {
+            break;
+        }
+        else
+        {
+            wait_ready(pipeline->attitudes_ready);
+        }
+    }
+    return NULL;
+}
+
+static void release(pipeline_t *pipeline)
+{
+    if (pipeline->samples_ready >= 0)
+        close(pipeline->samples_ready);
+    if (pipeline->attitudes_ready >= 0)
+        close(pipeline->attitudes_ready);
+    pipeline->samples_ready = -1;
+    pipeline->attitudes_ready = -1;
+    ring_free(&pipeline->samples);
+    ring_free(&pipeline->attitudes);
+}
+
+/**
+ * The threads block every signal, SIGINT and friends keep going to the
+ * thread that called pipeline_start(). Returns 0, or -1 with nothing left
+ * running.
+ */
+int pipeline_start(pipeline_t *pipeline, const pipeline_config_t *config)
+{
+    sigset_t all, previous;
+    int started = 0;
+
+    memset(pipeline, 0, sizeof(*pipeline));
+    pipeline->config = *config;
+    pipeline->samples_ready = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    pipeline->attitudes_ready = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (ring_init(&pipeline->samples, sizeof(pipeline_sample_t),
+                  config->sample_capacity ? config->sample_capacity : PIPELINE_SAMPLE_CAPACITY) != 0 ||
+        ring_init(&pipeline->attitudes, sizeof(pipeline_attitude_t),
+                  config->attitude_capacity ? config->attitude_capacity : PIPELINE_ATTITUDE_CAPACITY) != 0 ||
+        pipeline->samples_ready < 0 || pipeline->attitudes_ready < 0)
+    {
+        release(pipeline);
+        return -1;
+    }
+    atomic_init(&pipeline->running, 1);
+    atomic_init(&pipeline->fusing, 1);
+
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &previous);
+    if (pthread_create(&pipeline->publisher, NULL, publisher_run, pipeline) == 0)
+    {
+        started++;
+        if (pthread_create(&pipeline->fusion, NULL, fusion_run, pipeline) == 0)
+        {
+            started++;
+            if (pthread_create(&pipeline->acquisition, NULL, acquisition_run, pipeline) == 0)
+                started++;
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+    if (started < 3)
+    {
+        atomic_store(&pipeline->running, 0);
+        if (started < 2)
+            atomic_store(&pipeline->fusing, 0);
+        signal_ready(pipeline->samples_ready);
+        signal_ready(pipeline->attitudes_ready);
+        if (started > 1)
+            pthread_join(pipeline->fusion, NULL);
+        if (started > 0)
+            pthread_join(pipeline->publisher, NULL);
+        release(pipeline);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * 0 once pipeline_stop() was called or acquire() asked to stop.
+ */
+int pipeline_running(pipeline_t *pipeline)
+{
+    return atomic_load(&pipeline->running);
+}
+
+/**
+ * Joins the threads once acquire() returns and the queued samples and
+ * attitudes are through, the counters and ring statistics stay readable.
+ */
+void pipeline_stop(pipeline_t *pipeline)
+{
+    atomic_store(&pipeline->running, 0);
+    signal_ready(pipeline->samples_ready);
+    signal_ready(pipeline->attitudes_ready);
+    pthread_join(pipeline->acquisition, NULL);
+    pthread_join(pipeline->fusion, NULL);
+    pthread_join(pipeline->publisher, NULL);
+    release(pipeline);
+}
@@ -0,0 +1,86 @@
+#ifndef _PIPELINE_H_
+#define _PIPELINE_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "ring.h"
+
+#define PIPELINE_BURST 32            // samples handed to acquire() at most per call
+#define PIPELINE_SAMPLE_CAPACITY 256 // default ring sizes
+#define PIPELINE_ATTITUDE_CAPACITY 64
+
+/**
+ * Raw reading, timestamp is CLOCK_MONOTONIC ns of when it was sampled.
+ */
+typedef struct
+{
+    uint64_t timestamp;
+    int16_t ax, ay, az, gx, gy, gz, mx, my, mz;
+} pipeline_sample_t;
+
+/**
+ * Attitude in degrees and as a quaternion, with the raw reading and the
+ * timestamp of the sample it was fused from. fused is CLOCK_MONOTONIC ns of
+ * when fusion finished.
+ */
+typedef struct
+{
+    uint64_t timestamp;
+    uint64_t fused;
+    float q0, q1, q2, q3;
+    float roll, pitch, yaw;
+    int16_t ax, ay, az, gx, gy, gz, mx, my, mz;
+} pipeline_attitude_t;
+
+/**
+ * Stage callbacks, each one only ever runs on its own thread.
+ *
+ * acquire blocks until samples are available, stores up to max of them oldest
+ * first and returns how many, 0 after a timeout, -1 to stop the pipeline.
+ * fuse turns one sample into an attitude. publish writes an attitude out and
+ * may block as long as it likes.
+ */
+typedef struct
+{
+    int (*acquire)(void *context, pipeline_sample_t *samples, int max);
+    void (*fuse)(void *context, const pipeline_sample_t *sample, pipeline_attitude_t *attitude);
+    void (*publish)(void *context, const pipeline_attitude_t *attitude);
+    void *context;
+    int acquisition_cpu;      // core the acquisition thread is pinned to, -1 for none
+    size_t sample_capacity;   // 0 for PIPELINE_SAMPLE_CAPACITY
+    size_t attitude_capacity; // 0 for PIPELINE_ATTITUDE_CAPACITY
+} pipeline_config_t;
+
+/**
+ * Acquisition, fusion and publisher threads connected by two rings.
+ *
+ * The acquisition thread only reads sensors and pushes samples, when fusion
+ * falls behind samples are dropped instead of delaying the next read. The
+ * fusion thread drains every queued sample and pushes the attitude of the
+ * newest one, the publisher drains those. A full ring drops, nothing ever
+ * waits on a slower stage downstream. Consumers sleep on an eventfd the
+ * producer signals after each push, on stop they drain what was queued.
+ */
+typedef struct
+{
+    pipeline_config_t config;
+    ring_t samples;
+    ring_t attitudes;
+    int samples_ready;   // eventfd, signalled per pushed sample
+    int attitudes_ready; // eventfd, signalled per pushed attitude
+    pthread_t acquisition, fusion, publisher;
+    atomic_int running;
+    atomic_int fusing;           // 0 once the fusion thread is done, the publisher drains and stops
+    int pinned;                  // 1 once the acquisition thread runs on acquisition_cpu
+    unsigned long acquired;      // samples read, including dropped ones
+    unsigned long fused;         // samples fused
+    unsigned long published;     // attitudes published
+} pipeline_t;
+
+int pipeline_start(pipeline_t *pipeline, const pipeline_config_t *config);
+int pipeline_running(pipeline_t *pipeline);
+void pipeline_stop(pipeline_t *pipeline);
+
+#endif /* _PIPELINE_H_ */
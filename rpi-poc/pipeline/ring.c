@@ -0,0 +1,92 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "ring.h"
+
+/**
+ * capacity is rounded up to a power of two so the indices wrap with a mask,
+ * they run freely and head - tail is the number of queued elements.
+ */
+int ring_init(ring_t *ring, size_t element_size, size_t capacity)
+{
+    size_t size = 1;
+
+    while (size < capacity)
+        size <<= 1;
+
+    memset(ring, 0, sizeof(*ring));
+    ring->elements = calloc(size, element_size);
+    if (ring->elements == NULL)
+        return -1;
+    ring->mask = size - 1;
+    ring->element_size = element_size;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    return 0;
+}
+
+/**
+ * The counters stay readable after the elements are released.
+ */
+void ring_free(ring_t *ring)
+{
+    free(ring->elements);
+    ring->elements = NULL;
+}
+
+/**
+ * Producer side, 0 when the element was queued, -1 when the ring was full.
+ */
+int ring_push(ring_t *ring, const void *element)
+{
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t queued = head - ring->tail_cache;
+
+    if (queued > ring->mask)
+    {
+        ring->tail_cache = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        queued = head - ring->tail_cache;
+        if (queued > ring->mask)
+        {
+            ring->drops++;
+            return -1;
+        }
+    }
+
+    memcpy(ring->elements + (head & ring->mask) * ring->element_size, element, ring->element_size);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+    // the cached tail overstates the backlog, confirm before a new high-water mark
+    if (queued + 1 > ring->high_water)
+    {
+        ring->tail_cache = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        queued = head - ring->tail_cache;
+        if (queued + 1 > ring->high_water)
+            ring->high_water = queued + 1;
+    }
+    return 0;
+}
+
+/**
+ * Consumer side, 1 when an element was copied out, 0 when the ring was empty.
+ */
+int ring_pop(ring_t *ring, void *element)
+{
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+    if (tail == ring->head_cache)
+    {
+        ring->head_cache = atomic_load_explicit(&ring->head, memory_order_acquire);
+        if (tail == ring->head_cache)
+            return 0;
+    }
+
+    memcpy(element, ring->elements + (tail & ring->mask) * ring->element_size, ring->element_size);
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    return 1;
+}
+
+size_t ring_capacity(ring_t *ring)
+{
+    return ring->mask + 1;
+}
@@ -0,0 +1,36 @@
+#ifndef _RING_H_
+#define _RING_H_
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+#define RING_CACHE_LINE 64
+
+/**
+ * Bounded single-producer/single-consumer ring of fixed size elements.
+ *
+ * One thread pushes, one thread pops, neither takes a lock. Each side owns
+ * its index and keeps a cached copy of the other one, the shared indices are
+ * only reloaded when the cached copy says the ring is full or empty. A push
+ * into a full ring fails and counts a drop, it never waits for the consumer.
+ */
+typedef struct
+{
+    _Alignas(RING_CACHE_LINE) atomic_size_t head; // next slot written, producer owned
+    size_t tail_cache;                            // producer copy of tail
+    unsigned long drops;                          // pushes refused because the ring was full
+    size_t high_water;                            // most elements ever queued
+    _Alignas(RING_CACHE_LINE) atomic_size_t tail; // next slot read, consumer owned
+    size_t head_cache;                            // consumer copy of head
+    _Alignas(RING_CACHE_LINE) size_t mask;
+    size_t element_size;
+    unsigned char *elements;
+} ring_t;
+
+int ring_init(ring_t *ring, size_t element_size, size_t capacity);
+void ring_free(ring_t *ring);
+int ring_push(ring_t *ring, const void *element);
+int ring_pop(ring_t *ring, void *element);
+size_t ring_capacity(ring_t *ring);
+
+#endif /* _RING_H_ */
@@ -0,0 +1,337 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "recorder.h"
+#include "../comm/telemetry.h"
+
+_Static_assert(sizeof(recorder_record_t) == 64, "recorder records are 64 bytes");
+_Static_assert(sizeof(recorder_header_t) <= RECORDER_HEADER_SIZE, "recorder header does not fit");
+
+static void segment_path(recorder_t *recorder, uint32_t number, char *path, size_t size)
+{
+    uint32_t file = recorder->config.max_segments ? number % recorder->config.max_segments : number;
+
+    snprintf(path, size, "%s/flight-%06u.fdr", recorder->config.directory, file);
+}
+
+/**
+ * Create, preallocate and map segment number, the header is on disk before
+ * the segment is handed out. Returns NULL on failure.
+ */
+static recorder_segment_t *segment_create(recorder_t *recorder, uint32_t number)
+{
+    recorder_segment_t *segment = calloc(1, sizeof(*segment));
+    struct timespec now;
+    char path[PATH_MAX];
+
+    if (segment == NULL)
+        return NULL;
+    segment_path(recorder, number, path, sizeof(path));
+    segment->number = number;
+    segment->capacity = recorder->config.segment_records;
+    segment->size = RECORDER_HEADER_SIZE + (size_t)segment->capacity * sizeof(recorder_record_t);
+
+    segment->fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (segment->fd < 0)
+    {
+        perror(path);
+        free(segment);
+        return NULL;
+    }
+    // blocks allocated now cannot run out under a store into the mapping
+    errno = posix_fallocate(segment->fd, 0, segment->size);
+    if (errno != 0 && (errno != EOPNOTSUPP || ftruncate(segment->fd, segment->size) != 0))
+    {
+        perror(path);
+        close(segment->fd);
+        free(segment);
+        return NULL;
+    }
+    segment->map = mmap(NULL, segment->size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, segment->fd, 0);
+    if (segment->map == MAP_FAILED)
+    {
+        perror("mmap");
+        close(segment->fd);
+        free(segment);
+        return NULL;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    segment->header = segment->map;
+    segment->records = (recorder_record_t *)((char *)segment->map + RECORDER_HEADER_SIZE);
+    segment->header->magic = RECORDER_MAGIC;
+    segment->header->version = RECORDER_VERSION;
+    segment->header->header_size = RECORDER_HEADER_SIZE;
+    segment->header->record_size = sizeof(recorder_record_t);
+    segment->header->segment = number;
+    segment->header->capacity = segment->capacity;
+    segment->header->state = RECORDER_OPEN;
+    segment->header->created = now.tv_sec * 1000000000ull + now.tv_nsec;
+    segment->header->count = 0;
+    segment->header->sample_freq = recorder->config.sample_freq;
+    msync(segment->map, RECORDER_HEADER_SIZE, MS_SYNC);
+    atomic_init(&segment->count, 0);
+    return segment;
+}
+
+/**
+ * Records first, then the count that covers them.
+ */
+static void segment_sync(recorder_t *recorder, recorder_segment_t *segment)
+{
+    uint32_t count = atomic_load_explicit(&segment->count, memory_order_acquire);
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t start, end;
+
+    if (count == segment->synced)
+        return;
+    start = (RECORDER_HEADER_SIZE + (size_t)segment->synced * sizeof(recorder_record_t)) & ~(page - 1);
+    end = RECORDER_HEADER_SIZE + (size_t)count * sizeof(recorder_record_t);
+    if (msync((char *)segment->map + start, end - start, MS_SYNC) != 0)
+        atomic_fetch_add(&recorder->errors, 1);
+    segment->header->count = count;
+    if (msync(segment->map, RECORDER_HEADER_SIZE, MS_SYNC) != 0)
+        atomic_fetch_add(&recorder->errors, 1);
+    atomic_fetch_add(&recorder->syncs, 1);
+    segment->synced = count;
+}
+
+static void segment_close(recorder_t *recorder, recorder_segment_t *segment)
+{
+    segment_sync(recorder, segment);
+    segment->header->state = RECORDER_CLOSED;
+    msync(segment->map, RECORDER_HEADER_SIZE, MS_SYNC);
+    munmap(segment->map, segment->size);
+    close(segment->fd);
+    free(segment);
+}
+
+/**
+ * Background work: close the segment the writer handed back, prepare the
+ * next one, sync the current one. The retired segment is always gone before
+ * a next one is offered, so the writer finds the retired slot free.
+ */
+static void recorder_service(recorder_t *recorder)
+{
+    recorder_segment_t *segment = atomic_exchange(&recorder->retired, NULL);
+
+    if (segment)
+        segment_close(recorder, segment);
+    if (atomic_load(&recorder->next) == NULL)
+    {
+        segment = segment_create(recorder, recorder->segments);
+        if (segment)
+        {
+            recorder->segments++;
+            atomic_store(&recorder->next, segment);
+        }
+        else
+        {
+            atomic_fetch_add(&recorder->errors, 1);
+        }
+    }
+    segment = atomic_load(&recorder->current);
+    if (segment)
+        segment_sync(recorder, segment);
+}
+
+static void *recorder_run(void *arg)
+{
+    recorder_t *recorder = arg;
+    struct timespec deadline;
+
+    pthread_mutex_lock(&recorder->lock);
+    while (recorder->running)
+    {
+        pthread_mutex_unlock(&recorder->lock);
+        recorder_service(recorder);
+        pthread_mutex_lock(&recorder->lock);
+
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += recorder->config.sync_interval / 1000;
+        deadline.tv_nsec += (recorder->config.sync_interval % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        if (recorder->running)
+            pthread_cond_timedwait(&recorder->wake, &recorder->lock, &deadline);
+    }
+    pthread_mutex_unlock(&recorder->lock);
+    return NULL;
+}
+
+/**
+ * Create the first segment and start the background thread. Returns 0, -1
+ * when the directory cannot take a segment.
+ */
+int recorder_start(recorder_t *recorder, const recorder_config_t *config)
+{
+    recorder_segment_t *segment;
+
+    memset(recorder, 0, sizeof(*recorder));
+    recorder->config = *config;
+    if (recorder->config.segment_records == 0)
+        recorder->config.segment_records = RECORDER_SEGMENT_RECORDS;
+    if (recorder->config.sync_interval <= 0)
+        recorder->config.sync_interval = RECORDER_SYNC_INTERVAL;
+
+    if ((segment = segment_create(recorder, 0)) == NULL)
+        return -1;
+    recorder->segments = 1;
+    atomic_init(&recorder->current, segment);
+    atomic_init(&recorder->next, NULL);
+    atomic_init(&recorder->retired, NULL);
+    pthread_mutex_init(&recorder->lock, NULL);
+    pthread_cond_init(&recorder->wake, NULL);
+    recorder->running = 1;
+    if (pthread_create(&recorder->thread, NULL, recorder_run, recorder) != 0)
+    {
+        segment_close(recorder, segment);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Stamp the sequence number and CRC and copy the record into the current
+ * segment. A full segment is swapped for the prepared one, which costs a
+ * wake-up of the background thread once per segment. Returns 0, -1 when
+ * no segment was ready and the record was dropped.
+ */
+int recorder_append(recorder_t *recorder, recorder_record_t *record)
+{
+    recorder_segment_t *segment = atomic_load_explicit(&recorder->current, memory_order_relaxed);
+    uint32_t count = atomic_load_explicit(&segment->count, memory_order_relaxed);
+
+    if (count == segment->capacity)
+    {
+        recorder_segment_t *next = atomic_exchange(&recorder->next, NULL);
+
+        if (next == NULL)
+        {
+            atomic_fetch_add_explicit(&recorder->dropped, 1, memory_order_relaxed);
+            return -1;
+        }
+        atomic_store(&recorder->retired, segment);
+        atomic_store(&recorder->current, next);
+        pthread_cond_signal(&recorder->wake);
+        segment = next;
+        count = 0;
+    }
+
+    record->sequence = recorder->sequence++;
+    record->reserved = 0;
+    record->crc = 0;
+    record->crc = telemetry_crc16((const uint8_t *)record, sizeof(*record));
+    segment->records[count] = *record;
+    atomic_store_explicit(&segment->count, count + 1, memory_order_release);
+    recorder->records++;
+    return 0;
+}
+
+/**
+ * Stop the background thread and close the segments, an unused prepared
+ * segment is removed.
+ */
+void recorder_stop(recorder_t *recorder)
+{
+    recorder_segment_t *segment;
+    char path[PATH_MAX];
+
+    pthread_mutex_lock(&recorder->lock);
+    recorder->running = 0;
+    pthread_cond_signal(&recorder->wake);
+    pthread_mutex_unlock(&recorder->lock);
+    pthread_join(recorder->thread, NULL);
+
+    if ((segment = atomic_exchange(&recorder->retired, NULL)))
+        segment_close(recorder, segment);
+    if ((segment = atomic_exchange(&recorder->current, NULL)))
+        segment_close(recorder, segment);
+    if ((segment = atomic_exchange(&recorder->next, NULL)))
+    {
+        segment_path(recorder, segment->number, path, sizeof(path));
+        segment_close(recorder, segment);
+        unlink(path);
+        recorder->segments--;
+    }
+    pthread_mutex_destroy(&recorder->lock);
+    pthread_cond_destroy(&recorder->wake);
+}
+
+static int record_valid(const recorder_record_t *record, uint32_t sequence)
+{
+    recorder_record_t copy = *record;
+
+    copy.crc = 0;
+    return record->sequence == sequence && record->crc == telemetry_crc16((const uint8_t *)&copy, sizeof(copy));
+}
+
+/**
+ * Map a segment file read-only. A segment the writer did not close gets the
+ * valid records past its synced count back. Returns 0, -1 when it is not a
+ * segment file.
+ */
+int recorder_open(recorder_reader_t *reader, const char *path)
+{
+    const recorder_header_t *header;
+    struct stat st;
+    uint32_t first;
+    int fd;
+
+    memset(reader, 0, sizeof(*reader));
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+        return -1;
+    if (fstat(fd, &st) != 0 || st.st_size < RECORDER_HEADER_SIZE)
+    {
+        close(fd);
+        return -1;
+    }
+    reader->size = st.st_size;
+    reader->map = mmap(NULL, reader->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (reader->map == MAP_FAILED)
+        return -1;
+
+    header = reader->header = reader->map;
+    reader->records = (const recorder_record_t *)((const char *)reader->map + RECORDER_HEADER_SIZE);
+    if (header->magic != RECORDER_MAGIC || header->version != RECORDER_VERSION ||
+        header->header_size != RECORDER_HEADER_SIZE || header->record_size != sizeof(recorder_record_t) ||
+        RECORDER_HEADER_SIZE + (size_t)header->capacity * sizeof(recorder_record_t) > reader->size ||
+        header->count > header->capacity)
+    {
+        recorder_close(reader);
+        return -1;
+    }
+
+    reader->count = header->count;
+    if (header->state != RECORDER_CLOSED && reader->count < header->capacity)
+    {
+        first = reader->records[0].sequence;
+        while (reader->count < header->capacity && record_valid(&reader->records[reader->count], first + reader->count))
+        {
+            reader->count++;
+            reader->recovered++;
+        }
+    }
+    return 0;
+}
+
+void recorder_close(recorder_reader_t *reader)
+{
+    if (reader->map && reader->map != MAP_FAILED)
+        munmap(reader->map, reader->size);
+    reader->map = NULL;
+}
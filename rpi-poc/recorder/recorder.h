@@ -0,0 +1,138 @@
+#ifndef _RECORDER_H_
+#define _RECORDER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+/**
+ * Flight data recorder.
+ *
+ * Raw samples and the attitude fused from them go into fixed size records in
+ * segment files, preallocated on disk and mapped, so appending one is a copy
+ * into memory: no syscall, and no page fault since the mapping is populated
+ * up front. A background thread msync()s what was appended every
+ * sync_interval, prepares the next segment ahead of time and closes the full
+ * ones.
+ *
+ * Every segment starts with a page of header followed by capacity records:
+ *
+ *   RECORDER_MAGIC, version, header and record size, segment number,
+ *   capacity, creation time, state, the number of records synced and the
+ *   nominal rate the samples were fused at
+ *
+ * The record count in the header is only moved once the records it covers
+ * were synced, and the header is rewritten last when a segment is closed.
+ * After a crash the records past the count are recovered as long as their
+ * CRC and sequence numbers hold, the first bad one ends the segment.
+ * Records are native byte order, the magic tells.
+ *
+ * Segments are named flight-NNNNNN.fdr in the directory. With max_segments
+ * the numbers wrap and the oldest file is reused.
+ */
+
+#define RECORDER_MAGIC 0x52444649      // "IFDR" little-endian
+#define RECORDER_VERSION 1
+#define RECORDER_HEADER_SIZE 4096
+#define RECORDER_SEGMENT_RECORDS 262144 // 16 MiB of records per segment
+#define RECORDER_SYNC_INTERVAL 1000     // ms
+
+#define RECORDER_OPEN 1     // being written, or the writer died
+#define RECORDER_CLOSED 2   // complete, count is exact
+
+#define RECORDER_RAW 0x01   // ax..mz hold a sample
+#define RECORDER_FUSED 0x02 // q0..yaw hold the attitude fused from it
+
+typedef struct
+{
+    uint64_t timestamp;         // CLOCK_MONOTONIC ns of the sample
+    uint32_t sequence;          // consecutive across segments
+    uint16_t flags;             // RECORDER_RAW | RECORDER_FUSED
+    uint16_t crc;               // CRC-16/CCITT of the record with crc 0
+    int16_t ax, ay, az, gx, gy, gz, mx, my, mz;
+    int16_t reserved;
+    float q0, q1, q2, q3;
+    float roll, pitch, yaw;     // degrees
+} recorder_record_t;
+
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_size;
+    uint32_t record_size;
+    uint32_t segment;           // number of the segment since the recorder started
+    uint32_t capacity;          // records
+    uint32_t state;             // RECORDER_OPEN or RECORDER_CLOSED
+    uint64_t created;           // CLOCK_REALTIME ns
+    uint32_t count;             // records synced, exact once closed
+    float sample_freq;          // Hz the fusion filter was set up for, 0 unknown
+} recorder_header_t;
+
+typedef struct
+{
+    int fd;
+    uint32_t number;
+    uint32_t capacity;          // records
+    void *map;
+    size_t size;
+    recorder_header_t *header;
+    recorder_record_t *records;
+    atomic_uint count;          // records appended, stored by the writer
+    uint32_t synced;            // records msync()ed
+} recorder_segment_t;
+
+typedef struct
+{
+    const char *directory;
+    uint32_t segment_records;   // 0 for RECORDER_SEGMENT_RECORDS
+    uint32_t max_segments;      // files kept, 0 never reuses one
+    int sync_interval;          // ms, 0 for RECORDER_SYNC_INTERVAL
+    float sample_freq;          // Hz, written to every header for replay, 0 unknown
+} recorder_config_t;
+
+/**
+ * One writer thread appends, the background thread owns everything else.
+ * A segment changes hands through next (prepared, taken by the writer) and
+ * retired (full, handed back).
+ */
+typedef struct
+{
+    recorder_config_t config;
+    _Atomic(recorder_segment_t *) current;
+    _Atomic(recorder_segment_t *) next;
+    _Atomic(recorder_segment_t *) retired;
+    uint32_t sequence;          // of the next record
+    uint32_t segments;          // segments created and kept
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    int running;
+    unsigned long records;      // appended
+    atomic_ulong dropped;       // appended while no segment was ready
+    atomic_ulong syncs;         // msync() calls
+    atomic_ulong errors;        // failed segment creations or syncs
+} recorder_t;
+
+/**
+ * A segment file mapped read-only, count includes the recovered records.
+ */
+typedef struct
+{
+    void *map;
+    size_t size;
+    const recorder_header_t *header;
+    const recorder_record_t *records;
+    uint32_t count;
+    uint32_t recovered;         // records past the header count, the writer did not close it
+} recorder_reader_t;
+
+int recorder_start(recorder_t *recorder, const recorder_config_t *config);
+int recorder_append(recorder_t *recorder, recorder_record_t *record);
+void recorder_stop(recorder_t *recorder);
+
+int recorder_open(recorder_reader_t *reader, const char *path);
+void recorder_close(recorder_reader_t *reader);
+
+#endif /* _RECORDER_H_ */
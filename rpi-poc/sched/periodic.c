@@ -0,0 +1,136 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "periodic.h"
+#include "../stats/clock.h"
+
+#define NS_PER_S 1000000000ull
+
+static void sleep_until(uint64_t deadline)
+{
+    struct timespec ts = {deadline / NS_PER_S, deadline % NS_PER_S};
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
+}
+
+/**
+ * Applies the scheduling options to the calling thread, the loop has to run
+ * on it. Options that need privileges the process does not have are left off
+ * with a warning, the realtime, locked and pinned flags say what was granted.
+ * The first deadline is one period from now. Returns -1 on a zero period.
+ */
+int periodic_init(periodic_t *loop, const periodic_config_t *config)
+{
+    memset(loop, 0, sizeof(*loop));
+    loop->config = *config;
+    if (config->period == 0)
+        return -1;
+
+    if (config->lock_memory)
+    {
+        if (mlockall(MCL_CURRENT | MCL_FUTURE) == 0)
+            loop->locked = 1;
+        else
+            fprintf(stderr, "mlockall failed: %s\n", strerror(errno));
+    }
+    if (config->cpu >= 0)
+    {
+        cpu_set_t cpus;
+
+        CPU_ZERO(&cpus);
+        CPU_SET(config->cpu, &cpus);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0)
+            loop->pinned = 1;
+        else
+            fprintf(stderr, "Failed to pin the loop to cpu %d\n", config->cpu);
+    }
+    if (config->priority > 0)
+    {
+        struct sched_param param = {0};
+        int error;
+
+        param.sched_priority = config->priority;
+        error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (error == 0)
+            loop->realtime = 1;
+        else
+            fprintf(stderr, "SCHED_FIFO priority %d refused: %s\n", config->priority, strerror(error));
+    }
+
+    loop->deadline = clock_now_ns() + config->period;
+    return 0;
+}
+
+/**
+ * Sleep until the next deadline and advance it by a period. Returns how many
+ * periods the loop was behind when called, 0 when it slept.
+ */
+int periodic_wait(periodic_t *loop)
+{
+    uint64_t period = loop->config.period;
+    uint64_t now = clock_now_ns();
+    uint64_t wake;
+    int behind = 0;
+
+    if (now >= loop->deadline)
+    {
+        behind = (now - loop->deadline) / period + 1;
+        loop->overruns++;
+        if (loop->config.policy == PERIODIC_SKIP)
+        {
+            // the period now is in still runs, only the ones before are dropped
+            loop->skipped += behind - 1;
+            loop->deadline += (behind - 1) * period;
+        }
+        wake = now;
+    }
+    else
+    {
+        sleep_until(loop->deadline);
+        wake = clock_now_ns();
+        loop->latency_sum += wake - loop->deadline;
+        loop->latency_count++;
+        if (wake - loop->deadline > loop->latency_max)
+            loop->latency_max = wake - loop->deadline;
+    }
+
+    if (loop->last_wake != 0)
+    {
+        uint64_t elapsed = wake - loop->last_wake;
+        uint64_t jitter = elapsed > period ? elapsed - period : period - elapsed;
+
+        loop->jitter_sum += jitter;
+        loop->jitter_count++;
+        if (jitter > loop->jitter_max)
+            loop->jitter_max = jitter;
+    }
+    loop->last_wake = wake;
+    loop->deadline += period;
+    loop->cycles++;
+    return behind;
+}
+
+void periodic_print(periodic_t *loop, const char *name)
+{
+    fprintf(stderr,
+            "%s: %lu cycles at %.1f Hz%s%s%s, %lu overruns, %lu skipped, "
+            "latency %.1f/%.1f us, jitter %.1f/%.1f us (mean/max)\n",
+            name, loop->cycles, (double)NS_PER_S / loop->config.period,
+            loop->realtime ? ", SCHED_FIFO" : "",
+            loop->locked ? ", locked" : "",
+            loop->pinned ? ", pinned" : "",
+            loop->overruns, loop->skipped,
+            loop->latency_count ? loop->latency_sum / 1000.0 / loop->latency_count : 0.0,
+            loop->latency_max / 1000.0,
+            loop->jitter_count ? loop->jitter_sum / 1000.0 / loop->jitter_count : 0.0,
+            loop->jitter_max / 1000.0);
+}
@@ -0,0 +1,59 @@
+#ifndef _PERIODIC_H_
+#define _PERIODIC_H_
+
+#include <stdint.h>
+
+/**
+ * What periodic_wait() does with periods the loop already missed.
+ *
+ * PERIODIC_CATCH_UP keeps the deadline grid and returns at once until the
+ * loop is back on it, the average rate holds. PERIODIC_SKIP drops the missed
+ * periods and waits for the next deadline still ahead, the loop never runs
+ * back to back.
+ */
+typedef enum
+{
+    PERIODIC_CATCH_UP,
+    PERIODIC_SKIP
+} periodic_policy_t;
+
+typedef struct
+{
+    uint64_t period;           // ns
+    periodic_policy_t policy;
+    int priority;              // SCHED_FIFO priority, 0 keeps the default scheduler
+    int lock_memory;           // 1 to mlockall() so page faults never stall a cycle
+    int cpu;                   // core the loop thread is pinned to, -1 for none
+} periodic_config_t;
+
+/**
+ * Fixed rate loop on absolute CLOCK_MONOTONIC deadlines, sleeping to a
+ * deadline instead of for a period keeps the time spent in the loop body
+ * from accumulating as drift.
+ *
+ * latency is how late a wake-up came after its deadline, jitter how far the
+ * time between two wake-ups was off the period. An overrun is a wait called
+ * after its deadline had passed.
+ */
+typedef struct
+{
+    periodic_config_t config;
+    uint64_t deadline;          // next wake-up
+    uint64_t last_wake;         // previous wake-up, 0 before the first one
+    int realtime;               // 1 when SCHED_FIFO was granted
+    int locked;                 // 1 when mlockall() succeeded
+    int pinned;                 // 1 when the affinity was set
+    unsigned long cycles;       // waits returned
+    unsigned long overruns;     // waits called after their deadline
+    unsigned long skipped;      // periods dropped by PERIODIC_SKIP
+    uint64_t latency_max, latency_sum;  // ns, over the waits that slept
+    unsigned long latency_count;
+    uint64_t jitter_max, jitter_sum;    // ns
+    unsigned long jitter_count;
+} periodic_t;
+
+int periodic_init(periodic_t *loop, const periodic_config_t *config);
+int periodic_wait(periodic_t *loop);
+void periodic_print(periodic_t *loop, const char *name);
+
+#endif /* _PERIODIC_H_ */
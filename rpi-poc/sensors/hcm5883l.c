@@ -57,7 +57,21 @@ void hcm5883l_initialize()
     setMode(HMC5883L_MODE_SINGLE);
 }
 
-uint8_t buffer[6];
+/** Switch to continuous measurement, e.g. to be polled by the MPU6050
+ * auxiliary I2C master, which can not re-trigger Single mode.
+ * @param rate Output rate, HMC5883L_RATE_*
+ * @see HMC5883L_MODE_CONTINUOUS
+ */
+void hcm5883l_start_continuous(uint8_t rate)
+{
+    write_byte(HMC5883L_ADDRESS, HMC5883L_CONFIG_A,
+               (HMC5883L_AVERAGING_8 << (HMC5883L_CRA_AVERAGE_BIT - HMC5883L_CRA_AVERAGE_LENGTH + 1)) |
+                   (rate << (HMC5883L_CRA_RATE_BIT - HMC5883L_CRA_RATE_LENGTH + 1)) |
+                   (HMC5883L_BIAS_NORMAL << (HMC5883L_CRA_BIAS_BIT - HMC5883L_CRA_BIAS_LENGTH + 1)));
+    setMode(HMC5883L_MODE_CONTINUOUS);
+}
+
+uint8_t buffer[HMC5883L_HEADING_LENGTH];
 
 /** Get 3-axis heading measurements.
  * In the event the ADC reading overflows or underflows for the given channel,
@@ -72,10 +86,37 @@ uint8_t buffer[6];
  */
 void getHeading(int16_t *x, int16_t *y, int16_t *z)
 {
-    read_bytes(HMC5883L_ADDRESS, HMC5883L_DATAX_H, 6, buffer);
+    read_bytes(HMC5883L_ADDRESS, HMC5883L_DATAX_H, HMC5883L_HEADING_LENGTH, buffer);
     if (mode == HMC5883L_MODE_SINGLE)
         write_byte(HMC5883L_ADDRESS, HMC5883L_MODE, HMC5883L_MODE_SINGLE << (HMC5883L_MODEREG_BIT - HMC5883L_MODEREG_LENGTH + 1));
+    hcm5883l_decode_heading(buffer, x, y, z);
+}
+
+/** Append the heading read to a batch.
+ * When Single mode is active the MODE write that triggers the next measurement
+ * is appended as well, like getHeading() does.
+ * @param batch Batch to append to
+ * @param buffer HMC5883L_HEADING_LENGTH bytes filled in when the batch is submitted
+ * @return Entry index of the read in the batch, I2C_ERR when the batch is full
+ * @see hcm5883l_decode_heading()
+ */
+int hcm5883l_batch_heading(i2c_batch_t *batch, uint8_t *buffer)
+{
+    uint8_t single = HMC5883L_MODE_SINGLE << (HMC5883L_MODEREG_BIT - HMC5883L_MODEREG_LENGTH + 1);
+    int entry = i2c_batch_read(batch, HMC5883L_ADDRESS, HMC5883L_DATAX_H, HMC5883L_HEADING_LENGTH, buffer);
+
+    if (entry >= 0 && mode == HMC5883L_MODE_SINGLE && i2c_batch_write(batch, HMC5883L_ADDRESS, HMC5883L_MODE, 1, &single) < 0)
+        return I2C_ERR;
+    return entry;
+}
+
+/** Decode 3-axis heading registers, the device orders them X, Z, Y.
+ * @param buffer HMC5883L_HEADING_LENGTH bytes read from HMC5883L_DATAX_H
+ * @see getHeading()
+ */
+void hcm5883l_decode_heading(const uint8_t *buffer, int16_t *x, int16_t *y, int16_t *z)
+{
     *x = (((int16_t)buffer[0]) << 8) | buffer[1];
     *y = (((int16_t)buffer[4]) << 8) | buffer[5];
     *z = (((int16_t)buffer[2]) << 8) | buffer[3];
-}
\ No newline at end of file
+}
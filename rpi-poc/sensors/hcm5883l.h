@@ -1,7 +1,16 @@
 #ifndef __HCM5883L_H_
 #define __HCM5883L_H_
 
+#include <stdint.h>
+
+#include "../i2c/I2Cdev.h"
+
+#define HMC5883L_HEADING_LENGTH 6 // DATAX_H to DATAY_L
+
 void hcm5883l_initialize();
+void hcm5883l_start_continuous(uint8_t rate);
 void getHeading(int16_t *x, int16_t *y, int16_t *z);
+int hcm5883l_batch_heading(i2c_batch_t *batch, uint8_t *buffer);
+void hcm5883l_decode_heading(const uint8_t *buffer, int16_t *x, int16_t *y, int16_t *z);
 
 #endif
\ No newline at end of file
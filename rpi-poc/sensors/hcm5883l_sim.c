@@ -0,0 +1,151 @@
+#include <string.h>
+#include <math.h>
+
+#include "hcm5883l_sim.h"
+
+#define FIELD(value, bit, length) (((value) >> ((bit) - (length) + 1)) & ((1 << (length)) - 1))
+#define SATURATED -4096
+
+// ns between measurements per CONFIG_A rate, the reserved 7 runs at 75 Hz
+static const uint64_t periods[8] = {
+    1333333333ull, 666666667ull, 333333333ull, 133333333ull,
+    66666667ull, 33333333ull, 13333333ull, 13333333ull};
+
+// LSB per Gauss per CONFIG_B gain
+static const double gains[8] = {1370, 1090, 820, 660, 440, 390, 330, 230};
+
+static uint8_t mode(hcm5883l_sim_t *sim)
+{
+    return sim->regs[HMC5883L_MODE] & 0x03;
+}
+
+static int16_t raw(double value)
+{
+    value = round(value);
+    return value > 2047 || value < -2048 ? SATURATED : value;
+}
+
+static void put_word(uint8_t *p, int16_t value)
+{
+    p[0] = (uint16_t)value >> 8;
+    p[1] = value;
+}
+
+static void measure(hcm5883l_sim_t *sim, uint64_t t)
+{
+    double gain = gains[FIELD(sim->regs[HMC5883L_CONFIG_B], HMC5883L_CRB_GAIN_BIT, HMC5883L_CRB_GAIN_LENGTH)];
+    sim_motion_t motion;
+
+    sim->source.sample(sim->source.context, t - sim->origin, &motion);
+    put_word(sim->regs + HMC5883L_DATAX_H, raw(motion.mx * gain));
+    put_word(sim->regs + HMC5883L_DATAZ_H, raw(motion.mz * gain));
+    put_word(sim->regs + HMC5883L_DATAY_H, raw(motion.my * gain));
+    sim->regs[HMC5883L_STATUS] |= 1 << HMC5883L_STATUS_READY_BIT;
+    sim->measurements++;
+}
+
+/**
+ * Take the measurements due by now, only the latest one is visible.
+ */
+static void advance(hcm5883l_sim_t *sim, uint64_t now)
+{
+    uint64_t period;
+
+    if (mode(sim) == HMC5883L_MODE_SINGLE && sim->pending && now >= sim->next)
+    {
+        measure(sim, sim->next);
+        sim->pending = 0;
+        sim->regs[HMC5883L_MODE] = (sim->regs[HMC5883L_MODE] & ~0x03) | HMC5883L_MODE_IDLE;
+    }
+    else if (mode(sim) == HMC5883L_MODE_CONTINUOUS && now >= sim->next)
+    {
+        period = periods[FIELD(sim->regs[HMC5883L_CONFIG_A], HMC5883L_CRA_RATE_BIT, HMC5883L_CRA_RATE_LENGTH)];
+        sim->next += (now - sim->next) / period * period;
+        measure(sim, sim->next);
+        sim->next += period;
+    }
+}
+
+static void sim_read(void *model, uint64_t now, uint8_t reg_addr, uint8_t length, uint8_t *data)
+{
+    hcm5883l_sim_t *sim = model;
+    int i;
+
+    advance(sim, now);
+    for (i = 0; i < length; i++)
+    {
+        reg_addr %= HMC5883L_SIM_REGISTERS;
+        data[i] = sim->regs[reg_addr];
+        if (reg_addr >= HMC5883L_DATAX_H && reg_addr <= HMC5883L_DATAY_L)
+            sim->regs[HMC5883L_STATUS] &= ~(1 << HMC5883L_STATUS_READY_BIT);
+        reg_addr = reg_addr == HMC5883L_DATAY_L ? HMC5883L_DATAX_H : reg_addr + 1;
+    }
+}
+
+static void sim_write(void *model, uint64_t now, uint8_t reg_addr, uint8_t length, const uint8_t *data)
+{
+    hcm5883l_sim_t *sim = model;
+    int i;
+
+    advance(sim, now);
+    for (i = 0; i < length; i++, reg_addr++)
+    {
+        if (reg_addr > HMC5883L_MODE)
+            continue; // read only
+        sim->regs[reg_addr] = data[i];
+        if (reg_addr != HMC5883L_MODE)
+            continue;
+        // a mode write starts the first measurement
+        sim->next = now + HMC5883L_SIM_MEASUREMENT_NS;
+        sim->pending = mode(sim) == HMC5883L_MODE_SINGLE;
+    }
+}
+
+/**
+ * Power-on state: 15 Hz, gain 1090, single measurement mode and idle.
+ *
+ * @param sim Model
+ * @param source Magnetic field the sensor is exposed to, copied
+ * @param origin Time the motion source starts at
+ */
+void hcm5883l_sim_init(hcm5883l_sim_t *sim, const sim_motion_source_t *source, uint64_t origin)
+{
+    memset(sim, 0, sizeof(*sim));
+    sim->source = *source;
+    sim->origin = origin;
+    sim->next = origin;
+    sim->regs[HMC5883L_CONFIG_A] = 0x10;
+    sim->regs[HMC5883L_CONFIG_B] = 0x20;
+    sim->regs[HMC5883L_MODE] = 0x01;
+    sim->regs[HMC5883L_ID_A] = 'H';
+    sim->regs[HMC5883L_ID_B] = '4';
+    sim->regs[HMC5883L_ID_C] = '3';
+}
+
+/**
+ * Device to attach to a simulated bus at HMC5883L_ADDRESS, the host bus or
+ * the MPU6050 auxiliary one.
+ *
+ * @param sim Model
+ * @param device Filled in
+ */
+void hcm5883l_sim_device(hcm5883l_sim_t *sim, i2c_sim_device_t *device)
+{
+    device->address = HMC5883L_ADDRESS;
+    device->model = sim;
+    device->read = sim_read;
+    device->write = sim_write;
+}
+
+/**
+ * Level of the DRDY pin.
+ *
+ * @param sim Model
+ * @param now Current time
+ * @return 1 while a measurement is unread
+ */
+int hcm5883l_sim_data_ready(hcm5883l_sim_t *sim, uint64_t now)
+{
+    advance(sim, now);
+    return (sim->regs[HMC5883L_STATUS] >> HMC5883L_STATUS_READY_BIT) & 1;
+}
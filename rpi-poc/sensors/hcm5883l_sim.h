@@ -0,0 +1,36 @@
+#ifndef __HCM5883L_SIM_H_
+#define __HCM5883L_SIM_H_
+
+#include <stdint.h>
+
+#include "hcm5883l_registers.h"
+#include "sim_motion.h"
+#include "../i2c/sim_bus.h"
+
+#define HMC5883L_SIM_REGISTERS 13
+#define HMC5883L_SIM_MEASUREMENT_NS 6000000ull // single measurement, power up to DRDY
+
+/**
+ * Register map model of the HMC5883L for the simulated bus.
+ *
+ * Continuous mode measures at the CONFIG_A output rate, single mode once
+ * HMC5883L_SIM_MEASUREMENT_NS after MODE is written and then goes idle.
+ * A measurement is scaled by the CONFIG_B gain, saturated axes read -4096,
+ * and sets RDY until a data register is read. The read pointer wraps from
+ * DATAY_L back to DATAX_H and from ID_C to CONFIG_A.
+ */
+typedef struct
+{
+    uint8_t regs[HMC5883L_SIM_REGISTERS];
+    uint64_t origin;            // time 0 of the motion source
+    uint64_t next;              // time of the next measurement
+    int pending;                // single measurement under way
+    sim_motion_source_t source;
+    unsigned long measurements;
+} hcm5883l_sim_t;
+
+void hcm5883l_sim_init(hcm5883l_sim_t *sim, const sim_motion_source_t *source, uint64_t origin);
+void hcm5883l_sim_device(hcm5883l_sim_t *sim, i2c_sim_device_t *device);
+int hcm5883l_sim_data_ready(hcm5883l_sim_t *sim, uint64_t now);
+
+#endif
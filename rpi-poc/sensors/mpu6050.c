@@ -10,6 +10,14 @@
 #include "mpu6050.h"
 #include "mpu6050_registers.h"
 #include "../i2c/I2Cdev.h"
+#include "../i2c/shadow.h"
+
+// configuration registers kept in the shadow, SMPLRT_DIV to PWR_MGMT_2
+#define MPU6050_SHADOW_FIRST MPU6050_SMPLRT_DIV
+#define MPU6050_SHADOW_LENGTH (MPU6050_PWR_MGMT_2 - MPU6050_SMPLRT_DIV + 1)
+
+static i2c_shadow_t shadow;
+static unsigned long fifo_overflows;
 
 /**
  * Set clock source setting.
@@ -45,8 +53,8 @@
  */
 void mpu6050_set_clock_source(uint8_t source)
 {
-    write_bits(
-        MPU6050_ADDRESS,
+    i2c_shadow_write_bits(
+        &shadow,
         MPU6050_PWR_MGMT_1,
         MPU6050_PWR_MGMT_1_CLK_SEL_BIT,
         MPU6050_PWR_MGMT_1_CLK_SEL_LENGTH,
@@ -65,8 +73,8 @@ void mpu6050_set_clock_source(uint8_t source)
  */
 void mpu6050_set_full_scale_gyro_range(uint8_t range)
 {
-    write_bits(
-        MPU6050_ADDRESS,
+    i2c_shadow_write_bits(
+        &shadow,
         MPU6050_GYRO_CONFIG,
         MPU6050_GYRO_FS_SEL_BIT,
         MPU6050_GYRO_FS_SEL_LENGTH,
@@ -81,8 +89,8 @@ void mpu6050_set_full_scale_gyro_range(uint8_t range)
  */
 void mpu6050_set_full_scale_accel_range(uint8_t range)
 {
-    write_bits(
-        MPU6050_ADDRESS,
+    i2c_shadow_write_bits(
+        &shadow,
         MPU6050_ACCEL_CONFIG,
         MPU6050_ACCEL_CONFIG_AFS_SEL_BIT,
         MPU6050_ACCEL_CONFIG_AFS_SEL_LENGTH,
@@ -99,8 +107,8 @@ void mpu6050_set_full_scale_accel_range(uint8_t range)
  */
 void mpu6050_set_sleep_enabled(bool enabled)
 {
-    write_bit(
-        MPU6050_ADDRESS,
+    i2c_shadow_write_bit(
+        &shadow,
         MPU6050_PWR_MGMT_1,
         MPU6050_PWR_MGMT_1_SLEEP_BIT,
         enabled);
@@ -116,8 +124,8 @@ void mpu6050_set_sleep_enabled(bool enabled)
  */
 void mput6050_set_I2C_master_mode_enabled(bool enabled)
 {
-    write_bit(
-        MPU6050_ADDRESS,
+    i2c_shadow_write_bit(
+        &shadow,
         MPU6050_USER_CTRL,
         MPU6050_USER_CTRL_I2C_MST_EN_BIT,
         enabled);
@@ -140,8 +148,8 @@ void mput6050_set_I2C_master_mode_enabled(bool enabled)
  */
 void mpu6050_set_I2C_bypass_enabled(bool enabled)
 {
-    write_bit(
-        MPU6050_ADDRESS,
+    i2c_shadow_write_bit(
+        &shadow,
         MPU6050_INT_PIN_CFG,
         MPU6050_INT_PIN_CFG_I2C_BYPASS_EN_BIT,
         enabled);
@@ -201,15 +209,29 @@ void mpu6050_set_I2C_bypass_enabled(bool enabled)
  * to their most sensitive settings, namely +/- 2g and +/- 250 degrees/sec, and sets
  * the clock source to use the X Gyro for reference, which is slightly better than
  * the default internal clock source.
+ *
+ * The configuration registers are loaded into the shadow with burst reads
+ * that skip the data and status registers: I2C_SLV4_DI and I2C_MST_STATUS
+ * (which clears on read) are left out of the shadow, and so are INT_STATUS
+ * and the sensor data after INT_ENABLE. The settings are flushed together as
+ * coalesced burst writes.
  */
 void mpu6050_initialize()
 {
+    i2c_shadow_init(&shadow, MPU6050_ADDRESS, MPU6050_SHADOW_FIRST, MPU6050_SHADOW_LENGTH);
+    i2c_shadow_refresh(&shadow, MPU6050_SMPLRT_DIV, MPU6050_I2C_SLV4_CTRL - MPU6050_SMPLRT_DIV + 1);
+    i2c_shadow_invalidate(&shadow, MPU6050_I2C_SLV4_DI, MPU6050_I2C_MST_STATUS - MPU6050_I2C_SLV4_DI + 1);
+    i2c_shadow_refresh(&shadow, MPU6050_INT_PIN_CFG, MPU6050_INT_ENABLE - MPU6050_INT_PIN_CFG + 1);
+    i2c_shadow_refresh(&shadow, MPU6050_I2C_MST_DELAY_CTRL, MPU6050_PWR_MGMT_2 - MPU6050_I2C_MST_DELAY_CTRL + 1);
+
+    i2c_shadow_hold(&shadow);
     mput6050_set_I2C_master_mode_enabled(false);
     mpu6050_set_I2C_bypass_enabled(true);
     mpu6050_set_clock_source(MPU6050_CLOCK_PLL_XGYRO);
     mpu6050_set_full_scale_gyro_range(MPU6050_GYRO_FS_250);
     mpu6050_set_full_scale_accel_range(MPU6050_ACCEL_FS_2);
     mpu6050_set_sleep_enabled(false);
+    i2c_shadow_flush(&shadow);
 }
 
 /**
@@ -228,14 +250,43 @@ void mpu6050_initialize()
  */
 void mpu6050_get_motion_6(int16_t *ax, int16_t *ay, int16_t *az, int16_t *gx, int16_t *gy, int16_t *gz)
 {
-    uint8_t buffer[14];
+    uint8_t buffer[MPU6050_MOTION_6_LENGTH];
 
     read_bytes(
         MPU6050_ADDRESS,
         MPU6050_ACCEL_XOUT_H,
-        14,
+        MPU6050_MOTION_6_LENGTH,
         buffer);
 
+    mpu6050_decode_motion_6(buffer, ax, ay, az, gx, gy, gz);
+}
+
+/**
+ * Append the raw 6-axis motion read to a batch.
+ *
+ * @param batch Batch to append to
+ * @param buffer MPU6050_MOTION_6_LENGTH bytes filled in when the batch is submitted
+ * @return Entry index in the batch, I2C_ERR when the batch is full
+ * @see mpu6050_decode_motion_6()
+ */
+int mpu6050_batch_motion_6(i2c_batch_t *batch, uint8_t *buffer)
+{
+    return i2c_batch_read(
+        batch,
+        MPU6050_ADDRESS,
+        MPU6050_ACCEL_XOUT_H,
+        MPU6050_MOTION_6_LENGTH,
+        buffer);
+}
+
+/**
+ * Decode raw 6-axis motion registers (accel/gyro), temperature is skipped.
+ *
+ * @param buffer MPU6050_MOTION_6_LENGTH bytes read from MPU6050_ACCEL_XOUT_H
+ * @see mpu6050_get_motion_6()
+ */
+void mpu6050_decode_motion_6(const uint8_t *buffer, int16_t *ax, int16_t *ay, int16_t *az, int16_t *gx, int16_t *gy, int16_t *gz)
+{
     *ax = (((int16_t)buffer[0]) << 8) | buffer[1];
     *ay = (((int16_t)buffer[2]) << 8) | buffer[3];
     *az = (((int16_t)buffer[4]) << 8) | buffer[5];
@@ -243,3 +294,341 @@ void mpu6050_get_motion_6(int16_t *ax, int16_t *ay, int16_t *az, int16_t *gx, in
     *gy = (((int16_t)buffer[10]) << 8) | buffer[11];
     *gz = (((int16_t)buffer[12]) << 8) | buffer[13];
 }
+
+/**
+ * Get the sample rate from the CONFIG and SMPLRT_DIV registers.
+ *
+ * The gyroscope output rate is 8 kHz with the digital low pass filter
+ * disabled (DLPF_CFG 0 or 7) and 1 kHz otherwise.
+ *
+ * @return Sample rate in Hz, 0 when the registers can not be read
+ */
+uint16_t mpu6050_get_rate()
+{
+    uint8_t config, div, dlpf;
+
+    if (i2c_shadow_read_byte(&shadow, MPU6050_CONFIG, &config) != I2C_OK ||
+        i2c_shadow_read_byte(&shadow, MPU6050_SMPLRT_DIV, &div) != I2C_OK)
+    {
+        return 0;
+    }
+    dlpf = config & ((1 << MPU6050_CONFIG_DLPF_CFG_LENGTH) - 1);
+    return ((dlpf == 0 || dlpf == 7) ? 8000 : 1000) / (1 + div);
+}
+
+/**
+ * Let the auxiliary I2C master poll a slave on its own.
+ *
+ * Slave 0 reads length bytes from slave_reg of slave_addr and mirrors them
+ * into EXT_SENS_DATA_00, right after the gyroscope registers, so a single
+ * MPU6050_MOTION_9_LENGTH read from ACCEL_XOUT_H returns accel, temperature,
+ * gyro and the slave data. Bypass is turned off, the host can no longer reach
+ * the auxiliary bus directly, so the slave must be configured before (e.g. a
+ * magnetometer in continuous mode).
+ *
+ * @param slave_addr I2C address of the auxiliary slave
+ * @param slave_reg First register to read
+ * @param length Number of bytes to read (1-15)
+ * @param slave_rate Rate in Hz the slave is polled at, every sample when 0
+ * @return I2C_OK on success, I2C_ERR on failure
+ * @see mpu6050_batch_motion_9()
+ */
+int mpu6050_aux_slave_enable(uint8_t slave_addr, uint8_t slave_reg, uint8_t length, uint16_t slave_rate)
+{
+    uint16_t rate = mpu6050_get_rate();
+    uint8_t delay = 0;
+
+    if (length == 0 || length > 15)
+    {
+        return I2C_ERR;
+    }
+    // slave is read every 1 + delay samples
+    if (slave_rate > 0 && rate > slave_rate)
+    {
+        delay = rate / slave_rate - 1;
+        delay = delay > 31 ? 31 : delay;
+    }
+
+    i2c_shadow_hold(&shadow);
+    i2c_shadow_write_bits(&shadow, MPU6050_I2C_MST_CTRL, MPU6050_I2C_MST_CTRL_CLK_BIT, MPU6050_I2C_MST_CTRL_CLK_LENGTH, MPU6050_I2C_MST_CLK_400);
+    i2c_shadow_write_byte(&shadow, MPU6050_I2C_SLV0_ADDR, (1 << MPU6050_I2C_SLV_RW_BIT) | slave_addr);
+    i2c_shadow_write_byte(&shadow, MPU6050_I2C_SLV0_REG, slave_reg);
+    i2c_shadow_write_byte(&shadow, MPU6050_I2C_SLV0_CTRL, (1 << MPU6050_I2C_SLV_CTRL_EN_BIT) | length);
+    i2c_shadow_write_bits(&shadow, MPU6050_I2C_SLV4_CTRL, MPU6050_I2C_SLV4_CTRL_MST_DLY_BIT, MPU6050_I2C_SLV4_CTRL_MST_DLY_LENGTH, delay);
+    i2c_shadow_write_bit(&shadow, MPU6050_I2C_MST_DELAY_CTRL, MPU6050_I2C_MST_DELAY_CTRL_SLV0_DLY_EN_BIT, delay > 0);
+    mpu6050_set_I2C_bypass_enabled(false);
+    mput6050_set_I2C_master_mode_enabled(true);
+    return i2c_shadow_flush(&shadow);
+}
+
+/**
+ * Stop the auxiliary I2C master and give the host direct access to the
+ * auxiliary bus again.
+ */
+void mpu6050_aux_slave_disable()
+{
+    i2c_shadow_hold(&shadow);
+    i2c_shadow_write_byte(&shadow, MPU6050_I2C_SLV0_CTRL, 0);
+    mput6050_set_I2C_master_mode_enabled(false);
+    mpu6050_set_I2C_bypass_enabled(true);
+    i2c_shadow_flush(&shadow);
+}
+
+/**
+ * Append the raw 6-axis motion and auxiliary slave read to a batch.
+ *
+ * @param batch Batch to append to
+ * @param buffer MPU6050_MOTION_9_LENGTH bytes filled in when the batch is
+ * submitted, mpu6050_decode_motion_6() decodes the start and the slave data
+ * begins at MPU6050_EXT_SENS_OFFSET
+ * @return Entry index in the batch, I2C_ERR when the batch is full
+ * @see mpu6050_aux_slave_enable()
+ */
+int mpu6050_batch_motion_9(i2c_batch_t *batch, uint8_t *buffer)
+{
+    return i2c_batch_read(
+        batch,
+        MPU6050_ADDRESS,
+        MPU6050_ACCEL_XOUT_H,
+        MPU6050_MOTION_9_LENGTH,
+        buffer);
+}
+
+/**
+ * Read the data mirrored from the auxiliary slave.
+ *
+ * @param buffer Container for the slave data
+ * @param length Number of bytes to read
+ * @return I2C_OK on success, I2C_ERR on failure
+ */
+int mpu6050_read_ext_sens_data(uint8_t *buffer, uint8_t length)
+{
+    return read_bytes(MPU6050_ADDRESS, MPU6050_EXT_SENS_DATA_00, length, buffer) == length ? I2C_OK : I2C_ERR;
+}
+
+/**
+ * Set the digital low pass filter and the sample rate divider.
+ *
+ * The gyroscope output rate is 8 kHz with the filter disabled (DLPF_CFG 0,
+ * MPU6050_DLPF_BW_256, and the reserved 7) and 1 kHz otherwise, the sample
+ * rate is that divided by SMPLRT_DIV + 1, so rate must divide it evenly. Goes
+ * through the shadow, so several settings between i2c_shadow_hold() and
+ * i2c_shadow_flush() still end up in one burst.
+ *
+ * @param rate Sample rate in Hz, e.g. 1000
+ * @param dlpf Digital low pass filter setting, MPU6050_DLPF_BW_* or 7
+ * @return I2C_OK on success, I2C_ERR on failure, unreachable rate or a dlpf
+ * above 7
+ */
+int mpu6050_set_rate(uint16_t rate, uint8_t dlpf)
+{
+    uint16_t gyro_rate = (dlpf == 0 || dlpf == 7) ? 8000 : 1000;
+
+    if (dlpf > 7 || rate == 0 || rate > gyro_rate || gyro_rate % rate != 0 || gyro_rate / rate > 256)
+    {
+        return I2C_ERR;
+    }
+    if (i2c_shadow_write_bits(&shadow, MPU6050_CONFIG, MPU6050_CONFIG_DLPF_CFG_BIT, MPU6050_CONFIG_DLPF_CFG_LENGTH, dlpf) != I2C_OK)
+    {
+        return I2C_ERR;
+    }
+    return i2c_shadow_write_byte(&shadow, MPU6050_SMPLRT_DIV, gyro_rate / rate - 1);
+}
+
+/**
+ * Pulse the INT pin every time a new sample is in the data registers.
+ *
+ * The pin is active high, push-pull, with a 50 us pulse per sample so every
+ * sample is one rising edge without having to clear INT_STATUS.
+ *
+ * @param rate Sample rate in Hz, e.g. 100
+ * @param dlpf Digital low pass filter setting, MPU6050_DLPF_BW_*
+ * @return I2C_OK on success, I2C_ERR on failure or unreachable rate
+ * @see mpu6050_set_rate()
+ */
+int mpu6050_data_ready_enable(uint16_t rate, uint8_t dlpf)
+{
+    i2c_shadow_hold(&shadow);
+    if (mpu6050_set_rate(rate, dlpf) != I2C_OK)
+    {
+        i2c_shadow_flush(&shadow);
+        return I2C_ERR;
+    }
+    i2c_shadow_write_bit(&shadow, MPU6050_INT_PIN_CFG, MPU6050_INT_PIN_CFG_INT_LEVEL_BIT, false);
+    i2c_shadow_write_bit(&shadow, MPU6050_INT_PIN_CFG, MPU6050_INT_PIN_CFG_INT_OPEN_BIT, false);
+    i2c_shadow_write_bit(&shadow, MPU6050_INT_PIN_CFG, MPU6050_INT_PIN_CFG_LATCH_INT_EN_BIT, false);
+    i2c_shadow_write_byte(&shadow, MPU6050_INT_ENABLE, 1 << MPU6050_INT_DATA_RDY_BIT);
+    return i2c_shadow_flush(&shadow);
+}
+
+/**
+ * Stop the data ready interrupt.
+ */
+void mpu6050_data_ready_disable()
+{
+    i2c_shadow_write_bit(&shadow, MPU6050_INT_ENABLE, MPU6050_INT_DATA_RDY_BIT, false);
+}
+
+/**
+ * Start FIFO acquisition of accelerometer and gyroscope frames.
+ *
+ * Every sample pushes a MPU6050_FIFO_FRAME_LENGTH bytes frame.
+ *
+ * @param rate Sample rate in Hz, e.g. 1000
+ * @param dlpf Digital low pass filter setting, MPU6050_DLPF_BW_*
+ * @return I2C_OK on success, I2C_ERR on failure or unreachable rate
+ * @see mpu6050_set_rate()
+ * @see mpu6050_fifo_read()
+ */
+int mpu6050_fifo_enable(uint16_t rate, uint8_t dlpf)
+{
+    uint8_t int_status;
+    uint8_t fifo_en = (1 << MPU6050_FIFO_EN_XG_BIT) |
+                      (1 << MPU6050_FIFO_EN_YG_BIT) |
+                      (1 << MPU6050_FIFO_EN_ZG_BIT) |
+                      (1 << MPU6050_FIFO_EN_ACCEL_BIT);
+
+    i2c_shadow_hold(&shadow);
+    if (mpu6050_set_rate(rate, dlpf) != I2C_OK)
+    {
+        i2c_shadow_flush(&shadow);
+        return I2C_ERR;
+    }
+    i2c_shadow_write_byte(&shadow, MPU6050_FIFO_EN, fifo_en);
+    i2c_shadow_write_bit(&shadow, MPU6050_USER_CTRL, MPU6050_USER_CTRL_FIFO_EN_BIT, true);
+    if (i2c_shadow_flush(&shadow) != I2C_OK)
+    {
+        return I2C_ERR;
+    }
+
+    fifo_overflows = 0;
+    if (mpu6050_fifo_reset() != I2C_OK)
+    {
+        return I2C_ERR;
+    }
+    // clear a FIFO_OFLOW left from before, it would count as an overflow
+    return read_bytes(MPU6050_ADDRESS, MPU6050_INT_STATUS, 1, &int_status) == 1 ? I2C_OK : I2C_ERR;
+}
+
+/**
+ * Stop FIFO acquisition.
+ */
+void mpu6050_fifo_disable()
+{
+    i2c_shadow_hold(&shadow);
+    i2c_shadow_write_byte(&shadow, MPU6050_FIFO_EN, 0);
+    i2c_shadow_write_bit(&shadow, MPU6050_USER_CTRL, MPU6050_USER_CTRL_FIFO_EN_BIT, false);
+    i2c_shadow_flush(&shadow);
+}
+
+/**
+ * Empty the FIFO, used to resynchronise on frame boundaries after an overflow.
+ *
+ * FIFO_RESET clears itself, so it is written around the shadow: the FIFO is
+ * disabled while it is reset and enabled again with the shadowed USER_CTRL.
+ *
+ * @return I2C_OK on success, I2C_ERR on failure
+ */
+int mpu6050_fifo_reset()
+{
+    uint8_t user_ctrl;
+
+    if (i2c_shadow_read_byte(&shadow, MPU6050_USER_CTRL, &user_ctrl) != I2C_OK)
+    {
+        return I2C_ERR;
+    }
+    if (write_byte(MPU6050_ADDRESS, MPU6050_USER_CTRL,
+                   (user_ctrl & ~(1 << MPU6050_USER_CTRL_FIFO_EN_BIT)) | (1 << MPU6050_USER_CTRL_FIFO_RESET_BIT)) != 0)
+    {
+        return I2C_ERR;
+    }
+    return write_byte(MPU6050_ADDRESS, MPU6050_USER_CTRL, user_ctrl) == 0 ? I2C_OK : I2C_ERR;
+}
+
+/**
+ * Drain complete frames from the FIFO.
+ *
+ * Reads INT_STATUS and FIFO_COUNT in one batch, then fetches every complete
+ * frame (up to max_samples) in bursts of MPU6050_FIFO_CHUNK_FRAMES frames
+ * submitted as one batch. A partial frame stays in the FIFO for the next call.
+ * FIFO_OFLOW (or a full FIFO) means frames were overwritten and the byte
+ * stream is no longer frame aligned, so the FIFO is reset and the overflow
+ * counted. Reading INT_STATUS also clears the DATA_RDY flag.
+ *
+ * @param samples Container for decoded samples, oldest first
+ * @param max_samples Capacity of samples
+ * @return Number of samples read, -1 on bus error or overflow
+ * @see mpu6050_fifo_overflows()
+ */
+int mpu6050_fifo_read(mpu6050_sample_t *samples, int max_samples)
+{
+    uint8_t buffer[MPU6050_FIFO_SIZE];
+    uint8_t count_buffer[2];
+    uint8_t int_status;
+    i2c_batch_t batch;
+    int count, frames, chunk, i;
+
+    i2c_batch_init(&batch);
+    i2c_batch_read(&batch, MPU6050_ADDRESS, MPU6050_INT_STATUS, 1, &int_status);
+    i2c_batch_read(&batch, MPU6050_ADDRESS, MPU6050_FIFO_COUNTH, 2, count_buffer);
+    if (i2c_batch_submit(&batch) != I2C_OK)
+    {
+        return -1;
+    }
+    count = (count_buffer[0] << 8) | count_buffer[1];
+    if ((int_status & (1 << MPU6050_INT_FIFO_OFLOW_BIT)) || count >= MPU6050_FIFO_SIZE)
+    {
+        fifo_overflows++;
+        mpu6050_fifo_reset();
+        return -1;
+    }
+
+    frames = count / MPU6050_FIFO_FRAME_LENGTH;
+    if (frames > max_samples)
+    {
+        frames = max_samples;
+    }
+    if (frames == 0)
+    {
+        return 0;
+    }
+
+    i2c_batch_init(&batch);
+    for (i = 0; i < frames; i += chunk)
+    {
+        chunk = frames - i < MPU6050_FIFO_CHUNK_FRAMES ? frames - i : MPU6050_FIFO_CHUNK_FRAMES;
+        i2c_batch_read(
+            &batch,
+            MPU6050_ADDRESS,
+            MPU6050_FIFO_R_W,
+            chunk * MPU6050_FIFO_FRAME_LENGTH,
+            buffer + i * MPU6050_FIFO_FRAME_LENGTH);
+    }
+    if (i2c_batch_submit(&batch) != I2C_OK)
+    {
+        return -1;
+    }
+
+    for (i = 0; i < frames; i++)
+    {
+        const uint8_t *frame = buffer + i * MPU6050_FIFO_FRAME_LENGTH;
+        samples[i].ax = (((int16_t)frame[0]) << 8) | frame[1];
+        samples[i].ay = (((int16_t)frame[2]) << 8) | frame[3];
+        samples[i].az = (((int16_t)frame[4]) << 8) | frame[5];
+        samples[i].gx = (((int16_t)frame[6]) << 8) | frame[7];
+        samples[i].gy = (((int16_t)frame[8]) << 8) | frame[9];
+        samples[i].gz = (((int16_t)frame[10]) << 8) | frame[11];
+    }
+
+    return frames;
+}
+
+/**
+ * Number of FIFO overflows since mpu6050_fifo_enable().
+ *
+ * @return Overflow count
+ */
+unsigned long mpu6050_fifo_overflows()
+{
+    return fifo_overflows;
+}
@@ -4,7 +4,39 @@
 #include <stdlib.h>
 #include <stdint.h>
 
+#include "../i2c/I2Cdev.h"
+
+#define MPU6050_MOTION_6_LENGTH 14 // ACCEL_XOUT_H to GYRO_ZOUT_L
+#define MPU6050_MOTION_9_LENGTH 20 // ACCEL_XOUT_H to EXT_SENS_DATA_05
+#define MPU6050_EXT_SENS_OFFSET 14 // EXT_SENS_DATA_00 in a motion 9 buffer
+
+#define MPU6050_FIFO_FRAME_LENGTH 12 // accel x/y/z then gyro x/y/z
+#define MPU6050_FIFO_CHUNK_FRAMES 10 // frames per burst read
+
+typedef struct
+{
+    int16_t ax, ay, az;
+    int16_t gx, gy, gz;
+} mpu6050_sample_t;
+
 void mpu6050_initialize();
 void mpu6050_get_motion_6(int16_t* ax, int16_t* ay, int16_t* az, int16_t* gx, int16_t* gy, int16_t* gz);
+int mpu6050_batch_motion_6(i2c_batch_t *batch, uint8_t *buffer);
+void mpu6050_decode_motion_6(const uint8_t *buffer, int16_t* ax, int16_t* ay, int16_t* az, int16_t* gx, int16_t* gy, int16_t* gz);
+
+uint16_t mpu6050_get_rate();
+int mpu6050_set_rate(uint16_t rate, uint8_t dlpf);
+int mpu6050_data_ready_enable(uint16_t rate, uint8_t dlpf);
+void mpu6050_data_ready_disable();
+int mpu6050_aux_slave_enable(uint8_t slave_addr, uint8_t slave_reg, uint8_t length, uint16_t slave_rate);
+void mpu6050_aux_slave_disable();
+int mpu6050_batch_motion_9(i2c_batch_t *batch, uint8_t *buffer);
+int mpu6050_read_ext_sens_data(uint8_t *buffer, uint8_t length);
+
+int mpu6050_fifo_enable(uint16_t rate, uint8_t dlpf);
+void mpu6050_fifo_disable();
+int mpu6050_fifo_reset();
+int mpu6050_fifo_read(mpu6050_sample_t *samples, int max_samples);
+unsigned long mpu6050_fifo_overflows();
 
 #endif
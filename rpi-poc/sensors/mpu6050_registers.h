@@ -3,13 +3,31 @@
 
 #define MPU6050_ADDRESS                                 0x68
 
+// offset registers, undocumented, big-endian words per axis
+#define MPU6050_XA_OFFS_H                               0x06 // accel, 2048 LSB per g
+#define MPU6050_XG_OFFS_USRH                            0x13 // gyro, 32.8 LSB per degree/s
+
 #define MPU6050_SELF_TEST_X                             0x0D
 #define MPU6050_SELF_TEST_Y                             0x0E
 #define MPU6050_SELF_TEST_Z                             0x0F
 #define MPU6050_SELF_TEST_A                             0x10
 #define MPU6050_SMPLRT_DIV                              0x19
+
+// start config
 #define MPU6050_CONFIG                                  0x1A
 
+#define MPU6050_CONFIG_DLPF_CFG_BIT                     2
+#define MPU6050_CONFIG_DLPF_CFG_LENGTH                  3
+
+#define MPU6050_DLPF_BW_256                             0x00
+#define MPU6050_DLPF_BW_188                             0x01
+#define MPU6050_DLPF_BW_98                              0x02
+#define MPU6050_DLPF_BW_42                              0x03
+#define MPU6050_DLPF_BW_20                              0x04
+#define MPU6050_DLPF_BW_10                              0x05
+#define MPU6050_DLPF_BW_5                               0x06
+// ends config
+
 // start gyro config
 #define MPU6050_GYRO_CONFIG                             0x1B
 
@@ -34,8 +52,29 @@
 #define MPU6050_ACCEL_FS_16                             0X03
 // ends accel config
 
+// start fifo enable
 #define MPU6050_FIFO_EN                                 0x23
+
+#define MPU6050_FIFO_EN_TEMP_BIT                        7
+#define MPU6050_FIFO_EN_XG_BIT                          6
+#define MPU6050_FIFO_EN_YG_BIT                          5
+#define MPU6050_FIFO_EN_ZG_BIT                          4
+#define MPU6050_FIFO_EN_ACCEL_BIT                       3
+#define MPU6050_FIFO_EN_SLV2_BIT                        2
+#define MPU6050_FIFO_EN_SLV1_BIT                        1
+#define MPU6050_FIFO_EN_SLV0_BIT                        0
+// ends fifo enable
+
+// start i2c master ctrl
 #define MPU6050_I2C_MST_CTRL                            0x24
+
+#define MPU6050_I2C_MST_CTRL_WAIT_FOR_ES_BIT            6
+#define MPU6050_I2C_MST_CTRL_CLK_BIT                    3
+#define MPU6050_I2C_MST_CTRL_CLK_LENGTH                 4
+
+#define MPU6050_I2C_MST_CLK_400                         0x0D
+// ends i2c master ctrl
+
 #define MPU6050_I2C_SLV0_ADDR                           0x25
 #define MPU6050_I2C_SLV0_REG                            0x26
 #define MPU6050_I2C_SLV0_CTRL                           0x27
@@ -52,18 +91,37 @@
 #define MPU6050_I2C_SLV4_REG                            0x32
 #define MPU6050_I2C_SLV4_DO                             0x33
 #define MPU6050_I2C_SLV4_CTRL                           0x34
+
+// start i2c slave ctrl
+#define MPU6050_I2C_SLV_RW_BIT                          7
+
+#define MPU6050_I2C_SLV_CTRL_EN_BIT                     7
+#define MPU6050_I2C_SLV_CTRL_LEN_BIT                    3
+#define MPU6050_I2C_SLV_CTRL_LEN_LENGTH                 4
+
+#define MPU6050_I2C_SLV4_CTRL_MST_DLY_BIT               4
+#define MPU6050_I2C_SLV4_CTRL_MST_DLY_LENGTH            5
+// ends i2c slave ctrl
 #define MPU6050_I2C_SLV4_DI                             0x35
 #define MPU6050_I2C_MST_STATUS                          0x36
 
 // start int pin cfg
 #define MPU6050_INT_PIN_CFG                             0x37
 
+#define MPU6050_INT_PIN_CFG_INT_LEVEL_BIT               7
+#define MPU6050_INT_PIN_CFG_INT_OPEN_BIT                6
+#define MPU6050_INT_PIN_CFG_LATCH_INT_EN_BIT            5
+#define MPU6050_INT_PIN_CFG_INT_RD_CLEAR_BIT            4
 #define MPU6050_INT_PIN_CFG_I2C_BYPASS_EN_BIT           1
 // ends int pin cfg
 
 #define MPU6050_INT_ENABLE                              0x38
 #define MPU6050_INT_STATUS                              0x3A
 
+#define MPU6050_INT_FIFO_OFLOW_BIT                      4
+#define MPU6050_INT_I2C_MST_INT_BIT                     3
+#define MPU6050_INT_DATA_RDY_BIT                        0
+
 #define MPU6050_ACCEL_XOUT_H                            0x3B
 #define MPU6050_ACCEL_XOUT_L                            0x3C
 #define MPU6050_ACCEL_YOUT_H                            0x3D
@@ -110,12 +168,17 @@
 #define MPU6050_I2C_SLV2_DO                             0x65
 #define MPU6050_I2C_SLV3_DO                             0x66
 #define MPU6050_I2C_MST_DELAY_CTRL                      0x67
+
+#define MPU6050_I2C_MST_DELAY_CTRL_SLV0_DLY_EN_BIT      0
 #define MPU6050_SIGNAL_PATH_RESET                       0x68
 
 // start user ctrl
 #define MPU6050_USER_CTRL                               0x6A
 
+#define MPU6050_USER_CTRL_FIFO_EN_BIT                   6
 #define MPU6050_USER_CTRL_I2C_MST_EN_BIT                5
+#define MPU6050_USER_CTRL_FIFO_RESET_BIT                2
+#define MPU6050_USER_CTRL_SIG_COND_RESET_BIT            0
 // ends user ctrl
 
 // start power managment 1
@@ -135,6 +198,8 @@
 #define MPU6050_FIFO_COUNTH                             0x72
 #define MPU6050_FIFO_COUNTL                             0x73
 #define MPU6050_FIFO_R_W                                0x74
+
+#define MPU6050_FIFO_SIZE                               1024
 #define MPU6050_WHO_AM_I                                0x75
 
 #endif /* MPU6050_REGISTERS_H_ */
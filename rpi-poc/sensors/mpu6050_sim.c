@@ -0,0 +1,301 @@
+#include <string.h>
+#include <math.h>
+
+#include "mpu6050_sim.h"
+
+#define FIELD(value, bit, length) (((value) >> ((bit) - (length) + 1)) & ((1 << (length)) - 1))
+#define TEMP_RAW ((int16_t)((25.0 - 36.53) * 340.0)) // 25 degrees C
+#define MAX_CATCH_UP (MPU6050_FIFO_SIZE / 6 + 1)     // samples, more only overflow the FIFO again
+
+static void reset(mpu6050_sim_t *sim, uint64_t now)
+{
+    memset(sim->regs, 0, sizeof(sim->regs));
+    sim->regs[MPU6050_PWR_MGMT_1] = 1 << MPU6050_PWR_MGMT_1_SLEEP_BIT;
+    sim->regs[MPU6050_WHO_AM_I] = MPU6050_ADDRESS;
+    sim->fifo_head = 0;
+    sim->fifo_count = 0;
+    sim->clock_start = now;
+    sim->samples = 0;
+}
+
+/**
+ * ns between samples, gyroscope output rate over 1 + SMPLRT_DIV.
+ */
+static uint64_t sample_period(mpu6050_sim_t *sim)
+{
+    uint8_t dlpf = FIELD(sim->regs[MPU6050_CONFIG], MPU6050_CONFIG_DLPF_CFG_BIT, MPU6050_CONFIG_DLPF_CFG_LENGTH);
+    uint64_t gyro_rate = (dlpf == 0 || dlpf == 7) ? 8000 : 1000;
+
+    return 1000000000ull * (1 + sim->regs[MPU6050_SMPLRT_DIV]) / gyro_rate;
+}
+
+static int16_t raw(double value)
+{
+    value = round(value);
+    return value > 32767 ? 32767 : value < -32768 ? -32768 : value;
+}
+
+static int16_t word(const uint8_t *p)
+{
+    return (int16_t)((p[0] << 8) | p[1]);
+}
+
+static void put_word(uint8_t *p, int16_t value)
+{
+    p[0] = (uint16_t)value >> 8;
+    p[1] = value;
+}
+
+static void fifo_push(mpu6050_sim_t *sim, const uint8_t *data, int length)
+{
+    int i;
+
+    for (i = 0; i < length; i++)
+    {
+        if (sim->fifo_count == MPU6050_FIFO_SIZE)
+        {
+            // full, the oldest byte makes room
+            sim->fifo_head = (sim->fifo_head + 1) % MPU6050_FIFO_SIZE;
+            sim->fifo_count--;
+            sim->regs[MPU6050_INT_STATUS] |= 1 << MPU6050_INT_FIFO_OFLOW_BIT;
+            sim->fifo_overflows++;
+        }
+        sim->fifo[(sim->fifo_head + sim->fifo_count++) % MPU6050_FIFO_SIZE] = data[i];
+    }
+}
+
+/**
+ * Auxiliary master, slave 0 read into EXT_SENS_DATA_00 every 1 + MST_DLY
+ * samples when its delay is enabled.
+ */
+static void aux_read(mpu6050_sim_t *sim, uint64_t t)
+{
+    uint8_t slv_addr = sim->regs[MPU6050_I2C_SLV0_ADDR];
+    uint8_t slv_ctrl = sim->regs[MPU6050_I2C_SLV0_CTRL];
+    uint8_t delay = FIELD(sim->regs[MPU6050_I2C_SLV4_CTRL], MPU6050_I2C_SLV4_CTRL_MST_DLY_BIT, MPU6050_I2C_SLV4_CTRL_MST_DLY_LENGTH);
+    i2c_sim_device_t *slave;
+
+    if (sim->aux == NULL ||
+        !(sim->regs[MPU6050_USER_CTRL] & (1 << MPU6050_USER_CTRL_I2C_MST_EN_BIT)) ||
+        !(slv_ctrl & (1 << MPU6050_I2C_SLV_CTRL_EN_BIT)) || !(slv_addr & (1 << MPU6050_I2C_SLV_RW_BIT)))
+        return;
+    if ((sim->regs[MPU6050_I2C_MST_DELAY_CTRL] & (1 << MPU6050_I2C_MST_DELAY_CTRL_SLV0_DLY_EN_BIT)) &&
+        sim->samples % (1 + delay) != 0)
+        return;
+    slave = i2c_sim_bus_find(sim->aux, slv_addr & 0x7F);
+    if (slave)
+        slave->read(slave->model, t, sim->regs[MPU6050_I2C_SLV0_REG], slv_ctrl & 0x0F,
+                    sim->regs + MPU6050_EXT_SENS_DATA_00);
+}
+
+/**
+ * One sample taken at t: data registers, DATA_RDY, auxiliary slave, FIFO.
+ */
+static void sample(mpu6050_sim_t *sim, uint64_t t)
+{
+    uint8_t afs = FIELD(sim->regs[MPU6050_ACCEL_CONFIG], MPU6050_ACCEL_CONFIG_AFS_SEL_BIT, MPU6050_ACCEL_CONFIG_AFS_SEL_LENGTH);
+    uint8_t fs = FIELD(sim->regs[MPU6050_GYRO_CONFIG], MPU6050_GYRO_FS_SEL_BIT, MPU6050_GYRO_FS_SEL_LENGTH);
+    double accel_scale = 16384.0 / (1 << afs), gyro_scale = 131.0 / (1 << fs);
+    uint8_t *r = sim->regs, fifo_en = r[MPU6050_FIFO_EN];
+    sim_motion_t motion;
+
+    sim->source.sample(sim->source.context, t - sim->origin, &motion);
+    put_word(r + MPU6050_ACCEL_XOUT_H, raw(motion.ax * accel_scale + word(r + MPU6050_XA_OFFS_H) * accel_scale / 2048.0));
+    put_word(r + MPU6050_ACCEL_YOUT_H, raw(motion.ay * accel_scale + word(r + MPU6050_XA_OFFS_H + 2) * accel_scale / 2048.0));
+    put_word(r + MPU6050_ACCEL_ZOUT_H, raw(motion.az * accel_scale + word(r + MPU6050_XA_OFFS_H + 4) * accel_scale / 2048.0));
+    put_word(r + MPU6050_TEMP_OUT_H, TEMP_RAW);
+    put_word(r + MPU6050_GYRO_XOUT_H, raw(motion.gx * gyro_scale + word(r + MPU6050_XG_OFFS_USRH) * gyro_scale / 32.8));
+    put_word(r + MPU6050_GYRO_YOUT_H, raw(motion.gy * gyro_scale + word(r + MPU6050_XG_OFFS_USRH + 2) * gyro_scale / 32.8));
+    put_word(r + MPU6050_GYRO_ZOUT_H, raw(motion.gz * gyro_scale + word(r + MPU6050_XG_OFFS_USRH + 4) * gyro_scale / 32.8));
+    r[MPU6050_INT_STATUS] |= 1 << MPU6050_INT_DATA_RDY_BIT;
+    aux_read(sim, t);
+    sim->produced++;
+
+    if (!(r[MPU6050_USER_CTRL] & (1 << MPU6050_USER_CTRL_FIFO_EN_BIT)))
+        return;
+    if (fifo_en & (1 << MPU6050_FIFO_EN_ACCEL_BIT))
+        fifo_push(sim, r + MPU6050_ACCEL_XOUT_H, 6);
+    if (fifo_en & (1 << MPU6050_FIFO_EN_TEMP_BIT))
+        fifo_push(sim, r + MPU6050_TEMP_OUT_H, 2);
+    if (fifo_en & (1 << MPU6050_FIFO_EN_XG_BIT))
+        fifo_push(sim, r + MPU6050_GYRO_XOUT_H, 2);
+    if (fifo_en & (1 << MPU6050_FIFO_EN_YG_BIT))
+        fifo_push(sim, r + MPU6050_GYRO_YOUT_H, 2);
+    if (fifo_en & (1 << MPU6050_FIFO_EN_ZG_BIT))
+        fifo_push(sim, r + MPU6050_GYRO_ZOUT_H, 2);
+    if (fifo_en & (1 << MPU6050_FIFO_EN_SLV0_BIT))
+        fifo_push(sim, r + MPU6050_EXT_SENS_DATA_00, r[MPU6050_I2C_SLV0_CTRL] & 0x0F);
+}
+
+/**
+ * Produce the samples due by now, a sleeping device produces none.
+ */
+static void advance(mpu6050_sim_t *sim, uint64_t now)
+{
+    uint64_t period = sample_period(sim), due;
+
+    if ((sim->regs[MPU6050_PWR_MGMT_1] & (1 << MPU6050_PWR_MGMT_1_SLEEP_BIT)) || now < sim->clock_start)
+    {
+        sim->clock_start = now;
+        sim->samples = 0;
+        return;
+    }
+    due = (now - sim->clock_start) / period;
+    if (due - sim->samples > MAX_CATCH_UP)
+        sim->samples = due - MAX_CATCH_UP;
+    while (sim->samples < due)
+    {
+        sim->samples++;
+        sample(sim, sim->clock_start + sim->samples * period);
+    }
+}
+
+/**
+ * Bring the samples up to now with the old settings, then start the
+ * sample clock over for the new ones.
+ */
+static void restart_clock(mpu6050_sim_t *sim, uint64_t now)
+{
+    advance(sim, now);
+    sim->clock_start = now;
+    sim->samples = 0;
+}
+
+static uint8_t read_register(mpu6050_sim_t *sim, uint8_t reg)
+{
+    uint8_t value;
+
+    switch (reg)
+    {
+    case MPU6050_FIFO_COUNTH:
+        return sim->fifo_count >> 8;
+    case MPU6050_FIFO_COUNTL:
+        return sim->fifo_count;
+    case MPU6050_FIFO_R_W:
+        if (sim->fifo_count == 0)
+            return 0;
+        value = sim->fifo[sim->fifo_head];
+        sim->fifo_head = (sim->fifo_head + 1) % MPU6050_FIFO_SIZE;
+        sim->fifo_count--;
+        return value;
+    case MPU6050_INT_STATUS:
+        value = sim->regs[reg];
+        sim->regs[reg] = 0;
+        return value;
+    default:
+        return sim->regs[reg % MPU6050_SIM_REGISTERS];
+    }
+}
+
+static void write_register(mpu6050_sim_t *sim, uint64_t now, uint8_t reg, uint8_t value)
+{
+    switch (reg)
+    {
+    case MPU6050_PWR_MGMT_1:
+        if (value & (1 << MPU6050_PWR_MGMT_1_RESET_BIT))
+        {
+            reset(sim, now);
+            return;
+        }
+        restart_clock(sim, now);
+        sim->regs[reg] = value;
+        return;
+    case MPU6050_SMPLRT_DIV:
+    case MPU6050_CONFIG:
+        restart_clock(sim, now);
+        sim->regs[reg] = value;
+        return;
+    case MPU6050_USER_CTRL:
+        if (value & (1 << MPU6050_USER_CTRL_FIFO_RESET_BIT))
+        {
+            sim->fifo_head = 0;
+            sim->fifo_count = 0;
+        }
+        sim->regs[reg] = value & ~((1 << MPU6050_USER_CTRL_FIFO_RESET_BIT) | (1 << MPU6050_USER_CTRL_SIG_COND_RESET_BIT));
+        return;
+    case MPU6050_FIFO_R_W:
+        fifo_push(sim, &value, 1);
+        return;
+    case MPU6050_INT_STATUS:
+    case MPU6050_FIFO_COUNTH:
+    case MPU6050_FIFO_COUNTL:
+    case MPU6050_WHO_AM_I:
+        return; // read only
+    default:
+        if (reg >= MPU6050_ACCEL_XOUT_H && reg <= MPU6050_EXT_SENS_DATA_23)
+            return;
+        sim->regs[reg % MPU6050_SIM_REGISTERS] = value;
+    }
+}
+
+static void sim_read(void *model, uint64_t now, uint8_t reg_addr, uint8_t length, uint8_t *data)
+{
+    mpu6050_sim_t *sim = model;
+    int i;
+
+    advance(sim, now);
+    for (i = 0; i < length; i++)
+    {
+        data[i] = read_register(sim, reg_addr);
+        if (reg_addr != MPU6050_FIFO_R_W)
+            reg_addr = (reg_addr + 1) % MPU6050_SIM_REGISTERS;
+    }
+}
+
+static void sim_write(void *model, uint64_t now, uint8_t reg_addr, uint8_t length, const uint8_t *data)
+{
+    mpu6050_sim_t *sim = model;
+    int i;
+
+    advance(sim, now);
+    for (i = 0; i < length; i++)
+    {
+        write_register(sim, now, reg_addr, data[i]);
+        if (reg_addr != MPU6050_FIFO_R_W)
+            reg_addr = (reg_addr + 1) % MPU6050_SIM_REGISTERS;
+    }
+}
+
+/**
+ * Power-on state, asleep like the real part.
+ *
+ * @param sim Model
+ * @param source Motion the sensor is exposed to, copied
+ * @param origin Time the motion source starts at
+ * @param aux Bus the auxiliary master reaches slaves on, NULL for none
+ */
+void mpu6050_sim_init(mpu6050_sim_t *sim, const sim_motion_source_t *source, uint64_t origin, i2c_sim_bus_t *aux)
+{
+    memset(sim, 0, sizeof(*sim));
+    sim->source = *source;
+    sim->origin = origin;
+    sim->aux = aux;
+    reset(sim, origin);
+}
+
+/**
+ * Device to attach to the simulated bus at MPU6050_ADDRESS.
+ *
+ * @param sim Model
+ * @param device Filled in
+ */
+void mpu6050_sim_device(mpu6050_sim_t *sim, i2c_sim_device_t *device)
+{
+    device->address = MPU6050_ADDRESS;
+    device->model = sim;
+    device->read = sim_read;
+    device->write = sim_write;
+}
+
+/**
+ * Enabled interrupts pending, what the INT pin follows. Not cleared.
+ *
+ * @param sim Model
+ * @param now Current time
+ * @return INT_STATUS masked with INT_ENABLE
+ */
+uint8_t mpu6050_sim_int_status(mpu6050_sim_t *sim, uint64_t now)
+{
+    advance(sim, now);
+    return sim->regs[MPU6050_INT_STATUS] & sim->regs[MPU6050_INT_ENABLE];
+}
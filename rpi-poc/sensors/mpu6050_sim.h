@@ -0,0 +1,43 @@
+#ifndef __MPU6050_SIM_H_
+#define __MPU6050_SIM_H_
+
+#include <stdint.h>
+
+#include "mpu6050_registers.h"
+#include "sim_motion.h"
+#include "../i2c/sim_bus.h"
+
+#define MPU6050_SIM_REGISTERS 128
+
+/**
+ * Register map model of the MPU6050 for the simulated bus.
+ *
+ * Samples are produced at the rate SMPLRT_DIV and CONFIG select, on the
+ * bus clock, and scaled by the GYRO_CONFIG and ACCEL_CONFIG full scale plus
+ * the offset registers. Each one updates the data registers and DATA_RDY,
+ * is pushed into the 1024 byte FIFO as FIFO_EN selects (the oldest bytes
+ * are lost on overflow and FIFO_OFLOW is raised) and, with the auxiliary
+ * master on, copies slave 0 into EXT_SENS_DATA from the aux bus. Registers
+ * auto-increment except FIFO_R_W, INT_STATUS clears on read, FIFO_RESET
+ * and DEVICE_RESET clear themselves.
+ */
+typedef struct
+{
+    uint8_t regs[MPU6050_SIM_REGISTERS];
+    uint8_t fifo[MPU6050_FIFO_SIZE];
+    unsigned int fifo_head;     // oldest byte
+    unsigned int fifo_count;
+    uint64_t origin;            // time 0 of the motion source
+    uint64_t clock_start;       // time the sample clock was (re)started
+    uint64_t samples;           // produced since clock_start
+    sim_motion_source_t source;
+    i2c_sim_bus_t *aux;         // bus of the auxiliary master, NULL for none
+    unsigned long produced;
+    unsigned long fifo_overflows;
+} mpu6050_sim_t;
+
+void mpu6050_sim_init(mpu6050_sim_t *sim, const sim_motion_source_t *source, uint64_t origin, i2c_sim_bus_t *aux);
+void mpu6050_sim_device(mpu6050_sim_t *sim, i2c_sim_device_t *device);
+uint8_t mpu6050_sim_int_status(mpu6050_sim_t *sim, uint64_t now);
+
+#endif
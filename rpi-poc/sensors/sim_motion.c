@@ -0,0 +1,155 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "sim_motion.h"
+
+#define SIM_MAG_DIP 60.0 // degrees
+#define SIM_MAG_FIELD 0.5 // Gauss
+
+static double rad(double degrees) { return degrees * M_PI / 180.0; }
+
+/**
+ * Attitude of the synthetic trajectory in degrees.
+ *
+ * @param t ns since the source started
+ */
+void sim_motion_synthetic_attitude(uint64_t t, double *roll, double *pitch, double *yaw)
+{
+    double s = t * 1e-9;
+
+    *roll = 40.0 * sin(0.5 * s);
+    *pitch = 30.0 * sin(0.37 * s);
+    *yaw = 90.0 * sin(0.11 * s);
+}
+
+static void euler_to_quaternion(double roll, double pitch, double yaw, double *q)
+{
+    double cr = cos(roll / 2), sr = sin(roll / 2);
+    double cp = cos(pitch / 2), sp = sin(pitch / 2);
+    double cy = cos(yaw / 2), sy = sin(yaw / 2);
+
+    q[0] = cr * cp * cy + sr * sp * sy;
+    q[1] = sr * cp * cy - cr * sp * sy;
+    q[2] = cr * sp * cy + sr * cp * sy;
+    q[3] = cr * cp * sy - sr * sp * cy;
+}
+
+static void attitude_quaternion(uint64_t t, double *q)
+{
+    double roll, pitch, yaw;
+
+    sim_motion_synthetic_attitude(t, &roll, &pitch, &yaw);
+    euler_to_quaternion(rad(roll), rad(pitch), rad(yaw), q);
+}
+
+static double noise(sim_motion_synthetic_t *synthetic)
+{
+    return synthetic->noise * (rand_r(&synthetic->seed) / (double)RAND_MAX - 0.5) * 2.0;
+}
+
+/**
+ * Body rates from the attitude 1 ms apart, gravity and the earth field
+ * rotated into the sensor frame.
+ */
+static void synthetic_sample(void *context, uint64_t t, sim_motion_t *motion)
+{
+    sim_motion_synthetic_t *synthetic = context;
+    double q[4], n[4], r[3][3];
+    double m[3] = {SIM_MAG_FIELD * cos(rad(SIM_MAG_DIP)), 0.0, SIM_MAG_FIELD * sin(rad(SIM_MAG_DIP))};
+    const double dt = 1e-3;
+
+    attitude_quaternion(t, q);
+    attitude_quaternion(t + (uint64_t)(dt * 1e9), n);
+    // body rate = 2 * vec(conj(q) * n) / dt
+    motion->gx = 2.0 * (q[0] * n[1] - q[1] * n[0] - q[2] * n[3] + q[3] * n[2]) / dt * 180.0 / M_PI;
+    motion->gy = 2.0 * (q[0] * n[2] + q[1] * n[3] - q[2] * n[0] - q[3] * n[1]) / dt * 180.0 / M_PI;
+    motion->gz = 2.0 * (q[0] * n[3] - q[1] * n[2] + q[2] * n[1] - q[3] * n[0]) / dt * 180.0 / M_PI;
+
+    r[0][0] = 1 - 2 * (q[2] * q[2] + q[3] * q[3]);
+    r[0][1] = 2 * (q[1] * q[2] - q[0] * q[3]);
+    r[0][2] = 2 * (q[1] * q[3] + q[0] * q[2]);
+    r[1][0] = 2 * (q[1] * q[2] + q[0] * q[3]);
+    r[1][1] = 1 - 2 * (q[1] * q[1] + q[3] * q[3]);
+    r[1][2] = 2 * (q[2] * q[3] - q[0] * q[1]);
+    r[2][0] = 2 * (q[1] * q[3] - q[0] * q[2]);
+    r[2][1] = 2 * (q[2] * q[3] + q[0] * q[1]);
+    r[2][2] = 1 - 2 * (q[1] * q[1] + q[2] * q[2]);
+
+    motion->ax = r[2][0] + noise(synthetic);
+    motion->ay = r[2][1] + noise(synthetic);
+    motion->az = r[2][2] + noise(synthetic);
+    motion->gx += noise(synthetic);
+    motion->gy += noise(synthetic);
+    motion->gz += noise(synthetic);
+    motion->mx = r[0][0] * m[0] + r[1][0] * m[1] + r[2][0] * m[2] + noise(synthetic) * 0.01;
+    motion->my = r[0][1] * m[0] + r[1][1] * m[1] + r[2][1] * m[2] + noise(synthetic) * 0.01;
+    motion->mz = r[0][2] * m[0] + r[1][2] * m[1] + r[2][2] * m[2] + noise(synthetic) * 0.01;
+}
+
+/**
+ * Source following the synthetic trajectory.
+ *
+ * @param source Source to set up
+ * @param synthetic State of the source, must outlive it
+ * @param noise Noise amplitude, e.g. 0.01
+ */
+void sim_motion_synthetic_source(sim_motion_source_t *source, sim_motion_synthetic_t *synthetic, double noise)
+{
+    synthetic->noise = noise;
+    synthetic->seed = 1;
+    source->sample = synthetic_sample;
+    source->context = synthetic;
+}
+
+/**
+ * The record in effect at t, the log starts over once it ran out.
+ */
+static void log_sample(void *context, uint64_t t, sim_motion_t *motion)
+{
+    sim_motion_log_t *log = context;
+    uint64_t first = log->records[0].timestamp;
+    uint64_t span = log->records[log->count - 1].timestamp - first + 1;
+    long low = 0, high = log->count - 1, middle;
+    const recorder_record_t *r;
+
+    t = first + t % span;
+    while (low < high)
+    {
+        middle = (low + high + 1) / 2;
+        if (log->records[middle].timestamp <= t)
+            low = middle;
+        else
+            high = middle - 1;
+    }
+    r = &log->records[low];
+    motion->ax = r->ax / log->accel_scale;
+    motion->ay = r->ay / log->accel_scale;
+    motion->az = r->az / log->accel_scale;
+    motion->gx = r->gx / log->gyro_scale;
+    motion->gy = r->gy / log->gyro_scale;
+    motion->gz = r->gz / log->gyro_scale;
+    motion->mx = r->mx / log->mag_scale;
+    motion->my = r->my / log->mag_scale;
+    motion->mz = r->mz / log->mag_scale;
+}
+
+/**
+ * Source playing back recorded raw samples. The scales default to what
+ * main.c configures: +/- 2 g, +/- 250 degrees/s and a gain of 1090.
+ *
+ * @param source Source to set up
+ * @param log State of the source, must outlive it
+ * @param records Recorded samples in time order, must outlive the source
+ * @param count Number of records, at least one
+ */
+void sim_motion_log_source(sim_motion_source_t *source, sim_motion_log_t *log, const recorder_record_t *records, long count)
+{
+    log->records = records;
+    log->count = count;
+    log->accel_scale = 16384.0;
+    log->gyro_scale = 131.0;
+    log->mag_scale = 1090.0;
+    source->sample = log_sample;
+    source->context = log;
+}
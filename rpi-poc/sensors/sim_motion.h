@@ -0,0 +1,54 @@
+#ifndef __SIM_MOTION_H_
+#define __SIM_MOTION_H_
+
+#include <stdint.h>
+
+#include "../recorder/recorder.h"
+
+/**
+ * What the simulated sensors are exposed to at a given time, in the sensor
+ * frame: specific force in g, angular rate in degrees/s, magnetic field in
+ * Gauss. The device models turn it into raw counts with their configured
+ * full scale.
+ */
+typedef struct
+{
+    double ax, ay, az;
+    double gx, gy, gz;
+    double mx, my, mz;
+} sim_motion_t;
+
+typedef struct
+{
+    void (*sample)(void *context, uint64_t t, sim_motion_t *motion); // t in ns since the source started
+    void *context;
+} sim_motion_source_t;
+
+/**
+ * Smooth roll/pitch/yaw swings with uniform sensor noise, noise is relative
+ * to 1 g, 1 degree/s and 1 Gauss.
+ */
+typedef struct
+{
+    double noise;
+    unsigned int seed;
+} sim_motion_synthetic_t;
+
+/**
+ * Flight data recorder records played back in a loop, scales are the LSB
+ * per unit the raw values were recorded with.
+ */
+typedef struct
+{
+    const recorder_record_t *records;
+    long count;
+    double accel_scale;         // LSB per g
+    double gyro_scale;          // LSB per degree/s
+    double mag_scale;           // LSB per Gauss
+} sim_motion_log_t;
+
+void sim_motion_synthetic_source(sim_motion_source_t *source, sim_motion_synthetic_t *synthetic, double noise);
+void sim_motion_synthetic_attitude(uint64_t t, double *roll, double *pitch, double *yaw);
+void sim_motion_log_source(sim_motion_source_t *source, sim_motion_log_t *log, const recorder_record_t *records, long count);
+
+#endif
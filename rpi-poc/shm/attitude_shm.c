@@ -0,0 +1,245 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "attitude_shm.h"
+
+/**
+ * Create (or take over) the segment and start an empty stream. Returns 0, -1
+ * when it cannot be created or mapped.
+ */
+int attitude_shm_create(attitude_shm_writer_t *writer, const char *name)
+{
+    attitude_shm_t *shm;
+    int fd;
+
+    memset(writer, 0, sizeof(*writer));
+    snprintf(writer->name, sizeof(writer->name), "%s", name);
+    fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+    {
+        perror("shm_open");
+        return -1;
+    }
+    if (ftruncate(fd, sizeof(attitude_shm_t)) != 0)
+    {
+        perror("ftruncate");
+        close(fd);
+        return -1;
+    }
+    shm = mmap(NULL, sizeof(attitude_shm_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shm == MAP_FAILED)
+    {
+        perror("mmap");
+        return -1;
+    }
+
+    // readers of a previous writer see the magic go away while it resets
+    atomic_store_explicit(&shm->magic, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memset((char *)shm + sizeof(shm->magic), 0, sizeof(*shm) - sizeof(shm->magic));
+    shm->version = ATTITUDE_SHM_VERSION;
+    shm->ring_size = ATTITUDE_SHM_RING;
+    shm->record_size = sizeof(telemetry_record_t);
+    atomic_store_explicit(&shm->magic, ATTITUDE_SHM_MAGIC, memory_order_release);
+
+    writer->shm = shm;
+    return 0;
+}
+
+static void write_begin(atomic_uint *seq)
+{
+    atomic_store_explicit(seq, atomic_load_explicit(seq, memory_order_relaxed) + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static void write_end(atomic_uint *seq)
+{
+    atomic_store_explicit(seq, atomic_load_explicit(seq, memory_order_relaxed) + 1, memory_order_release);
+}
+
+/**
+ * Publish a record as the latest one, with the stats, and append it to the
+ * ring. The record's sequence is set to its ring index and stats.published is
+ * filled in. Never waits on a reader.
+ */
+void attitude_shm_publish(attitude_shm_writer_t *writer, telemetry_record_t *record, const attitude_shm_stats_t *stats)
+{
+    attitude_shm_t *shm = writer->shm;
+    uint32_t index = atomic_load_explicit(&shm->head, memory_order_relaxed);
+    attitude_shm_slot_t *slot = &shm->ring[index & (ATTITUDE_SHM_RING - 1)];
+
+    record->sequence = index;
+
+    write_begin(&shm->seq);
+    shm->latest = *record;
+    shm->stats = *stats;
+    shm->stats.published = ++writer->published;
+    write_end(&shm->seq);
+
+    write_begin(&slot->seq);
+    slot->index = index;
+    slot->record = *record;
+    write_end(&slot->seq);
+
+    atomic_store_explicit(&shm->head, index + 1, memory_order_release);
+}
+
+/**
+ * Unmap and remove the name, readers that still have it mapped keep the last
+ * records.
+ */
+void attitude_shm_destroy(attitude_shm_writer_t *writer)
+{
+    if (writer->shm == NULL)
+        return;
+    munmap(writer->shm, sizeof(attitude_shm_t));
+    shm_unlink(writer->name);
+    writer->shm = NULL;
+}
+
+/**
+ * Map an existing segment read-only, reading starts with the records
+ * published after this call. Returns 0, -1 when it is missing, not ready or
+ * from an incompatible writer.
+ */
+int attitude_shm_open(attitude_shm_reader_t *reader, const char *name)
+{
+    const attitude_shm_t *shm;
+    struct stat st;
+    int fd;
+
+    memset(reader, 0, sizeof(*reader));
+    fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(attitude_shm_t))
+    {
+        close(fd);
+        return -1;
+    }
+    shm = mmap(NULL, sizeof(attitude_shm_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shm == MAP_FAILED)
+        return -1;
+
+    if (atomic_load_explicit((atomic_uint *)&shm->magic, memory_order_acquire) != ATTITUDE_SHM_MAGIC ||
+        shm->version != ATTITUDE_SHM_VERSION || shm->ring_size != ATTITUDE_SHM_RING ||
+        shm->record_size != sizeof(telemetry_record_t))
+    {
+        munmap((void *)shm, sizeof(attitude_shm_t));
+        return -1;
+    }
+
+    reader->shm = shm;
+    reader->cursor = atomic_load_explicit(&shm->head, memory_order_acquire);
+    return 0;
+}
+
+static unsigned read_begin(const atomic_uint *seq)
+{
+    return atomic_load_explicit((atomic_uint *)seq, memory_order_acquire);
+}
+
+static int read_retry(const atomic_uint *seq, unsigned begin)
+{
+    atomic_thread_fence(memory_order_acquire);
+    return (begin & 1) || atomic_load_explicit((atomic_uint *)seq, memory_order_relaxed) != begin;
+}
+
+/**
+ * Copy the latest record and stats, either may be NULL. Bounded, a writer
+ * mid-update is retried ATTITUDE_SHM_RETRIES times and then counted as torn.
+ * Returns 0, 1 when nothing was published yet, -1 when torn.
+ */
+int attitude_shm_latest(attitude_shm_reader_t *reader, telemetry_record_t *record, attitude_shm_stats_t *stats)
+{
+    const attitude_shm_t *shm = reader->shm;
+    telemetry_record_t latest;
+    attitude_shm_stats_t latest_stats;
+    unsigned begin;
+    int attempt;
+
+    for (attempt = 0; attempt < ATTITUDE_SHM_RETRIES; attempt++)
+    {
+        begin = read_begin(&shm->seq);
+        latest = shm->latest;
+        latest_stats = shm->stats;
+        if (read_retry(&shm->seq, begin))
+            continue;
+        if (begin == 0)
+            return 1;
+        if (record)
+            *record = latest;
+        if (stats)
+            *stats = latest_stats;
+        return 0;
+    }
+    reader->torn++;
+    return -1;
+}
+
+/**
+ * Copy up to max ring records published since the last call, oldest first.
+ * Records the writer overwrote before they were read are skipped and counted
+ * in lost, a slot that stays torn ends the call early and is retried next
+ * time. Returns how many were copied.
+ */
+int attitude_shm_next(attitude_shm_reader_t *reader, telemetry_record_t *records, int max)
+{
+    const attitude_shm_t *shm = reader->shm;
+    uint32_t head = atomic_load_explicit((atomic_uint *)&shm->head, memory_order_acquire);
+    int count = 0;
+
+    // the writer lapped us, the oldest records still in the ring are next
+    if (head - reader->cursor > ATTITUDE_SHM_RING)
+    {
+        reader->lost += head - reader->cursor - ATTITUDE_SHM_RING;
+        reader->cursor = head - ATTITUDE_SHM_RING;
+    }
+
+    while (count < max && reader->cursor != head)
+    {
+        const attitude_shm_slot_t *slot = &shm->ring[reader->cursor & (ATTITUDE_SHM_RING - 1)];
+        uint32_t index = 0;
+        unsigned begin;
+        int attempt;
+
+        for (attempt = 0; attempt < ATTITUDE_SHM_RETRIES; attempt++)
+        {
+            begin = read_begin(&slot->seq);
+            index = slot->index;
+            records[count] = slot->record;
+            if (!read_retry(&slot->seq, begin))
+                break;
+        }
+        if (attempt == ATTITUDE_SHM_RETRIES)
+        {
+            reader->torn++;
+            break;
+        }
+        if (index != reader->cursor)
+        {
+            // overwritten while we were catching up
+            reader->lost++;
+            reader->cursor++;
+            continue;
+        }
+        reader->cursor++;
+        count++;
+    }
+    return count;
+}
+
+void attitude_shm_close(attitude_shm_reader_t *reader)
+{
+    if (reader->shm == NULL)
+        return;
+    munmap((void *)reader->shm, sizeof(attitude_shm_t));
+    reader->shm = NULL;
+}
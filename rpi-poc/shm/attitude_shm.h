@@ -0,0 +1,78 @@
+#ifndef _ATTITUDE_SHM_H_
+#define _ATTITUDE_SHM_H_
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "../comm/telemetry.h"
+
+#define ATTITUDE_SHM_NAME "/icaro_attitude"
+#define ATTITUDE_SHM_MAGIC 0x49434152 // "ICAR"
+#define ATTITUDE_SHM_VERSION 1
+#define ATTITUDE_SHM_RING 256      // recent records kept, power of two
+#define ATTITUDE_SHM_RETRIES 4     // reads attempted before a snapshot counts as torn
+
+/**
+ * Writer statistics published next to the latest record.
+ */
+typedef struct
+{
+    uint64_t published;     // records published since the segment was created, set by the writer
+    uint64_t updated;       // CLOCK_MONOTONIC ns of the last publish
+    float sample_freq;      // measured fusion rate, Hz
+    uint32_t dt_clamped;    // sample periods the filter clamped
+} attitude_shm_stats_t;
+
+typedef struct
+{
+    atomic_uint seq;        // odd while the slot is being written
+    uint32_t index;         // position of the record in the stream
+    telemetry_record_t record;
+} attitude_shm_slot_t;
+
+/**
+ * Segment layout. Every snapshot sits under a seqlock: the writer makes seq
+ * odd, copies, makes it even again. A reader copies between two reads of
+ * seq and keeps the copy only when both were the same even value. Readers
+ * map the segment read-only and never write to it, any number of them costs
+ * the writer nothing. The counters are 32 bit so every platform loads them
+ * with a plain load from the read-only mapping.
+ */
+typedef struct
+{
+    atomic_uint magic;      // written last, the segment is ready once it matches
+    uint32_t version;
+    uint32_t ring_size;
+    uint32_t record_size;   // sizeof(telemetry_record_t) of the writer
+    _Alignas(64) atomic_uint seq;
+    telemetry_record_t latest;
+    attitude_shm_stats_t stats;
+    _Alignas(64) atomic_uint head; // records published, the next ring index, wraps
+    _Alignas(64) attitude_shm_slot_t ring[ATTITUDE_SHM_RING];
+} attitude_shm_t;
+
+typedef struct
+{
+    attitude_shm_t *shm;
+    uint64_t published;         // records published through this writer
+    char name[64];
+} attitude_shm_writer_t;
+
+typedef struct
+{
+    const attitude_shm_t *shm;
+    uint32_t cursor;            // next ring index attitude_shm_next() returns
+    unsigned long torn;         // snapshots given up on after ATTITUDE_SHM_RETRIES
+    unsigned long lost;         // ring records overwritten before they were read
+} attitude_shm_reader_t;
+
+int attitude_shm_create(attitude_shm_writer_t *writer, const char *name);
+void attitude_shm_publish(attitude_shm_writer_t *writer, telemetry_record_t *record, const attitude_shm_stats_t *stats);
+void attitude_shm_destroy(attitude_shm_writer_t *writer);
+
+int attitude_shm_open(attitude_shm_reader_t *reader, const char *name);
+int attitude_shm_latest(attitude_shm_reader_t *reader, telemetry_record_t *record, attitude_shm_stats_t *stats);
+int attitude_shm_next(attitude_shm_reader_t *reader, telemetry_record_t *records, int max);
+void attitude_shm_close(attitude_shm_reader_t *reader);
+
+#endif /* _ATTITUDE_SHM_H_ */
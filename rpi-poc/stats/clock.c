@@ -0,0 +1,15 @@
+#include <time.h>
+
+#include "clock.h"
+
+/**
+ * CLOCK_MONOTONIC in ns, the time base of sample timestamps, stage timings
+ * and the benchmarks.
+ */
+uint64_t clock_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
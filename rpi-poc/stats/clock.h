@@ -0,0 +1,8 @@
+#ifndef _CLOCK_H_
+#define _CLOCK_H_
+
+#include <stdint.h>
+
+uint64_t clock_now_ns(void);
+
+#endif /* _CLOCK_H_ */
@@ -0,0 +1,124 @@
+#include <string.h>
+
+#include "histogram.h"
+
+static int bucket(uint64_t value)
+{
+    int bits;
+
+    if (value < HISTOGRAM_LINEAR)
+        return value;
+    bits = 63 - __builtin_clzll(value);
+    if (bits >= HISTOGRAM_MAX_BITS)
+        return HISTOGRAM_BUCKETS - 1;
+    return HISTOGRAM_LINEAR + (bits - HISTOGRAM_SUB_BITS - 1) * HISTOGRAM_SUB +
+           ((value >> (bits - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB - 1));
+}
+
+/**
+ * Largest value counted in bucket index.
+ */
+static uint64_t bucket_top(int index)
+{
+    int bits, sub;
+
+    if (index < HISTOGRAM_LINEAR)
+        return index;
+    bits = (index - HISTOGRAM_LINEAR) / HISTOGRAM_SUB + HISTOGRAM_SUB_BITS + 1;
+    sub = (index - HISTOGRAM_LINEAR) % HISTOGRAM_SUB;
+    return ((uint64_t)(HISTOGRAM_SUB + sub + 1) << (bits - HISTOGRAM_SUB_BITS)) - 1;
+}
+
+void histogram_init(histogram_t *histogram)
+{
+    int i;
+
+    for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+        atomic_init(&histogram->counts[i], 0);
+    atomic_init(&histogram->sum, 0);
+    atomic_init(&histogram->max, 0);
+}
+
+/**
+ * Count one value, only ever called by the one thread owning the histogram,
+ * so plain load and store pairs do instead of read-modify-write.
+ */
+void histogram_record(histogram_t *histogram, uint64_t value)
+{
+    atomic_ulong *count = &histogram->counts[bucket(value)];
+
+    atomic_store_explicit(count, atomic_load_explicit(count, memory_order_relaxed) + 1, memory_order_relaxed);
+    atomic_store_explicit(&histogram->sum, atomic_load_explicit(&histogram->sum, memory_order_relaxed) + value,
+                          memory_order_relaxed);
+    if (value > atomic_load_explicit(&histogram->max, memory_order_relaxed))
+        atomic_store_explicit(&histogram->max, value, memory_order_relaxed);
+}
+
+void histogram_snapshot(histogram_t *histogram, histogram_snapshot_t *snapshot)
+{
+    int i;
+
+    snapshot->count = 0;
+    for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+        snapshot->counts[i] = atomic_load_explicit(&histogram->counts[i], memory_order_relaxed);
+        snapshot->count += snapshot->counts[i];
+    }
+    snapshot->sum = atomic_load_explicit(&histogram->sum, memory_order_relaxed);
+    snapshot->max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+}
+
+/**
+ * What was recorded between two snapshots of the same histogram. The max of
+ * the interval is the top of its highest bucket, capped by the overall max.
+ */
+void histogram_delta(const histogram_snapshot_t *now, const histogram_snapshot_t *before, histogram_snapshot_t *delta)
+{
+    int i;
+
+    delta->count = 0;
+    delta->max = 0;
+    for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+        delta->counts[i] = now->counts[i] - before->counts[i];
+        delta->count += delta->counts[i];
+        if (delta->counts[i])
+            delta->max = bucket_top(i);
+    }
+    delta->sum = now->sum - before->sum;
+    if (delta->max > now->max)
+        delta->max = now->max;
+}
+
+/**
+ * Top of the bucket holding the given percentile, capped by the max, 0 for
+ * an empty histogram.
+ *
+ * @param snapshot Values
+ * @param percentile 0 to 100
+ */
+uint64_t histogram_percentile(const histogram_snapshot_t *snapshot, double percentile)
+{
+    unsigned long rank, seen = 0;
+    int i;
+
+    if (snapshot->count == 0)
+        return 0;
+    rank = percentile / 100.0 * snapshot->count;
+    if (rank < 1)
+        rank = 1;
+    if (rank > snapshot->count)
+        rank = snapshot->count;
+    for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+        seen += snapshot->counts[i];
+        if (seen >= rank)
+            break;
+    }
+    return bucket_top(i) < snapshot->max ? bucket_top(i) : snapshot->max;
+}
+
+double histogram_mean(const histogram_snapshot_t *snapshot)
+{
+    return snapshot->count ? (double)snapshot->sum / snapshot->count : 0.0;
+}
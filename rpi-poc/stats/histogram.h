@@ -0,0 +1,49 @@
+#ifndef _HISTOGRAM_H_
+#define _HISTOGRAM_H_
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define HISTOGRAM_SUB_BITS 3                          // 8 buckets per power of two, 12.5% wide
+#define HISTOGRAM_SUB (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_LINEAR (2 * HISTOGRAM_SUB)          // values below are counted exactly
+#define HISTOGRAM_MAX_BITS 40                         // values from 2^40 ns, 18 minutes, share the last bucket
+#define HISTOGRAM_BUCKETS (HISTOGRAM_LINEAR + (HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS - 1) * HISTOGRAM_SUB)
+
+/**
+ * Fixed size log-linear histogram of ns durations.
+ *
+ * Values below HISTOGRAM_LINEAR get a bucket each, above that every power of
+ * two is split into HISTOGRAM_SUB equal buckets, so a percentile is never
+ * more than 12.5% above the value it stands for. Recording is a few
+ * instructions and never allocates. One thread records, any thread may take
+ * a snapshot at the same time: counters are relaxed atomics and a snapshot
+ * derives its count from the buckets it copied, so it is always consistent
+ * with itself even if it misses the values being recorded.
+ */
+typedef struct
+{
+    atomic_ulong counts[HISTOGRAM_BUCKETS];
+    _Atomic uint64_t sum;   // ns, 64-bit on 32-bit ARM too
+    _Atomic uint64_t max;   // ns
+} histogram_t;
+
+/**
+ * Plain copy of a histogram, or the difference of two copies.
+ */
+typedef struct
+{
+    unsigned long counts[HISTOGRAM_BUCKETS];
+    unsigned long count;
+    uint64_t sum;
+    uint64_t max;
+} histogram_snapshot_t;
+
+void histogram_init(histogram_t *histogram);
+void histogram_record(histogram_t *histogram, uint64_t value);
+void histogram_snapshot(histogram_t *histogram, histogram_snapshot_t *snapshot);
+void histogram_delta(const histogram_snapshot_t *now, const histogram_snapshot_t *before, histogram_snapshot_t *delta);
+uint64_t histogram_percentile(const histogram_snapshot_t *snapshot, double percentile);
+double histogram_mean(const histogram_snapshot_t *snapshot);
+
+#endif /* _HISTOGRAM_H_ */
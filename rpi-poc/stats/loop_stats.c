@@ -0,0 +1,80 @@
+#include <stdio.h>
+
+#include "clock.h"
+#include "loop_stats.h"
+
+static const char *stage_names[LOOP_STATS_STAGES] = {"acquire", "mag", "fuse", "angles", "output", "period"};
+
+void loop_stats_init(loop_stats_t *stats)
+{
+    int i;
+
+    for (i = 0; i < LOOP_STATS_STAGES; i++)
+        histogram_init(&stats->stages[i]);
+    stats->started = clock_now_ns();
+}
+
+/**
+ * Count the time from start to now against a stage.
+ *
+ * @param stats Loop statistics
+ * @param stage Stage that ran
+ * @param start clock_now_ns() when it began
+ */
+void loop_stats_record(loop_stats_t *stats, loop_stats_stage_t stage, uint64_t start)
+{
+    histogram_record(&stats->stages[stage], clock_now_ns() - start);
+}
+
+/**
+ * Count a duration measured by the caller against a stage.
+ */
+void loop_stats_add(loop_stats_t *stats, loop_stats_stage_t stage, uint64_t ns)
+{
+    histogram_record(&stats->stages[stage], ns);
+}
+
+void loop_stats_snapshot(loop_stats_t *stats, loop_stats_snapshot_t *snapshot)
+{
+    int i;
+
+    snapshot->timestamp = clock_now_ns();
+    for (i = 0; i < LOOP_STATS_STAGES; i++)
+        histogram_snapshot(&stats->stages[i], &snapshot->stages[i]);
+}
+
+/**
+ * The stage times recorded between two snapshots, timestamp is the later one.
+ */
+void loop_stats_delta(const loop_stats_snapshot_t *now, const loop_stats_snapshot_t *before, loop_stats_snapshot_t *delta)
+{
+    int i;
+
+    delta->timestamp = now->timestamp;
+    for (i = 0; i < LOOP_STATS_STAGES; i++)
+        histogram_delta(&now->stages[i], &before->stages[i], &delta->stages[i]);
+}
+
+const char *loop_stats_stage_name(loop_stats_stage_t stage)
+{
+    return stage < LOOP_STATS_STAGES ? stage_names[stage] : "?";
+}
+
+/**
+ * One line per stage that ran to stderr, in us.
+ */
+void loop_stats_print(const loop_stats_snapshot_t *snapshot, const char *name)
+{
+    int i;
+
+    for (i = 0; i < LOOP_STATS_STAGES; i++)
+    {
+        const histogram_snapshot_t *stage = &snapshot->stages[i];
+
+        if (stage->count == 0)
+            continue;
+        fprintf(stderr, "%s %-8s %9lu samples, mean %9.1f p50 %9.1f p99 %9.1f max %9.1f us\n",
+                name, stage_names[i], stage->count, histogram_mean(stage) / 1e3,
+                histogram_percentile(stage, 50) / 1e3, histogram_percentile(stage, 99) / 1e3, stage->max / 1e3);
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef _LOOP_STATS_H_
+#define _LOOP_STATS_H_
+
+#include <stdint.h>
+
+#include "histogram.h"
+
+/**
+ * Stages of the sensor loop that are timed, in ns.
+ */
+typedef enum
+{
+    LOOP_STATS_ACQUIRE, // I2C read of a sample: the sweep batch, or a FIFO drain
+    LOOP_STATS_MAG,     // separate magnetometer read, FIFO mode only, the sweep carries it otherwise
+    LOOP_STATS_FUSE,    // filter update
+    LOOP_STATS_ANGLES,  // roll, pitch and yaw from the quaternion
+    LOOP_STATS_OUTPUT,  // text, telemetry or pipe output of an attitude
+    LOOP_STATS_PERIOD,  // time between the starts of two acquisitions
+    LOOP_STATS_STAGES
+} loop_stats_stage_t;
+
+/**
+ * One histogram per stage. Each stage is recorded by a single thread, the
+ * acquisition, fusion and output threads of the pipeline each own theirs,
+ * and snapshots can be taken from anywhere while they run.
+ */
+typedef struct
+{
+    histogram_t stages[LOOP_STATS_STAGES];
+    uint64_t started; // ns, loop_stats_init() time
+} loop_stats_t;
+
+typedef struct
+{
+    uint64_t timestamp; // ns, when it was taken
+    histogram_snapshot_t stages[LOOP_STATS_STAGES];
+} loop_stats_snapshot_t;
+
+void loop_stats_init(loop_stats_t *stats);
+void loop_stats_record(loop_stats_t *stats, loop_stats_stage_t stage, uint64_t start);
+void loop_stats_add(loop_stats_t *stats, loop_stats_stage_t stage, uint64_t ns);
+void loop_stats_snapshot(loop_stats_t *stats, loop_stats_snapshot_t *snapshot);
+void loop_stats_delta(const loop_stats_snapshot_t *now, const loop_stats_snapshot_t *before, loop_stats_snapshot_t *delta);
+const char *loop_stats_stage_name(loop_stats_stage_t stage);
+void loop_stats_print(const loop_stats_snapshot_t *snapshot, const char *name);
+
+#endif /* _LOOP_STATS_H_ */
@@ -0,0 +1,99 @@
+/**
+ * Read the attitude main -s publishes in shared memory. By default the latest
+ * record is printed every interval, -f follows the ring and prints every
+ * record. Lines are tab separated like telemetry_dump, the reader counters go
+ * to stderr at the end.
+ *
+ *   ./tools/attitude_shm_read [-i interval_ms] [-n count] [-f] [name]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "../shm/attitude_shm.h"
+
+volatile sig_atomic_t running = 1;
+
+void on_signal(int signum)
+{
+    running = 0;
+}
+
+static void print_record(const telemetry_record_t *record)
+{
+    printf("%" PRIu32 "\t%" PRIu64 "\t%f\t%f\t%f\t%f\t%f\t%f\t%f\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\n",
+           record->sequence, record->timestamp,
+           record->q0, record->q1, record->q2, record->q3,
+           record->roll, record->pitch, record->yaw,
+           record->ax, record->ay, record->az,
+           record->gx, record->gy, record->gz,
+           record->mx, record->my, record->mz);
+}
+
+int main(int argc, char **argv)
+{
+    attitude_shm_reader_t reader;
+    telemetry_record_t records[ATTITUDE_SHM_RING];
+    attitude_shm_stats_t stats;
+    const char *name = ATTITUDE_SHM_NAME;
+    int interval_ms = 100, follow = 0, opt, i, n;
+    long count = -1;
+
+    while ((opt = getopt(argc, argv, "i:n:f")) != -1)
+    {
+        switch (opt)
+        {
+        case 'i':
+            interval_ms = atoi(optarg);
+            break;
+        case 'n':
+            count = atol(optarg);
+            break;
+        case 'f':
+            follow = 1;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-i interval_ms] [-n count] [-f] [name]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind < argc)
+        name = argv[optind];
+
+    if (attitude_shm_open(&reader, name) != 0)
+    {
+        fprintf(stderr, "No attitude published in %s\n", name);
+        return 1;
+    }
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    while (running && count != 0)
+    {
+        if (follow)
+        {
+            n = attitude_shm_next(&reader, records, ATTITUDE_SHM_RING);
+            for (i = 0; i < n && count != 0; i++, count--)
+                print_record(&records[i]);
+        }
+        else if (attitude_shm_latest(&reader, records, &stats) == 0)
+        {
+            print_record(records);
+            if (count > 0)
+                count--;
+        }
+        fflush(stdout);
+        usleep(interval_ms * 1000);
+    }
+
+    if (attitude_shm_latest(&reader, NULL, &stats) == 0)
+        fprintf(stderr, "writer: %" PRIu64 " published, %.1f Hz, %" PRIu32 " periods clamped\n",
+                stats.published, stats.sample_freq, stats.dt_clamped);
+    fprintf(stderr, "reader: %lu torn, %lu lost\n", reader.torn, reader.lost);
+    attitude_shm_close(&reader);
+    return 0;
+}
@@ -0,0 +1,53 @@
+/**
+ * Print flight data recorder segments as text, one tab separated line per
+ * record: sequence, timestamp, raw ax ay az gx gy gz mx my mz, then
+ * q0 q1 q2 q3 roll pitch yaw. The segment headers and what was recovered
+ * from segments the recorder did not close go to stderr.
+ *
+ *   ./tools/fdr_dump records/flight-*.fdr
+ */
+
+#include <stdio.h>
+#include <inttypes.h>
+
+#include "../recorder/recorder.h"
+
+int main(int argc, char **argv)
+{
+    recorder_reader_t reader;
+    unsigned long total = 0;
+    uint32_t i;
+    int file, failed = 0;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s segment.fdr...\n", argv[0]);
+        return 1;
+    }
+
+    for (file = 1; file < argc; file++)
+    {
+        if (recorder_open(&reader, argv[file]) != 0)
+        {
+            fprintf(stderr, "%s: not a flight data recorder segment\n", argv[file]);
+            failed = 1;
+            continue;
+        }
+        fprintf(stderr, "%s: segment %" PRIu32 ", %" PRIu32 " of %" PRIu32 " records%s, %" PRIu32 " recovered\n",
+                argv[file], reader.header->segment, reader.count, reader.header->capacity,
+                reader.header->state == RECORDER_CLOSED ? "" : ", not closed", reader.recovered);
+        for (i = 0; i < reader.count; i++)
+        {
+            const recorder_record_t *r = &reader.records[i];
+
+            printf("%" PRIu32 "\t%" PRIu64 "\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%f\t%f\t%f\t%f\t%f\t%f\t%f\n",
+                   r->sequence, r->timestamp,
+                   r->ax, r->ay, r->az, r->gx, r->gy, r->gz, r->mx, r->my, r->mz,
+                   r->q0, r->q1, r->q2, r->q3, r->roll, r->pitch, r->yaw);
+        }
+        total += reader.count;
+        recorder_close(&reader);
+    }
+    fprintf(stderr, "%lu records\n", total);
+    return failed;
+}
@@ -0,0 +1,228 @@
+/**
+ * Replay flight data recorder segments (main -R) through the Mahony filter
+ * as fast as the CPU allows.
+ *
+ * Every recorded raw sample is fused like main.c does, with the period taken
+ * from the recorded timestamps and the filter set up for the nominal rate in
+ * the segment header (the median period for segments without one), and the
+ * attitude is compared to the one recorded in flight. With the same filter
+ * the difference is zero, a filter change shows up as the angle error it
+ * introduces and as the change in the cost per update. The attitude trace (timestamp, roll, pitch, yaw, the
+ * recorded roll, pitch, yaw) goes to stdout, the statistics to stderr.
+ *
+ *   ./tools/replay [-i] [-q] [-n repeats] [-e max_error_deg] segment.fdr...
+ *
+ *   -i  accelerometer and gyroscope only, mahony_update_imu
+ *   -q  no trace, for timing
+ *   -n  replay the log this many times, the trace is printed once
+ *   -e  fail when an angle is further than this off the recorded one
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "../MahonyAHRS.h"
+#include "../recorder/recorder.h"
+#include "../stats/clock.h"
+
+typedef struct
+{
+    double max, sum2;
+} angle_error_t;
+
+static recorder_record_t *records;
+static long count;
+static uint32_t *durations; // ns per update of the last replay
+static float sample_freq;   // Hz, nominal rate of the first segment that has one
+static unsigned long clamped; // periods the last replay clamped
+
+static int by_duration(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void accumulate(angle_error_t *error, double difference)
+{
+    difference = fabs(remainder(difference, 360.0));
+    error->max = difference > error->max ? difference : error->max;
+    error->sum2 += difference * difference;
+}
+
+/**
+ * Append the records of a segment file, returns -1 when it is not one.
+ */
+static int load(const char *path)
+{
+    recorder_reader_t reader;
+
+    if (recorder_open(&reader, path) != 0)
+    {
+        fprintf(stderr, "%s: not a flight data recorder segment\n", path);
+        return -1;
+    }
+    records = realloc(records, (count + reader.count) * sizeof(*records));
+    memcpy(records + count, reader.records, reader.count * sizeof(*records));
+    count += reader.count;
+    if (sample_freq == 0.0f)
+        sample_freq = reader.header->sample_freq;
+    fprintf(stderr, "%s: %u records%s\n", path, reader.count,
+            reader.header->state == RECORDER_CLOSED ? "" : " (recovered segment)");
+    recorder_close(&reader);
+    return 0;
+}
+
+/**
+ * Nominal rate from the median period between consecutive records, for
+ * segments recorded without one. Uses durations as scratch.
+ */
+static float median_rate(void)
+{
+    long i, n = 0;
+
+    for (i = 1; i < count; i++)
+    {
+        uint64_t period = records[i].timestamp - records[i - 1].timestamp;
+        if (period > 0 && period <= UINT32_MAX)
+            durations[n++] = period;
+    }
+    if (n == 0)
+        return 0.0f;
+    qsort(durations, n, sizeof(*durations), by_duration);
+    return 1e9f / durations[n / 2];
+}
+
+/**
+ * Fuse every record in turn, same scaling, period and nominal rate as
+ * main.c's fuse().
+ * Returns the wall time of the whole replay in ns.
+ */
+static uint64_t replay(int imu, int trace, angle_error_t *errors)
+{
+    const float gyroScale = 3.14159f / 180.0f;
+    mahony_filter_t filter;
+    uint64_t start = clock_now_ns(), begin, last = 0;
+    long i;
+
+    mahony_filter_init(&filter, NULL);
+    if (sample_freq > 0.0f)
+        mahony_filter_set_sample_freq(&filter, sample_freq);
+    for (i = 0; i < count; i++)
+    {
+        const recorder_record_t *r = &records[i];
+        float dt = last ? (r->timestamp - last) * 1e-9f : 0.0f;
+        float roll, pitch, yaw;
+
+        last = r->timestamp;
+        begin = clock_now_ns();
+        if (imu)
+            mahony_filter_update_imu_dt(&filter, r->gx * gyroScale, r->gy * gyroScale, r->gz * gyroScale,
+                                        r->ax, r->ay, r->az, dt);
+        else
+            mahony_filter_update_dt(&filter, r->gx * gyroScale, r->gy * gyroScale, r->gz * gyroScale,
+                                    r->ax, r->ay, r->az, r->mx, r->my, r->mz, dt);
+        roll = mahony_filter_get_roll(&filter);
+        pitch = mahony_filter_get_pitch(&filter);
+        yaw = mahony_filter_get_yaw(&filter);
+        durations[i] = clock_now_ns() - begin;
+
+        if (errors && (r->flags & RECORDER_FUSED))
+        {
+            accumulate(&errors[0], roll - r->roll);
+            accumulate(&errors[1], pitch - r->pitch);
+            accumulate(&errors[2], yaw - r->yaw);
+        }
+        if (trace)
+            printf("%llu\t%f\t%f\t%f\t%f\t%f\t%f\n", (unsigned long long)r->timestamp,
+                   roll, pitch, yaw, r->roll, r->pitch, r->yaw);
+    }
+    clamped = filter.dtClamped;
+    return clock_now_ns() - start;
+}
+
+int main(int argc, char **argv)
+{
+    angle_error_t errors[3] = {{0}};
+    const char *names[3] = {"roll", "pitch", "yaw"};
+    int imu = 0, trace = 1, repeats = 1, opt, i, failed = 0;
+    double bound = -1.0, flight, sum = 0.0;
+    uint64_t wall = 0;
+    const char *rate_source = "recorded";
+    long fused = 0, gaps = 0, n;
+
+    while ((opt = getopt(argc, argv, "iqn:e:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'i':
+            imu = 1;
+            break;
+        case 'q':
+            trace = 0;
+            break;
+        case 'n':
+            repeats = atoi(optarg);
+            break;
+        case 'e':
+            bound = atof(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-i] [-q] [-n repeats] [-e max_error_deg] segment.fdr...\n", argv[0]);
+            return 1;
+        }
+    }
+    for (i = optind; i < argc; i++)
+        failed |= load(argv[i]) != 0;
+    if (count < 2 || repeats < 1)
+    {
+        fprintf(stderr, "usage: %s [-i] [-q] [-n repeats] [-e max_error_deg] segment.fdr...\n", argv[0]);
+        return 1;
+    }
+    for (n = 1; n < count; n++)
+        gaps += records[n].sequence != records[n - 1].sequence + 1;
+    for (n = 0; n < count; n++)
+        fused += (records[n].flags & RECORDER_FUSED) != 0;
+    durations = malloc(count * sizeof(*durations));
+    if (sample_freq == 0.0f)
+    {
+        sample_freq = median_rate();
+        rate_source = "median period";
+    }
+
+    wall += replay(imu, trace, errors);
+    for (i = 1; i < repeats; i++)
+        wall += replay(imu, 0, NULL);
+
+    for (n = 0; n < count; n++)
+        sum += durations[n];
+    qsort(durations, count, sizeof(*durations), by_duration);
+    flight = (records[count - 1].timestamp - records[0].timestamp) * 1e-9;
+
+    fprintf(stderr, "%ld samples over %.1f s of flight, %ld sequence gaps, %s\n",
+            count, flight, gaps, imu ? "accel/gyro only" : "accel/gyro/mag");
+    fprintf(stderr, "%d replays in %.3f s, %.0f samples/s, %.0fx real time\n",
+            repeats, wall * 1e-9, count * repeats / (wall * 1e-9), flight * repeats / (wall * 1e-9));
+    fprintf(stderr, "fused at %.1f Hz nominal (%s), %lu sample periods clamped\n",
+            sample_freq, rate_source, clamped);
+    fprintf(stderr, "update ns: mean %.1f min %u p50 %u p99 %u max %u\n",
+            sum / count, durations[0], durations[count / 2], durations[count * 99 / 100], durations[count - 1]);
+    if (fused > 0)
+    {
+        fprintf(stderr, "%-8s %10s %10s\n", "angle", "max_deg", "rms_deg");
+        for (i = 0; i < 3; i++)
+        {
+            fprintf(stderr, "%-8s %10.4f %10.4f\n", names[i], errors[i].max, sqrt(errors[i].sum2 / fused));
+            failed |= bound >= 0.0 && errors[i].max > bound;
+        }
+    }
+    if (bound >= 0.0)
+        fprintf(stderr, "%s: %.4f degrees off the recorded attitude at most\n", failed ? "FAIL" : "OK", bound);
+
+    free(durations);
+    free(records);
+    return failed;
+}
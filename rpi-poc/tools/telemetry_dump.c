@@ -0,0 +1,61 @@
+/**
+ * Decode a binary telemetry stream (main -b) back into tab separated text,
+ * one record per line, the decoder counters go to stderr at the end. Loop
+ * statistics records (main -T) are lines starting with "stats", then the
+ * interval and count, p50, p99 and max ns of every stage.
+ *
+ *   ./main -b | ./tools/telemetry_dump
+ *   ./tools/telemetry_dump < capture.bin
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include "../comm/telemetry.h"
+
+static void print_stats(const telemetry_stats_t *stats)
+{
+    int i;
+
+    printf("stats\t%" PRIu32 "\t%" PRIu64 "\t%" PRIu32, stats->sequence, stats->timestamp, stats->interval);
+    for (i = 0; i < TELEMETRY_STATS_STAGES; i++)
+        printf("\t%" PRIu32 "\t%" PRIu32 "\t%" PRIu32 "\t%" PRIu32,
+               stats->stages[i].count, stats->stages[i].p50, stats->stages[i].p99, stats->stages[i].max);
+    printf("\t%" PRIu32 "\t%" PRIu32 "\n", stats->i2c_errors, stats->i2c_short);
+}
+
+int main(int argc, char **argv)
+{
+    uint8_t buffer[TELEMETRY_BATCH];
+    telemetry_decoder_t decoder;
+    telemetry_record_t record;
+    ssize_t length;
+    size_t used;
+    int ready;
+
+    telemetry_decoder_init(&decoder);
+    while ((length = read(STDIN_FILENO, buffer, sizeof(buffer))) > 0)
+    {
+        for (used = 0; used < (size_t)length;)
+        {
+            used += telemetry_decoder_feed(&decoder, buffer + used, length - used, &record, &ready);
+            if (ready == TELEMETRY_STATS)
+                print_stats(&decoder.stats);
+            if (ready != TELEMETRY_ATTITUDE)
+                continue;
+            printf("%" PRIu32 "\t%" PRIu64 "\t%f\t%f\t%f\t%f\t%f\t%f\t%f\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\n",
+                   record.sequence, record.timestamp,
+                   record.q0, record.q1, record.q2, record.q3,
+                   record.roll, record.pitch, record.yaw,
+                   record.ax, record.ay, record.az,
+                   record.gx, record.gy, record.gz,
+                   record.mx, record.my, record.mz);
+        }
+    }
+
+    fprintf(stderr, "%lu records, %lu lost, %lu crc errors, %lu frame errors\n",
+            decoder.records, decoder.lost, decoder.crc_errors, decoder.frame_errors);
+    return length < 0 ? 1 : 0;
+}